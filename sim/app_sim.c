@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    app_sim.c
+  * @brief   Runs the APP update requests (stm32g031g8_APP/UserCode
+  *          flash_config.c) on the host.
+  ******************************************************************************
+  * The APP main loop and its DMA console are not simulated. This program
+  * stands for them: it issues one request, then dispatches the scheduler
+  * events the config job posts until the APP resets into the IAP.
+  *
+  *   app_sim update         IAP_updata_mailbox(), no-init RAM mailbox
+  *   app_sim update-flash   IAP_updata(), upgrade flag in the config page
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "flash_config.h"
+#include "sched.h"
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* A request that has not reset the APP after this long has failed */
+#define APP_SIM_IDLE_MS         100
+
+/* Exported variables --------------------------------------------------------*/
+UART_HandleTypeDef huart2;
+
+/* Private variables ---------------------------------------------------------*/
+static volatile uint32_t Events = 0;
+
+/* Exported functions --------------------------------------------------------*/
+
+void Sched_Post(uint32_t events)
+{
+  Events |= events;
+}
+
+void Serial_PutString(uint8_t *p_string)
+{
+  HAL_UART_Transmit(&huart2, p_string, (uint16_t)strlen((char *)p_string), 1000);
+}
+
+int main(int argc, char **argv)
+{
+  SIM_ConfigTypeDef config;
+  uint32_t idle_start;
+  uint32_t events;
+  int i;
+
+  i = Sim_ParseArgs(&config, argc, argv, "update|update-flash");
+  if (i != argc - 1)
+  {
+    fprintf(stderr, "usage: %s [options] update|update-flash\n", argv[0]);
+    return SIM_EXIT_ERROR;
+  }
+  Sim_Init(&config);
+
+  huart2.Instance = USART2;
+  huart2.Init.BaudRate = 115200;
+  HAL_UART_Init(&huart2);
+  init_crc8_table();
+
+  if (strcmp(argv[i], "update") == 0)
+  {
+    IAP_updata_mailbox();
+  }
+  else if (strcmp(argv[i], "update-flash") == 0)
+  {
+    IAP_updata();
+  }
+  else
+  {
+    fprintf(stderr, "unknown request '%s'\n", argv[i]);
+    return SIM_EXIT_ERROR;
+  }
+
+  idle_start = HAL_GetTick();
+  while ((HAL_GetTick() - idle_start) < APP_SIM_IDLE_MS)
+  {
+    __disable_irq();
+    events = Events;
+    Events = 0;
+    __enable_irq();
+
+    if (events & SCHED_EVENT_CONFIG)
+    {
+      Flash_Config_Poll();
+      idle_start = HAL_GetTick();
+    }
+    else
+    {
+      __WFI();
+    }
+  }
+  Sim_Exit(SIM_EXIT_ERROR, "request finished without reset");
+  return SIM_EXIT_ERROR;
+}
@@ -0,0 +1,315 @@
+/**
+  ******************************************************************************
+  * @file    boot_bench.c
+  * @brief   Boot time benchmark: the IAP main() from reset to the jump to the
+  *          application, on the virtual clock.
+  ******************************************************************************
+  * Every case runs in its own child process on an in-memory flash holding a
+  * valid application, so the cases do not see each other. The time runs from
+  * the call of the IAP main() to __set_MSP() before the jump.
+  *
+  *   boot_bench [--size 8192,32768,45056] [--crc32-cycles 20]
+  *              [--page-erase 22000] [--dword-program 85]
+  *
+  * Two boot paths:
+  *   fast  no update request: Application_Start() on the reset clock (HSI16),
+  *         before HAL_Init, as every normal boot does
+  *   full  HAL_Init, PLL, GPIO, UART and "iap init ok" first, then the same
+  *         verification at 64 MHz; the path every boot took before the fast
+  *         one. It is forced by a config page asking for an update with the
+  *         wrong hardware version: main() prints "hardware version err!" as
+  *         well, 22 more bytes on the line, and jumps.
+  * Three states of the boot cache (bootcache.h):
+  *   cached   the record matches: header check and one boot slot programmed
+  *   verify   no record, as after an update: CRC32 of the whole image and the
+  *            record programmed
+  *   refresh  record matches but the IAP_VERIFY_PERIOD slots are used: CRC32,
+  *            config page erased and rewritten
+  *
+  * Only the modelled costs count: flash erase and program, the CRC32 at
+  * --crc32-cycles per byte on the clock of the path, and the UART bytes at
+  * the baud rate. The code between them, HAL_Init and the PLL lock are not
+  * modelled, so the figures are the floor the flash and the CRC set.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "bootcache.h"
+#include "common.h"
+#include "flash.h"
+#include "host_ymodem.h"
+#include "image.h"
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define BOOT_LIST_MAX           8
+#define BOOT_LIMIT_S            10      /* virtual time a boot may last */
+#define BOOT_RESET_CLOCK_HZ     16000000
+#define BOOT_NS_PER_MS          1000000.0
+
+/* Boot paths */
+#define BOOT_PATH_FAST          0
+#define BOOT_PATH_FULL          1
+#define BOOT_PATHS              2
+
+/* Boot cache states */
+#define BOOT_CACHE_CACHED       0
+#define BOOT_CACHE_VERIFY       1
+#define BOOT_CACHE_REFRESH      2
+#define BOOT_CACHES             3
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t size;
+  int path;
+  int cache;
+} BOOT_CaseTypeDef;
+
+typedef struct
+{
+  int jumped;               /* reached the jump to the application */
+  uint64_t boot_ns;
+  uint64_t phase_ns[SIM_PHASE_COUNT];
+  uint32_t erases;
+  uint32_t programs;
+} BOOT_ResultTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *aPathName[BOOT_PATHS] = {"fast", "full"};
+static const char *aCacheName[BOOT_CACHES] = {"cached", "verify", "refresh"};
+
+static SIM_TimingTypeDef Timing = SIM_TIMING_DEFAULT;
+static BOOT_CaseTypeDef RunCase;
+static jmp_buf Escape;
+
+/* Private functions ---------------------------------------------------------*/
+int iap_main(void);
+
+static void Boot_Jump(void)
+{
+  longjmp(Escape, 1);
+}
+
+static void Boot_TimeLimit(void)
+{
+  longjmp(Escape, 2);
+}
+
+/**
+  * @brief  Flash as the previous boots left it
+  */
+static void Boot_Prepare(const BOOT_CaseTypeDef *bench)
+{
+  config_data_t config;
+  FLASH_StreamTypeDef stream;
+  uint32_t data[((sizeof(config_data_t) + 7) / 8) * 2];
+  uint8_t *p_image;
+  uint32_t i;
+
+  p_image = malloc(bench->size);
+  if (p_image == NULL)
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "out of memory");
+  }
+  Host_YmodemImage(p_image, bench->size, 0x12345678 ^ bench->size);
+  FLASH_Stream_Init(&stream, APPLICATION_ADDRESS, APPLICATION_ADDRESS + APPLICATION_MAX_SIZE);
+  if ((FLASH_Stream_Write(&stream, p_image, bench->size) != FLASHIF_OK) || (FLASH_Stream_Flush(&stream) != FLASHIF_OK))
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "cannot install the image");
+  }
+  free(p_image);
+
+  if (bench->path == BOOT_PATH_FULL)
+  {
+    memset(&config, 0, sizeof(config));
+    strcpy(config.device_name, DEVICE_NAME);
+    config.HW_vision = HW_VERSION + 1;
+    config.updata_flg = UPDATA;
+    memset(data, 0xFF, sizeof(data));
+    memcpy(data, &config, sizeof(config));
+    if (FLASH_If_Write(CONFIG_START_ADDRESS, data, sizeof(data) / 4) != FLASHIF_OK)
+    {
+      Sim_Exit(SIM_EXIT_ERROR, "cannot write the config page");
+    }
+  }
+
+  if (bench->cache != BOOT_CACHE_VERIFY)
+  {
+    /* The record, then one slot per boot */
+    for (i = 0; i <= ((bench->cache == BOOT_CACHE_REFRESH) ? IAP_VERIFY_PERIOD : 0); i++)
+    {
+      if (BootCache_Verify() != IMAGE_OK)
+      {
+        Sim_Exit(SIM_EXIT_ERROR, "installed image does not verify");
+      }
+    }
+  }
+}
+
+/**
+  * @brief  One case, in a child process (Sim_Fork)
+  */
+static void Boot_RunCase(void *p_context)
+{
+  SIM_ConfigTypeDef config = {NULL, NULL, "model", 1};
+  BOOT_ResultTypeDef *p_result = p_context;
+  const BOOT_CaseTypeDef *bench = &RunCase;
+  uint32_t erases, programs;
+  int i;
+
+  memset(p_result, 0, sizeof(*p_result));
+  /* The fast path never leaves the reset clock */
+  if (bench->path == BOOT_PATH_FAST)
+  {
+    Timing.sysclk_hz = BOOT_RESET_CLOCK_HZ;
+  }
+  Sim_ClockVirtual(&Timing);
+  Sim_Init(&config);
+  Boot_Prepare(bench);
+
+  /* Reset: the clock starts again from 0 */
+  Sim_ClockVirtual(&Timing);
+  erases = Sim_FlashErases();
+  programs = Sim_FlashPrograms();
+  Sim_JumpHandler(Boot_Jump);
+  Sim_ClockDeadline(BOOT_LIMIT_S * 1000000000ULL, Boot_TimeLimit);
+  if (setjmp(Escape) == 0)
+  {
+    iap_main();
+  }
+  else
+  {
+    p_result->jumped = (Sim_Nanos() < BOOT_LIMIT_S * 1000000000ULL);
+  }
+  Sim_ClockDeadline(0, NULL);
+  Sim_JumpHandler(NULL);
+
+  p_result->boot_ns = Sim_Nanos();
+  for (i = 0; i < SIM_PHASE_COUNT; i++)
+  {
+    p_result->phase_ns[i] = Sim_PhaseTime((SIM_PhaseTypeDef)i);
+  }
+  p_result->erases = Sim_FlashErases() - erases;
+  p_result->programs = Sim_FlashPrograms() - programs;
+}
+
+static double Boot_Ms(uint64_t ns)
+{
+  return (double)ns / BOOT_NS_PER_MS;
+}
+
+static int Boot_ParseList(uint32_t *p_value, uint32_t *p_count, const char *arg)
+{
+  char *end;
+
+  *p_count = 0;
+  do
+  {
+    if (*p_count == BOOT_LIST_MAX)
+    {
+      return -1;
+    }
+    p_value[(*p_count)++] = (uint32_t)strtoul(arg, &end, 0);
+    if ((end == arg) || ((*end != ',') && (*end != '\0')))
+    {
+      return -1;
+    }
+    arg = end + 1;
+  } while (*end == ',');
+  return 0;
+}
+
+static void Boot_Usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --size LIST        image sizes in bytes (8192,32768,45056)\n"
+          "  --crc32-cycles N   image CRC32 cost per byte (%u)\n"
+          "  --page-erase US    page erase time (%u)\n"
+          "  --dword-program US double word program time (%u)\n",
+          name, Timing.crc32_cycles, Timing.page_erase_us, Timing.dword_program_us);
+  exit(SIM_EXIT_ERROR);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  static const struct option options[] =
+  {
+    {"size", required_argument, NULL, 's'},
+    {"crc32-cycles", required_argument, NULL, 'r'},
+    {"page-erase", required_argument, NULL, 'e'},
+    {"dword-program", required_argument, NULL, 'p'},
+    {NULL, 0, NULL, 0}
+  };
+  uint32_t size[BOOT_LIST_MAX] = {8192, 32768, 45056};
+  uint32_t sizes = 3, s;
+  BOOT_ResultTypeDef result;
+  int opt, path, cache, failed = 0;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+        if (Boot_ParseList(size, &sizes, optarg) != 0)
+        {
+          Boot_Usage(argv[0]);
+        }
+        break;
+      case 'r':
+        Timing.crc32_cycles = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'e':
+        Timing.page_erase_us = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        Timing.dword_program_us = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      default:
+        Boot_Usage(argv[0]);
+        break;
+    }
+  }
+  if (optind != argc)
+  {
+    Boot_Usage(argv[0]);
+  }
+
+  printf("  size path cache    boot_ms transfer    erase  program   verify erases programs\n");
+  for (s = 0; s < sizes; s++)
+  {
+    if ((size[s] <= IMAGE_HEADER_END + IMAGE_TRAILER_SIZE) || (size[s] > APPLICATION_MAX_SIZE))
+    {
+      fprintf(stderr, "image size %u out of range\n", size[s]);
+      return SIM_EXIT_ERROR;
+    }
+    for (path = 0; path < BOOT_PATHS; path++)
+    {
+      for (cache = 0; cache < BOOT_CACHES; cache++)
+      {
+        RunCase.size = size[s];
+        RunCase.path = path;
+        RunCase.cache = cache;
+        if (Sim_Fork(Boot_RunCase, &result, sizeof(result)) != 0)
+        {
+          memset(&result, 0, sizeof(result));
+        }
+        failed |= !result.jumped;
+        printf("%6u %-4s %-7s %8.3f %8.3f %8.3f %8.3f %8.3f %6u %8u  %s\n", size[s], aPathName[path],
+               aCacheName[cache], Boot_Ms(result.boot_ns), Boot_Ms(result.phase_ns[SIM_PHASE_TRANSFER]),
+               Boot_Ms(result.phase_ns[SIM_PHASE_ERASE]), Boot_Ms(result.phase_ns[SIM_PHASE_PROGRAM]),
+               Boot_Ms(result.phase_ns[SIM_PHASE_VERIFY]), result.erases, result.programs,
+               result.jumped ? "jump" : "FAIL");
+      }
+    }
+  }
+  return failed ? SIM_EXIT_ERROR : SIM_EXIT_OK;
+}
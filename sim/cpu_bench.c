@@ -0,0 +1,379 @@
+/**
+  ******************************************************************************
+  * @file    cpu_bench.c
+  * @brief   Host timing of the IAP functions the virtual clock only charges
+  *          at an assumed cost per byte (iap_timing.c).
+  ******************************************************************************
+  * Each function runs over a --size buffer, --repeat times in a row, on the
+  * host clock; the best of --runs is kept as ns per byte. The column "crc32"
+  * is that time over the one of Cal_CRC32 on the same buffer, the most
+  * comparable figure across machines.
+  *
+  *   cpu_bench [--size 32768] [--repeat 32] [--runs 5]
+  *
+  * These are host figures: they rank the implementations and show how the
+  * costs compare, they are not the cycles per byte of the M0+, where only
+  * the PROFILE_xxx probes measure them (profile.h). "aes-sbox" is a byte
+  * oriented AES-128 (256-byte S-box, MixColumns by xtime), the small
+  * alternative to the T-table of aes.c; it also checks the key stream of
+  * AES_CTR_Crypt. SHA256_Update is checked against the FIPS 180-4 "abc"
+  * example before it is timed.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "common.h"
+#include "aes.h"
+#include "sha256.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define CPU_BENCH_RUNS          5
+#define CPU_BENCH_REPEAT        32
+#define CPU_BENCH_SIZE          32768
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const char *name;
+  void (*run)(uint8_t *p_data, uint32_t size);
+} CPU_BenchTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t aBenchKey[AES_KEY_SIZE] = IAP_AES_KEY;
+static const uint8_t aBenchHeader[AES_IMAGE_HEADER_SIZE] =
+{
+  'A', 'E', 'S', '1', 0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB
+};
+static uint8_t aSbox[256];
+static uint8_t aRoundKey[AES_BLOCK_SIZE * (AES_ROUNDS + 1)];
+static volatile uint32_t Sink;
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint8_t Sbox_Xtime(uint8_t x)
+{
+  return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+}
+
+/**
+  * @brief  S-box from its definition: inverse in GF(2^8), then the affine map
+  */
+static void Sbox_Init(void)
+{
+  uint8_t p = 1, q = 1, x;
+
+  /* p runs over the powers of 3, q over those of its inverse 0xF6 */
+  do
+  {
+    p = p ^ Sbox_Xtime(p);
+    q ^= q << 1;
+    q ^= q << 2;
+    q ^= q << 4;
+    q ^= (q & 0x80) ? 0x09 : 0x00;
+    x = q ^ (uint8_t)((q << 1) | (q >> 7)) ^ (uint8_t)((q << 2) | (q >> 6))
+        ^ (uint8_t)((q << 3) | (q >> 5)) ^ (uint8_t)((q << 4) | (q >> 4));
+    aSbox[p] = x ^ 0x63;
+  } while (p != 1);
+  aSbox[0] = 0x63;
+}
+
+static void Sbox_KeyExpansion(const uint8_t *p_key)
+{
+  uint8_t rcon = 0x01, t[4];
+  uint32_t i;
+
+  memcpy(aRoundKey, p_key, AES_KEY_SIZE);
+  for (i = AES_KEY_SIZE; i < sizeof(aRoundKey); i += 4)
+  {
+    memcpy(t, &aRoundKey[i - 4], 4);
+    if ((i % AES_KEY_SIZE) == 0)
+    {
+      uint8_t first = t[0];
+
+      t[0] = aSbox[t[1]] ^ rcon;
+      t[1] = aSbox[t[2]];
+      t[2] = aSbox[t[3]];
+      t[3] = aSbox[first];
+      rcon = Sbox_Xtime(rcon);
+    }
+    aRoundKey[i + 0] = aRoundKey[i - 16] ^ t[0];
+    aRoundKey[i + 1] = aRoundKey[i - 15] ^ t[1];
+    aRoundKey[i + 2] = aRoundKey[i - 14] ^ t[2];
+    aRoundKey[i + 3] = aRoundKey[i - 13] ^ t[3];
+  }
+}
+
+/**
+  * @brief  Encrypt one block, state in FIPS-197 byte order
+  */
+static void Sbox_EncryptBlock(uint8_t *s)
+{
+  uint8_t t[AES_BLOCK_SIZE], a, b, c, d, e;
+  uint32_t round, i;
+
+  for (i = 0; i < AES_BLOCK_SIZE; i++)
+  {
+    s[i] ^= aRoundKey[i];
+  }
+  for (round = 1; round <= AES_ROUNDS; round++)
+  {
+    /* SubBytes and ShiftRows: byte r of column c comes from column c + r */
+    for (i = 0; i < AES_BLOCK_SIZE; i++)
+    {
+      t[i] = aSbox[s[(i + 4 * (i & 3)) & 15]];
+    }
+    for (i = 0; i < AES_BLOCK_SIZE; i += 4)
+    {
+      a = t[i];
+      b = t[i + 1];
+      c = t[i + 2];
+      d = t[i + 3];
+      if (round < AES_ROUNDS)
+      {
+        e = a ^ b ^ c ^ d;
+        t[i] ^= e ^ Sbox_Xtime(a ^ b);
+        t[i + 1] ^= e ^ Sbox_Xtime(b ^ c);
+        t[i + 2] ^= e ^ Sbox_Xtime(c ^ d);
+        t[i + 3] ^= e ^ Sbox_Xtime(d ^ a);
+      }
+    }
+    for (i = 0; i < AES_BLOCK_SIZE; i++)
+    {
+      s[i] = t[i] ^ aRoundKey[round * AES_BLOCK_SIZE + i];
+    }
+  }
+}
+
+/**
+  * @brief  Same key stream as AES_CTR_Crypt from the first block
+  */
+static void Sbox_CtrCrypt(uint8_t *p_data, uint32_t size)
+{
+  uint8_t block[AES_BLOCK_SIZE];
+  uint32_t n, i;
+
+  for (n = 0; n * AES_BLOCK_SIZE < size; n++)
+  {
+    memcpy(block, &aBenchHeader[4], AES_NONCE_SIZE);
+    block[12] = (uint8_t)(n >> 24);
+    block[13] = (uint8_t)(n >> 16);
+    block[14] = (uint8_t)(n >> 8);
+    block[15] = (uint8_t)n;
+    Sbox_EncryptBlock(block);
+    for (i = 0; (i < AES_BLOCK_SIZE) && (n * AES_BLOCK_SIZE + i < size); i++)
+    {
+      p_data[n * AES_BLOCK_SIZE + i] ^= block[i];
+    }
+  }
+}
+
+static void Run_Crc32(uint8_t *p_data, uint32_t size)
+{
+  Sink = Cal_CRC32(0, p_data, size);
+}
+
+static void Run_AesTable(uint8_t *p_data, uint32_t size)
+{
+  AES_CtrTypeDef ctx;
+
+  AES_CTR_Init(&ctx, aBenchKey, aBenchHeader);
+  AES_CTR_Crypt(&ctx, p_data, size);
+}
+
+static void Run_AesSbox(uint8_t *p_data, uint32_t size)
+{
+  Sbox_CtrCrypt(p_data, size);
+}
+
+static void Run_Sha256(uint8_t *p_data, uint32_t size)
+{
+  SHA256_CtxTypeDef ctx;
+  uint8_t digest[SHA256_DIGEST_SIZE];
+
+  SHA256_Init(&ctx);
+  SHA256_Update(&ctx, p_data, size);
+  SHA256_Final(&ctx, digest);
+  Sink = digest[0];
+}
+
+static const CPU_BenchTypeDef aBench[] =
+{
+  {"crc32", Run_Crc32},
+  {"aes-table", Run_AesTable},
+  {"aes-sbox", Run_AesSbox},
+  {"sha256", Run_Sha256},
+};
+
+static uint64_t Bench_Now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+  * @brief  Best time of a function over the buffer
+  * @retval ns per byte
+  */
+static double Bench_Time(const CPU_BenchTypeDef *bench, uint8_t *p_data, uint32_t size,
+                         uint32_t repeat, uint32_t runs)
+{
+  uint64_t start, elapsed, best = UINT64_MAX;
+  uint32_t run, i;
+
+  for (run = 0; run < runs; run++)
+  {
+    start = Bench_Now();
+    for (i = 0; i < repeat; i++)
+    {
+      bench->run(p_data, size);
+    }
+    elapsed = Bench_Now() - start;
+    if (elapsed < best)
+    {
+      best = elapsed;
+    }
+  }
+  return (double)best / ((double)size * repeat);
+}
+
+/**
+  * @brief  The two AES must give the same key stream, and it must be the one
+  *         of FIPS-197 C.1 for its test vector
+  */
+static int Bench_CheckAes(uint32_t size)
+{
+  static const uint8_t fips_key[AES_KEY_SIZE] =
+  {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+  };
+  static const uint8_t fips_out[AES_BLOCK_SIZE] =
+  {
+    0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A
+  };
+  uint8_t block[AES_BLOCK_SIZE];
+  uint8_t *p_table = calloc(1, size);
+  uint8_t *p_sbox = calloc(1, size);
+  uint32_t i;
+  int ok;
+
+  for (i = 0; i < AES_BLOCK_SIZE; i++)
+  {
+    block[i] = (uint8_t)(i * 0x11);
+  }
+  Sbox_KeyExpansion(fips_key);
+  Sbox_EncryptBlock(block);
+  ok = (memcmp(block, fips_out, sizeof(block)) == 0);
+
+  Sbox_KeyExpansion(aBenchKey);
+  Run_AesTable(p_table, size);
+  Run_AesSbox(p_sbox, size);
+  ok = ok && (memcmp(p_table, p_sbox, size) == 0);
+  free(p_table);
+  free(p_sbox);
+  return ok;
+}
+
+static int Bench_CheckSha256(void)
+{
+  static const uint8_t abc_digest[SHA256_DIGEST_SIZE] =
+  {
+    0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23,
+    0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD
+  };
+  SHA256_CtxTypeDef ctx;
+  uint8_t digest[SHA256_DIGEST_SIZE];
+
+  SHA256_Init(&ctx);
+  SHA256_Update(&ctx, (const uint8_t *)"abc", 3);
+  SHA256_Final(&ctx, digest);
+  return (memcmp(digest, abc_digest, sizeof(digest)) == 0);
+}
+
+static void Bench_Usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --size N           buffer size in bytes (%u)\n"
+          "  --repeat N         passes over the buffer per run (%u)\n"
+          "  --runs N           runs, the best one is kept (%u)\n",
+          name, CPU_BENCH_SIZE, CPU_BENCH_REPEAT, CPU_BENCH_RUNS);
+  exit(SIM_EXIT_ERROR);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  static const struct option options[] =
+  {
+    {"size", required_argument, NULL, 's'},
+    {"repeat", required_argument, NULL, 'r'},
+    {"runs", required_argument, NULL, 'n'},
+    {NULL, 0, NULL, 0}
+  };
+  uint32_t size = CPU_BENCH_SIZE, repeat = CPU_BENCH_REPEAT, runs = CPU_BENCH_RUNS, i;
+  double ns, crc32_ns = 0.0;
+  uint8_t *p_data;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+        size = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        repeat = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        runs = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      default:
+        Bench_Usage(argv[0]);
+        break;
+    }
+  }
+  if ((optind != argc) || (size == 0) || (repeat == 0) || (runs == 0))
+  {
+    Bench_Usage(argv[0]);
+  }
+
+  Sbox_Init();
+  if (!Bench_CheckAes(size))
+  {
+    fprintf(stderr, "aes-sbox and AES_CTR_Crypt disagree\n");
+    return SIM_EXIT_ERROR;
+  }
+  if (!Bench_CheckSha256())
+  {
+    fprintf(stderr, "SHA256_Update gives a wrong digest\n");
+    return SIM_EXIT_ERROR;
+  }
+
+  p_data = malloc(size);
+  for (i = 0; i < size; i++)
+  {
+    p_data[i] = (uint8_t)(i * 131 + 7);
+  }
+  printf("function     ns/byte  crc32\n");
+  for (i = 0; i < sizeof(aBench) / sizeof(aBench[0]); i++)
+  {
+    ns = Bench_Time(&aBench[i], p_data, size, repeat, runs);
+    if (i == 0)
+    {
+      crc32_ns = ns;
+    }
+    printf("%-10s %9.2f %6.1f\n", aBench[i].name, ns, ns / crc32_ns);
+  }
+  free(p_data);
+  return SIM_EXIT_OK;
+}
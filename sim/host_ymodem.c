@@ -0,0 +1,335 @@
+/**
+  ******************************************************************************
+  * @file    host_ymodem.c
+  * @brief   Ymodem sender standing for the host PC, see host_ymodem.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_ymodem.h"
+#include "sim.h"
+#include "common.h"
+#include "flash.h"
+#include "image.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SOH                     0x01
+#define STX                     0x02
+#define EOT                     0x04
+#define ACK                     0x06
+#define NAK                     0x15
+#define CA                      0x18
+#define CRC16                   0x43
+#define PAD                     0x1A
+#define BLOCK_MAX               1024
+#define RETRIES                 10    /* same block in a row, as ymodem_send.py */
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t aEot[1] = {EOT};
+static const uint8_t *pImage;
+static uint32_t ImageSize;
+static uint32_t BlockSize;
+static uint32_t NextOffset;           /* image offset of the block in flight */
+static uint8_t aBlock[BLOCK_MAX + 5];
+static uint32_t BlockLength;
+static uint8_t LastByte;
+static uint32_t Tries;
+static HOST_YmodemStatsTypeDef Stats;
+static void (*pLineSend)(const uint8_t *p_data, uint32_t size, uint64_t ready_ns) = Sim_UartHostSend;
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint16_t Host_Crc16(const uint8_t *p_data, uint32_t size)
+{
+  uint16_t crc = 0;
+  uint32_t i;
+
+  while (size-- > 0)
+  {
+    crc ^= (uint16_t)(*p_data++ << 8);
+    for (i = 0; i < 8; i++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static void Host_BuildBlock(uint8_t number, const uint8_t *p_data, uint32_t length, uint32_t size, uint8_t pad)
+{
+  uint16_t crc;
+
+  aBlock[0] = (size == 128) ? SOH : STX;
+  aBlock[1] = number;
+  aBlock[2] = (uint8_t)~number;
+  memcpy(&aBlock[3], p_data, length);
+  memset(&aBlock[3 + length], pad, size - length);
+  crc = Host_Crc16(&aBlock[3], size);
+  aBlock[3 + size] = (uint8_t)(crc >> 8);
+  aBlock[4 + size] = (uint8_t)crc;
+  BlockLength = size + 5;
+}
+
+static void Host_BuildHeader(void)
+{
+  uint8_t header[128];
+  int n;
+
+  memset(header, 0, sizeof(header));
+  n = snprintf((char *)header, sizeof(header), "image.bin");
+  snprintf((char *)&header[n + 1], sizeof(header) - n - 1, "%u ", (unsigned)ImageSize);
+  Host_BuildBlock(0, header, sizeof(header), 128, 0);
+}
+
+static void Host_BuildData(void)
+{
+  uint32_t length = ImageSize - NextOffset;
+
+  if (length > BlockSize)
+  {
+    length = BlockSize;
+  }
+  Host_BuildBlock((uint8_t)(Stats.blocks + 1), &pImage[NextOffset], length,
+                  (length <= 128) ? 128 : BlockSize, PAD);
+}
+
+static void Host_Send(const uint8_t *p_data, uint32_t size, uint64_t time_ns, HOST_YmodemStateTypeDef state)
+{
+  pLineSend(p_data, size, time_ns);
+  Stats.state = state;
+}
+
+static void Host_SendBlock(uint64_t time_ns, HOST_YmodemStateTypeDef state)
+{
+  Tries = 1;
+  Host_Send(aBlock, BlockLength, time_ns, state);
+}
+
+static void Host_SendEot(uint64_t time_ns)
+{
+  Tries = 1;
+  Host_Send(aEot, sizeof(aEot), time_ns, HOST_YMODEM_EOT_SENT);
+}
+
+/* Same block or EOT again, the transfer is cancelled after RETRIES tries */
+static void Host_Resend(uint64_t time_ns)
+{
+  static const uint8_t cancel[2] = {CA, CA};
+
+  if (Tries >= RETRIES)
+  {
+    Host_Send(cancel, sizeof(cancel), time_ns, HOST_YMODEM_CANCELLED);
+    Stats.end_ns = time_ns;
+    return;
+  }
+  Tries++;
+  Stats.retransmits++;
+  if (Stats.state == HOST_YMODEM_EOT_SENT)
+  {
+    Host_Send(&aBlock[0], 0, time_ns, HOST_YMODEM_EOT_SENT);
+    Host_Send((const uint8_t *)"\x04", 1, time_ns, HOST_YMODEM_EOT_SENT);
+  }
+  else
+  {
+    Host_Send(aBlock, BlockLength, time_ns, Stats.state);
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Prepare a transfer, the IAP starts it with its first 'C'
+  * @param  p_image: file to send, must stay valid during the transfer
+  * @param  size: file size
+  * @param  block_size: 128 or 1024
+  * @retval None
+  */
+void Host_YmodemStart(const uint8_t *p_image, uint32_t size, uint32_t block_size)
+{
+  pImage = p_image;
+  ImageSize = size;
+  BlockSize = (block_size == 128) ? 128 : BLOCK_MAX;
+  NextOffset = 0;
+  LastByte = 0;
+  Tries = 0;
+  memset(&Stats, 0, sizeof(Stats));
+  Sim_UartModel(Host_YmodemOnByte);
+}
+
+/**
+  * @brief  Line the host sends on, Sim_UartHostSend unless a fault injector
+  *         sits in between
+  * @param  send: same arguments as Sim_UartHostSend
+  * @retval None
+  */
+void Host_YmodemSetLine(void (*send)(const uint8_t *p_data, uint32_t size, uint64_t ready_ns))
+{
+  pLineSend = send;
+}
+
+/**
+  * @brief  Byte from the IAP
+  * @param  byte: received byte
+  * @param  time_ns: end of its stop bit
+  * @retval None
+  */
+void Host_YmodemOnByte(uint8_t byte, uint64_t time_ns)
+{
+  uint8_t previous = LastByte;
+
+  LastByte = byte;
+  if ((byte == CA) && (previous == CA))
+  {
+    Stats.state = HOST_YMODEM_CANCELLED;
+    Stats.end_ns = time_ns;
+    return;
+  }
+
+  switch (Stats.state)
+  {
+    case HOST_YMODEM_WAIT_HEADER:
+      if (byte == CRC16)
+      {
+        Stats.start_ns = time_ns;
+        Host_BuildHeader();
+        Host_SendBlock(time_ns, HOST_YMODEM_HEADER_SENT);
+      }
+      break;
+
+    case HOST_YMODEM_HEADER_SENT:
+      if (byte == ACK)
+      {
+        Stats.state = HOST_YMODEM_WAIT_DATA;
+      }
+      else if ((byte == NAK) || (byte == CRC16))
+      {
+        Host_Resend(time_ns);
+      }
+      break;
+
+    case HOST_YMODEM_WAIT_DATA:
+      if (byte == CRC16)
+      {
+        Host_BuildData();
+        Host_SendBlock(time_ns, HOST_YMODEM_DATA_SENT);
+      }
+      break;
+
+    case HOST_YMODEM_DATA_SENT:
+      if (byte == ACK)
+      {
+        Stats.blocks++;
+        NextOffset += BlockSize;
+        if (NextOffset < ImageSize)
+        {
+          Host_BuildData();
+          Host_SendBlock(time_ns, HOST_YMODEM_DATA_SENT);
+        }
+        else
+        {
+          Host_SendEot(time_ns);
+        }
+      }
+      else if ((byte == NAK) || (byte == CRC16))
+      {
+        Host_Resend(time_ns);
+      }
+      break;
+
+    case HOST_YMODEM_EOT_SENT:
+      if (byte == ACK)
+      {
+        Stats.state = HOST_YMODEM_WAIT_END;
+      }
+      else if ((byte == NAK) || (byte == CRC16))
+      {
+        Host_Resend(time_ns);
+      }
+      break;
+
+    case HOST_YMODEM_WAIT_END:
+      if (byte == CRC16)
+      {
+        Host_BuildBlock(0, NULL, 0, 128, 0);
+        Host_SendBlock(time_ns, HOST_YMODEM_END_SENT);
+      }
+      break;
+
+    case HOST_YMODEM_END_SENT:
+      if (byte == ACK)
+      {
+        Stats.state = HOST_YMODEM_DONE;
+        Stats.end_ns = time_ns;
+      }
+      else if ((byte == NAK) || (byte == CRC16))
+      {
+        Host_Resend(time_ns);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Progress of the transfer
+  * @param  None
+  * @retval Statistics, updated as the transfer goes
+  */
+const HOST_YmodemStatsTypeDef *Host_YmodemStats(void)
+{
+  return &Stats;
+}
+
+/**
+  * @brief  Stamped APP image with a pseudo random body, as image_stamp.py
+  *         would produce for this device
+  * @param  p_image: output, size bytes
+  * @param  size: file size, CRC32 trailer included
+  * @param  seed: body content, the same seed gives the same image
+  * @retval None
+  */
+void Host_YmodemImage(uint8_t *p_image, uint32_t size, uint32_t seed)
+{
+  IMAGE_HeaderTypeDef header;
+  uint32_t length = size - IMAGE_TRAILER_SIZE;
+  uint32_t crc, i, j;
+
+  seed |= 1;
+  for (i = 0; i < length; i++)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    p_image[i] = (uint8_t)seed;
+  }
+
+  /* Vector table: stack at the end of RAM, reset handler in the APP area */
+  ((uint32_t *)p_image)[0] = SIM_SRAM_BASE + SIM_SRAM_SIZE;
+  ((uint32_t *)p_image)[1] = APPLICATION_ADDRESS + 0x101;
+
+  memset(&header, 0, sizeof(header));
+  header.magic = IMAGE_MAGIC;
+  header.length = length;
+  header.build_id = 1;
+  strncpy(header.device_name, DEVICE_NAME, IMAGE_NAME_LENGTH);
+  header.hw_version = HW_VERSION;
+  header.fw_version = 1;
+  memcpy(&p_image[IMAGE_HEADER_OFFSET], &header, sizeof(header));
+
+  /* zlib CRC32, computed here so that it costs no simulated time */
+  crc = 0xFFFFFFFF;
+  for (i = 0; i < length; i++)
+  {
+    crc ^= p_image[i];
+    for (j = 0; j < 8; j++)
+    {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+  }
+  crc = ~crc;
+  memcpy(&p_image[length], &crc, IMAGE_TRAILER_SIZE);
+}
@@ -0,0 +1,52 @@
+/**
+  ******************************************************************************
+  * @file    host_ymodem.h
+  * @brief   Ymodem sender standing for the host PC, for the "model" UART of
+  *          the simulation (see sim.h, Sim_UartModel).
+  ******************************************************************************
+  * Reacts to every byte the IAP sends the way tools/ymodem_send.py does:
+  * header block on the first 'C', data blocks on ACK, the same block again
+  * on NAK or on a 'C' while an ACK is awaited, EOT, then the empty header
+  * block closing the session. Everything runs inside the UART callback, on
+  * the virtual clock.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HOST_YMODEM_H
+#define __HOST_YMODEM_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  HOST_YMODEM_WAIT_HEADER = 0,  /* waiting for the first 'C' */
+  HOST_YMODEM_HEADER_SENT,
+  HOST_YMODEM_WAIT_DATA,        /* header acknowledged, waiting for 'C' */
+  HOST_YMODEM_DATA_SENT,
+  HOST_YMODEM_EOT_SENT,
+  HOST_YMODEM_WAIT_END,         /* EOT acknowledged, waiting for 'C' */
+  HOST_YMODEM_END_SENT,
+  HOST_YMODEM_DONE,
+  HOST_YMODEM_CANCELLED         /* CA CA from the IAP */
+} HOST_YmodemStateTypeDef;
+
+typedef struct
+{
+  HOST_YmodemStateTypeDef state;
+  uint32_t blocks;              /* data blocks acknowledged */
+  uint32_t retransmits;         /* blocks and EOT sent again */
+  uint64_t start_ns;            /* first 'C' received */
+  uint64_t end_ns;              /* last ACK received */
+} HOST_YmodemStatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void Host_YmodemStart(const uint8_t *p_image, uint32_t size, uint32_t block_size);
+void Host_YmodemSetLine(void (*send)(const uint8_t *p_data, uint32_t size, uint64_t ready_ns));
+void Host_YmodemOnByte(uint8_t byte, uint64_t time_ns);
+const HOST_YmodemStatsTypeDef *Host_YmodemStats(void);
+void Host_YmodemImage(uint8_t *p_image, uint32_t size, uint32_t seed);
+
+#endif  /* __HOST_YMODEM_H */
@@ -0,0 +1,28 @@
+/**
+  ******************************************************************************
+  * @file    iap_sim.c
+  * @brief   Runs the IAP (stm32g031g8_IAP/Core/Src/main.c, renamed iap_main)
+  *          on the host.
+  ******************************************************************************
+  * One run is one boot: it ends when the IAP jumps to the application
+  * (exit 10), resets (exit 11) or loses its UART peer (exit 12). Run it
+  * again on the same flash and RAM files for the next boot.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+
+/* Exported functions --------------------------------------------------------*/
+int iap_main(void);
+
+int main(int argc, char **argv)
+{
+  SIM_ConfigTypeDef config;
+
+  Sim_ParseArgs(&config, argc, argv, "");
+  Sim_Init(&config);
+  iap_main();
+  Sim_Exit(SIM_EXIT_ERROR, "iap main returned");
+  return SIM_EXIT_ERROR;
+}
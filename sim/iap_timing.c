@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file    iap_timing.c
+  * @brief   Virtual clock cost of the IAP functions the simulation cannot
+  *          time by itself.
+  ******************************************************************************
+  * Linked with -Wl,--wrap=Cal_CRC32: the calls from image.c and delta.c come
+  * here first, and with -Wl,--wrap=AES_CTR_Crypt the decryption of the
+  * packets from ymodem.c, with -Wl,--wrap=SHA256_Update the hash of the
+  * programmed bytes. The packet CRC16 is called from inside ymodem.c, out of reach
+  * of --wrap; the UART model charges it per received byte instead.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "aes.h"
+#include "sha256.h"
+#include <stddef.h>
+
+/* Exported functions --------------------------------------------------------*/
+uint32_t __real_Cal_CRC32(uint32_t crc, const uint8_t *p_data, uint32_t size);
+uint32_t __wrap_Cal_CRC32(uint32_t crc, const uint8_t *p_data, uint32_t size);
+
+/**
+  * @brief  Cal_CRC32, charged to the verify phase
+  */
+uint32_t __wrap_Cal_CRC32(uint32_t crc, const uint8_t *p_data, uint32_t size)
+{
+  const SIM_TimingTypeDef *timing = Sim_Timing();
+
+  if (timing != NULL)
+  {
+    Sim_Advance(SIM_PHASE_VERIFY, (uint64_t)size * timing->crc32_cycles * 1000000000ULL / timing->sysclk_hz);
+  }
+  return __real_Cal_CRC32(crc, p_data, size);
+}
+
+void __real_AES_CTR_Crypt(AES_CtrTypeDef *ctx, uint8_t *p_data, uint32_t length);
+void __wrap_AES_CTR_Crypt(AES_CtrTypeDef *ctx, uint8_t *p_data, uint32_t length);
+
+/**
+  * @brief  AES_CTR_Crypt, charged to the CPU phase
+  */
+void __wrap_AES_CTR_Crypt(AES_CtrTypeDef *ctx, uint8_t *p_data, uint32_t length)
+{
+  const SIM_TimingTypeDef *timing = Sim_Timing();
+
+  if (timing != NULL)
+  {
+    Sim_Advance(SIM_PHASE_CPU, (uint64_t)length * timing->aes_cycles * 1000000000ULL / timing->sysclk_hz);
+  }
+  __real_AES_CTR_Crypt(ctx, p_data, length);
+}
+
+void __real_SHA256_Update(SHA256_CtxTypeDef *ctx, const uint8_t *p_data, uint32_t length);
+void __wrap_SHA256_Update(SHA256_CtxTypeDef *ctx, const uint8_t *p_data, uint32_t length);
+
+/**
+  * @brief  SHA256_Update, charged to the CPU phase
+  */
+void __wrap_SHA256_Update(SHA256_CtxTypeDef *ctx, const uint8_t *p_data, uint32_t length)
+{
+  const SIM_TimingTypeDef *timing = Sim_Timing();
+
+  if (timing != NULL)
+  {
+    Sim_Advance(SIM_PHASE_CPU, (uint64_t)length * timing->sha_cycles * 1000000000ULL / timing->sysclk_hz);
+  }
+  __real_SHA256_Update(ctx, p_data, length);
+}
@@ -0,0 +1,174 @@
+/**
+  ******************************************************************************
+  * @file    line_fault.c
+  * @brief   Faults on the line between the host model and the IAP, see
+  *          line_fault.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "line_fault.h"
+#include "host_ymodem.h"
+#include "sim.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define ACK                     0x06
+#define PPM                     1000000U
+
+/* Private variables ---------------------------------------------------------*/
+static const FAULT_ProfileTypeDef *pProfile;
+static uint32_t Random;
+static FAULT_StatsTypeDef Stats;
+static uint32_t Pending;                /* a fault waits for progress */
+static uint64_t PendingNs;
+static uint32_t PendingProgress;
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t Fault_Random(void)
+{
+  Random ^= Random << 13;
+  Random ^= Random >> 17;
+  Random ^= Random << 5;
+  return Random;
+}
+
+static int Fault_Chance(uint32_t ppm)
+{
+  return (ppm != 0) && ((Fault_Random() % PPM) < ppm);
+}
+
+/* Acknowledged steps of the transfer so far */
+static uint32_t Fault_Progress(void)
+{
+  const HOST_YmodemStatsTypeDef *host = Host_YmodemStats();
+  uint32_t progress = host->blocks;
+
+  if ((host->state == HOST_YMODEM_WAIT_END) || (host->state == HOST_YMODEM_END_SENT)
+      || (host->state == HOST_YMODEM_DONE))
+  {
+    progress++;
+  }
+  if (host->state == HOST_YMODEM_DONE)
+  {
+    progress++;
+  }
+  return progress;
+}
+
+static void Fault_Injected(uint64_t time_ns)
+{
+  if (!Pending)
+  {
+    Pending = 1;
+    PendingNs = time_ns;
+    PendingProgress = Fault_Progress();
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Put the faults of a profile on the line
+  * @note   After Host_YmodemStart, which connects the host straight to the
+  *         UART model.
+  * @param  profile: must stay valid during the transfer
+  * @param  seed: random generator seed, not 0
+  * @retval None
+  */
+void Fault_Start(const FAULT_ProfileTypeDef *profile, uint32_t seed)
+{
+  pProfile = profile;
+  Random = (seed != 0) ? seed : 1;
+  memset(&Stats, 0, sizeof(Stats));
+  Pending = 0;
+  Host_YmodemSetLine(Fault_HostSend);
+  Sim_UartModel(Fault_DeviceByte);
+}
+
+/**
+  * @brief  Host to device bytes, through the faults of the profile
+  * @param  p_data: bytes
+  * @param  size: number of bytes
+  * @param  ready_ns: as Sim_UartHostSend
+  * @retval None
+  */
+void Fault_HostSend(const uint8_t *p_data, uint32_t size, uint64_t ready_ns)
+{
+  uint8_t byte;
+
+  /* Turnaround first, then byte by byte on the line */
+  Sim_UartHostSend(p_data, 0, ready_ns);
+  while (size-- > 0)
+  {
+    byte = *p_data++;
+    if (Fault_Chance(pProfile->gap_ppm))
+    {
+      Stats.gaps++;
+      Fault_Injected(ready_ns);
+      Sim_UartHostIdle((uint64_t)pProfile->gap_us * 1000);
+    }
+    if (Fault_Chance(pProfile->drop_ppm))
+    {
+      Stats.dropped++;
+      Fault_Injected(ready_ns);
+      Sim_UartHostIdle(Sim_UartByteTime());
+      continue;
+    }
+    if (Fault_Chance(pProfile->flip_ppm))
+    {
+      Stats.flipped++;
+      Fault_Injected(ready_ns);
+      byte ^= (uint8_t)(1U << (Fault_Random() % 8));
+    }
+    Sim_UartHostSend(&byte, 1, 0);
+    if (Fault_Chance(pProfile->dup_ppm))
+    {
+      Stats.duplicated++;
+      Fault_Injected(ready_ns);
+      Sim_UartHostSend(&byte, 1, 0);
+    }
+  }
+}
+
+/**
+  * @brief  Device to host byte, ACKs may be lost on the way
+  * @param  byte: byte sent by the IAP
+  * @param  time_ns: end of its stop bit
+  * @retval None
+  */
+void Fault_DeviceByte(uint8_t byte, uint64_t time_ns)
+{
+  uint64_t recover_ns;
+
+  if ((byte == ACK) && Fault_Chance(pProfile->ack_loss_ppm))
+  {
+    Stats.acks_lost++;
+    Fault_Injected(time_ns);
+    return;
+  }
+  Host_YmodemOnByte(byte, time_ns);
+
+  if (Pending && (Fault_Progress() > PendingProgress))
+  {
+    Pending = 0;
+    recover_ns = time_ns - PendingNs;
+    Stats.recoveries++;
+    Stats.recover_ns += recover_ns;
+    if (recover_ns > Stats.recover_max_ns)
+    {
+      Stats.recover_max_ns = recover_ns;
+    }
+  }
+}
+
+/**
+  * @brief  Faults injected so far
+  * @param  None
+  * @retval Statistics, updated as the transfer goes
+  */
+const FAULT_StatsTypeDef *Fault_Stats(void)
+{
+  return &Stats;
+}
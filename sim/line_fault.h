@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file    line_fault.h
+  * @brief   Faults on the line between the host model (host_ymodem.c) and the
+  *          IAP, for the "model" UART of the simulation.
+  ******************************************************************************
+  * Sits between the two ends: the host sends through Fault_HostSend, the IAP
+  * output reaches the host through Fault_DeviceByte. Host to device bytes can
+  * be lost, get one bit flipped, arrive twice or after an idle gap; ACKs from
+  * the device can be lost. Rates are per byte in parts per million, drawn
+  * from a seeded generator so that a run can be replayed.
+  *
+  * A fault counts as recovered when the transfer makes progress again (a new
+  * block, EOT or the end of session acknowledged); the time in between is
+  * the time to recover.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LINE_FAULT_H
+#define __LINE_FAULT_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const char *name;
+  uint32_t drop_ppm;        /* host to device byte lost */
+  uint32_t flip_ppm;        /* host to device byte with one bit flipped */
+  uint32_t dup_ppm;         /* host to device byte received twice */
+  uint32_t gap_ppm;         /* idle line before a host to device byte */
+  uint32_t gap_us;          /* length of that gap */
+  uint32_t ack_loss_ppm;    /* ACK from the device lost */
+  uint32_t power_cut_pct;   /* power cut at this share of the flash operations, 0: none */
+} FAULT_ProfileTypeDef;
+
+typedef struct
+{
+  uint32_t dropped;
+  uint32_t flipped;
+  uint32_t duplicated;
+  uint32_t gaps;
+  uint32_t acks_lost;
+  uint32_t recoveries;      /* faults followed by progress */
+  uint64_t recover_ns;      /* sum over the recoveries */
+  uint64_t recover_max_ns;
+} FAULT_StatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void Fault_Start(const FAULT_ProfileTypeDef *profile, uint32_t seed);
+void Fault_HostSend(const uint8_t *p_data, uint32_t size, uint64_t ready_ns);
+void Fault_DeviceByte(uint8_t byte, uint64_t time_ns);
+const FAULT_StatsTypeDef *Fault_Stats(void);
+
+#endif  /* __LINE_FAULT_H */
@@ -0,0 +1,73 @@
+/**
+  ******************************************************************************
+  * @file    cmsis_compiler.h
+  * @brief   Host replacement of the CMSIS compiler header for the simulation.
+  ******************************************************************************
+  * Included first in every file (-include) with the guard of the CMSIS one,
+  * so core_cm0plus.h and the HAL headers build with the host compiler. The Cortex-M intrinsics
+  * become calls into sim_core.c; PRIMASK is a plain variable since nothing
+  * preempts the simulated code.
+  ******************************************************************************
+  */
+
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#define __ASM                   __asm
+#define __INLINE                inline
+#define __STATIC_INLINE         static inline
+#define __STATIC_FORCEINLINE    static inline
+#define __NO_RETURN             __attribute__((__noreturn__))
+#define __USED                  __attribute__((used))
+#define __WEAK                  __attribute__((weak))
+#define __PACKED                __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT         struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION          union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+#define __RESTRICT              __restrict
+#define __COMPILER_BARRIER()    __asm volatile("" ::: "memory")
+#define __UNALIGNED_UINT32(x)   (*((uint32_t *)(x)))
+
+/* sim_core.c */
+void Sim_DisableIrq(void);
+void Sim_EnableIrq(void);
+uint32_t Sim_GetPrimask(void);
+void Sim_SetPrimask(uint32_t primask);
+void Sim_SetMsp(uint32_t msp);
+void Sim_Barrier(void);
+void Sim_Wfi(void);
+
+#define __disable_irq()         Sim_DisableIrq()
+#define __enable_irq()          Sim_EnableIrq()
+#define __get_PRIMASK()         Sim_GetPrimask()
+#define __set_PRIMASK(x)        Sim_SetPrimask(x)
+#define __set_MSP(x)            Sim_SetMsp(x)
+#define __DSB()                 Sim_Barrier()
+#define __ISB()                 __COMPILER_BARRIER()
+#define __DMB()                 __COMPILER_BARRIER()
+#define __NOP()                 __COMPILER_BARRIER()
+#define __WFI()                 Sim_Wfi()
+#define __WFE()                 Sim_Wfi()
+#define __SEV()                 ((void)0)
+#define __BKPT(x)               __builtin_trap()
+#define __REV(x)                __builtin_bswap32(x)
+#define __REV16(x)              ((uint32_t)((__builtin_bswap32(x) >> 16) | (__builtin_bswap32(x) << 16)))
+#define __REVSH(x)              ((int16_t)__builtin_bswap16(x))
+#define __RBIT(x)               Sim_Rbit(x)
+#define __CLZ(x)                (((x) == 0U) ? 32U : (uint8_t)__builtin_clz(x))
+
+static inline uint32_t Sim_Rbit(uint32_t value)
+{
+  uint32_t result = 0;
+  uint32_t i;
+
+  for (i = 0; i < 32; i++)
+  {
+    result = (result << 1) | ((value >> i) & 1U);
+  }
+  return result;
+}
+
+#endif /* __CMSIS_COMPILER_H */
@@ -0,0 +1,139 @@
+/**
+  ******************************************************************************
+  * @file    sim.h
+  * @brief   Host simulation of the STM32G031G8 for the IAP and APP user code.
+  ******************************************************************************
+  * The user code runs unchanged on Linux against the real HAL and CMSIS
+  * headers. Only cmsis_compiler.h is replaced (shim/cmsis_compiler.h) and the
+  * HAL functions the code calls are implemented in the shim sources.
+  *
+  * The memory map is rebuilt with fixed mappings at the device addresses:
+  *
+  *   0x08000000  64 KB flash, backed by a file (erased = 0xFF), read only;
+  *               only the HAL_FLASH_xxx shim writes it, with G0 rules
+  *   0x1FFF7000  engineering bytes (flash size)
+  *   0x20000000  8 KB SRAM, backed by a file so no-init RAM (handoff block,
+  *               mailbox) survives from one run to the next like a soft reset
+  *   0x40000000  APB/AHB peripherals, IOPORT and the Cortex-M SCS as plain
+  *   0x50000000  memory: registers hold what is written, nothing runs behind
+  *   0xE000E000  them except what the shim updates (TIM2->CNT, USART ISR,
+  *               USART2 TDR and the CNDTR of its receive DMA, see sim_uart.c,
+ *               the SPI1 DMA, NSS and SR, see sim_spi.c)
+  *
+  * Time is the host monotonic clock, or a virtual clock (Sim_ClockVirtual)
+  * that only moves when the modelled hardware takes time: bytes on the UART
+  * at the configured baud rate, flash erase and program times, the CRC loops
+  * and waits. Results are then the same on every host and every run.
+  *
+  * The process ends where the device would leave the simulated code:
+  * SIM_EXIT_JUMP at __set_MSP() before the jump to the application,
+  * SIM_EXIT_RESET on NVIC_SystemReset() or an option byte launch.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_H
+#define __SIM_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define SIM_FLASH_BASE          ((uint32_t)0x08000000)
+#define SIM_FLASH_SIZE          ((uint32_t)0x10000)
+#define SIM_FLASH_PAGE          ((uint32_t)0x800)
+#define SIM_FLASH_ROW           ((uint32_t)0x100)     /* fast programming row, 32 double words */
+#define SIM_SRAM_BASE           ((uint32_t)0x20000000)
+#define SIM_SRAM_SIZE           ((uint32_t)0x2000)
+
+/* Process exit codes */
+#define SIM_EXIT_OK             0
+#define SIM_EXIT_ERROR          1
+#define SIM_EXIT_JUMP           10    /* IAP started the application */
+#define SIM_EXIT_RESET          11    /* system reset requested */
+#define SIM_EXIT_EOF            12    /* UART peer closed the line */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const char *flash_file;   /* flash image, created erased if missing; NULL: in memory */
+  const char *ram_file;     /* SRAM image, created on first run (power-on); NULL: in memory */
+  const char *uart;         /* "stdio", "pty", "fd:N" or "model" (see Sim_UartModel) */
+  int power_on;             /* force a power-on reset: clear SRAM, set PWRRSTF */
+  const char *uart2;        /* USART2: "fd:N", NULL when nothing is connected */
+  const char *spi;          /* SPI1 host: "fd:N", NULL when nothing is connected */
+} SIM_ConfigTypeDef;
+
+/* Where virtual time goes, see Sim_Advance() */
+typedef enum
+{
+  SIM_PHASE_WAIT = 0,       /* receive with nothing on the line: host turnaround, timeouts */
+  SIM_PHASE_TRANSFER,       /* bytes on the line, both directions */
+  SIM_PHASE_ERASE,          /* flash page erase */
+  SIM_PHASE_PROGRAM,        /* flash double word / row program */
+  SIM_PHASE_VERIFY,         /* image CRC32 */
+  SIM_PHASE_CPU,            /* packet CRC16, charged per received byte */
+  SIM_PHASE_OTHER,          /* HAL_Delay, WFI */
+  SIM_PHASE_COUNT
+} SIM_PhaseTypeDef;
+
+/* Timing model of the virtual clock. Flash times are the typical values of
+   the STM32G031x4/x6/x8 datasheet (flash memory characteristics); the CPU
+   costs are estimates from the instruction count of the C loops at 64 MHz,
+   there is no cycle counter on the M0+ to calibrate them against. */
+typedef struct
+{
+  uint32_t baud;            /* both directions, 10 bits per byte */
+  uint32_t host_latency_us; /* host turnaround: last byte received to first byte sent */
+  uint32_t page_erase_us;   /* tERASE, 2 KB page */
+  uint32_t dword_program_us;/* tprog, one double word */
+  uint32_t row_program_us;  /* tprog_row, 32 double words, fast programming */
+  uint32_t sysclk_hz;       /* for the CPU costs below */
+  uint32_t crc16_cycles;    /* UpdateCRC16, per byte */
+  uint32_t crc32_cycles;    /* Cal_CRC32, per byte */
+  uint32_t aes_cycles;      /* AES_CTR_Crypt, per byte, see aes.h */
+  uint32_t sha_cycles;      /* SHA256_Update, per byte, see sha256.h */
+} SIM_TimingTypeDef;
+
+#define SIM_TIMING_DEFAULT      {921600, 1000, 22000, 85, 1700, 64000000, 100, 20, 115, 80}
+
+/* Exported functions ------------------------------------------------------- */
+/* sim_core.c */
+int Sim_ParseArgs(SIM_ConfigTypeDef *config, int argc, char **argv, const char *usage);
+void Sim_Init(const SIM_ConfigTypeDef *config);
+__NO_RETURN void Sim_Exit(int code, const char *reason);
+uint64_t Sim_Micros(void);
+void Sim_PendIrq(void (*handler)(void));
+void Sim_RunIrqs(void);
+void Sim_ClockVirtual(const SIM_TimingTypeDef *timing);
+const SIM_TimingTypeDef *Sim_Timing(void);
+uint64_t Sim_Nanos(void);
+void Sim_Advance(SIM_PhaseTypeDef phase, uint64_t ns);
+void Sim_Sleep(uint32_t us);
+uint64_t Sim_PhaseTime(SIM_PhaseTypeDef phase);
+void Sim_ClockDeadline(uint64_t ns, void (*handler)(void));
+void Sim_JumpHandler(void (*handler)(void));
+int Sim_Fork(void (*run)(void *p_result), void *p_result, uint32_t size);
+
+/* sim_flash.c */
+void Sim_FlashInit(const char *path);
+uint32_t Sim_FlashErases(void);
+uint32_t Sim_FlashPrograms(void);
+void Sim_FlashPowerCut(uint32_t operation, void (*handler)(void));
+
+/* sim_uart.c */
+void Sim_UartInit(const char *spec);
+void Sim_Uart2Init(const char *spec);
+void Sim_UartPoll(void);
+void Sim_UartModel(void (*peer)(uint8_t byte, uint64_t time_ns));
+void Sim_UartHostSend(const uint8_t *p_data, uint32_t size, uint64_t ready_ns);
+void Sim_UartHostIdle(uint64_t ns);
+uint64_t Sim_UartByteTime(void);
+uint64_t Sim_UartBytesRx(void);
+uint64_t Sim_UartBytesTx(void);
+
+/* sim_spi.c */
+void Sim_SpiInit(const char *spec);
+void Sim_SpiPoll(void);
+
+#endif  /* __SIM_H */
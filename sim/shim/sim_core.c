@@ -0,0 +1,518 @@
+/**
+  ******************************************************************************
+  * @file    sim_core.c
+  * @brief   Memory map, reset/jump exits and Cortex-M intrinsics of the host
+  *          simulation, see sim.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32g0xx.h"
+#include "sim.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t base;
+  uint32_t size;
+} SIM_RegionTypeDef;
+
+/* Private define ------------------------------------------------------------*/
+/* Reset cause stored after the SRAM image, for the next run */
+#define SIM_RAM_TRAILER         SIM_SRAM_SIZE
+#define SIM_IRQ_MAX             8
+
+/* Private variables ---------------------------------------------------------*/
+static const SIM_RegionTypeDef aRegisters[] =
+{
+  {0x1FFF7000, 0x1000},     /* engineering bytes, option bytes */
+  {0x40000000, 0x16000},    /* APB peripherals */
+  {0x40020000, 0x6000},     /* AHB peripherals: DMA, RCC, EXTI, FLASH, CRC */
+  {0x50000000, 0x2000},     /* IOPORT, GPIOA..GPIOF */
+  {0xE000E000, 0x1000},     /* SCS: SysTick, NVIC, SCB */
+};
+
+static int RamFd = -1;
+static const SIM_TimingTypeDef *pTiming = NULL;
+static uint64_t VirtualNs = 0;
+static uint64_t aPhaseNs[SIM_PHASE_COUNT];
+static uint64_t DeadlineNs = 0;
+static void (*pDeadlineHandler)(void) = NULL;
+static void (*pJumpHandler)(void) = NULL;
+static uint32_t Primask = 0;
+static struct timespec StartTime;
+static void (*aPendingIrq[SIM_IRQ_MAX])(void);
+static uint32_t PendingCount = 0;
+
+/* Private functions ---------------------------------------------------------*/
+
+static void *Sim_Map(uint32_t base, uint32_t size, int prot, int flags, int fd)
+{
+  void *p = mmap((void *)(uintptr_t)base, size, prot, flags | MAP_FIXED_NOREPLACE, fd, 0);
+
+  if (p != (void *)(uintptr_t)base)
+  {
+    fprintf(stderr, "sim: cannot map 0x%08x (%u bytes)\n", (unsigned)base, (unsigned)size);
+    exit(SIM_EXIT_ERROR);
+  }
+  return p;
+}
+
+static void Sim_RamInit(const char *path, int power_on)
+{
+  uint32_t cause = 0;
+  uint32_t seed = 0x12345678;
+  uint8_t *p_ram;
+  uint32_t i;
+
+  RamFd = (path != NULL) ? open(path, O_RDWR | O_CREAT, 0644) : memfd_create("ram", 0);
+  if ((RamFd < 0) || (ftruncate(RamFd, SIM_SRAM_SIZE + 4) != 0))
+  {
+    perror((path != NULL) ? path : "ram");
+    exit(SIM_EXIT_ERROR);
+  }
+  if (pread(RamFd, &cause, 4, SIM_RAM_TRAILER) != 4)
+  {
+    cause = 0;
+  }
+  p_ram = Sim_Map(SIM_SRAM_BASE, SIM_SRAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, RamFd);
+
+  if (power_on || (cause == 0))
+  {
+    /* SRAM content is undefined after power-on */
+    for (i = 0; i < SIM_SRAM_SIZE; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      p_ram[i] = (uint8_t)(seed >> 16);
+    }
+    cause = RCC_CSR_PWRRSTF | RCC_CSR_PINRSTF;
+  }
+  RCC->CSR = cause;
+  /* A later run without a reset request is an NRST reset */
+  cause = RCC_CSR_PINRSTF;
+  if (pwrite(RamFd, &cause, 4, SIM_RAM_TRAILER) != 4)
+  {
+    perror("ram");
+  }
+}
+
+static void Sim_RegistersInit(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < sizeof(aRegisters) / sizeof(aRegisters[0]); i++)
+  {
+    Sim_Map(aRegisters[i].base, aRegisters[i].size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+  }
+
+  *(uint16_t *)FLASHSIZE_BASE = (uint16_t)(SIM_FLASH_SIZE >> 10);
+  /* nBOOT_SEL already cleared by Flash_OB_Handle on an earlier boot */
+  FLASH->OPTR = 0xFFFFFEAAU & ~FLASH_OPTR_nBOOT_SEL;
+  FLASH->CR = FLASH_CR_LOCK | FLASH_CR_OPTLOCK;
+  USART1->ISR = USART_ISR_TXE_TXFNF | USART_ISR_TC;
+  USART2->ISR = USART_ISR_TXE_TXFNF | USART_ISR_TC;
+  *(volatile uint32_t *)&SCB->CPUID = 0x410CC601U;     /* Cortex-M0+ r0p1 */
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Parse the options common to every simulation program
+  * @param  config: filled with the options, defaults for the others
+  * @param  argc, argv: command line
+  * @param  usage: extra usage text of the program, printed on error
+  * @retval Index of the first argument that is not a simulation option
+  */
+int Sim_ParseArgs(SIM_ConfigTypeDef *config, int argc, char **argv, const char *usage)
+{
+  int i;
+
+  config->flash_file = "flash.bin";
+  config->ram_file = "ram.bin";
+  config->uart = "stdio";
+  config->uart2 = NULL;
+  config->spi = NULL;
+  config->power_on = 0;
+
+  for (i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "--flash") == 0) && (i + 1 < argc))
+    {
+      config->flash_file = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--ram") == 0) && (i + 1 < argc))
+    {
+      config->ram_file = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--uart") == 0) && (i + 1 < argc))
+    {
+      config->uart = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--uart2") == 0) && (i + 1 < argc))
+    {
+      config->uart2 = argv[++i];
+    }
+    else if ((strcmp(argv[i], "--spi") == 0) && (i + 1 < argc))
+    {
+      config->spi = argv[++i];
+    }
+    else if (strcmp(argv[i], "--power-on") == 0)
+    {
+      config->power_on = 1;
+    }
+    else if (strncmp(argv[i], "--", 2) == 0)
+    {
+      fprintf(stderr, "usage: %s [--flash FILE] [--ram FILE] [--uart stdio|pty|fd:N] [--uart2 fd:N] [--spi fd:N] [--power-on] %s\n",
+              argv[0], usage);
+      exit(SIM_EXIT_ERROR);
+    }
+    else
+    {
+      break;
+    }
+  }
+  return i;
+}
+
+/**
+  * @brief  Build the memory map and open the UART
+  * @param  config: files and UART to use
+  * @retval None
+  */
+void Sim_Init(const SIM_ConfigTypeDef *config)
+{
+  clock_gettime(CLOCK_MONOTONIC, &StartTime);
+  Sim_RegistersInit();
+  Sim_RamInit(config->ram_file, config->power_on);
+  Sim_FlashInit(config->flash_file);
+  Sim_UartInit(config->uart);
+  Sim_Uart2Init(config->uart2);
+  Sim_SpiInit(config->spi);
+}
+
+/**
+  * @brief  Leave the simulation, keeping flash and SRAM images
+  * @param  code: SIM_EXIT_xxx
+  * @param  reason: printed on stderr, NULL for none
+  * @retval None
+  */
+void Sim_Exit(int code, const char *reason)
+{
+  uint32_t cause;
+
+  if (reason != NULL)
+  {
+    fprintf(stderr, "sim: %s\n", reason);
+  }
+  if ((code == SIM_EXIT_RESET) && (RamFd >= 0))
+  {
+    cause = RCC_CSR_SFTRSTF;
+    if (pwrite(RamFd, &cause, 4, SIM_RAM_TRAILER) != 4)
+    {
+      perror("ram");
+    }
+  }
+  fflush(stdout);
+  msync((void *)(uintptr_t)SIM_SRAM_BASE, SIM_SRAM_SIZE, MS_SYNC);
+  exit(code);
+}
+
+/**
+  * @brief  Switch to the virtual clock, before Sim_Init()
+  * @param  timing: timing model, must stay valid for the whole run
+  * @retval None
+  */
+void Sim_ClockVirtual(const SIM_TimingTypeDef *timing)
+{
+  pTiming = timing;
+  VirtualNs = 0;
+  memset(aPhaseNs, 0, sizeof(aPhaseNs));
+}
+
+/**
+  * @brief  Timing model in use
+  * @param  None
+  * @retval NULL on the host clock
+  */
+const SIM_TimingTypeDef *Sim_Timing(void)
+{
+  return pTiming;
+}
+
+/**
+  * @brief  Time since the start of the run
+  * @param  None
+  * @retval Nanoseconds
+  */
+uint64_t Sim_Nanos(void)
+{
+  struct timespec now;
+
+  if (pTiming != NULL)
+  {
+    return VirtualNs;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - StartTime.tv_sec) * 1000000000 + (now.tv_nsec - StartTime.tv_nsec);
+}
+
+/**
+  * @brief  Let modelled time pass, does nothing on the host clock
+  * @param  phase: what the time is spent on
+  * @param  ns: duration
+  * @retval None
+  */
+void Sim_Advance(SIM_PhaseTypeDef phase, uint64_t ns)
+{
+  if (pTiming != NULL)
+  {
+    VirtualNs += ns;
+    aPhaseNs[phase] += ns;
+    if ((pDeadlineHandler != NULL) && (VirtualNs >= DeadlineNs))
+    {
+      void (*handler)(void) = pDeadlineHandler;
+
+      pDeadlineHandler = NULL;
+      handler();
+    }
+  }
+}
+
+/**
+  * @brief  Call a handler once the virtual clock passes a deadline, to get
+  *         out of code that would wait forever (it usually longjmps)
+  * @param  ns: deadline, virtual time
+  * @param  handler: NULL to cancel
+  * @retval None
+  */
+void Sim_ClockDeadline(uint64_t ns, void (*handler)(void))
+{
+  DeadlineNs = ns;
+  pDeadlineHandler = handler;
+}
+
+/**
+  * @brief  Wait: sleeps on the host clock, advances the virtual one
+  * @param  us: duration
+  * @retval None
+  */
+void Sim_Sleep(uint32_t us)
+{
+  if (pTiming != NULL)
+  {
+    Sim_Advance(SIM_PHASE_OTHER, (uint64_t)us * 1000);
+  }
+  else
+  {
+    usleep(us);
+  }
+}
+
+/**
+  * @brief  Virtual time spent on one phase since the start of the run
+  * @param  phase: SIM_PHASE_xxx
+  * @retval Nanoseconds
+  */
+uint64_t Sim_PhaseTime(SIM_PhaseTypeDef phase)
+{
+  return aPhaseNs[phase];
+}
+
+/**
+  * @brief  Time since the start of the run, also drives TIM2->CNT
+  * @param  None
+  * @retval Microseconds
+  */
+uint64_t Sim_Micros(void)
+{
+  uint64_t us = Sim_Nanos() / 1000;
+
+  if (TIM2->CR1 & TIM_CR1_CEN)
+  {
+    /* 1 MHz timebase, see timebase.h */
+    TIM2->CNT = (uint32_t)us;
+  }
+  return us;
+}
+
+/**
+  * @brief  Queue an interrupt handler
+  * @note   Handlers run at the next WFI, HAL_GetTick() or PRIMASK clear,
+  *         never from inside the HAL call that raised them.
+  * @param  handler: function standing for the interrupt
+  * @retval None
+  */
+void Sim_PendIrq(void (*handler)(void))
+{
+  if (PendingCount < SIM_IRQ_MAX)
+  {
+    aPendingIrq[PendingCount++] = handler;
+  }
+}
+
+/**
+  * @brief  Run the pending handlers unless interrupts are masked
+  * @param  None
+  * @retval None
+  */
+void Sim_RunIrqs(void)
+{
+  if ((Primask == 0) && (PendingCount > 0))
+  {
+    Sim_EnableIrq();
+  }
+}
+
+void Sim_DisableIrq(void)
+{
+  Primask = 1;
+}
+
+void Sim_EnableIrq(void)
+{
+  void (*handler)(void);
+  uint32_t i;
+
+  Primask = 0;
+  while (PendingCount > 0)
+  {
+    handler = aPendingIrq[0];
+    PendingCount--;
+    for (i = 0; i < PendingCount; i++)
+    {
+      aPendingIrq[i] = aPendingIrq[i + 1];
+    }
+    handler();
+  }
+}
+
+uint32_t Sim_GetPrimask(void)
+{
+  return Primask;
+}
+
+void Sim_SetPrimask(uint32_t primask)
+{
+  if (primask == 0)
+  {
+    Sim_EnableIrq();
+  }
+  else
+  {
+    Primask = 1;
+  }
+}
+
+/**
+  * @brief  __set_MSP is only used right before the jump to the application
+  * @param  msp: initial stack pointer of the application
+  * @retval None
+  */
+void Sim_SetMsp(uint32_t msp)
+{
+  char reason[48];
+
+  if (pJumpHandler != NULL)
+  {
+    pJumpHandler();
+  }
+  snprintf(reason, sizeof(reason), "jump to application, sp 0x%08x", (unsigned)msp);
+  Sim_Exit(SIM_EXIT_JUMP, reason);
+}
+
+/**
+  * @brief  Call a handler at the jump to the application instead of ending
+  *         the run, for a harness that times the boot (it usually longjmps)
+  * @param  handler: NULL to end the run again
+  * @retval None
+  */
+void Sim_JumpHandler(void (*handler)(void))
+{
+  pJumpHandler = handler;
+}
+
+/**
+  * @brief  __DSB, ends the run when NVIC_SystemReset() requested a reset
+  * @param  None
+  * @retval None
+  */
+void Sim_Barrier(void)
+{
+  __COMPILER_BARRIER();
+  if ((SCB->AIRCR & SCB_AIRCR_SYSRESETREQ_Msk) && ((SCB->AIRCR >> SCB_AIRCR_VECTKEY_Pos) == 0x05FA))
+  {
+    Sim_Exit(SIM_EXIT_RESET, "system reset");
+  }
+}
+
+/**
+  * @brief  __WFI, returns once an interrupt is pending; its handler runs now
+  *         or, with PRIMASK set, when PRIMASK is cleared
+  * @param  None
+  * @retval None
+  */
+void Sim_Wfi(void)
+{
+  if (PendingCount == 0)
+  {
+    /* Nothing can raise an interrupt while we wait, let time pass */
+    Sim_Sleep(1000);
+    return;
+  }
+  Sim_RunIrqs();
+}
+
+/**
+  * @brief  Run a function in a child process and get its result back
+  * @note   Sim_Init maps the device at fixed addresses and the user code keeps
+  *         its state in globals: a harness running several cases gives each
+  *         one a fresh process, Sim_Init is then called by the child.
+  * @param  run: fills the result, in the child
+  * @param  p_result: result, the same address in both processes
+  * @param  size: result size
+  * @retval 0 if the child completed and returned its result
+  */
+int Sim_Fork(void (*run)(void *p_result), void *p_result, uint32_t size)
+{
+  int fd[2], status;
+  pid_t pid;
+  ssize_t n;
+
+  if (pipe(fd) != 0)
+  {
+    return -1;
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0)
+  {
+    close(fd[0]);
+    close(fd[1]);
+    return -1;
+  }
+  if (pid == 0)
+  {
+    close(fd[0]);
+    run(p_result);
+    n = write(fd[1], p_result, size);
+    _exit((n == (ssize_t)size) ? SIM_EXIT_OK : SIM_EXIT_ERROR);
+  }
+
+  close(fd[1]);
+  n = read(fd[0], p_result, size);
+  close(fd[0]);
+  waitpid(pid, &status, 0);
+  if ((n != (ssize_t)size) || !WIFEXITED(status) || (WEXITSTATUS(status) != SIM_EXIT_OK))
+  {
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,417 @@
+/**
+  ******************************************************************************
+  * @file    sim_flash.c
+  * @brief   HAL_FLASH_xxx on a file mapped at 0x08000000, with the STM32G0
+  *          erase/program rules.
+  ******************************************************************************
+  * The flash is mapped read only at its device address, so a stray write from
+  * the user code faults like a bus error. Only this file writes it, through a
+  * second mapping of the same file, and only what the G0 allows:
+  *   - erase by 2 KB page or mass erase, erased = 0xFF
+  *   - program one double word (8-byte aligned) or one 256-byte row (fast
+  *     programming), the target must be erased; a double word of zero may
+  *     overwrite anything
+  *   - nothing while the FLASH->CR LOCK bit is set, nothing in a WRP area
+  * An error sets the FLASH->SR bit the device would set and returns HAL_ERROR.
+  * On the virtual clock every erase and program takes its datasheet time.
+  * Sim_FlashPowerCut interrupts one operation halfway, like a power loss.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32g0xx_hal.h"
+#include "sim.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_FLASH_PAGES         (SIM_FLASH_SIZE / SIM_FLASH_PAGE)
+#define SIM_WRP_NONE            ((uint32_t)0x0000003F)  /* start > end: no page protected */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t *pFlashRw = NULL;
+static uint32_t EraseCount = 0;
+static uint32_t ProgramCount = 0;
+static uint32_t LastErasedPage = 0;
+static uint32_t CutOperation = 0;
+static void (*pCutHandler)(void) = NULL;
+
+/* Private functions ---------------------------------------------------------*/
+
+static void Sim_FlashBusy(SIM_PhaseTypeDef phase, uint32_t us)
+{
+  Sim_Advance(phase, (uint64_t)us * 1000);
+}
+
+static HAL_StatusTypeDef Sim_FlashError(uint32_t flag)
+{
+  FLASH->SR |= flag;
+  return HAL_ERROR;
+}
+
+static int Sim_FlashProtected(uint32_t page)
+{
+  uint32_t wrp[2];
+  uint32_t i;
+
+  wrp[0] = FLASH->WRP1AR;
+  wrp[1] = FLASH->WRP1BR;
+  for (i = 0; i < 2; i++)
+  {
+    if (((wrp[i] & FLASH_WRP1AR_WRP1A_STRT) <= page)
+        && (((wrp[i] & FLASH_WRP1AR_WRP1A_END) >> FLASH_WRP1AR_WRP1A_END_Pos) >= page))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Counts the operations down to the one the power cut interrupts */
+static int Sim_FlashCutNow(void)
+{
+  return (pCutHandler != NULL) && (--CutOperation == 0);
+}
+
+static void Sim_FlashPowerLost(void)
+{
+  void (*handler)(void) = pCutHandler;
+
+  pCutHandler = NULL;
+  /* What the next power-on finds in the flash interface */
+  FLASH->CR = FLASH_CR_LOCK | FLASH_CR_OPTLOCK;
+  FLASH->SR = 0;
+  handler();
+  Sim_Exit(SIM_EXIT_ERROR, "power cut handler returned");
+}
+
+static HAL_StatusTypeDef Sim_FlashErasePage(uint32_t page)
+{
+  if (page >= SIM_FLASH_PAGES)
+  {
+    return Sim_FlashError(FLASH_SR_PGAERR);
+  }
+  if (Sim_FlashProtected(page))
+  {
+    return Sim_FlashError(FLASH_SR_WRPERR);
+  }
+  if (Sim_FlashCutNow())
+  {
+    memset(pFlashRw + page * SIM_FLASH_PAGE, 0xFF, SIM_FLASH_PAGE / 2);
+    Sim_FlashPowerLost();
+  }
+  memset(pFlashRw + page * SIM_FLASH_PAGE, 0xFF, SIM_FLASH_PAGE);
+  if (Sim_Timing() != NULL)
+  {
+    Sim_FlashBusy(SIM_PHASE_ERASE, Sim_Timing()->page_erase_us);
+  }
+  EraseCount++;
+  LastErasedPage = page;
+  return HAL_OK;
+}
+
+static int Sim_FlashErased(uint32_t offset, uint32_t size)
+{
+  uint32_t i;
+
+  for (i = 0; i < size; i++)
+  {
+    if (pFlashRw[offset + i] != 0xFF)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void Sim_FlashEraseDone(void)
+{
+  FLASH->SR |= FLASH_SR_EOP;
+  HAL_FLASH_EndOfOperationCallback(LastErasedPage);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Map the flash image, created erased if the file does not exist
+  * @param  path: flash image file, NULL for an erased flash in memory
+  * @retval None
+  */
+void Sim_FlashInit(const char *path)
+{
+  struct stat st;
+  int fd;
+
+  fd = (path != NULL) ? open(path, O_RDWR | O_CREAT, 0644) : memfd_create("flash", 0);
+  if ((fd < 0) || (fstat(fd, &st) != 0))
+  {
+    perror((path != NULL) ? path : "flash");
+    exit(SIM_EXIT_ERROR);
+  }
+  if ((uint32_t)st.st_size < SIM_FLASH_SIZE)
+  {
+    /* A shorter file is an image at 0x08000000, the rest is erased */
+    static uint8_t erased[SIM_FLASH_PAGE];
+
+    memset(erased, 0xFF, sizeof(erased));
+    while ((uint32_t)st.st_size < SIM_FLASH_SIZE)
+    {
+      uint32_t n = SIM_FLASH_PAGE - ((uint32_t)st.st_size % SIM_FLASH_PAGE);
+
+      if (pwrite(fd, erased, n, st.st_size) != (ssize_t)n)
+      {
+        perror("flash");
+        exit(SIM_EXIT_ERROR);
+      }
+      st.st_size += n;
+    }
+  }
+
+  if (mmap((void *)(uintptr_t)SIM_FLASH_BASE, SIM_FLASH_SIZE, PROT_READ,
+           MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0) != (void *)(uintptr_t)SIM_FLASH_BASE)
+  {
+    fprintf(stderr, "sim: cannot map the flash at 0x%08x\n", (unsigned)SIM_FLASH_BASE);
+    exit(SIM_EXIT_ERROR);
+  }
+  pFlashRw = mmap(NULL, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (pFlashRw == MAP_FAILED)
+  {
+    perror("flash");
+    exit(SIM_EXIT_ERROR);
+  }
+  close(fd);
+
+  FLASH->WRP1AR = SIM_WRP_NONE;
+  FLASH->WRP1BR = SIM_WRP_NONE;
+}
+
+/**
+  * @brief  Number of pages erased since the start of the run
+  * @param  None
+  * @retval Pages
+  */
+uint32_t Sim_FlashErases(void)
+{
+  return EraseCount;
+}
+
+/**
+  * @brief  Number of program operations (double words or rows) since the
+  *         start of the run
+  * @param  None
+  * @retval Operations
+  */
+uint32_t Sim_FlashPrograms(void)
+{
+  return ProgramCount;
+}
+
+/**
+  * @brief  Cut the power during a later flash operation: an erase leaves its
+  *         page half erased, a program half written; the flash interface is
+  *         then reset and the handler called, it must not return (longjmp)
+  * @param  operation: 1 for the next erase or program, 2 for the one after...
+  * @param  handler: NULL to disarm
+  * @retval None
+  */
+void Sim_FlashPowerCut(uint32_t operation, void (*handler)(void))
+{
+  CutOperation = operation;
+  pCutHandler = (operation != 0) ? handler : NULL;
+}
+
+/* HAL_FLASH -----------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+  FLASH->CR &= ~FLASH_CR_LOCK;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+  FLASH->CR |= FLASH_CR_LOCK;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_OB_Unlock(void)
+{
+  if (FLASH->CR & FLASH_CR_LOCK)
+  {
+    return HAL_ERROR;
+  }
+  FLASH->CR &= ~FLASH_CR_OPTLOCK;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_OB_Lock(void)
+{
+  FLASH->CR |= FLASH_CR_OPTLOCK;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_OB_Launch(void)
+{
+  /* OBL_LAUNCH reloads the option bytes through a system reset */
+  Sim_Exit(SIM_EXIT_RESET, "option byte launch");
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+  uint32_t offset = Address - SIM_FLASH_BASE;
+  uint32_t size = (TypeProgram == FLASH_TYPEPROGRAM_FAST) ? SIM_FLASH_ROW : 8;
+
+  if (FLASH->CR & FLASH_CR_LOCK)
+  {
+    return Sim_FlashError(FLASH_SR_PGSERR);
+  }
+  if ((Address < SIM_FLASH_BASE) || (offset + size > SIM_FLASH_SIZE) || (offset % size != 0))
+  {
+    return Sim_FlashError(FLASH_SR_PGAERR);
+  }
+  if (Sim_FlashProtected(offset / SIM_FLASH_PAGE))
+  {
+    return Sim_FlashError(FLASH_SR_WRPERR);
+  }
+
+  if (Sim_FlashCutNow())
+  {
+    memcpy(pFlashRw + offset, (TypeProgram == FLASH_TYPEPROGRAM_FAST) ? (const void *)(uintptr_t)Data : &Data, size / 2);
+    Sim_FlashPowerLost();
+  }
+
+  if (TypeProgram == FLASH_TYPEPROGRAM_FAST)
+  {
+    /* Data is the address of the 32 double words in RAM */
+    if (!Sim_FlashErased(offset, size))
+    {
+      return Sim_FlashError(FLASH_SR_PROGERR);
+    }
+    memcpy(pFlashRw + offset, (const void *)(uintptr_t)Data, size);
+    if (Sim_Timing() != NULL)
+    {
+      Sim_FlashBusy(SIM_PHASE_PROGRAM, Sim_Timing()->row_program_us);
+    }
+  }
+  else
+  {
+    if ((Data != 0) && !Sim_FlashErased(offset, size))
+    {
+      return Sim_FlashError(FLASH_SR_PROGERR);
+    }
+    memcpy(pFlashRw + offset, &Data, size);
+    if (Sim_Timing() != NULL)
+    {
+      Sim_FlashBusy(SIM_PHASE_PROGRAM, Sim_Timing()->dword_program_us);
+    }
+  }
+  ProgramCount++;
+  FLASH->SR |= FLASH_SR_EOP;
+  return HAL_OK;
+}
+
+void HAL_FLASH_IRQHandler(void)
+{
+}
+
+__WEAK void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+  (void)ReturnValue;
+}
+
+__WEAK void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+  (void)ReturnValue;
+}
+
+/* HAL_FLASHEx ---------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError)
+{
+  uint32_t page;
+  uint32_t first = 0;
+  uint32_t count = SIM_FLASH_PAGES;
+
+  *PageError = 0xFFFFFFFFU;
+  if (FLASH->CR & FLASH_CR_LOCK)
+  {
+    return Sim_FlashError(FLASH_SR_PGSERR);
+  }
+  if (pEraseInit->TypeErase == FLASH_TYPEERASE_PAGES)
+  {
+    first = pEraseInit->Page;
+    count = pEraseInit->NbPages;
+  }
+  for (page = first; page < first + count; page++)
+  {
+    if (Sim_FlashErasePage(page) != HAL_OK)
+    {
+      *PageError = page;
+      return HAL_ERROR;
+    }
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit)
+{
+  uint32_t error;
+
+  if (HAL_FLASHEx_Erase(pEraseInit, &error) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  /* The erase itself is instant, the end of operation interrupt follows */
+  Sim_PendIrq(Sim_FlashEraseDone);
+  return HAL_OK;
+}
+
+void HAL_FLASHEx_OBGetConfig(FLASH_OBProgramInitTypeDef *pOBInit)
+{
+  uint32_t wrp = (pOBInit->WRPArea == OB_WRPAREA_ZONE_B) ? FLASH->WRP1BR : FLASH->WRP1AR;
+
+  pOBInit->OptionType = OPTIONBYTE_WRP | OPTIONBYTE_RDP | OPTIONBYTE_USER;
+  pOBInit->WRPStartOffset = wrp & FLASH_WRP1AR_WRP1A_STRT;
+  pOBInit->WRPEndOffset = (wrp & FLASH_WRP1AR_WRP1A_END) >> FLASH_WRP1AR_WRP1A_END_Pos;
+  pOBInit->RDPLevel = FLASH->OPTR & FLASH_OPTR_RDP;
+  pOBInit->USERConfig = FLASH->OPTR & ~FLASH_OPTR_RDP;
+  pOBInit->USERType = OB_USER_ALL;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_OBProgram(FLASH_OBProgramInitTypeDef *pOBInit)
+{
+  uint32_t wrp;
+
+  if (FLASH->CR & FLASH_CR_OPTLOCK)
+  {
+    return HAL_ERROR;
+  }
+  if (pOBInit->OptionType & OPTIONBYTE_WRP)
+  {
+    wrp = (pOBInit->WRPStartOffset & FLASH_WRP1AR_WRP1A_STRT)
+          | ((pOBInit->WRPEndOffset << FLASH_WRP1AR_WRP1A_END_Pos) & FLASH_WRP1AR_WRP1A_END);
+    if (pOBInit->WRPArea == OB_WRPAREA_ZONE_A)
+    {
+      FLASH->WRP1AR = wrp;
+    }
+    else if (pOBInit->WRPArea == OB_WRPAREA_ZONE_B)
+    {
+      FLASH->WRP1BR = wrp;
+    }
+  }
+  if (pOBInit->OptionType & OPTIONBYTE_RDP)
+  {
+    FLASH->OPTR = (FLASH->OPTR & ~FLASH_OPTR_RDP) | (pOBInit->RDPLevel & FLASH_OPTR_RDP);
+  }
+  if (pOBInit->OptionType & OPTIONBYTE_USER)
+  {
+    FLASH->OPTR = (FLASH->OPTR & ~pOBInit->USERType) | (pOBInit->USERConfig & pOBInit->USERType);
+  }
+  return HAL_OK;
+}
@@ -0,0 +1,227 @@
+/**
+  ******************************************************************************
+  * @file    sim_hal.c
+  * @brief   HAL core, RCC, PWR, GPIO and NVIC functions of the host simulation.
+  ******************************************************************************
+  * Clock configuration only updates SystemCoreClock; the HAL tick follows the
+  * simulation clock, host or virtual. GPIO writes land in the mapped GPIO
+  * registers so the LED state can still be read back from GPIOx->ODR.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32g0xx_hal.h"
+#include "sim.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_HSI_VALUE           16000000U
+#define SIM_PLL_VALUE           64000000U     /* HSI16 * 8 / 2, SystemClock_Config */
+
+/* Exported variables --------------------------------------------------------*/
+__IO uint32_t uwTick;
+uint32_t uwTickPrio = (1UL << __NVIC_PRIO_BITS);
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+uint32_t SystemCoreClock = SIM_HSI_VALUE;
+const uint32_t AHBPrescTable[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9};
+const uint32_t APBPrescTable[8] = {0, 0, 0, 0, 1, 2, 3, 4};
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t TickSuspended = 0;
+static uint32_t TickOffset = 0;
+
+/* HAL -----------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+  HAL_MspInit();
+  return HAL_OK;
+}
+
+__WEAK void HAL_MspInit(void)
+{
+}
+
+/**
+  * @brief  HAL tick from the simulation clock
+  * @note   Also the point where pending interrupts are taken, since every
+  *         polling loop of the user code goes through it.
+  * @param  None
+  * @retval Milliseconds
+  */
+uint32_t HAL_GetTick(void)
+{
+  if (!TickSuspended)
+  {
+    uwTick = (uint32_t)(Sim_Micros() / 1000) - TickOffset;
+  }
+  Sim_UartPoll();
+  Sim_SpiPoll();
+  Sim_RunIrqs();
+  return uwTick;
+}
+
+void HAL_IncTick(void)
+{
+  uwTick += (uint32_t)uwTickFreq;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while ((HAL_GetTick() - tickstart) < Delay)
+  {
+    Sim_Sleep(1000);
+  }
+}
+
+void HAL_SuspendTick(void)
+{
+  TickSuspended = 1;
+}
+
+void HAL_ResumeTick(void)
+{
+  /* Code that catches up uwTick by hand keeps its value */
+  TickOffset = (uint32_t)(Sim_Micros() / 1000) - uwTick;
+  TickSuspended = 0;
+}
+
+void SystemInit(void)
+{
+}
+
+void SystemCoreClockUpdate(void)
+{
+  SystemCoreClock = ((RCC->CFGR & RCC_CFGR_SWS) == RCC_CFGR_SWS_1) ? SIM_PLL_VALUE : SIM_HSI_VALUE;
+}
+
+/* RCC, PWR ------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+  if (RCC_OscInitStruct->PLL.PLLState == RCC_PLL_ON)
+  {
+    RCC->CR |= RCC_CR_PLLON | RCC_CR_PLLRDY;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+  FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | FLatency;
+  if ((RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_SYSCLK)
+      && (RCC_ClkInitStruct->SYSCLKSource == RCC_SYSCLKSOURCE_PLLCLK))
+  {
+    RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_SW | RCC_CFGR_SWS)) | RCC_CFGR_SW_1 | RCC_CFGR_SWS_1;
+  }
+  SystemCoreClockUpdate();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit)
+{
+  (void)PeriphClkInit;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling(uint32_t VoltageScaling)
+{
+  PWR->CR1 = (PWR->CR1 & ~PWR_CR1_VOS) | VoltageScaling;
+  return HAL_OK;
+}
+
+/* GPIO ----------------------------------------------------------------------*/
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+  (void)GPIOx;
+  (void)GPIO_Init;
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+  (void)GPIOx;
+  (void)GPIO_Pin;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if (PinState != GPIO_PIN_RESET)
+  {
+    GPIOx->ODR |= GPIO_Pin;
+  }
+  else
+  {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  GPIOx->ODR ^= GPIO_Pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/* Called by the line models (sim_spi.c) where the EXTI would interrupt */
+__WEAK void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin)
+{
+  (void)GPIO_Pin;
+}
+
+HAL_StatusTypeDef HAL_EXTI_SetConfigLine(EXTI_HandleTypeDef *hexti, EXTI_ConfigTypeDef *pExtiConfig)
+{
+  hexti->Line = pExtiConfig->Line;
+  return HAL_OK;
+}
+
+/* DMA -----------------------------------------------------------------------*/
+
+/* Only the USART2 circular reception (sim_uart.c) and the SPI1 transfers
+   (sim_spi.c) are modelled */
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+  hdma->State = HAL_DMA_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma)
+{
+  hdma->Instance->CCR = 0;
+  hdma->State = HAL_DMA_STATE_RESET;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+  if (hdma->State != HAL_DMA_STATE_BUSY)
+  {
+    return HAL_ERROR;
+  }
+  hdma->Instance->CCR &= ~DMA_CCR_EN;
+  hdma->State = HAL_DMA_STATE_READY;
+  return HAL_OK;
+}
+
+/* NVIC ----------------------------------------------------------------------*/
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+  (void)IRQn;
+  (void)PreemptPriority;
+  (void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+  NVIC_EnableIRQ(IRQn);
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+  NVIC_DisableIRQ(IRQn);
+}
@@ -0,0 +1,265 @@
+/**
+  ******************************************************************************
+  * @file    sim_spi.c
+  * @brief   SPI1 slave of the IAP SPI link (spi_link.c) on a host descriptor.
+  ******************************************************************************
+  * The host plays the SPI master on "fd:N" (--spi), one transaction at a
+  * time: it writes the number of bytes to clock (2 bytes, little-endian) and
+  * the bytes on MOSI, then reads as many bytes of MISO back.
+  *
+  * Sim_SpiPoll, called from HAL_GetTick, takes a transaction only while
+  * READY (PB1) is high, as a host on the real bus waits for it; until then
+  * it stays in the descriptor and the host blocks on its answer. The
+  * transaction is what the hardware does behind the code: NSS (PA4) falls
+  * and the EXTI callback runs, the armed DMA channels move the bytes and
+  * count their CNDTR down, NSS rises. Clocking past the armed transfer sets
+  * OVR; MISO is then 0xFF.
+  *
+  * Only the IAP enables the SPI HAL; the APP build gets empty functions.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32g0xx_hal.h"
+#include "sim.h"
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAL_SPI_MODULE_ENABLED
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_SPI_READY_PORT      GPIOB
+#define SIM_SPI_READY_PIN       GPIO_PIN_1
+#define SIM_SPI_NSS_PORT        GPIOA
+#define SIM_SPI_NSS_PIN         GPIO_PIN_4
+#define SIM_SPI_MAX_TRANSFER    4096
+
+/* Private variables ---------------------------------------------------------*/
+static int SpiFd = -1;
+static SPI_HandleTypeDef *pSpiDma = NULL;
+
+/* Private functions ---------------------------------------------------------*/
+
+static void Sim_SpiReadAll(uint8_t *p_data, uint32_t size)
+{
+  ssize_t n;
+
+  while (size > 0)
+  {
+    n = read(SpiFd, p_data, size);
+    if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      Sim_Exit(SIM_EXIT_EOF, "spi host closed the line");
+    }
+    p_data += n;
+    size -= (uint32_t)n;
+  }
+}
+
+static void Sim_SpiWriteAll(const uint8_t *p_data, uint32_t size)
+{
+  ssize_t n;
+
+  while (size > 0)
+  {
+    n = write(SpiFd, p_data, size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      Sim_Exit(SIM_EXIT_EOF, "spi host closed the line");
+    }
+    p_data += n;
+    size -= (uint32_t)n;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Open the SPI line
+  * @param  spec: "fd:N", NULL for no host on the bus
+  * @retval None
+  */
+void Sim_SpiInit(const char *spec)
+{
+  /* NSS idle high */
+  SIM_SPI_NSS_PORT->IDR |= SIM_SPI_NSS_PIN;
+  if (spec == NULL)
+  {
+    return;
+  }
+  if (strncmp(spec, "fd:", 3) != 0)
+  {
+    fprintf(stderr, "sim: unknown spi '%s'\n", spec);
+    exit(SIM_EXIT_ERROR);
+  }
+  SpiFd = atoi(spec + 3);
+}
+
+/**
+  * @brief  Run one transaction of the host when READY is high
+  * @param  None
+  * @retval None
+  */
+void Sim_SpiPoll(void)
+{
+  static uint8_t mosi[SIM_SPI_MAX_TRANSFER];
+  static uint8_t miso[SIM_SPI_MAX_TRANSFER];
+  DMA_Channel_TypeDef *rx = NULL;
+  DMA_Channel_TypeDef *tx = NULL;
+  struct pollfd pfd;
+  uint8_t header[2];
+  uint32_t size, pos, i;
+
+  if ((SpiFd < 0) || ((SIM_SPI_READY_PORT->ODR & SIM_SPI_READY_PIN) == 0))
+  {
+    return;
+  }
+  pfd.fd = SpiFd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if ((poll(&pfd, 1, 0) <= 0) || (pfd.revents == 0))
+  {
+    /* Polled in a loop while waiting for the host: let it run */
+    sched_yield();
+    return;
+  }
+  Sim_SpiReadAll(header, sizeof(header));
+  size = header[0] | ((uint32_t)header[1] << 8);
+  if (size > SIM_SPI_MAX_TRANSFER)
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "spi transaction too long");
+  }
+  Sim_SpiReadAll(mosi, size);
+
+  SIM_SPI_NSS_PORT->IDR &= ~(uint32_t)SIM_SPI_NSS_PIN;
+  HAL_GPIO_EXTI_Falling_Callback(SIM_SPI_NSS_PIN);
+
+  memset(miso, 0xFF, size);
+  if ((pSpiDma != NULL) && (pSpiDma->Instance->CR1 & SPI_CR1_SPE))
+  {
+    rx = pSpiDma->hdmarx->Instance;
+    tx = pSpiDma->hdmatx->Instance;
+  }
+  for (i = 0; i < size; i++)
+  {
+    if ((rx == NULL) || ((rx->CCR & DMA_CCR_EN) == 0) || (rx->CNDTR == 0))
+    {
+      if (rx != NULL)
+      {
+        pSpiDma->Instance->SR |= SPI_SR_OVR;
+      }
+      break;
+    }
+    pos = pSpiDma->RxXferSize - rx->CNDTR;
+    pSpiDma->pRxBuffPtr[pos] = mosi[i];
+    rx->CNDTR--;
+    if ((tx->CCR & DMA_CCR_EN) && (tx->CNDTR > 0))
+    {
+      miso[i] = pSpiDma->pTxBuffPtr[pSpiDma->TxXferSize - tx->CNDTR];
+      tx->CNDTR--;
+    }
+  }
+  Sim_SpiWriteAll(miso, size);
+  SIM_SPI_NSS_PORT->IDR |= SIM_SPI_NSS_PIN;
+}
+
+#else
+
+void Sim_SpiInit(const char *spec)
+{
+  (void)spec;
+}
+
+void Sim_SpiPoll(void)
+{
+}
+
+#endif /* HAL_SPI_MODULE_ENABLED */
+
+#ifdef HAL_SPI_MODULE_ENABLED
+
+/* HAL_SPI -------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi)
+{
+  if (hspi == NULL)
+  {
+    return HAL_ERROR;
+  }
+  if (hspi->State == HAL_SPI_STATE_RESET)
+  {
+    hspi->Lock = HAL_UNLOCKED;
+    HAL_SPI_MspInit(hspi);
+  }
+  /* After an RCC reset: disabled, no flag */
+  hspi->Instance->CR1 = 0;
+  hspi->Instance->SR = 0;
+  hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+  hspi->State = HAL_SPI_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi)
+{
+  if (hspi == NULL)
+  {
+    return HAL_ERROR;
+  }
+  hspi->Instance->CR1 = 0;
+  HAL_SPI_MspDeInit(hspi);
+  hspi->State = HAL_SPI_STATE_RESET;
+  pSpiDma = NULL;
+  return HAL_OK;
+}
+
+__WEAK void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi)
+{
+  (void)hspi;
+}
+
+__WEAK void HAL_SPI_MspDeInit(SPI_HandleTypeDef *hspi)
+{
+  (void)hspi;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData,
+                                              uint16_t Size)
+{
+  if ((pTxData == NULL) || (pRxData == NULL) || (Size == 0U) || (hspi->hdmarx == NULL) || (hspi->hdmatx == NULL))
+  {
+    return HAL_ERROR;
+  }
+  if (hspi->State != HAL_SPI_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+  hspi->pTxBuffPtr = pTxData;
+  hspi->TxXferSize = Size;
+  hspi->pRxBuffPtr = pRxData;
+  hspi->RxXferSize = Size;
+  hspi->State = HAL_SPI_STATE_BUSY_TX_RX;
+  hspi->hdmarx->Instance->CNDTR = Size;
+  hspi->hdmarx->Instance->CCR |= DMA_CCR_EN;
+  hspi->hdmarx->State = HAL_DMA_STATE_BUSY;
+  hspi->hdmatx->Instance->CNDTR = Size;
+  hspi->hdmatx->Instance->CCR |= DMA_CCR_EN;
+  hspi->hdmatx->State = HAL_DMA_STATE_BUSY;
+  hspi->Instance->CR1 |= SPI_CR1_SPE;
+  pSpiDma = hspi;
+  return HAL_OK;
+}
+
+#endif /* HAL_SPI_MODULE_ENABLED */
@@ -0,0 +1,593 @@
+/**
+  ******************************************************************************
+  * @file    sim_uart.c
+  * @brief   Blocking HAL_UART_xxx on a host file descriptor.
+  ******************************************************************************
+  * Every UART instance is the same line, one of:
+  *   stdio   receive on stdin, transmit on stdout (raw mode on a terminal)
+  *   pty     a pseudo-terminal, its slave path is printed on stderr for a
+  *           host tool to open like a USB serial adapter
+  *   fd:N    an inherited descriptor, e.g. one end of a socketpair
+  *   model   a host model in the same process (Sim_UartModel), on the
+  *           virtual clock: every byte takes 10 bit times at the modelled
+  *           baud rate and the host answers after its turnaround latency
+  * On a descriptor, bytes move at host speed. HAL_UART_Receive keeps the HAL
+  * timeout semantics (total time for the call, HAL_MAX_DELAY waits forever).
+  * The run ends with SIM_EXIT_EOF when the peer goes away.
+  *
+  * USART2 is a second line, "fd:N" or nothing (--uart2), for the next board
+  * of an IAP chain (chain.c): HAL_UART_Transmit, bytes written straight to
+  * TDR and a circular HAL_UART_Receive_DMA. Sim_UartPoll, called from
+  * HAL_GetTick, does what the hardware does behind the code: sends what TDR
+  * holds and moves received bytes to the DMA buffer. Bytes to a next board
+  * that went away are lost, as on an unplugged cable.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32g0xx_hal.h"
+#include "sim.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* termios output delay flag, clashes with the USART CR1 register */
+#undef CR1
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_UART_QUEUE          8192    /* bytes in flight from the host model */
+#define SIM_UART_TDR_EMPTY      0xFFFFFFFFU   /* no byte written to TDR since the last poll */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t data[SIM_UART_QUEUE];
+  uint64_t arrival[SIM_UART_QUEUE];   /* end of the stop bit, ns */
+  uint32_t head;
+  uint32_t count;
+  uint64_t line_free;                 /* host to device line busy until, ns */
+  void (*peer)(uint8_t byte, uint64_t time_ns);
+} SIM_UartModelTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static int RxFd = -1;
+static int TxFd = -1;
+static int PtySlaveFd = -1;
+static int TermSaved = 0;
+static struct termios TermSave;
+static uint64_t BytesRx = 0;
+static uint64_t BytesTx = 0;
+static int ModelMode = 0;
+static SIM_UartModelTypeDef Model;
+static int Uart2Fd = -1;
+static UART_HandleTypeDef *pUart2Dma = NULL;
+
+/* Private functions ---------------------------------------------------------*/
+
+static void Sim_UartRestoreTerm(void)
+{
+  if (TermSaved)
+  {
+    tcsetattr(STDIN_FILENO, TCSANOW, &TermSave);
+  }
+}
+
+static void Sim_UartRaw(int fd)
+{
+  struct termios tio;
+
+  if (tcgetattr(fd, &tio) == 0)
+  {
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+}
+
+static void Sim_UartOpenPty(void)
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0))
+  {
+    perror("sim: pty");
+    exit(SIM_EXIT_ERROR);
+  }
+  /* Keep the slave open: the line stays up while the host tool reopens it */
+  PtySlaveFd = open(ptsname(fd), O_RDWR | O_NOCTTY);
+  if (PtySlaveFd < 0)
+  {
+    perror(ptsname(fd));
+    exit(SIM_EXIT_ERROR);
+  }
+  Sim_UartRaw(PtySlaveFd);
+  fprintf(stderr, "sim: uart on %s\n", ptsname(fd));
+  RxFd = fd;
+  TxFd = fd;
+}
+
+static HAL_StatusTypeDef Sim_UartModelTransmit(const uint8_t *pData, uint16_t Size)
+{
+  while (Size-- > 0)
+  {
+    Sim_Advance(SIM_PHASE_TRANSFER, Sim_UartByteTime());
+    BytesTx++;
+    if (Model.peer != NULL)
+    {
+      Model.peer(*pData, Sim_Nanos());
+    }
+    pData++;
+  }
+  return HAL_OK;
+}
+
+static HAL_StatusTypeDef Sim_UartModelReceive(uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  const SIM_TimingTypeDef *timing = Sim_Timing();
+  uint64_t now = Sim_Nanos();
+  uint64_t deadline = (Timeout == HAL_MAX_DELAY) ? UINT64_MAX : now + (uint64_t)Timeout * 1000000;
+  uint64_t arrival;
+  uint64_t start;
+
+  while (Size > 0)
+  {
+    if (Model.count == 0)
+    {
+      if (deadline == UINT64_MAX)
+      {
+        Sim_Exit(SIM_EXIT_EOF, "host model has nothing more to send");
+      }
+      Sim_Advance(SIM_PHASE_WAIT, deadline - now);
+      return HAL_TIMEOUT;
+    }
+    arrival = Model.arrival[Model.head];
+    if (arrival > deadline)
+    {
+      Sim_Advance(SIM_PHASE_WAIT, deadline - now);
+      return HAL_TIMEOUT;
+    }
+    if (arrival > now)
+    {
+      /* Idle line until the start bit, then the byte itself */
+      start = arrival - Sim_UartByteTime();
+      if (start > now)
+      {
+        Sim_Advance(SIM_PHASE_WAIT, start - now);
+        now = start;
+      }
+      Sim_Advance(SIM_PHASE_TRANSFER, arrival - now);
+    }
+    *pData++ = Model.data[Model.head];
+    Model.head = (Model.head + 1) % SIM_UART_QUEUE;
+    Model.count--;
+    Size--;
+    BytesRx++;
+    /* Every received byte goes through the packet CRC16 */
+    Sim_Advance(SIM_PHASE_CPU, (uint64_t)timing->crc16_cycles * 1000000000 / timing->sysclk_hz);
+    now = Sim_Nanos();
+  }
+  return HAL_OK;
+}
+
+static void Sim_Uart2Write(const uint8_t *pData, uint16_t Size)
+{
+  ssize_t n;
+
+  while ((Size > 0) && (Uart2Fd >= 0))
+  {
+    n = write(Uart2Fd, pData, Size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      Uart2Fd = -1;
+      break;
+    }
+    pData += n;
+    Size -= (uint16_t)n;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Open the line
+  * @param  spec: "stdio", "pty" or "fd:N"
+  * @retval None
+  */
+void Sim_UartInit(const char *spec)
+{
+  if (strcmp(spec, "stdio") == 0)
+  {
+    RxFd = STDIN_FILENO;
+    TxFd = STDOUT_FILENO;
+    if (isatty(RxFd) && (tcgetattr(RxFd, &TermSave) == 0))
+    {
+      TermSaved = 1;
+      atexit(Sim_UartRestoreTerm);
+      Sim_UartRaw(RxFd);
+    }
+  }
+  else if (strcmp(spec, "pty") == 0)
+  {
+    Sim_UartOpenPty();
+  }
+  else if (strncmp(spec, "fd:", 3) == 0)
+  {
+    RxFd = atoi(spec + 3);
+    TxFd = RxFd;
+  }
+  else if ((strcmp(spec, "model") == 0) && (Sim_Timing() != NULL))
+  {
+    ModelMode = 1;
+  }
+  else
+  {
+    fprintf(stderr, "sim: unknown uart '%s'\n", spec);
+    exit(SIM_EXIT_ERROR);
+  }
+}
+
+/**
+  * @brief  Open the USART2 line
+  * @param  spec: "fd:N", NULL for nothing connected
+  * @retval None
+  */
+void Sim_Uart2Init(const char *spec)
+{
+  USART2->TDR = SIM_UART_TDR_EMPTY;
+  if (spec == NULL)
+  {
+    return;
+  }
+  if (strncmp(spec, "fd:", 3) != 0)
+  {
+    fprintf(stderr, "sim: unknown uart2 '%s'\n", spec);
+    exit(SIM_EXIT_ERROR);
+  }
+  Uart2Fd = atoi(spec + 3);
+  /* The next board may leave first, a write then fails with EPIPE */
+  signal(SIGPIPE, SIG_IGN);
+}
+
+/**
+  * @brief  Move the USART2 data the hardware moves without the code: the
+  *         byte written to TDR is sent, received bytes go to the DMA buffer
+  * @param  None
+  * @retval None
+  */
+void Sim_UartPoll(void)
+{
+  DMA_Channel_TypeDef *channel;
+  struct pollfd pfd;
+  uint8_t byte;
+  uint32_t pos;
+  ssize_t n;
+
+  if (USART2->TDR != SIM_UART_TDR_EMPTY)
+  {
+    byte = (uint8_t)USART2->TDR;
+    USART2->TDR = SIM_UART_TDR_EMPTY;
+    Sim_Uart2Write(&byte, 1);
+  }
+  if ((Uart2Fd < 0) || (pUart2Dma == NULL))
+  {
+    return;
+  }
+  channel = pUart2Dma->hdmarx->Instance;
+  if ((channel->CCR & DMA_CCR_EN) == 0)
+  {
+    return;
+  }
+
+  pfd.fd = Uart2Fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if ((poll(&pfd, 1, 0) <= 0) || (pfd.revents == 0))
+  {
+    /* Polled in a loop while waiting for the next board: let it run */
+    sched_yield();
+    return;
+  }
+  /* Up to the end of the buffer, the rest on the next poll */
+  pos = pUart2Dma->RxXferSize - channel->CNDTR;
+  n = read(Uart2Fd, pUart2Dma->pRxBuffPtr + pos, channel->CNDTR);
+  if (n <= 0)
+  {
+    if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+    {
+      return;
+    }
+    /* Next board gone, the line stays idle */
+    Uart2Fd = -1;
+    return;
+  }
+  channel->CNDTR -= (uint32_t)n;
+  if (channel->CNDTR == 0)
+  {
+    channel->CNDTR = pUart2Dma->RxXferSize;
+  }
+}
+
+/**
+  * @brief  Connect the host model of the "model" UART
+  * @param  peer: called with every byte the device sends and the time its
+  *         stop bit ends; answers with Sim_UartHostSend()
+  * @retval None
+  */
+void Sim_UartModel(void (*peer)(uint8_t byte, uint64_t time_ns))
+{
+  memset(&Model, 0, sizeof(Model));
+  Model.peer = peer;
+}
+
+/**
+  * @brief  Host model sends bytes to the device
+  * @param  p_data: bytes, copied
+  * @param  size: number of bytes
+  * @param  ready_ns: time the host has the data ready, the turnaround
+  *         latency of the timing model is added
+  * @retval None
+  */
+void Sim_UartHostSend(const uint8_t *p_data, uint32_t size, uint64_t ready_ns)
+{
+  uint64_t t = ready_ns + (uint64_t)Sim_Timing()->host_latency_us * 1000;
+  uint32_t tail;
+
+  if (t < Model.line_free)
+  {
+    t = Model.line_free;
+  }
+  while ((size-- > 0) && (Model.count < SIM_UART_QUEUE))
+  {
+    t += Sim_UartByteTime();
+    tail = (Model.head + Model.count) % SIM_UART_QUEUE;
+    Model.data[tail] = *p_data++;
+    Model.arrival[tail] = t;
+    Model.count++;
+  }
+  Model.line_free = t;
+}
+
+/**
+  * @brief  Keep the host to device line busy without delivering anything:
+  *         an idle gap, or the time of bytes lost on the line
+  * @param  ns: duration, from the end of what was sent last
+  * @retval None
+  */
+void Sim_UartHostIdle(uint64_t ns)
+{
+  Model.line_free += ns;
+}
+
+/**
+  * @brief  Time of one byte on the line at the modelled baud rate
+  * @param  None
+  * @retval Nanoseconds, 0 on the host clock
+  */
+uint64_t Sim_UartByteTime(void)
+{
+  const SIM_TimingTypeDef *timing = Sim_Timing();
+
+  return (timing != NULL) ? 10ULL * 1000000000 / timing->baud : 0;
+}
+
+/**
+  * @brief  Bytes received since the start of the run
+  * @param  None
+  * @retval Bytes
+  */
+uint64_t Sim_UartBytesRx(void)
+{
+  return BytesRx;
+}
+
+/**
+  * @brief  Bytes transmitted since the start of the run
+  * @param  None
+  * @retval Bytes
+  */
+uint64_t Sim_UartBytesTx(void)
+{
+  return BytesTx;
+}
+
+/* HAL_UART ------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+  if (huart == NULL)
+  {
+    return HAL_ERROR;
+  }
+  if (huart->gState == HAL_UART_STATE_RESET)
+  {
+    huart->Lock = HAL_UNLOCKED;
+    HAL_UART_MspInit(huart);
+  }
+  huart->ErrorCode = HAL_UART_ERROR_NONE;
+  huart->gState = HAL_UART_STATE_READY;
+  huart->RxState = HAL_UART_STATE_READY;
+  huart->Instance->CR1 |= USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+  huart->Instance->ISR |= USART_ISR_TXE_TXFNF | USART_ISR_TC;
+  return HAL_OK;
+}
+
+/* The DE pin has no effect on a point to point link */
+HAL_StatusTypeDef HAL_RS485Ex_Init(UART_HandleTypeDef *huart, uint32_t Polarity, uint32_t AssertionTime,
+                                   uint32_t DeassertionTime)
+{
+  (void)Polarity;
+  (void)AssertionTime;
+  (void)DeassertionTime;
+  return HAL_UART_Init(huart);
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart)
+{
+  if (huart == NULL)
+  {
+    return HAL_ERROR;
+  }
+  huart->Instance->CR1 = 0;
+  HAL_UART_MspDeInit(huart);
+  huart->gState = HAL_UART_STATE_RESET;
+  huart->RxState = HAL_UART_STATE_RESET;
+  return HAL_OK;
+}
+
+__WEAK void HAL_UART_MspInit(UART_HandleTypeDef *huart)
+{
+  (void)huart;
+}
+
+__WEAK void HAL_UART_MspDeInit(UART_HandleTypeDef *huart)
+{
+  (void)huart;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  ssize_t n;
+
+  (void)Timeout;
+  if ((pData == NULL) || (Size == 0U))
+  {
+    return HAL_ERROR;
+  }
+  if (huart->gState != HAL_UART_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+  if (huart->Instance == USART2)
+  {
+    /* After what is still in TDR */
+    Sim_UartPoll();
+    Sim_Uart2Write(pData, Size);
+    return HAL_OK;
+  }
+  if (ModelMode)
+  {
+    return Sim_UartModelTransmit(pData, Size);
+  }
+  while (Size > 0)
+  {
+    n = write(TxFd, pData, Size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      Sim_Exit(SIM_EXIT_EOF, "uart closed");
+    }
+    pData += n;
+    Size -= (uint16_t)n;
+    BytesTx += (uint64_t)n;
+  }
+  huart->Instance->ISR |= USART_ISR_TC;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  struct pollfd pfd;
+  int wait_ms;
+  ssize_t n;
+
+  if ((pData == NULL) || (Size == 0U))
+  {
+    return HAL_ERROR;
+  }
+  if (huart->RxState != HAL_UART_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+  if (huart->Instance == USART2)
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "USART2 only receives with DMA");
+  }
+  if (ModelMode)
+  {
+    return Sim_UartModelReceive(pData, Size, Timeout);
+  }
+  while (Size > 0)
+  {
+    if (Timeout == HAL_MAX_DELAY)
+    {
+      wait_ms = -1;
+    }
+    else
+    {
+      uint32_t elapsed = HAL_GetTick() - tickstart;
+
+      if (elapsed >= Timeout)
+      {
+        return HAL_TIMEOUT;
+      }
+      wait_ms = (int)(Timeout - elapsed);
+    }
+
+    pfd.fd = RxFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, wait_ms) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      Sim_Exit(SIM_EXIT_ERROR, "uart poll failed");
+    }
+    if (pfd.revents == 0)
+    {
+      continue;
+    }
+
+    n = read(RxFd, pData, Size);
+    if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      Sim_Exit(SIM_EXIT_EOF, "uart peer closed the line");
+    }
+    pData += n;
+    Size -= (uint16_t)n;
+    BytesRx += (uint64_t)n;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+  if ((pData == NULL) || (Size == 0U) || (huart->hdmarx == NULL))
+  {
+    return HAL_ERROR;
+  }
+  if (huart->Instance != USART2)
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "only USART2 receives with DMA");
+  }
+  if (huart->RxState != HAL_UART_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+  huart->pRxBuffPtr = pData;
+  huart->RxXferSize = Size;
+  huart->RxState = HAL_UART_STATE_BUSY_RX;
+  huart->hdmarx->Instance->CNDTR = Size;
+  huart->hdmarx->Instance->CCR |= DMA_CCR_EN;
+  pUart2Dma = huart;
+  return HAL_OK;
+}
@@ -0,0 +1,580 @@
+/**
+  ******************************************************************************
+  * @file    ymodem_bench.c
+  * @brief   Update throughput benchmark: Ymodem_Receive of the IAP against the
+  *          host model (host_ymodem.c) on the virtual clock.
+  ******************************************************************************
+  * Every case (baud rate, block size, image size, host latency) runs in its
+  * own child process on an erased in-memory flash, so the cases do not see
+  * each other. The session lasts from the call of Ymodem_Receive to its
+  * return, as seen by the user after selecting the download in the menu,
+  * including the IAP timeouts before the first 'C' and before the end of
+  * session 'C'.
+  *
+  *   ymodem_bench [--baud 115200,921600] [--block 128,1024] [--size 8192]
+  *                [--latency 0,1000] [--json] [--compare baseline.json]
+  *                [--encrypt] [--aes-cycles 115] [--spi]
+  *                [--file update.dlt --image new.bin --base old.bin]
+  *
+  * --encrypt sends every image AES-CTR encrypted (aes.h) with the key of
+  * common.h; compared with the plain baseline it shows what the decryption,
+  * at --aes-cycles per byte, costs the session. Built as ymodem_bench_sha
+  * (IAP_SHA256_ENABLED) the IAP also hashes the image it programs, at
+  * --sha-cycles per byte; compared with the ymodem_bench baseline it shows
+  * what the hash costs the session.
+  * --spi times the SPI link (spi_link.h) in place of the UART: the --baud
+  * list is then the SCK frequency (16000000 by default), 8 bits per byte
+  * with no start and stop bits, that is the UART model at SCK * 10 / 8 baud.
+  * The READY handshake and the empty frames the host clocks to read the
+  * answer are not modelled one by one; --latency stands for them.
+  * --file sends a prepared file (raw, LZSS, DLT1 patch) in place of the
+  * generated image, --image is the image flash must hold afterwards (the
+  * file itself by default) and --base the one installed before the session,
+  * which a patch applies to. The size list is then the size of --image;
+  * line_bytes against session and phase times show what the format saves on
+  * the wire and what applying it costs.
+  * The virtual clock makes the results exact: --compare fails when a case of
+  * the baseline got slower by more than --tolerance percent.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "host_ymodem.h"
+#include "flash.h"
+#include "image.h"
+#include "aes.h"
+#include "usart.h"
+#include "ymodem.h"
+#include <getopt.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_LIST_MAX          8
+#define BENCH_CASES_MAX         (BENCH_LIST_MAX * BENCH_LIST_MAX * BENCH_LIST_MAX * BENCH_LIST_MAX)
+#define BENCH_NS_PER_MS         1000000.0
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t value[BENCH_LIST_MAX];
+  uint32_t count;
+} BENCH_ListTypeDef;
+
+typedef struct
+{
+  uint32_t baud;
+  uint32_t block;
+  uint32_t size;
+  uint32_t latency_us;
+} BENCH_CaseTypeDef;
+
+typedef struct
+{
+  int result;               /* COM_StatusTypeDef, -1 if flash does not match */
+  uint64_t session_ns;
+  uint64_t transfer_ns;     /* first 'C' to last ACK */
+  uint64_t line_bytes;      /* received by the IAP */
+  uint64_t phase_ns[SIM_PHASE_COUNT];
+  uint32_t retransmits;
+  uint32_t errors;          /* Ymodem_GetErrors */
+  uint32_t erases;
+  uint32_t programs;
+} BENCH_ResultTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *aPhaseName[SIM_PHASE_COUNT] =
+{
+  "wait", "transfer", "erase", "program", "verify", "cpu", "other"
+};
+
+static SIM_TimingTypeDef Timing = SIM_TIMING_DEFAULT;
+static int Encrypt = 0;
+static int Spi = 0;
+static uint8_t *pFileData = NULL;     /* --file */
+static uint32_t FileSize = 0;
+static uint8_t *pImageData = NULL;    /* --image */
+static uint32_t ImageSize = 0;
+static uint8_t *pBaseData = NULL;     /* --base */
+static uint32_t BaseSize = 0;
+static const uint8_t aBenchKey[AES_KEY_SIZE] = IAP_AES_KEY;
+static BENCH_CaseTypeDef aCase[BENCH_CASES_MAX];
+static BENCH_ResultTypeDef aResult[BENCH_CASES_MAX];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Read a whole file for --file, --image or --base
+  * @param  path: file
+  * @param  p_size: its size
+  * @retval Contents, exits if the file cannot be read or is too large
+  */
+static uint8_t *Bench_Load(const char *path, uint32_t *p_size)
+{
+  uint8_t *p_data = malloc(APPLICATION_MAX_SIZE + AES_IMAGE_HEADER_SIZE + 1);
+  size_t n;
+  FILE *f;
+
+  f = fopen(path, "rb");
+  if ((f == NULL) || (p_data == NULL))
+  {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    exit(SIM_EXIT_ERROR);
+  }
+  n = fread(p_data, 1, APPLICATION_MAX_SIZE + AES_IMAGE_HEADER_SIZE + 1, f);
+  fclose(f);
+  if ((n == 0) || (n > APPLICATION_MAX_SIZE + AES_IMAGE_HEADER_SIZE))
+  {
+    fprintf(stderr, "%s: empty or larger than the application area\n", path);
+    exit(SIM_EXIT_ERROR);
+  }
+  *p_size = (uint32_t)n;
+  return p_data;
+}
+
+/**
+  * @brief  One case, in a child process (Sim_Fork)
+  * @param  p_context: BENCH_ResultTypeDef of the case in aResult
+  * @retval None
+  */
+static void Bench_RunCase(void *p_context)
+{
+  BENCH_ResultTypeDef *p_result = p_context;
+  const BENCH_CaseTypeDef *bench = &aCase[p_result - aResult];
+  SIM_ConfigTypeDef config = {NULL, NULL, "model", 1};
+  const HOST_YmodemStatsTypeDef *stats;
+  uint64_t start_ns, phase_ns[SIM_PHASE_COUNT];
+  AES_CtrTypeDef cipher;
+  FLASH_StreamTypeDef stream;
+  uint8_t *p_image;
+  uint8_t *p_file;
+  uint32_t file_size = (pFileData != NULL) ? FileSize : bench->size;
+  uint32_t size = 0, erases, programs;
+  int i;
+
+  p_image = malloc(bench->size);
+  p_file = malloc(file_size + AES_IMAGE_HEADER_SIZE);
+  if ((p_image == NULL) || (p_file == NULL))
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "out of memory");
+  }
+  if (pFileData != NULL)
+  {
+    memcpy(p_image, pImageData, bench->size);
+    memcpy(p_file, pFileData, file_size);
+  }
+  else
+  {
+    Host_YmodemImage(p_image, bench->size, 0x12345678 ^ bench->size);
+    memcpy(p_file, p_image, bench->size);
+  }
+  if (Encrypt)
+  {
+    /* Before the virtual clock starts, so that it costs no simulated time */
+    memcpy(p_file, "AES1", 4);
+    for (i = 4; i < (int)AES_IMAGE_HEADER_SIZE; i++)
+    {
+      p_file[i] = (uint8_t)(bench->size >> (i & 3)) ^ (uint8_t)i;
+    }
+    memmove(&p_file[AES_IMAGE_HEADER_SIZE], (pFileData != NULL) ? pFileData : p_image, file_size);
+    AES_CTR_Init(&cipher, aBenchKey, p_file);
+    AES_CTR_Crypt(&cipher, &p_file[AES_IMAGE_HEADER_SIZE], file_size);
+    file_size += AES_IMAGE_HEADER_SIZE;
+  }
+
+  Timing.baud = Spi ? bench->baud / 8 * 10 : bench->baud;
+  Timing.host_latency_us = bench->latency_us;
+  Sim_ClockVirtual(&Timing);
+  Sim_Init(&config);
+  MX_USART1_UART_Init();
+  FLASH_Init();
+  if (pBaseData != NULL)
+  {
+    /* Installed by an earlier session, not part of this one */
+    FLASH_Stream_Init(&stream, APPLICATION_ADDRESS, APPLICATION_ADDRESS + APPLICATION_MAX_SIZE);
+    if ((FLASH_Stream_Write(&stream, pBaseData, BaseSize) != FLASHIF_OK)
+        || (FLASH_Stream_Flush(&stream) != FLASHIF_OK))
+    {
+      Sim_Exit(SIM_EXIT_ERROR, "cannot install the base image");
+    }
+  }
+  Host_YmodemStart(p_file, file_size, bench->block);
+  erases = Sim_FlashErases();
+  programs = Sim_FlashPrograms();
+
+  start_ns = Sim_Nanos();
+  for (i = 0; i < SIM_PHASE_COUNT; i++)
+  {
+    phase_ns[i] = Sim_PhaseTime((SIM_PhaseTypeDef)i);
+  }
+
+  p_result->result = Ymodem_Receive(&size);
+
+  p_result->session_ns = Sim_Nanos() - start_ns;
+  for (i = 0; i < SIM_PHASE_COUNT; i++)
+  {
+    p_result->phase_ns[i] = Sim_PhaseTime((SIM_PhaseTypeDef)i) - phase_ns[i];
+  }
+  stats = Host_YmodemStats();
+  p_result->transfer_ns = stats->end_ns - stats->start_ns;
+  p_result->retransmits = stats->retransmits;
+  p_result->line_bytes = Sim_UartBytesRx();
+  p_result->errors = Ymodem_GetErrors();
+  p_result->erases = Sim_FlashErases() - erases;
+  p_result->programs = Sim_FlashPrograms() - programs;
+  if ((p_result->result == COM_OK)
+      && ((stats->state != HOST_YMODEM_DONE) || (size != file_size)
+          || (memcmp((const void *)APPLICATION_ADDRESS, p_image, bench->size) != 0)))
+  {
+    p_result->result = -1;
+  }
+  free(p_file);
+  free(p_image);
+}
+
+static double Bench_Ms(uint64_t ns)
+{
+  return (double)ns / BENCH_NS_PER_MS;
+}
+
+static uint32_t Bench_PerSecond(uint64_t bytes, uint64_t ns)
+{
+  return (ns != 0) ? (uint32_t)(bytes * 1000000000ULL / ns) : 0;
+}
+
+/**
+  * @brief  One result as a single line JSON object, read back by Bench_Compare
+  */
+static void Bench_PrintJson(const BENCH_CaseTypeDef *bench, const BENCH_ResultTypeDef *result, int last)
+{
+  int i;
+
+  printf("  {\"baud\": %u, \"block\": %u, \"size\": %u, \"latency_us\": %u, \"session_ms\": %.3f, ",
+         bench->baud, bench->block, bench->size, bench->latency_us, Bench_Ms(result->session_ns));
+  printf("\"transfer_ms\": %.3f, \"bytes_per_second\": %u, \"goodput\": %u, ",
+         Bench_Ms(result->transfer_ns), Bench_PerSecond(result->line_bytes, result->session_ns),
+         Bench_PerSecond(bench->size, result->session_ns));
+  printf("\"line_bytes\": %llu, \"retransmits\": %u, \"errors\": %u, \"erases\": %u, \"programs\": %u, \"phases_ms\": {",
+         (unsigned long long)result->line_bytes, result->retransmits, result->errors, result->erases, result->programs);
+  for (i = 0; i < SIM_PHASE_COUNT; i++)
+  {
+    printf("%s\"%s\": %.3f", (i == 0) ? "" : ", ", aPhaseName[i], Bench_Ms(result->phase_ns[i]));
+  }
+  printf("}, \"result\": %d%s}%s\n", result->result, Spi ? ", \"link\": \"spi\"" : "", last ? "" : ",");
+}
+
+static void Bench_PrintText(const BENCH_CaseTypeDef *bench, const BENCH_ResultTypeDef *result)
+{
+  int i;
+
+  printf("%7u %5u %6u %6u %10.1f %8u %8u %4u ", bench->baud, bench->block, bench->size, bench->latency_us,
+         Bench_Ms(result->session_ns), Bench_PerSecond(result->line_bytes, result->session_ns),
+         Bench_PerSecond(bench->size, result->session_ns), result->retransmits);
+  for (i = 0; i < SIM_PHASE_COUNT; i++)
+  {
+    printf(" %8.1f", Bench_Ms(result->phase_ns[i]));
+  }
+  printf("  %s\n", (result->result == COM_OK) ? "ok" : "FAIL");
+}
+
+/**
+  * @brief  Check the results against a baseline written with --json
+  * @param  path: baseline file
+  * @param  count: number of cases run
+  * @param  tolerance: allowed slowdown, percent
+  * @retval Number of regressions, -1 if the baseline cannot be read
+  */
+static int Bench_Compare(const char *path, uint32_t count, double tolerance)
+{
+  BENCH_CaseTypeDef bench;
+  char line[1024];
+  double session_ms, now_ms;
+  int regressions = 0;
+  uint32_t i;
+  FILE *f;
+
+  f = fopen(path, "r");
+  if (f == NULL)
+  {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    if (sscanf(line, " {\"baud\": %u, \"block\": %u, \"size\": %u, \"latency_us\": %u, \"session_ms\": %lf",
+               &bench.baud, &bench.block, &bench.size, &bench.latency_us, &session_ms) != 5)
+    {
+      continue;
+    }
+    for (i = 0; i < count; i++)
+    {
+      if ((aCase[i].baud == bench.baud) && (aCase[i].block == bench.block)
+          && (aCase[i].size == bench.size) && (aCase[i].latency_us == bench.latency_us))
+      {
+        break;
+      }
+    }
+    if (i == count)
+    {
+      continue;
+    }
+    now_ms = Bench_Ms(aResult[i].session_ns);
+    /* The baseline holds the time rounded to the microsecond */
+    if ((aResult[i].result != COM_OK) || (now_ms > session_ms * (1.0 + tolerance / 100.0) + 0.0005))
+    {
+      fprintf(stderr, "regression: baud %u block %u size %u latency %u us: %.3f ms, baseline %.3f ms%s\n",
+              bench.baud, bench.block, bench.size, bench.latency_us, now_ms, session_ms,
+              (aResult[i].result != COM_OK) ? ", transfer failed" : "");
+      regressions++;
+    }
+  }
+  fclose(f);
+  return regressions;
+}
+
+static int Bench_ParseList(BENCH_ListTypeDef *list, const char *arg)
+{
+  char *end;
+
+  list->count = 0;
+  do
+  {
+    if (list->count == BENCH_LIST_MAX)
+    {
+      return -1;
+    }
+    list->value[list->count++] = (uint32_t)strtoul(arg, &end, 0);
+    if ((end == arg) || ((*end != ',') && (*end != '\0')))
+    {
+      return -1;
+    }
+    arg = end + 1;
+  } while (*end == ',');
+  return 0;
+}
+
+static void Bench_Usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --baud LIST        baud rates (115200,460800,921600)\n"
+          "  --block LIST       Ymodem block sizes, 128 or 1024 (128,1024)\n"
+          "  --size LIST        image sizes in bytes (8192,32768)\n"
+          "  --latency LIST     host turnaround in us (0,1000,16000)\n"
+          "  --page-erase US    page erase time (%u)\n"
+          "  --dword-program US double word program time (%u)\n"
+          "  --encrypt          send the images AES-CTR encrypted\n"
+          "  --aes-cycles N     decryption cost per byte at 64 MHz (%u)\n"
+          "  --spi              SPI link, --baud is the SCK (16000000)\n"
+          "  --file FILE        send this file (raw, LZSS, patch) instead\n"
+          "  --image FILE       image expected in flash after --file (FILE)\n"
+          "  --base FILE        image installed before the session\n"
+#ifdef IAP_SHA256_ENABLED
+          "  --sha-cycles N     SHA-256 cost per byte at 64 MHz (%u)\n"
+#endif /* IAP_SHA256_ENABLED */
+          "  --json             print the results as JSON\n"
+          "  --compare FILE     fail on slowdowns against a --json baseline\n"
+          "  --tolerance PCT    allowed slowdown for --compare (1)\n",
+          name, Timing.page_erase_us, Timing.dword_program_us, Timing.aes_cycles
+#ifdef IAP_SHA256_ENABLED
+          , Timing.sha_cycles
+#endif /* IAP_SHA256_ENABLED */
+          );
+  exit(SIM_EXIT_ERROR);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  static const struct option options[] =
+  {
+    {"baud", required_argument, NULL, 'b'},
+    {"block", required_argument, NULL, 'k'},
+    {"size", required_argument, NULL, 's'},
+    {"latency", required_argument, NULL, 'l'},
+    {"page-erase", required_argument, NULL, 'e'},
+    {"dword-program", required_argument, NULL, 'p'},
+    {"encrypt", no_argument, NULL, 'x'},
+    {"aes-cycles", required_argument, NULL, 'a'},
+    {"spi", no_argument, NULL, 'i'},
+    {"file", required_argument, NULL, 'f'},
+    {"image", required_argument, NULL, 'g'},
+    {"base", required_argument, NULL, 'o'},
+#ifdef IAP_SHA256_ENABLED
+    {"sha-cycles", required_argument, NULL, 'h'},
+#endif /* IAP_SHA256_ENABLED */
+    {"json", no_argument, NULL, 'j'},
+    {"compare", required_argument, NULL, 'c'},
+    {"tolerance", required_argument, NULL, 't'},
+    {NULL, 0, NULL, 0}
+  };
+  BENCH_ListTypeDef baud = {{115200, 460800, 921600}, 3};
+  BENCH_ListTypeDef block = {{128, 1024}, 2};
+  BENCH_ListTypeDef size = {{8192, 32768}, 2};
+  BENCH_ListTypeDef latency = {{0, 1000, 16000}, 3};
+  const char *compare = NULL;
+  double tolerance = 1.0;
+  uint32_t count = 0, a, b, c, d;
+  int json = 0, opt, failed = 0, regressions, baud_set = 0;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 'b':
+        if (Bench_ParseList(&baud, optarg) != 0)
+        {
+          Bench_Usage(argv[0]);
+        }
+        baud_set = 1;
+        break;
+      case 'k':
+        if (Bench_ParseList(&block, optarg) != 0)
+        {
+          Bench_Usage(argv[0]);
+        }
+        break;
+      case 's':
+        if (Bench_ParseList(&size, optarg) != 0)
+        {
+          Bench_Usage(argv[0]);
+        }
+        break;
+      case 'l':
+        if (Bench_ParseList(&latency, optarg) != 0)
+        {
+          Bench_Usage(argv[0]);
+        }
+        break;
+      case 'e':
+        Timing.page_erase_us = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'p':
+        Timing.dword_program_us = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'x':
+        Encrypt = 1;
+        break;
+      case 'a':
+        Timing.aes_cycles = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        Spi = 1;
+        break;
+      case 'f':
+        pFileData = Bench_Load(optarg, &FileSize);
+        break;
+      case 'g':
+        pImageData = Bench_Load(optarg, &ImageSize);
+        break;
+      case 'o':
+        pBaseData = Bench_Load(optarg, &BaseSize);
+        break;
+#ifdef IAP_SHA256_ENABLED
+      case 'h':
+        Timing.sha_cycles = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+#endif /* IAP_SHA256_ENABLED */
+      case 'j':
+        json = 1;
+        break;
+      case 'c':
+        compare = optarg;
+        break;
+      case 't':
+        tolerance = strtod(optarg, NULL);
+        break;
+      default:
+        Bench_Usage(argv[0]);
+        break;
+    }
+  }
+  if (optind != argc)
+  {
+    Bench_Usage(argv[0]);
+  }
+  if (Spi && !baud_set)
+  {
+    baud.value[0] = 16000000;
+    baud.count = 1;
+  }
+  if (((pImageData != NULL) || (pBaseData != NULL)) && (pFileData == NULL))
+  {
+    Bench_Usage(argv[0]);
+  }
+  if (pFileData != NULL)
+  {
+    if (pImageData == NULL)
+    {
+      pImageData = pFileData;
+      ImageSize = FileSize;
+    }
+    size.value[0] = ImageSize;
+    size.count = 1;
+  }
+
+  for (a = 0; a < baud.count; a++)
+  {
+    for (b = 0; b < block.count; b++)
+    {
+      for (c = 0; c < size.count; c++)
+      {
+        for (d = 0; d < latency.count; d++)
+        {
+          if ((size.value[c] <= IMAGE_HEADER_END + IMAGE_TRAILER_SIZE)
+              || (size.value[c] > APPLICATION_MAX_SIZE))
+          {
+            fprintf(stderr, "image size %u out of range\n", size.value[c]);
+            return SIM_EXIT_ERROR;
+          }
+          aCase[count].baud = baud.value[a];
+          aCase[count].block = block.value[b];
+          aCase[count].size = size.value[c];
+          aCase[count].latency_us = latency.value[d];
+          count++;
+        }
+      }
+    }
+  }
+
+  if (json)
+  {
+    printf("[\n");
+  }
+  else
+  {
+    printf("%s block   size lat_us session_ms     B/s  goodput  rtx     wait transfer    erase  program   verify      cpu    other\n", Spi ? "    sck" : "   baud");
+  }
+  for (a = 0; a < count; a++)
+  {
+    if (Sim_Fork(Bench_RunCase, &aResult[a], sizeof(aResult[a])) != 0)
+    {
+      memset(&aResult[a], 0, sizeof(aResult[a]));
+      aResult[a].result = -1;
+    }
+    failed |= (aResult[a].result != COM_OK);
+    if (json)
+    {
+      Bench_PrintJson(&aCase[a], &aResult[a], a + 1 == count);
+    }
+    else
+    {
+      Bench_PrintText(&aCase[a], &aResult[a]);
+    }
+  }
+  if (json)
+  {
+    printf("]\n");
+  }
+
+  if (compare != NULL)
+  {
+    regressions = Bench_Compare(compare, count, tolerance);
+    failed |= (regressions != 0);
+  }
+  return failed ? SIM_EXIT_ERROR : SIM_EXIT_OK;
+}
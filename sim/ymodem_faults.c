@@ -0,0 +1,434 @@
+/**
+  ******************************************************************************
+  * @file    ymodem_faults.c
+  * @brief   Update under line errors and power loss: Ymodem_Receive of the IAP
+  *          against the host model through the fault injector (line_fault.c),
+  *          on the virtual clock.
+  ******************************************************************************
+  * The device starts with a valid application (the "old" image) and receives
+  * a new one. Each fault profile runs a few times with different seeds, each
+  * run in its own child process. A run reports the session time, goodput,
+  * retransmissions, the time to recover from the line faults, and what the
+  * next boot would find: the new image, the old one, or none (the IAP stays
+  * in the bootloader). When the new image is not there, the run downloads it
+  * again on a clean line, as the operator would, to check that the device
+  * can still be updated.
+  *
+  * The power cut profiles interrupt a flash operation (page erase or
+  * program) at a share of the operations of a clean transfer.
+  *
+  *   ymodem_faults [--profile noisy,power-50] [--runs 5] [--seed 1]
+  *                 [--baud 921600] [--block 1024] [--size 32768] [--json]
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "host_ymodem.h"
+#include "line_fault.h"
+#include "flash.h"
+#include "image.h"
+#include "usart.h"
+#include "ymodem.h"
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define FAULTS_RUNS_MAX         64
+#define FAULTS_LIMIT_S          600     /* virtual time a session may last */
+#define FAULTS_NS_PER_MS        1000000.0
+
+/* Outcome of the session */
+#define FAULTS_DONE             0       /* Ymodem_Receive returned */
+#define FAULTS_POWER_CUT        1
+#define FAULTS_HANG             2       /* still running at the time limit */
+
+/* What the next boot finds */
+#define FAULTS_BOOT_NEW         0
+#define FAULTS_BOOT_OLD         1
+#define FAULTS_BOOT_IAP         2       /* no valid image, stays in the bootloader */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  int outcome;
+  int result;               /* COM_StatusTypeDef when FAULTS_DONE */
+  int boot;
+  int recovered;            /* second download on a clean line went through */
+  uint64_t session_ns;
+  uint64_t recovery_ns;     /* that second download */
+  uint32_t retransmits;
+  uint32_t errors;          /* Ymodem_GetErrors */
+  uint32_t flash_ops;       /* erases and programs of the session */
+  FAULT_StatsTypeDef faults;
+} FAULTS_RunTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const FAULT_ProfileTypeDef aProfile[] =
+{
+  /* name              drop  flip   dup   gap  gap_us   ack  power */
+  {"clean",               0,    0,    0,    0,       0,    0,   0},
+  {"drop-100ppm",       100,    0,    0,    0,       0,    0,   0},
+  {"drop-1000ppm",     1000,    0,    0,    0,       0,    0,   0},
+  {"flip-100ppm",         0,  100,    0,    0,       0,    0,   0},
+  {"flip-1000ppm",        0, 1000,    0,    0,       0,    0,   0},
+  {"dup-100ppm",          0,    0,  100,    0,       0,    0,   0},
+  {"gap-5ms",             0,    0,    0, 1000,    5000,    0,   0},
+  {"stall-1500ms",        0,    0,    0,   20, 1500000,    0,   0},
+  {"ack-loss-1pct",       0,    0,    0,    0,       0, 10000,  0},
+  {"noisy",             100,  100,   50,  200,    5000, 1000,   0},
+  {"power-first",         0,    0,    0,    0,       0,    0,   1},
+  {"power-25",            0,    0,    0,    0,       0,    0,  25},
+  {"power-50",            0,    0,    0,    0,       0,    0,  50},
+  {"power-last",          0,    0,    0,    0,       0,    0, 100},
+};
+#define FAULTS_PROFILES         (sizeof(aProfile) / sizeof(aProfile[0]))
+
+static SIM_TimingTypeDef Timing = SIM_TIMING_DEFAULT;
+static uint32_t BlockSize = 1024;
+static uint32_t ImageSize = 32768;
+static uint32_t CleanFlashOps = 0;
+static const FAULT_ProfileTypeDef *pRunProfile;
+static uint32_t RunSeed;
+static FAULTS_RunTypeDef aRun[FAULTS_RUNS_MAX];
+static uint8_t *pNewImage;
+static jmp_buf Escape;
+
+/* Private functions ---------------------------------------------------------*/
+
+static void Faults_PowerCut(void)
+{
+  longjmp(Escape, 1 + FAULTS_POWER_CUT);
+}
+
+static void Faults_TimeLimit(void)
+{
+  longjmp(Escape, 1 + FAULTS_HANG);
+}
+
+static void Faults_Install(const uint8_t *p_image, uint32_t size)
+{
+  FLASH_StreamTypeDef stream;
+
+  FLASH_Stream_Init(&stream, APPLICATION_ADDRESS, APPLICATION_ADDRESS + APPLICATION_MAX_SIZE);
+  if ((FLASH_Stream_Write(&stream, p_image, size) != FLASHIF_OK) || (FLASH_Stream_Flush(&stream) != FLASHIF_OK))
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "cannot install the old image");
+  }
+}
+
+/* What Application_Start (menu.c) would do at the next boot */
+static int Faults_Boot(void)
+{
+  if ((Image_Verify(APPLICATION_ADDRESS, APPLICATION_MAX_SIZE) != IMAGE_OK)
+      || (((*(const uint32_t *)APPLICATION_ADDRESS) & 0x2FFE0000) != 0x20000000))
+  {
+    return FAULTS_BOOT_IAP;
+  }
+  return (memcmp((const void *)APPLICATION_ADDRESS, pNewImage, ImageSize) == 0) ? FAULTS_BOOT_NEW : FAULTS_BOOT_OLD;
+}
+
+/**
+  * @brief  One download, within the time limit
+  * @param  p_size: received size
+  * @param  p_outcome: FAULTS_xxx
+  * @retval COM_StatusTypeDef, -1 if Ymodem_Receive did not return
+  */
+static int Faults_Session(uint32_t *p_size, volatile int *p_outcome)
+{
+  int escape;
+
+  Sim_ClockDeadline(Sim_Nanos() + FAULTS_LIMIT_S * 1000000000ULL, Faults_TimeLimit);
+  escape = setjmp(Escape);
+  if (escape != 0)
+  {
+    *p_outcome = escape - 1;
+    return -1;
+  }
+  *p_outcome = FAULTS_DONE;
+  escape = Ymodem_Receive(p_size);
+  Sim_ClockDeadline(0, NULL);
+  return escape;
+}
+
+/**
+  * @brief  One run of a profile, in a child process (Sim_Fork)
+  * @param  p_context: FAULTS_RunTypeDef of the run in aRun
+  * @retval None
+  */
+static void Faults_Run(void *p_context)
+{
+  SIM_ConfigTypeDef config = {NULL, NULL, "model", 1};
+  FAULTS_RunTypeDef *run = p_context;
+  const FAULT_ProfileTypeDef *profile = pRunProfile;
+  uint8_t *p_old_image;
+  uint64_t start_ns;
+  uint32_t size = 0, flash_ops;
+  volatile int outcome;
+
+  Sim_ClockVirtual(&Timing);
+  Sim_Init(&config);
+  MX_USART1_UART_Init();
+  FLASH_Init();
+
+  p_old_image = malloc(ImageSize);
+  pNewImage = malloc(ImageSize);
+  if ((p_old_image == NULL) || (pNewImage == NULL))
+  {
+    Sim_Exit(SIM_EXIT_ERROR, "out of memory");
+  }
+  Host_YmodemImage(p_old_image, ImageSize, 0x0DD0DD);
+  Host_YmodemImage(pNewImage, ImageSize, 0x4E4557);
+  Faults_Install(p_old_image, ImageSize);
+
+  Host_YmodemStart(pNewImage, ImageSize, BlockSize);
+  Fault_Start(profile, RunSeed);
+  if (profile->power_cut_pct != 0)
+  {
+    Sim_FlashPowerCut((CleanFlashOps * profile->power_cut_pct + 99) / 100, Faults_PowerCut);
+  }
+
+  flash_ops = Sim_FlashErases() + Sim_FlashPrograms();
+  start_ns = Sim_Nanos();
+  run->result = Faults_Session(&size, &outcome);
+  run->outcome = outcome;
+  Sim_FlashPowerCut(0, NULL);
+  run->session_ns = Sim_Nanos() - start_ns;
+  run->flash_ops = Sim_FlashErases() + Sim_FlashPrograms() - flash_ops;
+  run->retransmits = Host_YmodemStats()->retransmits;
+  run->errors = Ymodem_GetErrors();
+  run->faults = *Fault_Stats();
+  run->boot = Faults_Boot();
+
+  if (run->boot != FAULTS_BOOT_NEW)
+  {
+    /* Power back on, the operator starts the download again */
+    Host_YmodemStart(pNewImage, ImageSize, BlockSize);
+    Host_YmodemSetLine(Sim_UartHostSend);
+    start_ns = Sim_Nanos();
+    run->recovered = (Faults_Session(&size, &outcome) == COM_OK) && (Faults_Boot() == FAULTS_BOOT_NEW);
+    run->recovery_ns = Sim_Nanos() - start_ns;
+  }
+  free(p_old_image);
+  free(pNewImage);
+}
+
+static double Faults_Ms(uint64_t ns)
+{
+  return (double)ns / FAULTS_NS_PER_MS;
+}
+
+/**
+  * @brief  Sum of the runs of one profile, as text or one JSON object
+  */
+static void Faults_Report(const FAULT_ProfileTypeDef *profile, uint32_t runs, int json, int last)
+{
+  uint32_t boot[3] = {0, 0, 0};
+  uint32_t i, completed = 0, hangs = 0, recovered = 0, needed = 0, retransmits = 0, faults = 0;
+  uint32_t recoveries = 0;
+  uint64_t session_ns = 0, recovery_ns = 0, recover_ns = 0, recover_max_ns = 0;
+  double goodput;
+
+  for (i = 0; i < runs; i++)
+  {
+    const FAULTS_RunTypeDef *run = &aRun[i];
+
+    boot[run->boot]++;
+    hangs += (run->outcome == FAULTS_HANG);
+    retransmits += run->retransmits;
+    faults += run->faults.dropped + run->faults.flipped + run->faults.duplicated
+              + run->faults.gaps + run->faults.acks_lost + (run->outcome == FAULTS_POWER_CUT);
+    recoveries += run->faults.recoveries;
+    recover_ns += run->faults.recover_ns;
+    if (run->faults.recover_max_ns > recover_max_ns)
+    {
+      recover_max_ns = run->faults.recover_max_ns;
+    }
+    if (run->boot == FAULTS_BOOT_NEW)
+    {
+      completed++;
+      session_ns += run->session_ns;
+    }
+    else
+    {
+      needed++;
+      recovered += run->recovered;
+      recovery_ns += run->recovery_ns;
+    }
+  }
+  /* Image bytes over the time of the sessions that delivered them */
+  goodput = (session_ns != 0) ? (double)ImageSize * completed * 1e9 / (double)session_ns : 0;
+
+  if (json)
+  {
+    printf("  {\"profile\": \"%s\", \"runs\": %u, \"completed\": %u, \"hangs\": %u, \"goodput\": %.0f, "
+           "\"session_ms\": %.3f, \"retransmits\": %u, \"faults\": %u, \"recover_ms\": %.3f, \"recover_max_ms\": %.3f, "
+           "\"boot\": {\"new\": %u, \"old\": %u, \"iap\": %u}, \"redownload\": %u, \"redownload_ok\": %u, "
+           "\"redownload_ms\": %.3f}%s\n",
+           profile->name, runs, completed, hangs, goodput,
+           completed ? Faults_Ms(session_ns / completed) : 0.0, retransmits, faults,
+           recoveries ? Faults_Ms(recover_ns / recoveries) : 0.0, Faults_Ms(recover_max_ns),
+           boot[FAULTS_BOOT_NEW], boot[FAULTS_BOOT_OLD], boot[FAULTS_BOOT_IAP], needed, recovered,
+           needed ? Faults_Ms(recovery_ns / needed) : 0.0, last ? "" : ",");
+  }
+  else
+  {
+    printf("%-14s %4u/%-4u %5u %8.0f %10.1f %5u %6u %10.1f %10.1f  %3u/%3u/%3u  %3u/%-3u %10.1f\n",
+           profile->name, completed, runs, hangs, goodput,
+           completed ? Faults_Ms(session_ns / completed) : 0.0, retransmits, faults,
+           recoveries ? Faults_Ms(recover_ns / recoveries) : 0.0, Faults_Ms(recover_max_ns),
+           boot[FAULTS_BOOT_NEW], boot[FAULTS_BOOT_OLD], boot[FAULTS_BOOT_IAP], recovered, needed,
+           needed ? Faults_Ms(recovery_ns / needed) : 0.0);
+  }
+}
+
+static void Faults_Usage(const char *name)
+{
+  uint32_t i;
+
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --profile LIST  fault profiles, all by default\n"
+          "  --runs N        runs per profile, one seed each (5)\n"
+          "  --seed N        seed of the first run (1)\n"
+          "  --baud N        line baud rate (%u)\n"
+          "  --block N       Ymodem block size, 128 or 1024 (%u)\n"
+          "  --size N        image size in bytes (%u)\n"
+          "  --json          print the results as JSON\n"
+          "profiles:",
+          name, Timing.baud, BlockSize, ImageSize);
+  for (i = 0; i < FAULTS_PROFILES; i++)
+  {
+    fprintf(stderr, " %s", aProfile[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(SIM_EXIT_ERROR);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  static const struct option options[] =
+  {
+    {"profile", required_argument, NULL, 'p'},
+    {"runs", required_argument, NULL, 'r'},
+    {"seed", required_argument, NULL, 's'},
+    {"baud", required_argument, NULL, 'b'},
+    {"block", required_argument, NULL, 'k'},
+    {"size", required_argument, NULL, 'z'},
+    {"json", no_argument, NULL, 'j'},
+    {NULL, 0, NULL, 0}
+  };
+  static const FAULT_ProfileTypeDef clean = {"clean", 0, 0, 0, 0, 0, 0, 0};
+  uint8_t selected[FAULTS_PROFILES];
+  char *profiles = NULL, *name;
+  uint32_t runs = 5, seed = 1, i, r, count = 0, shown = 0;
+  int json = 0, opt, failed = 0;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 'p':
+        profiles = optarg;
+        break;
+      case 'r':
+        runs = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        seed = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        Timing.baud = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'k':
+        BlockSize = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'z':
+        ImageSize = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'j':
+        json = 1;
+        break;
+      default:
+        Faults_Usage(argv[0]);
+        break;
+    }
+  }
+  if ((optind != argc) || (runs == 0) || (runs > FAULTS_RUNS_MAX) || (Timing.baud == 0)
+      || ((BlockSize != 128) && (BlockSize != 1024))
+      || (ImageSize <= IMAGE_HEADER_END + IMAGE_TRAILER_SIZE) || (ImageSize > APPLICATION_MAX_SIZE))
+  {
+    Faults_Usage(argv[0]);
+  }
+
+  memset(selected, profiles == NULL, sizeof(selected));
+  for (name = (profiles != NULL) ? strtok(profiles, ",") : NULL; name != NULL; name = strtok(NULL, ","))
+  {
+    for (i = 0; (i < FAULTS_PROFILES) && (strcmp(aProfile[i].name, name) != 0); i++)
+    {
+    }
+    if (i == FAULTS_PROFILES)
+    {
+      Faults_Usage(argv[0]);
+    }
+    selected[i] = 1;
+  }
+  for (i = 0; i < FAULTS_PROFILES; i++)
+  {
+    count += selected[i];
+  }
+
+  /* Flash operations of a clean transfer, where the power cuts are placed */
+  pRunProfile = &clean;
+  RunSeed = seed;
+  if ((Sim_Fork(Faults_Run, &aRun[0], sizeof(aRun[0])) != 0) || (aRun[0].boot != FAULTS_BOOT_NEW))
+  {
+    fprintf(stderr, "clean transfer failed\n");
+    return SIM_EXIT_ERROR;
+  }
+  CleanFlashOps = aRun[0].flash_ops;
+
+  if (json)
+  {
+    printf("[\n");
+  }
+  else
+  {
+    printf("profile         done/runs hangs  goodput session_ms   rtx faults recover_ms    max_ms  new/old/iap  redownload     ms\n");
+  }
+  for (i = 0; i < FAULTS_PROFILES; i++)
+  {
+    if (!selected[i])
+    {
+      continue;
+    }
+    pRunProfile = &aProfile[i];
+    for (r = 0; r < runs; r++)
+    {
+      RunSeed = seed + r;
+      if (Sim_Fork(Faults_Run, &aRun[r], sizeof(aRun[r])) != 0)
+      {
+        fprintf(stderr, "%s: run %u crashed\n", aProfile[i].name, r);
+        memset(&aRun[r], 0, sizeof(aRun[r]));
+        aRun[r].boot = FAULTS_BOOT_IAP;
+        failed = 1;
+      }
+      /* A device that cannot be updated any more is a failure, a slow update is not */
+      if ((aRun[r].boot != FAULTS_BOOT_NEW) && !aRun[r].recovered)
+      {
+        failed = 1;
+      }
+    }
+    Faults_Report(&aProfile[i], runs, json, ++shown == count);
+  }
+  if (json)
+  {
+    printf("]\n");
+  }
+  return failed ? SIM_EXIT_ERROR : SIM_EXIT_OK;
+}
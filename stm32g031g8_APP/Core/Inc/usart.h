@@ -32,15 +32,23 @@ extern "C" {
 
 /* USER CODE END Includes */
 
-extern UART_HandleTypeDef huart1;
+extern UART_HandleTypeDef huart2;
 
 /* USER CODE BEGIN Private defines */
-#define UartHandle huart1
+#define UartHandle huart2
+#define Rx_len     128
+extern uint8_t Rx_Buf[Rx_len];
 /* USER CODE END Private defines */
 
-void MX_USART1_UART_Init(void);
+void MX_USART2_UART_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+void uart2_rx_start(void);
+uint16_t uart2_rx_read(uint8_t *buf, uint16_t size);
+void uart2_send_one_byte(uint8_t Data);
+void uart2_send_buf(uint8_t *buf, uint8_t len);
+void Serial_PutString(uint8_t *p_string);
+void debug_tx2(char *fmt, ...);
 
 /* USER CODE END Prototypes */
 
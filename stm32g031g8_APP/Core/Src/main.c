@@ -10,33 +10,84 @@
 #include "iwdg.h"
 #include "usart.h"
 #include "gpio.h"
+#include "dma.h"
 #include "string.h"
 #include "common.h"
 #include "flash.h"
 #include "flash_config.h"
+#include "handoff.h"
+#include "boot_trace.h"
+#include "dlog.h"
+#include "sched.h"
+#include "profile.h"
 void SystemClock_Config(void);
 void Flash_OB_Handle(void);
+static void led_task(void);
+static void sched_report_task(void);
 
 void SystemClock_Config(void);
 
 int main(void) 
 {
+	const HANDOFF_TypeDef *handoff;
+
 	SCB->VTOR=APPLICATION_ADDRESS;
-	
-	HAL_Init();
-  SystemClock_Config();
+	BootTrace_Event("AENT");
+	handoff = Handoff_Accept();
+
+	if ((handoff != NULL) && (handoff->flags & HANDOFF_CLOCK))
+	{
+		// IAP已经切到PLL时钟, 只更新SystemCoreClock, 不再等PLL锁定
+		SystemCoreClockUpdate();
+		HAL_Init();
+	}
+	else
+	{
+		HAL_Init();
+		SystemClock_Config();
+		Timebase_SetClock();
+	}
+	BootTrace_Event("ACLK");
+	if ((handoff != NULL) && (handoff->flags & HANDOFF_TICK))
+	{
+		uwTick = handoff->tick;
+	}
+	// IAP跳转前关闭了中断, VTOR指向APP向量表后再打开
+	__enable_irq();
 
   MX_GPIO_Init();
-
+  MX_DMA_Init();
   MX_USART2_UART_Init();
+  uart2_rx_start();
   init_crc8_table();
   Serial_PutString((uint8_t*)"APP init ok\n");
-  while (1)
-  {
-	uart2_rx_handle();
-	led_bink(1000);
-  }
+  BootTrace_Event("LOOP");
+  DLOG2("boot: reset cause %x, main loop at %u us", (handoff != NULL) ? handoff->reset_cause : 0, Timebase_Now());
+
+  // 主循环只在有事件或定时到期时运行, 其余时间WFI睡眠
+  PROFILE_RESET();
+  Sched_Init();
+  Sched_AddEvent(uart2_rx_handle, SCHED_EVENT_UART_RX);
+  Sched_AddEvent(DLog_Poll, SCHED_EVENT_LOG);
+  Sched_AddEvent(Flash_Config_Poll, SCHED_EVENT_CONFIG);
+  Sched_AddPeriodic(led_task, 1000);
+  Sched_AddPeriodic(sched_report_task, 10000);
+  Sched_Run();
+}
+
+static void led_task(void)
+{
+	HAL_GPIO_TogglePin(LED_GPIO_Port, LED_Pin);
+}
+
+// 每10秒输出一次CPU空闲率和唤醒延迟
+static void sched_report_task(void)
+{
+	SCHED_StatsTypeDef stats;
 
+	Sched_GetStats(&stats);
+	DLOG3("sched: idle %u%%, timer wake avg %u us max %u us", stats.idle_pct, stats.timer_wake_avg, stats.timer_wake_max);
+	DLOG2("sched: event wake avg %u us max %u us", stats.event_wake_avg, stats.event_wake_max);
 }
 
 /**
@@ -25,11 +25,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include "dlog.h"
+#include "sched.h"
 /* USER CODE END 0 */
 
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
-uint8_t		Rx_Buf[Rx_len] = {0};
+uint8_t		Rx_Buf[Rx_len] = {0};	// 循环DMA接收缓冲区
+static volatile uint16_t Rx_head = 0;	// DMA写位置, 由接收事件回调更新
+static uint16_t Rx_tail = 0;			// 主循环读位置
+static volatile uint8_t Rx_restart = 0;	// 错误回调重启DMA的次数, Rx_head随之回到0
+static uint8_t Rx_restart_seen = 0;	// 主循环已按其把Rx_tail归零的次数
 /* USART2 init function */
 
 void MX_USART2_UART_Init(void)
@@ -87,6 +95,44 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     GPIO_InitStruct.Alternate = GPIO_AF1_USART2;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+    /* USART2 DMA Init */
+    /* USART2_RX Init */
+    hdma_usart2_rx.Instance = DMA1_Channel1;
+    hdma_usart2_rx.Init.Request = DMA_REQUEST_USART2_RX;
+    hdma_usart2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_usart2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_usart2_rx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart2_rx);
+
+    /* USART2_TX Init */
+    hdma_usart2_tx.Instance = DMA1_Channel2;
+    hdma_usart2_tx.Init.Request = DMA_REQUEST_USART2_TX;
+    hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_usart2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart2_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart2_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_usart2_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart2_tx);
+
+    /* USART2 interrupt Init */
+    HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(USART2_IRQn);
   /* USER CODE BEGIN USART2_MspInit 1 */
 
   /* USER CODE END USART2_MspInit 1 */
@@ -110,6 +156,12 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     */
     HAL_GPIO_DeInit(GPIOA, GPIO_PIN_2|GPIO_PIN_3);
 
+    /* USART2 DMA DeInit */
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+    HAL_DMA_DeInit(uartHandle->hdmatx);
+
+    /* USART2 interrupt Deinit */
+    HAL_NVIC_DisableIRQ(USART2_IRQn);
   /* USER CODE BEGIN USART2_MspDeInit 1 */
 
   /* USER CODE END USART2_MspDeInit 1 */
@@ -117,8 +169,106 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief  启动USART2循环DMA接收, 空闲线/半满/满时更新写位置
+  * @retval None
+  */
+void uart2_rx_start(void)
+{
+    Rx_head = 0;
+    Rx_tail = 0;
+    HAL_UARTEx_ReceiveToIdle_DMA(&huart2, Rx_Buf, Rx_len);
+}
+
+/**
+  * @brief  出错后在中断中重启接收, 不动主循环的Rx_tail, 由uart2_rx_read同步
+  * @retval None
+  */
+static void uart2_rx_restart(void)
+{
+    Rx_head = 0;
+    Rx_restart++;
+    HAL_UARTEx_ReceiveToIdle_DMA(&huart2, Rx_Buf, Rx_len);
+    Sched_Post(SCHED_EVENT_UART_RX);
+}
+
+/**
+  * @brief  取出已收到的字节, 不阻塞
+  * @param  buf: 目标缓冲区
+  * @param  size: 最多取出的字节数
+  * @retval 实际取出的字节数
+  */
+uint16_t uart2_rx_read(uint8_t *buf, uint16_t size)
+{
+    uint16_t head;
+    uint8_t restart;
+    uint16_t n = 0;
+
+    // 两次读到同一重启次数, head才属于这一次重启
+    do
+    {
+        restart = Rx_restart;
+        head = Rx_head;
+    } while (restart != Rx_restart);
+    if (restart != Rx_restart_seen)
+    {
+        // 重启前未读的数据已被新的DMA覆盖, 从头开始读
+        Rx_restart_seen = restart;
+        Rx_tail = 0;
+    }
+
+    while ((Rx_tail != head) && (n < size))
+    {
+        buf[n++] = Rx_Buf[Rx_tail];
+        Rx_tail = (Rx_tail + 1) % Rx_len;
+    }
+    return n;
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    if (huart->Instance == USART2)
+    {
+        // 循环模式下Size是DMA在缓冲区中的写位置, 写满一圈时等于Rx_len
+        Rx_head = (Size == Rx_len) ? 0 : Size;
+        Sched_Post(SCHED_EVENT_UART_RX);
+    }
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance == USART2)
+    {
+        DLog_TxCplt();
+    }
+}
+
+// 等待后台DMA发送(日志)结束, 避免阻塞发送返回HAL_BUSY丢数据
+static void uart2_tx_wait(void)
+{
+    while (huart2.gState == HAL_UART_STATE_BUSY_TX)
+    {
+    }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance == USART2)
+    {
+        DLOG1("uart2 error %x", huart->ErrorCode);
+        // 溢出/帧错误时HAL会停止DMA接收, 重新启动
+        uart2_rx_restart();
+        // 发送DMA出错时也要释放这段日志, 否则日志停住
+        if (huart->gState == HAL_UART_STATE_READY)
+        {
+            DLog_TxCplt();
+        }
+    }
+}
+
 void uart2_send_one_byte(uint8_t Data)
 {
+	uart2_tx_wait();
 	HAL_UART_Transmit(&huart2, (uint8_t *)&Data,1, 100);
 
 }
@@ -145,6 +295,7 @@ void Serial_PutString(uint8_t *p_string)
   {
     length++;
   }
+  uart2_tx_wait();
   HAL_UART_Transmit(&huart2, p_string, length, 100);
 }
 
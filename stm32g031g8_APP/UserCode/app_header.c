@@ -0,0 +1,24 @@
+/**
+  ******************************************************************************
+  * @file    app_header.c
+  * @brief   Image header read by the IAP, placed right after the vector table.
+  *          length and build_id are filled in by tools/image_stamp.py from the
+  *          AfterMake step, which also appends the CRC32 trailer.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "image.h"
+#include "flash.h"
+#include "flash_config.h"
+
+/* Exported variables --------------------------------------------------------*/
+const IMAGE_HeaderTypeDef AppHeader __attribute__((at(APPLICATION_ADDRESS + IMAGE_HEADER_OFFSET), used)) =
+{
+  .magic = IMAGE_MAGIC,
+  .length = 0,
+  .build_id = 0,
+  .device_name = DEVICE_NAME,
+  .hw_version = HW_VERSION,
+  .fw_version = FW_VERSION
+};
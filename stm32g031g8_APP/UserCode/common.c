@@ -1,22 +1,214 @@
 #include "common.h"
 #include "flash_config.h"
+#include "boot_trace.h"
+#include "handoff.h"
+#include "image.h"
+#include "dlog.h"
+#include "update_stats.h"
+#include "profile.h"
+#include "string.h"
 
-uint32_t uart2_rx_tick = 0;
+// 回传启动时间记录, 小端:
+// 60 F2 | count | dropped | count * (time_us(4) name(4)) | sum8
+// 主机端用 tools/boot_trace.py 解析
+static void boot_trace_dump(void)
+{
+    BOOT_TraceTypeDef *trace = BOOT_TRACE;
+    uint8_t head[4];
+    uint8_t sum = 0;
+    uint8_t *p;
+    uint8_t i;
+
+    head[0] = CMD_IAP;
+    head[1] = CMD_TRACE;
+    head[2] = (trace->magic == BOOT_TRACE_MAGIC) ? trace->count : 0;
+    head[3] = (trace->dropped > 0xFF) ? 0xFF : trace->dropped;
+    for (i = 0; i < sizeof(head); i++)
+    {
+        sum += head[i];
+    }
+    uart2_send_buf(head, sizeof(head));
+
+    for (i = 0; i < head[2]; i++)
+    {
+        p = (uint8_t *)&trace->event[i];
+        for (uint8_t j = 0; j < sizeof(BOOT_TraceEventTypeDef); j++)
+        {
+            sum += p[j];
+        }
+        uart2_send_buf(p, sizeof(BOOT_TraceEventTypeDef));
+    }
+    uart2_send_buf(&sum, 1);
+}
+
+// 回传设备状态, 一次应答包含全部信息:
+// 60 F3 | len | APP_StatusTypeDef | sum8
+// 主机端用 tools/app_status.py 解析
+static void status_dump(void)
+{
+    const IMAGE_HeaderTypeDef *header = IMAGE_HEADER(APPLICATION_ADDRESS);
+    const HANDOFF_TypeDef *handoff = Handoff_Get();
+    const BOOT_InfoTypeDef *info = Handoff_GetBootInfo();
+    const IMAGE_DigestTypeDef *digest = Image_GetDigest(APPLICATION_ADDRESS, APPLICATION_MAX_SIZE);
+    APP_StatusTypeDef status;
+    uint8_t head[3];
+    const uint8_t *p_trailer;
+    uint8_t sum = 0;
+    uint8_t *p;
+    uint8_t i;
+
+    memset(&status, 0, sizeof(status));
+    status.layout = STATUS_LAYOUT;
+    status.hw_version = HW_VERSION;
+    status.fw_version = FW_VERSION;
+    memcpy(status.device_name, header->device_name, sizeof(status.device_name));
+    status.build_id = header->build_id;
+    if ((header->length >= IMAGE_HEADER_END) && (header->length <= APPLICATION_MAX_SIZE - IMAGE_TRAILER_SIZE))
+    {
+        /* The trailer is not word aligned when length is not */
+        p_trailer = (const uint8_t *)(APPLICATION_ADDRESS + header->length);
+        status.image_crc = p_trailer[0] | (p_trailer[1] << 8) | (p_trailer[2] << 16) | ((uint32_t)p_trailer[3] << 24);
+    }
+    status.uptime = HAL_GetTick();
+    status.reset_cause = (handoff != NULL) ? handoff->reset_cause : 0;
+    status.update_result = BOOT_INFO_NO_UPDATE;
+    if (info != NULL)
+    {
+        status.boot_count = info->boot_count;
+        status.update_result = info->update_result;
+        status.update_image = info->update_image;
+        status.update_size = info->update_size;
+        status.update_time = info->update_time;
+        status.update_errors = info->update_errors;
+    }
+    status.log_dropped = (DLog_Dropped() > 0xFFFF) ? 0xFFFF : DLog_Dropped();
+    if (digest != NULL)
+    {
+        memcpy(status.image_sha256, digest->sha256, sizeof(status.image_sha256));
+    }
+
+    head[0] = CMD_IAP;
+    head[1] = CMD_STATUS;
+    head[2] = sizeof(status);
+    for (i = 0; i < sizeof(head); i++)
+    {
+        sum += head[i];
+    }
+    p = (uint8_t *)&status;
+    for (i = 0; i < sizeof(status); i++)
+    {
+        sum += p[i];
+    }
+    uart2_send_buf(head, sizeof(head));
+    uart2_send_buf(p, sizeof(status));
+    uart2_send_buf(&sum, 1);
+}
+
+// 回传IAP写在配置页中的上次升级统计, 原样发送:
+// 60 F5 | len | UPDATE_StatsTypeDef | sum8, 没有记录时len为0
+// 主机端用 tools/update_stats.py 解析
+static void update_stats_dump(void)
+{
+    const UPDATE_StatsTypeDef *stats = UpdateStats_Get();
+    uint8_t head[3];
+    uint8_t sum = 0;
+    const uint8_t *p = (const uint8_t *)stats;
+    uint8_t i;
+
+    head[0] = CMD_IAP;
+    head[1] = CMD_UPDATE_STATS;
+    head[2] = (stats != NULL) ? sizeof(UPDATE_StatsTypeDef) : 0;
+    for (i = 0; i < sizeof(head); i++)
+    {
+        sum += head[i];
+    }
+    for (i = 0; i < head[2]; i++)
+    {
+        sum += p[i];
+    }
+    uart2_send_buf(head, sizeof(head));
+    if (head[2] > 0)
+    {
+        uart2_send_buf((uint8_t *)p, head[2]);
+    }
+    uart2_send_buf(&sum, 1);
+}
+
+// 指令帧: 60 cmd 55 55, 可以从数据流任意位置开始
+static uint8_t cmd_frame[4];
+static uint8_t cmd_len = 0;
+
+static void cmd_execute(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case CMD_UPDATE:
+        IAP_updata_mailbox();
+        break;
+    case CMD_UPDATE_FLASH:
+        IAP_updata();
+        break;
+    case CMD_TRACE:
+        boot_trace_dump();
+        break;
+    case CMD_STATUS:
+        status_dump();
+        break;
+    case CMD_UPDATE_STATS:
+        update_stats_dump();
+        break;
+#ifdef PROFILE_ENABLED
+    case CMD_PROFILE:
+        Profile_Dump(uart2_send_buf);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+// 逐字节解析, 帧不对时从帧内下一个60重新同步
+static void cmd_parse_byte(uint8_t byte)
+{
+    uint8_t i;
+
+    if (cmd_len == 0 && byte != CMD_IAP)
+    {
+        return;
+    }
+    cmd_frame[cmd_len++] = byte;
+    if (cmd_len < sizeof(cmd_frame))
+    {
+        return;
+    }
+
+    if (cmd_frame[2] == 0x55 && cmd_frame[3] == 0x55)
+    {
+        cmd_len = 0;
+        cmd_execute(cmd_frame[1]);
+        return;
+    }
+    for (i = 1; i < sizeof(cmd_frame) && cmd_frame[i] != CMD_IAP; i++)
+    {
+    }
+    cmd_len = sizeof(cmd_frame) - i;
+    memmove(cmd_frame, &cmd_frame[i], cmd_len);
+}
+
+// 主循环调用, 只处理DMA已经收到的数据, 不阻塞
 void uart2_rx_handle(void)
 {
-    uint8_t flash_status = 0;
-    uint8_t i = 0;
+    uint8_t buf[16];
+    uint16_t n;
+    uint16_t i;
 
-    if ((HAL_GetTick() - uart2_rx_tick) > 20)
+    PROFILE_ENTER(PROFILE_APP_RX);
+    while ((n = uart2_rx_read(buf, sizeof(buf))) > 0)
     {
-        if(HAL_UART_Receive(&UartHandle, Rx_Buf, Rx_len, 1000) == HAL_OK)
+        for (i = 0; i < n; i++)
         {
-			// 收到 60 F1 55 55 升级指令
-            if(Rx_Buf[0] == CMD_IAP && Rx_Buf[1] == 0xF1 && Rx_Buf[2] == 0x55 && Rx_Buf[3] == 0x55) 
-            {
-                IAP_updata();
-			}
+            cmd_parse_byte(buf[i]);
         }
-        uart2_rx_tick = HAL_GetTick();
     }
+    PROFILE_EXIT(PROFILE_APP_RX);
 }
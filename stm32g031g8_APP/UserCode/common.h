@@ -4,6 +4,39 @@
 #include "main.h"
 
 #define CMD_IAP			0x60
+#define CMD_UPDATE		0xF1	// 60 F1 55 55: 进入bootloader升级(RAM邮箱, 软复位)
+#define CMD_TRACE		0xF2	// 60 F2 55 55: 回传启动时间记录
+#define CMD_STATUS		0xF3	// 60 F3 55 55: 回传设备状态
+#define CMD_UPDATE_FLASH	0xF4	// 60 F4 55 55: 进入bootloader升级(写配置页, 断电保持)
+#define CMD_UPDATE_STATS	0xF5	// 60 F5 55 55: 回传上次升级的统计记录
+#define CMD_PROFILE		0xF6	// 60 F6 55 55: 回传热点路径探针统计(PROFILE_ENABLED)
+
+// 主循环和串口接收的耗时探针, 见profile.h, 关闭时不占代码和RAM
+// #define PROFILE_ENABLED
+
+#define STATUS_LAYOUT	0x02	// 状态结构版本, 增加字段时加1
+
+// 设备状态, 小端, tools/app_status.py 按同样的顺序解析
+typedef struct
+{
+	uint8_t  layout;			// STATUS_LAYOUT
+	uint8_t  hw_version;		// HW_VERSION
+	uint8_t  fw_version;		// FW_VERSION
+	uint8_t  update_result;		// 上次下载结果COM_StatusTypeDef, 0xFF:上电后没有下载
+	char     device_name[10];	// 镜像头中的设备名称
+	uint8_t  update_image;		// 镜像被拒绝的原因IMAGE_StatusTypeDef
+	uint8_t  reserved;
+	uint32_t build_id;			// 镜像头build_id
+	uint32_t image_crc;			// 镜像CRC32
+	uint32_t uptime;			// ms
+	uint32_t boot_count;		// 上电后启动次数
+	uint32_t reset_cause;		// RCC->CSR复位标志
+	uint32_t update_size;		// 上次下载的文件大小
+	uint32_t update_time;		// 上次下载耗时ms
+	uint16_t update_errors;		// 上次下载重传的包数
+	uint16_t log_dropped;		// dlog丢弃的记录数
+	uint8_t  image_sha256[32];	// IAP写在镜像后的SHA-256(IAP_SHA256_ENABLED), 没有时全0, layout 2起
+} __attribute__((packed)) APP_StatusTypeDef;
 
 
 void uart2_rx_handle(void);
@@ -0,0 +1,165 @@
+/**
+  ******************************************************************************
+  * @file    dlog.c
+  * @brief   Deferred-format binary log, drained by DMA on USART2.
+  ******************************************************************************
+  * The ring is an array of words indexed by free running head/tail counters.
+  * The Cortex-M0+ has no LDREX/STREX, so a writer masks interrupts for the few
+  * stores of one record instead of taking a lock; the DMA drain only ever
+  * moves tail. Cost of a DLOGn() call is the call itself plus about a dozen
+  * loads and stores.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "dlog.h"
+#include "timebase.h"
+#include "usart.h"
+#include "sched.h"
+
+/* Private define ------------------------------------------------------------*/
+#define DLOG_MASK               (DLOG_RING_WORDS - 1)
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t aLogRing[DLOG_RING_WORDS];
+static volatile uint32_t LogHead = 0;       /* words written */
+static volatile uint32_t LogTail = 0;       /* words sent */
+static volatile uint32_t LogSending = 0;    /* words in the running DMA transfer */
+static uint32_t LogDropped = 0;             /* not yet reported */
+static uint32_t LogDroppedTotal = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void DLog_Start(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Send the next contiguous part of the ring
+  * @note   Only started from the main loop, so it never races the blocking
+  *         uart2_send_xxx / Serial_PutString calls for the port.
+  * @param  None
+  * @retval None
+  */
+static void DLog_Start(void)
+{
+  uint32_t tail = LogTail;
+  uint32_t count = LogHead - tail;
+
+  if (count == 0)
+  {
+    return;
+  }
+  if ((tail & DLOG_MASK) + count > DLOG_RING_WORDS)
+  {
+    count = DLOG_RING_WORDS - (tail & DLOG_MASK);
+  }
+
+  LogSending = count;
+  if (HAL_UART_Transmit_DMA(&huart2, (uint8_t *)&aLogRing[tail & DLOG_MASK], count * 4) != HAL_OK)
+  {
+    /* Port busy with a blocking transmit, DLog_Poll retries */
+    LogSending = 0;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Queue one record
+  * @param  fmt: format string, must be a literal in the APP image
+  * @param  nargs: number of arguments used, 0 to DLOG_MAX_ARGS
+  * @param  a0: first argument
+  * @param  a1: second argument
+  * @param  a2: third argument
+  * @retval None
+  */
+void DLog_Write(const char *fmt, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t head, free;
+
+  __disable_irq();
+  head = LogHead;
+  free = DLOG_RING_WORDS - (head - LogTail);
+
+  if ((LogDropped != 0) && (free >= 3 + 2 + nargs))
+  {
+    aLogRing[head & DLOG_MASK] = DLOG_SYNC | (1 << 8);
+    aLogRing[(head + 1) & DLOG_MASK] = Timebase_Now();
+    aLogRing[(head + 2) & DLOG_MASK] = LogDropped;
+    head += 3;
+    free -= 3;
+    LogDropped = 0;
+  }
+
+  if (free < 2 + nargs)
+  {
+    LogDropped++;
+    LogDroppedTotal++;
+    __set_PRIMASK(primask);
+    return;
+  }
+
+  aLogRing[head & DLOG_MASK] = DLOG_SYNC | (nargs << 8) | (((uint32_t)fmt - APPLICATION_ADDRESS) << 16);
+  aLogRing[(head + 1) & DLOG_MASK] = Timebase_Now();
+  switch (nargs)
+  {
+    case 3:
+      aLogRing[(head + 4) & DLOG_MASK] = a2;
+      /* fall through */
+    case 2:
+      aLogRing[(head + 3) & DLOG_MASK] = a1;
+      /* fall through */
+    case 1:
+      aLogRing[(head + 2) & DLOG_MASK] = a0;
+      /* fall through */
+    default:
+      break;
+  }
+  LogHead = head + 2 + nargs;
+  __set_PRIMASK(primask);
+  Sched_Post(SCHED_EVENT_LOG);
+}
+
+/**
+  * @brief  Start draining if records are waiting, SCHED_EVENT_LOG task
+  * @param  None
+  * @retval None
+  */
+void DLog_Poll(void)
+{
+  if ((LogSending == 0) && (LogHead != LogTail))
+  {
+    DLog_Start();
+  }
+}
+
+/**
+  * @brief  DMA transfer done, called from HAL_UART_TxCpltCallback
+  * @note   The next part goes out from the DLog_Poll task.
+  * @param  None
+  * @retval None
+  */
+void DLog_TxCplt(void)
+{
+  if (LogSending == 0)
+  {
+    return;
+  }
+  LogTail += LogSending;
+  LogSending = 0;
+  if (LogHead != LogTail)
+  {
+    Sched_Post(SCHED_EVENT_LOG);
+  }
+}
+
+/**
+  * @brief  Records lost because the ring was full
+  * @param  None
+  * @retval Count since reset
+  */
+uint32_t DLog_Dropped(void)
+{
+  return LogDroppedTotal;
+}
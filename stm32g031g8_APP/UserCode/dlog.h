@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file    dlog.h
+  * @brief   Deferred-format binary log, drained by DMA on USART2.
+  ******************************************************************************
+  * A log call only stores where its format string sits in the APP image and
+  * the raw arguments; the text is rebuilt on the host by tools/dlog_decode.py
+  * from the same .bin. Records on the wire, little endian:
+  *
+  *   A5 | nargs | format offset from APPLICATION_ADDRESS (u16) | time us (u32)
+  *   | nargs * arg (u32)
+  *
+  * Offset 0 is reserved for "n records dropped" (one argument).
+  *
+  * Formats support integer conversions only (%d %u %x %c ...), 3 arguments at
+  * most. Callable from thread and interrupt context.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DLOG_H
+#define __DLOG_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define DLOG_SYNC               ((uint8_t)0xA5)
+#define DLOG_RING_WORDS         128         /* power of 2, 512 bytes */
+#define DLOG_MAX_ARGS           3
+
+/* Exported macro ------------------------------------------------------------*/
+#define DLOG0(fmt)              DLog_Write((fmt), 0, 0, 0, 0)
+#define DLOG1(fmt, a)           DLog_Write((fmt), 1, (uint32_t)(a), 0, 0)
+#define DLOG2(fmt, a, b)        DLog_Write((fmt), 2, (uint32_t)(a), (uint32_t)(b), 0)
+#define DLOG3(fmt, a, b, c)     DLog_Write((fmt), 3, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c))
+
+/* Exported functions ------------------------------------------------------- */
+void DLog_Write(const char *fmt, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2);
+void DLog_Poll(void);
+void DLog_TxCplt(void);
+uint32_t DLog_Dropped(void);
+
+#endif  /* __DLOG_H */
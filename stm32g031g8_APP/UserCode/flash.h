@@ -92,6 +92,7 @@ enum {
 #define FLASH_PAGE_STEP         FLASH_PAGE_SIZE           /* Size of page : 1K bytes */
 #define APPLICATION_ADDRESS     (uint32_t)0x08004000      /* Start user code address */
 #define CONFIG_START_ADDRESS     (uint32_t)0x0800F800      /* Config address */
+#define APPLICATION_MAX_SIZE     (CONFIG_START_ADDRESS - APPLICATION_ADDRESS) /* APP area, 46 Kbytes */
 
 /* Notable Flash addresses */
 #define FLASH_START		              ((uint32_t)0x08000000)
@@ -1,6 +1,9 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "flash_config.h"
+#include "handoff.h"
+#include "update_stats.h"
+#include "sched.h"
 #include "string.h"
 
 config_data_t Read_Config = {0};
@@ -52,112 +55,221 @@ static uint8_t calculate_crc8(uint8_t *data, size_t length)
     return crc;
 }
 
-static config_status Flash_Config_Read(config_data_t buf)
+// 写入一次失败后重新擦除的次数上限
+#define CONFIG_MAX_RETRIES	3
+// 配置占用的双字数, 不足部分填0xFF
+#define CONFIG_DWORDS		((sizeof(config_data_t) + 7) / 8)
+// IAP写的升级统计记录(update_stats.h)的双字数, 擦页后原样写回
+#define STATS_DWORDS		(sizeof(UPDATE_StatsTypeDef) / 8)
+
+// 配置写入任务, 每次SCHED_EVENT_CONFIG推进一步
+typedef struct
+{
+	config_step_typedef step;
+	config_data_t data;			// 要写入的配置, crc已计算
+	uint8_t retries;
+	uint8_t written;			// 已写入的双字数
+	uint8_t total;				// 要写入的双字数, 配置加上统计记录
+	config_done_cb done;
+} config_job_t;
+
+static config_job_t config_job = {.step = END};
+static uint64_t config_buf[CONFIG_DWORDS + STATS_DWORDS];
+static volatile config_status config_erase = DOING;	// 擦除中断的结果
+
+static void IAP_reset(void);
+
+// config_buf第i个双字在配置页中的地址: 先是配置, 然后是统计记录
+static uint32_t config_dword_address(uint8_t i)
 {
-    config_status status = DOING;
-    if (STMFLASH_Read(CONFIG_START_ADDRESS, (uint8_t *)&buf, sizeof(buf)) == FLASHIF_OK)
+    if (i < CONFIG_DWORDS)
     {
-        status = OK;
+        return CONFIG_START_ADDRESS + 8 * i;
     }
-    return status;
+    return UPDATE_STATS_ADDRESS + 8 * (i - CONFIG_DWORDS);
 }
 
-static config_status Flash_Config_Erase(void)
+static void Flash_Config_Finish(config_status status)
 {
-    config_status status = DOING;
-    if (FLASH_Erase(CONFIG_START_ADDRESS) == FLASHIF_OK)
+    HAL_FLASH_Lock();
+    config_job.step = END;
+    if (config_job.done != NULL)
     {
-        status = OK;
+        config_job.done(status);
     }
-    return status;
 }
 
-static config_status Flash_Config_Write(config_data_t buf)
+static void Flash_Config_Retry(void)
 {
-    config_status status = DOING;
-    buf.crc_cal = calculate_crc8((uint8_t *)&buf, sizeof(buf) - 1); // crc只校验前面的数据
-    if (FLASH_If_Write(CONFIG_START_ADDRESS, (uint32_t *)&buf, sizeof(buf)) == FLASHIF_OK)
+    HAL_FLASH_Lock();
+    if (++config_job.retries >= CONFIG_MAX_RETRIES)
+    {
+        Flash_Config_Finish(ERR);
+    }
+    else
+    {
+        config_job.step = ERASE;
+    }
+}
+
+// 开始写配置页, 立即返回; 写完(或重试后仍失败)时调用done
+// 返回DOING表示已开始, ERR表示上一次写入还没结束
+config_status Flash_Config_Start(const config_data_t *cfg, config_done_cb done)
+{
+    if (config_job.step != END)
+    {
+        return ERR;
+    }
+    config_job.data = *cfg;
+    // 保留IAP分配的RS-485地址
+    config_job.data.bus_address = ((const config_data_t *)CONFIG_START_ADDRESS)->bus_address;
+    config_job.data.crc_cal = calculate_crc8((uint8_t *)&config_job.data, offsetof(config_data_t, crc_cal)); // crc只校验前面的数据
+    memset(config_buf, 0xFF, sizeof(config_buf));
+    memcpy(config_buf, &config_job.data, sizeof(config_job.data));
+    config_job.total = CONFIG_DWORDS;
+    if (UpdateStats_Get() != NULL)
     {
-        status = OK;
+        memcpy(&config_buf[CONFIG_DWORDS], UpdateStats_Get(), sizeof(UPDATE_StatsTypeDef));
+        config_job.total += STATS_DWORDS;
     }
-    return status;
+    config_job.retries = 0;
+    config_job.done = done;
+    config_job.step = READ;
+
+    HAL_NVIC_SetPriority(FLASH_IRQn, 3, 0);
+    HAL_NVIC_EnableIRQ(FLASH_IRQn);
+    Sched_Post(SCHED_EVENT_CONFIG);
+    return DOING;
 }
 
-static void Flash_Config_Set_Defalt(void)
+// SCHED_EVENT_CONFIG任务, 每次只做一步, 擦除由EOP中断通知完成
+// 注意: 单bank flash擦除期间CPU从flash取指会停顿, DMA收发不受影响
+void Flash_Config_Poll(void)
 {
-    uint8_t calculated_crc = 0;
-    if (FLASH_Erase(CONFIG_START_ADDRESS) == FLASHIF_OK)
+    FLASH_EraseInitTypeDef erase_init;
+
+    switch (config_job.step)
+    {
+    case READ:
+        // 内容没变就不擦写
+        if (memcmp((const void *)CONFIG_START_ADDRESS, &config_job.data, sizeof(config_job.data)) == 0)
+        {
+            Flash_Config_Finish(OK);
+            return;
+        }
+        config_job.step = ERASE;
+        break;
+    case ERASE:
+        erase_init.TypeErase = FLASH_TYPEERASE_PAGES;
+        erase_init.Banks = FLASH_BANK_1;
+        erase_init.Page = (CONFIG_START_ADDRESS - FLASH_BASE) / FLASH_PAGE_SIZE;
+        erase_init.NbPages = 1;
+        config_erase = DOING;
+        HAL_FLASH_Unlock();
+        if (HAL_FLASHEx_Erase_IT(&erase_init) != HAL_OK)
+        {
+            Flash_Config_Retry();
+            break;
+        }
+        config_job.step = ERASE_WAIT;
+        return;
+    case ERASE_WAIT:
+        if (config_erase == DOING)
+        {
+            return;
+        }
+        if (config_erase != OK)
+        {
+            Flash_Config_Retry();
+            break;
+        }
+        config_job.written = 0;
+        config_job.step = WRITE;
+        break;
+    case WRITE:
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, config_dword_address(config_job.written),
+                              config_buf[config_job.written]) != HAL_OK)
+        {
+            Flash_Config_Retry();
+            break;
+        }
+        if (++config_job.written == config_job.total)
+        {
+            HAL_FLASH_Lock();
+            config_job.step = CHECK;
+        }
+        break;
+    case CHECK:
+        if ((memcmp((const void *)CONFIG_START_ADDRESS, config_buf, CONFIG_DWORDS * 8) == 0)
+            && (memcmp((const void *)UPDATE_STATS_ADDRESS, &config_buf[CONFIG_DWORDS], (config_job.total - CONFIG_DWORDS) * 8) == 0)
+            && (calculate_crc8((uint8_t *)CONFIG_START_ADDRESS, offsetof(config_data_t, crc_cal)) == config_job.data.crc_cal))
+        {
+            Flash_Config_Finish(OK);
+            return;
+        }
+        Serial_PutString((uint8_t *)"CRC Erro !\n");
+        Flash_Config_Retry();
+        break;
+    default:
+        return;
+    }
+    if (config_job.step != END)
     {
-        calculated_crc = calculate_crc8((uint8_t *)&Config_Default, sizeof(Config_Default) - 1);
-        Flash_Config_Write(Config_Default);
+        Sched_Post(SCHED_EVENT_CONFIG);
     }
 }
 
-static config_status Flash_Config_Check(config_data_t buf)
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
 {
-    uint8_t calculated_crc = 0;
-    uint8_t i = 0;
-    config_status status = DOING;
+    if (config_erase == DOING)
+    {
+        config_erase = OK;
+        Sched_Post(SCHED_EVENT_CONFIG);
+    }
+}
 
-    /*读取上一步写入的buf*/
-    STMFLASH_Read(CONFIG_START_ADDRESS, (uint8_t *)&buf, sizeof(buf));
-    calculated_crc = calculate_crc8((uint8_t *)&buf, sizeof(buf) - 1);
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+    config_erase = ERR;
+    Sched_Post(SCHED_EVENT_CONFIG);
+}
 
-    if (calculated_crc == buf.crc_cal) // CRC 校验通过
+static void IAP_updata_done(config_status status)
+{
+    if (status == OK)
     {
-        status = OK;
+        Serial_PutString((uint8_t *)"into bootloader \n");
+        IAP_reset();
     }
     else
     {
-		status = ERR;
-        Serial_PutString((uint8_t *)"CRC Erro !\n");
+        Serial_PutString((uint8_t *)"config write err!\n");
     }
-    return status;
 }
 
+// 写配置页中的升级标志(断电保持), 不阻塞主循环
 void IAP_updata(void)
 {
-    static config_step_typedef config_step = READ;
-    while (config_step != END)
+    if (Flash_Config_Start(&Config_Write, IAP_updata_done) != DOING)
     {
-        switch (config_step)
-        {
-        case READ:
-            if (Flash_Config_Read(Read_Config) == OK)
-            {
-                config_step = ERASE;
-            }
-            break;
-        case ERASE:
-            if (Flash_Config_Erase() == OK)
-            {
-                Serial_PutString((uint8_t *)"ERASE ok \n");
-                config_step = WRITE;
-            }
-            break;
-        case WRITE:
-            if (Flash_Config_Write(Config_Write) == OK)
-            {
-                config_step = CHECK;
-            }
-            break;
-        case CHECK:
-            if (Flash_Config_Check(Config_Write) == OK)
-            {
-                config_step = END;
-            }
-            break;
+        Serial_PutString((uint8_t *)"config busy!\n");
+    }
+}
 
-        default:
-            Flash_Config_Set_Defalt();
-            break;
-        }
-	}
-        if (config_step == END)
-        {
-            Serial_PutString((uint8_t *)"into bootloader \n");
-            config_step = READ;
-            MX_IWDG_Init(); // 使用看门狗复位
-        }
+// 等最后一个字节发完再软复位, 不用等看门狗
+static void IAP_reset(void)
+{
+    while (__HAL_UART_GET_FLAG(&huart2, UART_FLAG_TC) == RESET)
+    {
+    }
+    NVIC_SystemReset();
+}
 
+// 通过RAM邮箱请求升级: 不写flash, 软复位后IAP直接进入升级菜单
+// 断电后请求丢失, 需要断电保持时用IAP_updata()写配置页
+void IAP_updata_mailbox(void)
+{
+    Serial_PutString((uint8_t *)"into bootloader \n");
+    Handoff_PostMailbox(MAILBOX_UPDATE, 0);
+    IAP_reset();
 }
\ No newline at end of file
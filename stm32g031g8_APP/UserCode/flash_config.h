@@ -18,7 +18,8 @@ typedef struct config_data_s
 	uint8_t FW_vision;		//软件版本
 	uint8_t updata_flg;       //更新标志
 	uint8_t crc_cal; 		//crc8校验
-	
+	uint8_t bus_address;	//RS-485地址, 由IAP写入, 不参与crc
+
 }__attribute__((packed)) config_data_t;
 extern config_data_t Config_Write;
 
@@ -31,12 +32,18 @@ typedef enum{
 typedef enum{
 	READ = 0,
 	ERASE,
+	ERASE_WAIT,
 	WRITE,
 	CHECK,
 	END	
 }config_step_typedef;
 
+typedef void (*config_done_cb)(config_status status);
+
 void init_crc8_table(void);
+config_status Flash_Config_Start(const config_data_t *cfg, config_done_cb done);
+void Flash_Config_Poll(void);
 void IAP_updata(void);
+void IAP_updata_mailbox(void);
 
 #endif
\ No newline at end of file
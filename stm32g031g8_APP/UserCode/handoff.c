@@ -0,0 +1,79 @@
+/**
+  ******************************************************************************
+  * @file    handoff.c
+  * @brief   APP side of the boot handoff block, see handoff.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "handoff.h"
+
+/* Private variables ---------------------------------------------------------*/
+static HANDOFF_TypeDef BootHandoff;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Take over the block left by the IAP
+  * @note   The block is consumed, a later reset straight into the application
+  *         (debugger, watchdog) must not find it again.
+  * @param  None
+  * @retval Copy of the block, NULL if the IAP did not leave a valid one
+  */
+const HANDOFF_TypeDef *Handoff_Accept(void)
+{
+  HANDOFF_TypeDef *handoff = HANDOFF;
+
+  if ((handoff->magic != HANDOFF_MAGIC) || (handoff->version != HANDOFF_VERSION)
+      || (handoff->size != sizeof(HANDOFF_TypeDef)) || (handoff->check != Handoff_Sum(handoff)))
+  {
+    return NULL;
+  }
+
+  BootHandoff = *handoff;
+  handoff->magic = 0;
+  return &BootHandoff;
+}
+
+/**
+  * @brief  Block taken over by Handoff_Accept
+  * @param  None
+  * @retval Copy of the block, NULL if there was none
+  */
+const HANDOFF_TypeDef *Handoff_Get(void)
+{
+  return (BootHandoff.magic == HANDOFF_MAGIC) ? &BootHandoff : NULL;
+}
+
+/**
+  * @brief  Leave a command for the IAP
+  * @note   Only survives a reset, follow with NVIC_SystemReset().
+  * @param  command: MAILBOX_xxx
+  * @param  arg: command specific, 0 if unused
+  * @retval None
+  */
+void Handoff_PostMailbox(uint32_t command, uint32_t arg)
+{
+  MAILBOX_TypeDef *mailbox = MAILBOX;
+
+  mailbox->magic = MAILBOX_MAGIC;
+  mailbox->command = command;
+  mailbox->arg = arg;
+  mailbox->check = Mailbox_Sum(mailbox);
+}
+
+/**
+  * @brief  Boot count and last download result kept by the IAP
+  * @param  None
+  * @retval The record, NULL if the IAP did not leave a valid one
+  */
+const BOOT_InfoTypeDef *Handoff_GetBootInfo(void)
+{
+  const BOOT_InfoTypeDef *info = BOOT_INFO;
+
+  if ((info->magic != BOOT_INFO_MAGIC) || (info->check != BootInfo_Sum(info)))
+  {
+    return NULL;
+  }
+  return info;
+}
@@ -0,0 +1,105 @@
+/**
+  ******************************************************************************
+  * @file    image.h
+  * @brief   Application image header, shared by the IAP and the APP.
+  ******************************************************************************
+  * The APP places an IMAGE_HeaderTypeDef right after its vector table. The
+  * build (tools/image_stamp.py, run from the MDK AfterMake step) fills in the
+  * length and build ID and appends the CRC32 of the image:
+  *
+  *   | vector table | header | code ...                   | CRC32 |
+  *   0              0xC0                         header.length
+  *
+  * header.length covers everything up to, not including, the CRC32 trailer.
+  *
+  * An IAP built with IAP_SHA256_ENABLED then programs an IMAGE_DigestTypeDef
+  * at the next double word, the SHA-256 of the image and its trailer,
+  * computed while the image was written (sha256.h). It is bound to the image
+  * by the CRC32, a record left over from an earlier image of the same length
+  * does not pass for the current one.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define IMAGE_MAGIC             ((uint32_t)0x48505041)  /* "APPH" */
+#define IMAGE_HEADER_OFFSET     ((uint32_t)0xC0)        /* end of the G031 vector table */
+#define IMAGE_TRAILER_SIZE      ((uint32_t)4)           /* CRC32 after the image */
+#define IMAGE_NAME_LENGTH       ((uint32_t)10)
+#define IMAGE_DIGEST_MAGIC      ((uint32_t)0x32414853)  /* "SHA2" */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;                           /* IMAGE_MAGIC */
+  uint32_t length;                          /* image length, stamped after build */
+  uint32_t build_id;                        /* stamped after build */
+  char     device_name[IMAGE_NAME_LENGTH];  /* DEVICE_NAME the image is built for */
+  uint8_t  hw_version;                      /* HW_VERSION the image is built for */
+  uint8_t  fw_version;                      /* FW_VERSION of the image */
+} __attribute__((packed)) IMAGE_HeaderTypeDef;
+
+typedef struct
+{
+  uint32_t magic;                           /* IMAGE_DIGEST_MAGIC */
+  uint32_t crc32;                           /* CRC32 trailer of the image */
+  uint8_t  sha256[32];                      /* over header.length + IMAGE_TRAILER_SIZE bytes */
+} IMAGE_DigestTypeDef;
+
+typedef enum
+{
+  IMAGE_OK = 0,
+  IMAGE_NO_HEADER,      /* magic not found */
+  IMAGE_BAD_DEVICE,     /* built for another product */
+  IMAGE_BAD_HW,         /* built for another hardware version */
+  IMAGE_BAD_LENGTH,     /* length does not fit the APP area */
+  IMAGE_BAD_CRC,        /* content does not match the CRC32 trailer */
+  IMAGE_BAD_VECTOR      /* initial stack pointer outside RAM */
+} IMAGE_StatusTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#define IMAGE_HEADER_END        (IMAGE_HEADER_OFFSET + sizeof(IMAGE_HeaderTypeDef))
+#define IMAGE_HEADER(address)   ((const IMAGE_HeaderTypeDef *)((address) + IMAGE_HEADER_OFFSET))
+/* Offset of the digest record of an image of the given header.length */
+#define IMAGE_DIGEST_OFFSET(length) (((length) + IMAGE_TRAILER_SIZE + 7u) & ~7u)
+
+/**
+  * @brief  Digest record of the image programmed at an address
+  * @param  address: start of the image (vector table)
+  * @param  max_size: size of the area holding the image
+  * @retval Record, NULL if there is none or it belongs to another image
+  */
+__STATIC_INLINE const IMAGE_DigestTypeDef *Image_GetDigest(uint32_t address, uint32_t max_size)
+{
+  uint32_t length = IMAGE_HEADER(address)->length;
+  const uint8_t *p_trailer;
+  const IMAGE_DigestTypeDef *digest;
+
+  if ((IMAGE_HEADER(address)->magic != IMAGE_MAGIC) || (length < IMAGE_HEADER_END)
+      || (length > max_size - IMAGE_TRAILER_SIZE)
+      || (IMAGE_DIGEST_OFFSET(length) + sizeof(IMAGE_DigestTypeDef) > max_size))
+  {
+    return NULL;
+  }
+  p_trailer = (const uint8_t *)(address + length);
+  digest = (const IMAGE_DigestTypeDef *)(address + IMAGE_DIGEST_OFFSET(length));
+  if ((digest->magic != IMAGE_DIGEST_MAGIC)
+      || (digest->crc32 != (p_trailer[0] | (p_trailer[1] << 8) | (p_trailer[2] << 16) | ((uint32_t)p_trailer[3] << 24))))
+  {
+    return NULL;
+  }
+  return digest;
+}
+
+/* Exported functions ------------------------------------------------------- */
+IMAGE_StatusTypeDef Image_CheckHeader(const IMAGE_HeaderTypeDef *header, uint32_t max_size);
+IMAGE_StatusTypeDef Image_Verify(uint32_t address, uint32_t max_size);
+uint32_t Image_GetCRC(uint32_t address);
+
+#endif  /* __IMAGE_H */
@@ -0,0 +1,88 @@
+/**
+  ******************************************************************************
+  * @file    profile.c
+  * @brief   Hot path probe table and its dump, see profile.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "profile.h"
+#include "string.h"
+
+#ifdef PROFILE_ENABLED
+
+/* Private variables ---------------------------------------------------------*/
+/* In the order of PROFILE_ProbeTypeDef */
+static const char PROFILE_NAMES[PROFILE_PROBES][4] =
+{
+  {'C', 'R', 'C', '6'},
+  {'U', 'R', 'X', ' '},
+  {'F', 'P', 'R', 'G'},
+  {'F', 'E', 'R', 'A'},
+  {'I', 'W', 'R', 'T'},
+  {'I', 'V', 'F', 'Y'},
+  {'A', 'E', 'S', ' '},
+  {'S', 'H', 'A', ' '},
+  {'L', 'O', 'O', 'P'},
+  {'A', 'R', 'X', ' '},
+};
+
+/* Exported variables --------------------------------------------------------*/
+PROFILE_EntryTypeDef aProfile[PROFILE_PROBES];
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Clear every probe
+  * @param  None
+  * @retval None
+  */
+void Profile_Reset(void)
+{
+  uint32_t i;
+
+  memset(aProfile, 0, sizeof(aProfile));
+  for (i = 0; i < PROFILE_PROBES; i++)
+  {
+    aProfile[i].min = 0xFFFFFFFF;
+  }
+}
+
+/**
+  * @brief  Send the probe table as one frame, see profile.h
+  * @param  p_send: blocking write to the console
+  * @retval None
+  */
+void Profile_Dump(PROFILE_SendFn p_send)
+{
+  PROFILE_RecordTypeDef record;
+  uint8_t head[3];
+  uint8_t sum = 0;
+  uint32_t i, j;
+
+  head[0] = CMD_IAP;
+  head[1] = PROFILE_FRAME_ID;
+  head[2] = PROFILE_PROBES;
+  for (i = 0; i < sizeof(head); i++)
+  {
+    sum += head[i];
+  }
+  p_send(head, sizeof(head));
+
+  for (i = 0; i < PROFILE_PROBES; i++)
+  {
+    memcpy(record.name, PROFILE_NAMES[i], sizeof(record.name));
+    record.count = aProfile[i].count;
+    record.min = aProfile[i].min;
+    record.max = aProfile[i].max;
+    record.total = aProfile[i].total;
+    for (j = 0; j < sizeof(record); j++)
+    {
+      sum += ((uint8_t *)&record)[j];
+    }
+    p_send((uint8_t *)&record, sizeof(record));
+  }
+  p_send(&sum, 1);
+}
+
+#endif /* PROFILE_ENABLED */
@@ -0,0 +1,299 @@
+/**
+  ******************************************************************************
+  * @file    sched.c
+  * @brief   Cooperative, tickless scheduler for the APP main loop.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sched.h"
+#include "timebase.h"
+#include "profile.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  SCHED_TaskFn fn;
+  uint32_t period;          /* us, 0 for one-shot and event tasks */
+  uint32_t due;             /* Timebase_Now() value */
+  uint32_t events;          /* event mask, 0 for timer tasks */
+  uint8_t active;
+} SCHED_TaskTypeDef;
+
+typedef struct
+{
+  uint32_t max;
+  uint32_t sum;
+  uint32_t count;
+} SCHED_LatencyTypeDef;
+
+/* Private macro -------------------------------------------------------------*/
+#define TIME_REACHED(now, t)    ((int32_t)((now) - (t)) >= 0)
+
+/* Private variables ---------------------------------------------------------*/
+static SCHED_TaskTypeDef aTasks[SCHED_MAX_TASKS];
+static volatile uint32_t PendingEvents = 0;
+static volatile uint32_t EventPostTime = 0;   /* first post not yet dispatched */
+static SCHED_LatencyTypeDef TimerWake;
+static SCHED_LatencyTypeDef EventWake;
+static uint32_t IdleTime = 0;                 /* us in WFI since WindowStart */
+static uint32_t WindowStart = 0;
+static uint32_t TickRemainder = 0;            /* us not yet added to uwTick */
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t Sched_Add(SCHED_TaskFn fn, uint32_t period, uint32_t delay, uint32_t events);
+static void Sched_Record(SCHED_LatencyTypeDef *p_latency, uint32_t latency);
+static void Sched_Idle(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+static int32_t Sched_Add(SCHED_TaskFn fn, uint32_t period, uint32_t delay, uint32_t events)
+{
+  int32_t i;
+
+  for (i = 0; i < SCHED_MAX_TASKS; i++)
+  {
+    if (!aTasks[i].active)
+    {
+      aTasks[i].fn = fn;
+      aTasks[i].period = period;
+      aTasks[i].due = Timebase_Now() + delay;
+      aTasks[i].events = events;
+      aTasks[i].active = 1;
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void Sched_Record(SCHED_LatencyTypeDef *p_latency, uint32_t latency)
+{
+  if (latency > p_latency->max)
+  {
+    p_latency->max = latency;
+  }
+  p_latency->sum += latency;
+  p_latency->count++;
+}
+
+/**
+  * @brief  Sleep until the next deadline or interrupt
+  * @note   Interrupts stay masked from the last check to WFI, so an event
+  *         posted in between still wakes the core; its handler runs once
+  *         PRIMASK is cleared at the end.
+  * @param  None
+  * @retval None
+  */
+static void Sched_Idle(void)
+{
+  uint32_t next = 0, t0, t1;
+  uint8_t timed = 0;
+  int32_t i;
+
+  __disable_irq();
+  if (PendingEvents != 0)
+  {
+    __enable_irq();
+    return;
+  }
+
+  for (i = 0; i < SCHED_MAX_TASKS; i++)
+  {
+    if (aTasks[i].active && (aTasks[i].events == 0)
+        && (!timed || ((int32_t)(aTasks[i].due - next) < 0)))
+    {
+      next = aTasks[i].due;
+      timed = 1;
+    }
+  }
+
+  if (timed)
+  {
+    TIMEBASE_TIM->CCR1 = next;
+    TIMEBASE_TIM->SR = ~TIM_SR_CC1IF;
+    TIMEBASE_TIM->DIER |= TIM_DIER_CC1IE;
+    /* The compare only fires on an exact match, do not sleep past it */
+    if (TIME_REACHED(Timebase_Now(), next))
+    {
+      TIMEBASE_TIM->DIER &= ~TIM_DIER_CC1IE;
+      __enable_irq();
+      return;
+    }
+  }
+
+  HAL_SuspendTick();
+  t0 = Timebase_Now();
+  __WFI();
+  t1 = Timebase_Now();
+  HAL_ResumeTick();
+
+  /* SysTick did not count while suspended */
+  TickRemainder += t1 - t0;
+  uwTick += TickRemainder / 1000;
+  TickRemainder %= 1000;
+  IdleTime += t1 - t0;
+
+  TIMEBASE_TIM->DIER &= ~TIM_DIER_CC1IE;
+  __enable_irq();
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Reset the task table and enable the TIM2 wake-up interrupt
+  * @note   Timebase_Init must have run (IAP or APP main).
+  * @param  None
+  * @retval None
+  */
+void Sched_Init(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < SCHED_MAX_TASKS; i++)
+  {
+    aTasks[i].active = 0;
+  }
+  PendingEvents = 0;
+
+  Timebase_Init();
+  WindowStart = Timebase_Now();
+  HAL_NVIC_SetPriority(TIM2_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+/**
+  * @brief  Run fn every period_ms, first time one period from now
+  * @retval Task index, -1 if the table is full
+  */
+int32_t Sched_AddPeriodic(SCHED_TaskFn fn, uint32_t period_ms)
+{
+  return Sched_Add(fn, period_ms * 1000, period_ms * 1000, 0);
+}
+
+/**
+  * @brief  Run fn once, delay_ms from now
+  * @retval Task index, -1 if the table is full
+  */
+int32_t Sched_AddOneShot(SCHED_TaskFn fn, uint32_t delay_ms)
+{
+  return Sched_Add(fn, 0, delay_ms * 1000, 0);
+}
+
+/**
+  * @brief  Run fn whenever one of events is posted
+  * @retval Task index, -1 if the table is full
+  */
+int32_t Sched_AddEvent(SCHED_TaskFn fn, uint32_t events)
+{
+  return Sched_Add(fn, 0, 0, events);
+}
+
+/**
+  * @brief  Signal events, callable from interrupt context
+  * @param  events: SCHED_EVENT_xxx bits
+  * @retval None
+  */
+void Sched_Post(uint32_t events)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (PendingEvents == 0)
+  {
+    EventPostTime = Timebase_Now();
+  }
+  PendingEvents |= events;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Dispatch tasks forever
+  * @param  None
+  * @retval None
+  */
+void Sched_Run(void)
+{
+  uint32_t events, posted, now;
+  int32_t i;
+
+  while (1)
+  {
+    PROFILE_ENTER(PROFILE_APP_LOOP);
+    __disable_irq();
+    events = PendingEvents;
+    posted = EventPostTime;
+    PendingEvents = 0;
+    __enable_irq();
+
+    if (events != 0)
+    {
+      Sched_Record(&EventWake, Timebase_Now() - posted);
+      for (i = 0; i < SCHED_MAX_TASKS; i++)
+      {
+        if (aTasks[i].active && (aTasks[i].events & events))
+        {
+          aTasks[i].fn();
+        }
+      }
+    }
+
+    for (i = 0; i < SCHED_MAX_TASKS; i++)
+    {
+      now = Timebase_Now();
+      if (!aTasks[i].active || (aTasks[i].events != 0) || !TIME_REACHED(now, aTasks[i].due))
+      {
+        continue;
+      }
+      Sched_Record(&TimerWake, now - aTasks[i].due);
+      if (aTasks[i].period != 0)
+      {
+        aTasks[i].due += aTasks[i].period;
+        if (TIME_REACHED(now, aTasks[i].due))
+        {
+          /* Overran by more than a period: skip the missed runs */
+          aTasks[i].due = now + aTasks[i].period;
+        }
+      }
+      else
+      {
+        aTasks[i].active = 0;
+      }
+      aTasks[i].fn();
+    }
+
+    PROFILE_EXIT(PROFILE_APP_LOOP);
+    Sched_Idle();
+  }
+}
+
+/**
+  * @brief  Idle time and wake-up latencies since the previous call
+  * @param  p_stats: filled with the figures, counters then restart
+  * @retval None
+  */
+void Sched_GetStats(SCHED_StatsTypeDef *p_stats)
+{
+  uint32_t now = Timebase_Now();
+  uint32_t window = now - WindowStart;
+
+  p_stats->idle_pct = (window != 0) ? (uint32_t)(((uint64_t)IdleTime * 100) / window) : 0;
+  p_stats->timer_wake_max = TimerWake.max;
+  p_stats->timer_wake_avg = (TimerWake.count != 0) ? TimerWake.sum / TimerWake.count : 0;
+  p_stats->event_wake_max = EventWake.max;
+  p_stats->event_wake_avg = (EventWake.count != 0) ? EventWake.sum / EventWake.count : 0;
+
+  TimerWake.max = TimerWake.sum = TimerWake.count = 0;
+  EventWake.max = EventWake.sum = EventWake.count = 0;
+  IdleTime = 0;
+  WindowStart = now;
+}
+
+/**
+  * @brief  TIM2 interrupt, the compare only has to wake the core
+  * @param  None
+  * @retval None
+  */
+void Sched_TIM_IRQHandler(void)
+{
+  TIMEBASE_TIM->SR = ~TIM_SR_CC1IF;
+}
@@ -0,0 +1,52 @@
+/**
+  ******************************************************************************
+  * @file    sched.h
+  * @brief   Cooperative, tickless scheduler for the APP main loop.
+  ******************************************************************************
+  * Tasks run to completion from Sched_Run(), either on a deadline (periodic or
+  * one-shot, TIM2 timebase) or when an interrupt posts one of their events.
+  * With nothing due the core sleeps in WFI with SysTick suspended and TIM2
+  * channel 1 armed for the next deadline; the HAL tick is caught up on wake.
+  *
+  * Stop mode is not used: neither TIM2 nor USART2 can wake the G031 from it.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCHED_H
+#define __SCHED_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SCHED_MAX_TASKS         8
+
+/* Events posted from interrupt context */
+#define SCHED_EVENT_UART_RX     ((uint32_t)0x01)  /* USART2 idle line / DMA half or full */
+#define SCHED_EVENT_LOG         ((uint32_t)0x02)  /* dlog records queued or DMA done */
+#define SCHED_EVENT_CONFIG      ((uint32_t)0x04)  /* config page job step or flash EOP */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*SCHED_TaskFn)(void);
+
+typedef struct
+{
+  uint32_t idle_pct;        /* time spent in WFI since the last call, % */
+  uint32_t timer_wake_max;  /* deadline to task start, us */
+  uint32_t timer_wake_avg;
+  uint32_t event_wake_max;  /* Sched_Post to task start, us */
+  uint32_t event_wake_avg;
+} SCHED_StatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void Sched_Init(void);
+int32_t Sched_AddPeriodic(SCHED_TaskFn fn, uint32_t period_ms);
+int32_t Sched_AddOneShot(SCHED_TaskFn fn, uint32_t delay_ms);
+int32_t Sched_AddEvent(SCHED_TaskFn fn, uint32_t events);
+void Sched_Post(uint32_t events);
+void Sched_Run(void);
+void Sched_GetStats(SCHED_StatsTypeDef *p_stats);
+void Sched_TIM_IRQHandler(void);
+
+#endif  /* __SCHED_H */
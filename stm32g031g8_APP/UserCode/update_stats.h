@@ -0,0 +1,117 @@
+/**
+  ******************************************************************************
+  * @file    update_stats.h
+  * @brief   Statistics of the last update session, kept in the config page.
+  ******************************************************************************
+  * The IAP counts line and protocol errors and times the phases of every
+  * Ymodem download, then programs one record into the config page:
+  *
+  *   CONFIG_START_ADDRESS + 0x000  config_data_t
+  *   UPDATE_STATS_ADDRESS          UPDATE_StatsTypeDef
+  *   BOOT_RECORD_ADDRESS           boot cache, see bootcache.h
+  *
+  * The record survives resets and power loss until the next session replaces
+  * it. Both projects keep it when they rewrite the config page. The APP
+  * returns it as is on 60 F5 55 55 (tools/update_stats.py).
+  *
+  * The phases, in ms:
+  *   handshake  menu entry to the file header packet
+  *   erase      page erases while writing the image
+  *   program    decoding and programming, erases and verification excluded
+  *   verify     CRC32 of the whole image after EOT
+  *   transfer   file header packet to the end of the session
+  *   total      menu entry to the end of the session
+  *
+  * This file is shared by both projects, keep the two copies identical.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __UPDATE_STATS_H
+#define __UPDATE_STATS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "flash.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define UPDATE_STATS_ADDRESS    (CONFIG_START_ADDRESS + 0x80)
+#define UPDATE_STATS_MAGIC      ((uint32_t)0x54535055)  /* "UPST" */
+#define UPDATE_STATS_LAYOUT     ((uint8_t)1)            /* +1 when fields are added */
+
+/* UPDATE_StatsTypeDef.format */
+#define UPDATE_FORMAT_RAW       ((uint8_t)0)
+#define UPDATE_FORMAT_LZSS      ((uint8_t)1)
+#define UPDATE_FORMAT_DELTA     ((uint8_t)2)
+#define UPDATE_FORMAT_ENCRYPTED ((uint8_t)0x80)      /* flag: the file was AES-CTR encrypted */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;               /* UPDATE_STATS_MAGIC */
+  uint32_t build_id;            /* build ID of the installed image, 0 if the session failed */
+  uint32_t file_size;           /* size announced by the sender */
+  uint8_t  result;              /* COM_StatusTypeDef */
+  uint8_t  image_status;        /* IMAGE_StatusTypeDef */
+  uint8_t  format;              /* UPDATE_FORMAT_xxx, | UPDATE_FORMAT_ENCRYPTED */
+  uint8_t  layout;              /* UPDATE_STATS_LAYOUT */
+  uint16_t packets;             /* packets accepted, file header included */
+  uint16_t naks;                /* NAKs sent */
+  uint16_t crc_errors;          /* packets with a bad CRC16 or packet number */
+  uint16_t timeouts;            /* no packet within DOWNLOAD_TIMEOUT once started */
+  uint16_t overruns;            /* packets hit by an overrun (USART ORE, SPI OVR) */
+  uint16_t framing_errors;      /* packets hit by a framing error (USART FE, cut SPI frame) */
+  uint16_t noise_errors;        /* packets hit by noise (NE) */
+  uint16_t duplicates;          /* packets received again after a lost ACK */
+  uint32_t bytes_skipped;       /* line noise and damaged packets dropped */
+  uint32_t bytes_retransmitted; /* payload of the duplicates */
+  uint32_t handshake_time;
+  uint32_t erase_time;
+  uint32_t program_time;
+  uint32_t verify_time;
+  uint32_t transfer_time;
+  uint32_t total_time;
+  uint32_t reserved;            /* keeps the record a whole number of double words */
+  uint32_t check;               /* ~sum of the words above */
+} UPDATE_StatsTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#define UPDATE_STATS            ((const UPDATE_StatsTypeDef *)UPDATE_STATS_ADDRESS)
+
+/**
+  * @brief  Checksum over every word of the record except check itself
+  * @param  stats: record to sum
+  * @retval Value expected in stats->check
+  */
+__STATIC_INLINE uint32_t UpdateStats_Sum(const UPDATE_StatsTypeDef *stats)
+{
+  const uint32_t *p_word = (const uint32_t *)stats;
+  uint32_t sum = 0;
+  uint32_t i;
+
+  for (i = 0; i < (sizeof(UPDATE_StatsTypeDef) / 4) - 1; i++)
+  {
+    sum += p_word[i];
+  }
+  return ~sum;
+}
+
+/**
+  * @brief  Record of the last session in the config page
+  * @param  None
+  * @retval Record, NULL if there is none or it is damaged
+  */
+__STATIC_INLINE const UPDATE_StatsTypeDef *UpdateStats_Get(void)
+{
+  if ((UPDATE_STATS->magic != UPDATE_STATS_MAGIC) || (UPDATE_STATS->check != UpdateStats_Sum(UPDATE_STATS)))
+  {
+    return NULL;
+  }
+  return UPDATE_STATS;
+}
+
+/* Exported functions ------------------------------------------------------- */
+/* IAP side, update_stats.c in stm32g031g8_IAP */
+uint32_t UpdateStats_Save(UPDATE_StatsTypeDef *stats);
+
+#endif  /* __UPDATE_STATS_H */
@@ -59,6 +59,10 @@ void Error_Handler(void);
 /* Private defines -----------------------------------------------------------*/
 #define LED_Pin GPIO_PIN_0
 #define LED_GPIO_Port GPIOB
+#define SPI_READY_Pin GPIO_PIN_1
+#define SPI_READY_GPIO_Port GPIOB
+#define SPI_NSS_Pin GPIO_PIN_4
+#define SPI_NSS_GPIO_Port GPIOA
 
 /* USER CODE BEGIN Private defines */
 
@@ -29,16 +29,22 @@ extern "C" {
 #include "main.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "common.h"
 /* USER CODE END Includes */
 
 extern UART_HandleTypeDef huart1;
+#ifdef IAP_CHAIN_ENABLED
+extern UART_HandleTypeDef huart2;
+#endif /* IAP_CHAIN_ENABLED */
 
 /* USER CODE BEGIN Private defines */
 #define UartHandle huart1
 /* USER CODE END Private defines */
 
 void MX_USART1_UART_Init(void);
+#ifdef IAP_CHAIN_ENABLED
+void MX_USART2_UART_Init(void);
+#endif /* IAP_CHAIN_ENABLED */
 
 /* USER CODE BEGIN Prototypes */
 
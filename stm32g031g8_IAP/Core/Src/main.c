@@ -9,9 +9,13 @@
 #include "main.h"
 #include "iwdg.h"
 #include "usart.h"
+#include "spi.h"
 #include "gpio.h"
 #include "string.h"
 #include "menu.h"
+#include "handoff.h"
+#include "boot_trace.h"
+#include "spi_link.h"
 
 config_data_t Read_Config = {0};
 
@@ -26,17 +30,51 @@ void SystemClock_Config(void);
  */
 int main(void)
 {
+    uint32_t mailbox;
+
+    BOOT_PROFILE_START();
+    Handoff_Begin();
+    mailbox = Handoff_TakeMailbox();
+    BootTrace_Begin();
+
+    STMFLASH_Read(CONFIG_START_ADDRESS, (uint8_t *)&Read_Config, sizeof(Read_Config));
+    BootTrace_Event("CONF");
+
+    // 快速启动: 没有更新请求且选项字节已配置时, 直接在复位时钟(HSI16)下校验并跳转,
+    // 不初始化HAL、PLL和串口, 失败才进入下面的完整流程
+    if ((mailbox != MAILBOX_UPDATE)
+        && ((Read_Config.updata_flg != UPDATA) || (strcmp(Read_Config.device_name, DEVICE_NAME) != 0))
+        && ((FLASH->OPTR & FLASH_OPTR_nBOOT_SEL_Msk) == OB_BOOT0_FROM_PIN))
+    {
+        Application_Start();
+    }
+
     HAL_Init();
     SystemClock_Config();
+    Timebase_SetClock();
+    BootTrace_Event("CLK ");
 
     MX_GPIO_Init();
 
+#ifdef IAP_SPI_ENABLED
+    MX_SPI1_Init();
+    SpiLink_Init();
+#else
+    MX_USART1_UART_Init();
+#endif /* IAP_SPI_ENABLED */
+#ifdef IAP_CHAIN_ENABLED
     MX_USART2_UART_Init();
+#endif /* IAP_CHAIN_ENABLED */
 
     Flash_OB_Handle(); // 把nBOOT_sel的√拉低
     Serial_PutString((uint8_t *)"iap init ok\n");
 
-    STMFLASH_Read(CONFIG_START_ADDRESS, (uint8_t *)&Read_Config, sizeof(Read_Config));
+    // 0.APP通过RAM邮箱请求升级(软复位), 不检查配置页
+    if (mailbox == MAILBOX_UPDATE)
+    {
+        ReadyToUpdate();
+    }
+
     // 1.检查标志位
     if (Read_Config.updata_flg == UPDATA)
     {
@@ -53,7 +91,7 @@ int main(void)
                 Serial_PutString((uint8_t *)"hardware version err!\n");
             }
         }
-        else if (Read_Config.device_name != DEVICE_NAME)
+        else
         {
             //Serial_PutString((uint8_t*)"not this device!\n");
             goto Application;
@@ -67,6 +105,9 @@ int main(void)
 Application:
     JumpToApplication_Funtion();
 
+    /* No valid image to start: stay in the bootloader */
+    ReadyToUpdate();
+
     while (1)
     {
     }
@@ -0,0 +1,247 @@
+/**
+  ******************************************************************************
+  * @file    aes.c
+  * @brief   AES-128 encryption with a single T-table and the CTR mode on top
+  *          of it, see aes.h.
+  ******************************************************************************
+  * State and round keys are held as little-endian column words: byte r of a
+  * word is row r. aTe0[x] is the column S(x) contributes to when in row 0,
+  * {02}S, S, S, {03}S from row 0 to row 3; a byte in row r gives the same
+  * column rotated by r bytes. Byte 1 of aTe0[x] is S(x) itself, which serves
+  * the key schedule and the last round, so there is no separate S-box.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "aes.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Compiled to a single RORS */
+#define ROTL8(x)                (((x) << 8) | ((x) >> 24))
+#define ROTL16(x)               (((x) << 16) | ((x) >> 16))
+#define ROTL24(x)               (((x) << 24) | ((x) >> 8))
+#define SBOX(x)                 ((aTe0[(x)] >> 8) & 0xFFu)
+#define LOAD32(p)               ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+/* Private variables ---------------------------------------------------------*/
+static const uint32_t aTe0[256] =
+{
+  0xA56363C6, 0x847C7CF8, 0x997777EE, 0x8D7B7BF6, 0x0DF2F2FF, 0xBD6B6BD6, 0xB16F6FDE, 0x54C5C591,
+  0x50303060, 0x03010102, 0xA96767CE, 0x7D2B2B56, 0x19FEFEE7, 0x62D7D7B5, 0xE6ABAB4D, 0x9A7676EC,
+  0x45CACA8F, 0x9D82821F, 0x40C9C989, 0x877D7DFA, 0x15FAFAEF, 0xEB5959B2, 0xC947478E, 0x0BF0F0FB,
+  0xECADAD41, 0x67D4D4B3, 0xFDA2A25F, 0xEAAFAF45, 0xBF9C9C23, 0xF7A4A453, 0x967272E4, 0x5BC0C09B,
+  0xC2B7B775, 0x1CFDFDE1, 0xAE93933D, 0x6A26264C, 0x5A36366C, 0x413F3F7E, 0x02F7F7F5, 0x4FCCCC83,
+  0x5C343468, 0xF4A5A551, 0x34E5E5D1, 0x08F1F1F9, 0x937171E2, 0x73D8D8AB, 0x53313162, 0x3F15152A,
+  0x0C040408, 0x52C7C795, 0x65232346, 0x5EC3C39D, 0x28181830, 0xA1969637, 0x0F05050A, 0xB59A9A2F,
+  0x0907070E, 0x36121224, 0x9B80801B, 0x3DE2E2DF, 0x26EBEBCD, 0x6927274E, 0xCDB2B27F, 0x9F7575EA,
+  0x1B090912, 0x9E83831D, 0x742C2C58, 0x2E1A1A34, 0x2D1B1B36, 0xB26E6EDC, 0xEE5A5AB4, 0xFBA0A05B,
+  0xF65252A4, 0x4D3B3B76, 0x61D6D6B7, 0xCEB3B37D, 0x7B292952, 0x3EE3E3DD, 0x712F2F5E, 0x97848413,
+  0xF55353A6, 0x68D1D1B9, 0x00000000, 0x2CEDEDC1, 0x60202040, 0x1FFCFCE3, 0xC8B1B179, 0xED5B5BB6,
+  0xBE6A6AD4, 0x46CBCB8D, 0xD9BEBE67, 0x4B393972, 0xDE4A4A94, 0xD44C4C98, 0xE85858B0, 0x4ACFCF85,
+  0x6BD0D0BB, 0x2AEFEFC5, 0xE5AAAA4F, 0x16FBFBED, 0xC5434386, 0xD74D4D9A, 0x55333366, 0x94858511,
+  0xCF45458A, 0x10F9F9E9, 0x06020204, 0x817F7FFE, 0xF05050A0, 0x443C3C78, 0xBA9F9F25, 0xE3A8A84B,
+  0xF35151A2, 0xFEA3A35D, 0xC0404080, 0x8A8F8F05, 0xAD92923F, 0xBC9D9D21, 0x48383870, 0x04F5F5F1,
+  0xDFBCBC63, 0xC1B6B677, 0x75DADAAF, 0x63212142, 0x30101020, 0x1AFFFFE5, 0x0EF3F3FD, 0x6DD2D2BF,
+  0x4CCDCD81, 0x140C0C18, 0x35131326, 0x2FECECC3, 0xE15F5FBE, 0xA2979735, 0xCC444488, 0x3917172E,
+  0x57C4C493, 0xF2A7A755, 0x827E7EFC, 0x473D3D7A, 0xAC6464C8, 0xE75D5DBA, 0x2B191932, 0x957373E6,
+  0xA06060C0, 0x98818119, 0xD14F4F9E, 0x7FDCDCA3, 0x66222244, 0x7E2A2A54, 0xAB90903B, 0x8388880B,
+  0xCA46468C, 0x29EEEEC7, 0xD3B8B86B, 0x3C141428, 0x79DEDEA7, 0xE25E5EBC, 0x1D0B0B16, 0x76DBDBAD,
+  0x3BE0E0DB, 0x56323264, 0x4E3A3A74, 0x1E0A0A14, 0xDB494992, 0x0A06060C, 0x6C242448, 0xE45C5CB8,
+  0x5DC2C29F, 0x6ED3D3BD, 0xEFACAC43, 0xA66262C4, 0xA8919139, 0xA4959531, 0x37E4E4D3, 0x8B7979F2,
+  0x32E7E7D5, 0x43C8C88B, 0x5937376E, 0xB76D6DDA, 0x8C8D8D01, 0x64D5D5B1, 0xD24E4E9C, 0xE0A9A949,
+  0xB46C6CD8, 0xFA5656AC, 0x07F4F4F3, 0x25EAEACF, 0xAF6565CA, 0x8E7A7AF4, 0xE9AEAE47, 0x18080810,
+  0xD5BABA6F, 0x887878F0, 0x6F25254A, 0x722E2E5C, 0x241C1C38, 0xF1A6A657, 0xC7B4B473, 0x51C6C697,
+  0x23E8E8CB, 0x7CDDDDA1, 0x9C7474E8, 0x211F1F3E, 0xDD4B4B96, 0xDCBDBD61, 0x868B8B0D, 0x858A8A0F,
+  0x907070E0, 0x423E3E7C, 0xC4B5B571, 0xAA6666CC, 0xD8484890, 0x05030306, 0x01F6F6F7, 0x120E0E1C,
+  0xA36161C2, 0x5F35356A, 0xF95757AE, 0xD0B9B969, 0x91868617, 0x58C1C199, 0x271D1D3A, 0xB99E9E27,
+  0x38E1E1D9, 0x13F8F8EB, 0xB398982B, 0x33111122, 0xBB6969D2, 0x70D9D9A9, 0x898E8E07, 0xA7949433,
+  0xB69B9B2D, 0x221E1E3C, 0x92878715, 0x20E9E9C9, 0x49CECE87, 0xFF5555AA, 0x78282850, 0x7ADFDFA5,
+  0x8F8C8C03, 0xF8A1A159, 0x80898909, 0x170D0D1A, 0xDABFBF65, 0x31E6E6D7, 0xC6424284, 0xB86868D0,
+  0xC3414182, 0xB0999929, 0x772D2D5A, 0x110F0F1E, 0xCBB0B07B, 0xFC5454A8, 0xD6BBBB6D, 0x3A16162C
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Expand the cipher key into the round keys (FIPS-197 5.2)
+  * @param  p_round_key: 4 * (AES_ROUNDS + 1) words
+  * @param  p_key: AES_KEY_SIZE bytes
+  * @retval None
+  */
+static void KeyExpansion(uint32_t *p_round_key, const uint8_t *p_key)
+{
+  uint32_t rcon = 0x01;
+  uint32_t temp;
+  uint32_t i;
+
+  for (i = 0; i < 4; i++)
+  {
+    p_round_key[i] = LOAD32(&p_key[4 * i]);
+  }
+  for (i = 4; i < 4 * (AES_ROUNDS + 1); i++)
+  {
+    temp = p_round_key[i - 1];
+    if ((i & 3) == 0)
+    {
+      /* SubWord(RotWord(temp)) ^ Rcon */
+      temp = SBOX((temp >> 8) & 0xFF) | (SBOX((temp >> 16) & 0xFF) << 8)
+             | (SBOX(temp >> 24) << 16) | (SBOX(temp & 0xFF) << 24);
+      temp ^= rcon;
+      rcon = (rcon & 0x80) ? ((rcon << 1) ^ 0x11B) : (rcon << 1);
+    }
+    p_round_key[i] = p_round_key[i - 4] ^ temp;
+  }
+}
+
+/**
+  * @brief  Encrypt one block
+  * @param  p_round_key: expanded key
+  * @param  p_in: 4 column words
+  * @param  p_out: 4 column words, may be p_in
+  * @retval None
+  */
+static void EncryptBlock(const uint32_t *p_round_key, const uint32_t *p_in, uint32_t *p_out)
+{
+  uint32_t s0, s1, s2, s3;
+  uint32_t t0, t1, t2, t3;
+  uint32_t round;
+
+  s0 = p_in[0] ^ p_round_key[0];
+  s1 = p_in[1] ^ p_round_key[1];
+  s2 = p_in[2] ^ p_round_key[2];
+  s3 = p_in[3] ^ p_round_key[3];
+
+  /* SubBytes, ShiftRows, MixColumns and AddRoundKey in one pass: row r of
+     column c comes from column c + r */
+  for (round = 1; round < AES_ROUNDS; round++)
+  {
+    p_round_key += 4;
+    t0 = aTe0[s0 & 0xFF] ^ ROTL8(aTe0[(s1 >> 8) & 0xFF]) ^ ROTL16(aTe0[(s2 >> 16) & 0xFF])
+         ^ ROTL24(aTe0[s3 >> 24]) ^ p_round_key[0];
+    t1 = aTe0[s1 & 0xFF] ^ ROTL8(aTe0[(s2 >> 8) & 0xFF]) ^ ROTL16(aTe0[(s3 >> 16) & 0xFF])
+         ^ ROTL24(aTe0[s0 >> 24]) ^ p_round_key[1];
+    t2 = aTe0[s2 & 0xFF] ^ ROTL8(aTe0[(s3 >> 8) & 0xFF]) ^ ROTL16(aTe0[(s0 >> 16) & 0xFF])
+         ^ ROTL24(aTe0[s1 >> 24]) ^ p_round_key[2];
+    t3 = aTe0[s3 & 0xFF] ^ ROTL8(aTe0[(s0 >> 8) & 0xFF]) ^ ROTL16(aTe0[(s1 >> 16) & 0xFF])
+         ^ ROTL24(aTe0[s2 >> 24]) ^ p_round_key[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+
+  /* Last round, no MixColumns */
+  p_round_key += 4;
+  p_out[0] = (SBOX(s0 & 0xFF) | (SBOX((s1 >> 8) & 0xFF) << 8) | (SBOX((s2 >> 16) & 0xFF) << 16)
+              | (SBOX(s3 >> 24) << 24)) ^ p_round_key[0];
+  p_out[1] = (SBOX(s1 & 0xFF) | (SBOX((s2 >> 8) & 0xFF) << 8) | (SBOX((s3 >> 16) & 0xFF) << 16)
+              | (SBOX(s0 >> 24) << 24)) ^ p_round_key[1];
+  p_out[2] = (SBOX(s2 & 0xFF) | (SBOX((s3 >> 8) & 0xFF) << 8) | (SBOX((s0 >> 16) & 0xFF) << 16)
+              | (SBOX(s1 >> 24) << 24)) ^ p_round_key[2];
+  p_out[3] = (SBOX(s3 & 0xFF) | (SBOX((s0 >> 8) & 0xFF) << 8) | (SBOX((s1 >> 16) & 0xFF) << 16)
+              | (SBOX(s2 >> 24) << 24)) ^ p_round_key[3];
+}
+
+/**
+  * @brief  Compute the next key stream block
+  * @param  ctx: CTR instance
+  * @retval None
+  */
+static void NextBlock(AES_CtrTypeDef *ctx)
+{
+  uint32_t counter[4];
+
+  counter[0] = ctx->nonce[0];
+  counter[1] = ctx->nonce[1];
+  counter[2] = ctx->nonce[2];
+  counter[3] = __REV(ctx->block);
+  EncryptBlock(ctx->round_key, counter, ctx->stream);
+  ctx->block++;
+  ctx->used = 0;
+}
+
+/* Public functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check whether a first data block carries the encryption header
+  * @param  p_data: start of the file
+  * @param  length: number of bytes available
+  * @retval 1 if encrypted, 0 otherwise
+  */
+uint32_t AES_IsEncrypted(const uint8_t *p_data, uint32_t length)
+{
+  if (length < AES_IMAGE_HEADER_SIZE)
+  {
+    return 0;
+  }
+  return (LOAD32(p_data) == AES_IMAGE_MAGIC) ? 1 : 0;
+}
+
+/**
+  * @brief  Start decrypting a file
+  * @param  ctx: CTR instance
+  * @param  p_key: AES_KEY_SIZE bytes
+  * @param  p_header: the AES_IMAGE_HEADER_SIZE header bytes
+  * @retval None
+  */
+void AES_CTR_Init(AES_CtrTypeDef *ctx, const uint8_t *p_key, const uint8_t *p_header)
+{
+  uint32_t i;
+
+  KeyExpansion(ctx->round_key, p_key);
+  for (i = 0; i < AES_NONCE_SIZE / 4; i++)
+  {
+    ctx->nonce[i] = LOAD32(&p_header[4 + 4 * i]);
+  }
+  ctx->block = 0;
+  ctx->used = AES_BLOCK_SIZE;
+}
+
+/**
+  * @brief  Encrypt or decrypt the next bytes of the file, in place
+  * @note   Chunks may have any length; whole blocks of a word aligned
+  *         buffer, as the packet payload, are XORed a word at a time.
+  * @param  ctx: CTR instance
+  * @param  p_data: bytes following the ones of the previous call
+  * @param  length: number of bytes
+  * @retval None
+  */
+void AES_CTR_Crypt(AES_CtrTypeDef *ctx, uint8_t *p_data, uint32_t length)
+{
+  uint32_t *p_word;
+
+  /* What is left of the key stream block of the previous call */
+  while ((length > 0) && (ctx->used < AES_BLOCK_SIZE))
+  {
+    *p_data++ ^= ((const uint8_t *)ctx->stream)[ctx->used++];
+    length--;
+  }
+
+  if (((uint32_t)p_data & 3) == 0)
+  {
+    p_word = (uint32_t *)p_data;
+    while (length >= AES_BLOCK_SIZE)
+    {
+      NextBlock(ctx);
+      p_word[0] ^= ctx->stream[0];
+      p_word[1] ^= ctx->stream[1];
+      p_word[2] ^= ctx->stream[2];
+      p_word[3] ^= ctx->stream[3];
+      ctx->used = AES_BLOCK_SIZE;
+      p_word += 4;
+      length -= AES_BLOCK_SIZE;
+    }
+    p_data = (uint8_t *)p_word;
+  }
+
+  while (length > 0)
+  {
+    if (ctx->used == AES_BLOCK_SIZE)
+    {
+      NextBlock(ctx);
+    }
+    *p_data++ ^= ((const uint8_t *)ctx->stream)[ctx->used++];
+    length--;
+  }
+}
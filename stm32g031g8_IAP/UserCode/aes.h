@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file    aes.h
+  * @brief   AES-128-CTR decryption of encrypted application images.
+  ******************************************************************************
+  * Encrypted file layout (tools/aes_ctr.py, tools/fw_package.py --key):
+  *
+  *   | "AES1" | nonce (12) | ciphertext ... |
+  *
+  * The ciphertext is the file that would otherwise be sent (raw, LZSS or
+  * patch) XORed with the key stream AES-128(key, nonce | n), n the block
+  * number as a 32-bit big-endian counter from 0 (NIST SP 800-38A CTR). It
+  * is decrypted in place in the packet buffer, packet by packet, before the
+  * format is recognised and the bytes go to flash. CTR gives secrecy only:
+  * the image is still accepted on its header and CRC32, which do not
+  * authenticate it. The key is in the IAP flash (IAP_AES_KEY, common.h) and
+  * is only out of reach of the debug port with read protection level 1.
+  *
+  * The G031 has no AES peripheral. The cipher uses one 1 KB T-table in flash
+  * (SubBytes and MixColumns of a byte, the three other columns by rotation)
+  * and keeps 176 bytes of round keys in RAM. A bitsliced AES would be
+  * constant time, but its S-box needs far more than the 8 low registers
+  * Thumb-1 works with and spills on every gate; the G0 has no data cache,
+  * so the table index does not leak through cache timing either.
+  *
+  * The T-table was chosen on that argument; no bitsliced version was
+  * written. On the host (sim/cpu_bench) AES_CTR_Crypt costs 1.1 times
+  * Cal_CRC32 per byte and a byte oriented AES with a 256-byte S-box 6.5
+  * times. The cost on the M0+ has not been measured: 115 cycles per byte
+  * at 64 MHz with 2 flash wait states (about 10 cycles per table lookup,
+  * 1.8k per block) is estimated from the instruction count, and it is the
+  * figure ymodem_bench --aes-cycles charges. One byte on the line takes
+  * 694 cycles at 921600 baud. The PROFILE_AES probe measures it on target.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AES_H
+#define __AES_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define AES_IMAGE_MAGIC         ((uint32_t)0x31534541)  /* "AES1" */
+#define AES_IMAGE_HEADER_SIZE   ((uint32_t)16)
+#define AES_NONCE_SIZE          ((uint32_t)12)
+#define AES_KEY_SIZE            ((uint32_t)16)
+#define AES_BLOCK_SIZE          ((uint32_t)16)
+#define AES_ROUNDS              ((uint32_t)10)
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t round_key[4 * (AES_ROUNDS + 1)];
+  uint32_t nonce[AES_NONCE_SIZE / 4];   /* first 12 bytes of the counter block */
+  uint32_t block;                       /* number of the next key stream block */
+  uint32_t stream[AES_BLOCK_SIZE / 4];  /* key stream of block - 1 */
+  uint32_t used;                        /* bytes of stream already used */
+} AES_CtrTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t AES_IsEncrypted(const uint8_t *p_data, uint32_t length);
+void AES_CTR_Init(AES_CtrTypeDef *ctx, const uint8_t *p_key, const uint8_t *p_header);
+void AES_CTR_Crypt(AES_CtrTypeDef *ctx, uint8_t *p_data, uint32_t length);
+
+#endif  /* __AES_H */
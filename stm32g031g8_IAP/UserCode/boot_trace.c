@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file    boot_trace.c
+  * @brief   Timestamped boot events shared by the IAP and the APP.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "boot_trace.h"
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start the timebase and an empty trace
+  * @note   Called by the IAP on every reset, the APP only appends.
+  * @param  None
+  * @retval None
+  */
+void BootTrace_Begin(void)
+{
+  BOOT_TraceTypeDef *trace = BOOT_TRACE;
+
+  Timebase_Init();
+  trace->count = 0;
+  trace->dropped = 0;
+  trace->magic = BOOT_TRACE_MAGIC;
+  BootTrace_Event("RSET");
+}
+
+/**
+  * @brief  Append an event
+  * @param  p_name: 4 character event name
+  * @retval None
+  */
+void BootTrace_Event(const char *p_name)
+{
+  BOOT_TraceTypeDef *trace = BOOT_TRACE;
+  BOOT_TraceEventTypeDef *event;
+
+  if (trace->magic != BOOT_TRACE_MAGIC)
+  {
+    return;
+  }
+  if (trace->count >= BOOT_TRACE_EVENTS)
+  {
+    trace->dropped++;
+    return;
+  }
+
+  event = &trace->event[trace->count];
+  event->time = Timebase_Now();
+  event->name[0] = p_name[0];
+  event->name[1] = p_name[1];
+  event->name[2] = p_name[2];
+  event->name[3] = p_name[3];
+  trace->count++;
+}
@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file    boot_trace.h
+  * @brief   Timestamped boot events shared by the IAP and the APP.
+  ******************************************************************************
+  * The buffer sits in no-init RAM right after the handoff block:
+  *
+  *   NOINIT_RAM_ADDRESS + 0x40   BOOT_TraceTypeDef (136 bytes)
+  *
+  * The IAP restarts it on every reset, then both stages append events named
+  * by 4 characters with a Timebase_Now() stamp. Time 0 is the IAP main()
+  * entry; the startup code before it is not covered.
+  *
+  * This file is shared by both projects, keep the two copies identical.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BOOT_TRACE_H
+#define __BOOT_TRACE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "handoff.h"
+#include "timebase.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define BOOT_TRACE_ADDRESS      (NOINIT_RAM_ADDRESS + 0x40)
+#define BOOT_TRACE_MAGIC        ((uint32_t)0x43525442)  /* "BTRC" */
+#define BOOT_TRACE_EVENTS       16
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t time;            /* Timebase_Now(), us */
+  char name[4];             /* not terminated */
+} BOOT_TraceEventTypeDef;
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t count;
+  uint16_t dropped;         /* events lost once the buffer was full */
+  BOOT_TraceEventTypeDef event[BOOT_TRACE_EVENTS];
+} BOOT_TraceTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#define BOOT_TRACE              ((BOOT_TraceTypeDef *)BOOT_TRACE_ADDRESS)
+
+/* Exported functions ------------------------------------------------------- */
+void BootTrace_Begin(void);
+void BootTrace_Event(const char *p_name);
+
+#endif  /* __BOOT_TRACE_H */
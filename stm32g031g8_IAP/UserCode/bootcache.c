@@ -0,0 +1,185 @@
+/**
+  ******************************************************************************
+  * @file    bootcache.c
+  * @brief   Cached result of the application image verification.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootcache.h"
+#include "common.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BOOT_CONFIG_SIZE        (BOOT_RECORD_ADDRESS - CONFIG_START_ADDRESS)
+#define BOOT_SLOT_END           (BOOT_SLOT_ADDRESS + IAP_VERIFY_PERIOD * BOOT_SLOT_SIZE)
+
+#if (IAP_VERIFY_PERIOD > (0x800 - 0x110) / 8)
+#error "IAP_VERIFY_PERIOD does not fit in the config page"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t aConfigCopy[BOOT_CONFIG_SIZE / 4];
+static const uint32_t aSlotUsed[BOOT_SLOT_SIZE / 4] = {0, 0};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t IsErased(uint32_t address, uint32_t end);
+static uint32_t FindFreeSlot(void);
+static uint32_t RewriteConfigPage(void);
+static void WriteRecord(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check that a double word aligned flash area is erased
+  * @param  address: start of the area
+  * @param  end: first address after the area
+  * @retval 1 if every byte reads 0xFF, 0 otherwise
+  */
+static uint32_t IsErased(uint32_t address, uint32_t end)
+{
+  for (; address < end; address += 4)
+  {
+    if (*(__IO uint32_t *)address != 0xFFFFFFFF)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  Find the first unused boot slot
+  * @note   Slots are programmed in order, so a binary search is enough
+  * @param  None
+  * @retval Slot index, IAP_VERIFY_PERIOD when all slots are used
+  */
+static uint32_t FindFreeSlot(void)
+{
+  uint32_t low = 0, high = IAP_VERIFY_PERIOD, mid, address;
+
+  while (low < high)
+  {
+    mid = (low + high) / 2;
+    address = BOOT_SLOT_ADDRESS + mid * BOOT_SLOT_SIZE;
+    if (IsErased(address, address + BOOT_SLOT_SIZE))
+    {
+      high = mid;
+    }
+    else
+    {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
+
+/**
+  * @brief  Erase the config page, keeping the config data and the update
+  *         statistics in front of the record
+  * @note   Erased double words are left alone: programming 0xFF over them would
+  *         set their ECC and make them unusable until the next erase.
+  * @param  None
+  * @retval FLASHIF_OK if the page is ready for a new record
+  */
+static uint32_t RewriteConfigPage(void)
+{
+  uint32_t i;
+  uint32_t status;
+
+  for (i = 0; i < BOOT_CONFIG_SIZE / 4; i++)
+  {
+    aConfigCopy[i] = *(__IO uint32_t *)(CONFIG_START_ADDRESS + i * 4);
+  }
+
+  status = FLASH_ErasePage(CONFIG_START_ADDRESS);
+  for (i = 0; (status == FLASHIF_OK) && (i < BOOT_CONFIG_SIZE / 4); i += 2)
+  {
+    if ((aConfigCopy[i] & aConfigCopy[i + 1]) != 0xFFFFFFFF)
+    {
+      status = FLASH_If_Write(CONFIG_START_ADDRESS + i * 4, &aConfigCopy[i], 2);
+    }
+  }
+  return status;
+}
+
+/**
+  * @brief  Record the installed image as verified
+  * @param  None
+  * @retval None
+  */
+static void WriteRecord(void)
+{
+  const IMAGE_HeaderTypeDef *header = IMAGE_HEADER(APPLICATION_ADDRESS);
+  BOOT_RecordTypeDef record;
+
+  record.magic = BOOT_RECORD_MAGIC;
+  record.build_id = header->build_id;
+  record.length = header->length;
+  record.crc = Image_GetCRC(APPLICATION_ADDRESS);
+
+  if (!IsErased(BOOT_RECORD_ADDRESS, BOOT_SLOT_END) && (RewriteConfigPage() != FLASHIF_OK))
+  {
+    return;
+  }
+  /* A failed write only costs a full verification on the next boot */
+  FLASH_If_Write(BOOT_RECORD_ADDRESS, (uint32_t *)&record, sizeof(record) / 4);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Verify the application image, trusting a previous result if possible
+  * @note   The cached path costs a header check, a trailer read and one double
+  *         word program, against CRC32 over up to APPLICATION_MAX_SIZE bytes.
+  * @param  None
+  * @retval IMAGE_OK if the application may be started
+  */
+IMAGE_StatusTypeDef BootCache_Verify(void)
+{
+  const IMAGE_HeaderTypeDef *header = IMAGE_HEADER(APPLICATION_ADDRESS);
+  const BOOT_RecordTypeDef *record = (const BOOT_RecordTypeDef *)BOOT_RECORD_ADDRESS;
+  IMAGE_StatusTypeDef status;
+  uint32_t slot;
+
+  status = Image_CheckHeader(header, APPLICATION_MAX_SIZE);
+  if (status != IMAGE_OK)
+  {
+    return status;
+  }
+
+  if ((IAP_VERIFY_PERIOD > 0) && (record->magic == BOOT_RECORD_MAGIC)
+      && (record->build_id == header->build_id) && (record->length == header->length)
+      && (record->crc == Image_GetCRC(APPLICATION_ADDRESS)))
+  {
+    slot = FindFreeSlot();
+    if ((slot < IAP_VERIFY_PERIOD)
+        && (FLASH_If_Write(BOOT_SLOT_ADDRESS + slot * BOOT_SLOT_SIZE, (uint32_t *)aSlotUsed, 2) == FLASHIF_OK))
+    {
+      return IMAGE_OK;
+    }
+  }
+
+  status = Image_Verify(APPLICATION_ADDRESS, APPLICATION_MAX_SIZE);
+  if ((status == IMAGE_OK) && (IAP_VERIFY_PERIOD > 0))
+  {
+    WriteRecord();
+  }
+  return status;
+}
+
+/**
+  * @brief  Drop the record before the application area is erased, so that the
+  *         next boot verifies whatever ends up there
+  * @note   Costs one config page erase when there is a record, nothing
+  *         otherwise. The config data and update statistics are kept.
+  * @param  None
+  * @retval FLASHIF_OK if no record is left
+  */
+uint32_t BootCache_Invalidate(void)
+{
+  if (IsErased(BOOT_RECORD_ADDRESS, BOOT_SLOT_END))
+  {
+    return FLASHIF_OK;
+  }
+  return RewriteConfigPage();
+}
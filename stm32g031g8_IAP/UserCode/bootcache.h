@@ -0,0 +1,51 @@
+/**
+  ******************************************************************************
+  * @file    bootcache.h
+  * @brief   Cached result of the application image verification.
+  ******************************************************************************
+  * A full Image_Verify() runs CRC32 over the whole application on every boot.
+  * Once an image has passed, a record of it is kept in the config page:
+  *
+  *   CONFIG_START_ADDRESS + 0x000  config_data_t (IAP / APP settings)
+  *   UPDATE_STATS_ADDRESS          last update session, see update_stats.h
+  *   BOOT_RECORD_ADDRESS           | magic | build_id | length | crc |
+  *   BOOT_SLOT_ADDRESS             one double word per trusted boot
+  *
+  * A later boot only compares the record against the header and trailer of
+  * the installed image and programs the next boot slot. When the slots run out
+  * (IAP_VERIFY_PERIOD boots) the image is verified again and the page is
+  * rewritten. Every download (Ymodem or RS-485) and the delete entry of the
+  * menu call BootCache_Invalidate() before the first APP page is erased, so an
+  * image rewritten in part, even with the same build ID, header and trailer
+  * as the recorded one, is fully verified on the next boot.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BOOTCACHE_H
+#define __BOOTCACHE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "flash.h"
+#include "image.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define BOOT_RECORD_MAGIC       ((uint32_t)0x4B4F5642)  /* "BVOK" */
+#define BOOT_RECORD_ADDRESS     (CONFIG_START_ADDRESS + 0x100)
+#define BOOT_SLOT_ADDRESS       (BOOT_RECORD_ADDRESS + sizeof(BOOT_RecordTypeDef))
+#define BOOT_SLOT_SIZE          ((uint32_t)8)
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  uint32_t build_id;      /* IMAGE_HeaderTypeDef.build_id of the verified image */
+  uint32_t length;        /* IMAGE_HeaderTypeDef.length */
+  uint32_t crc;           /* trailer CRC32 */
+} BOOT_RecordTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+IMAGE_StatusTypeDef BootCache_Verify(void);
+uint32_t BootCache_Invalidate(void);
+
+#endif  /* __BOOTCACHE_H */
@@ -0,0 +1,194 @@
+/**
+  ******************************************************************************
+  * @file    chain.c
+  * @brief   Cut-through forwarding to the next board of a chain and merge of
+  *          its answers with the board's own ones, see chain.h.
+  ******************************************************************************
+  * USART2 receives with a circular DMA: the next board answers while this
+  * one is still erasing or programming, with the CPU stalled on the flash.
+  * Nothing is interrupt driven, the buffer is read by Chain_Answer.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "chain.h"
+#include "common.h"
+#include "ymodem.h"
+#include "usart.h"
+
+#ifdef IAP_CHAIN_ENABLED
+
+/* Private define ------------------------------------------------------------*/
+#define CHAIN_RX_SIZE           ((uint16_t)128)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t aChainRx[CHAIN_RX_SIZE];
+static uint16_t ChainRxTail;
+/* Something was received from the next board since Chain_Init */
+static uint8_t NextBoard;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t RxHead(void);
+static void SkipAnswers(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Position the DMA writes the next received byte to
+  * @param  None
+  * @retval Index in aChainRx
+  */
+static uint16_t RxHead(void)
+{
+  return (CHAIN_RX_SIZE - __HAL_DMA_GET_COUNTER(huart2.hdmarx)) % CHAIN_RX_SIZE;
+}
+
+/**
+  * @brief  Drop what the next board has sent so far: it was not the answer
+  *         to what is being forwarded now
+  * @param  None
+  * @retval None
+  */
+static void SkipAnswers(void)
+{
+  uint16_t head = RxHead();
+
+  if (head != ChainRxTail)
+  {
+    NextBoard = 1;
+    ChainRxTail = head;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start receiving from the next board, USART2 is initialized
+  * @param  None
+  * @retval None
+  */
+void Chain_Init(void)
+{
+  ChainRxTail = 0;
+  NextBoard = 0;
+  HAL_UART_Receive_DMA(&huart2, aChainRx, CHAIN_RX_SIZE);
+}
+
+/**
+  * @brief  Stop USART2 and its DMA before the application takes the RAM
+  * @note   Also called on the fast boot path, before anything is initialized
+  * @param  None
+  * @retval None
+  */
+void Chain_DeInit(void)
+{
+  if (huart2.gState != HAL_UART_STATE_RESET)
+  {
+    HAL_UART_DeInit(&huart2);
+  }
+}
+
+/**
+  * @brief  HAL_UART_Receive on USART1, every byte is written to USART2 as
+  *         soon as it is read
+  * @note   The transmitter has one byte time to empty TDR, the same time the
+  *         receiver takes for the next byte: both lines run at the same rate.
+  * @param  p_data: received bytes
+  * @param  size: number of bytes
+  * @param  timeout: for the whole call, in ms
+  * @retval HAL_OK, HAL_TIMEOUT or the HAL_UART_Receive error
+  */
+HAL_StatusTypeDef Chain_Receive(uint8_t *p_data, uint16_t size, uint32_t timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t elapsed;
+  HAL_StatusTypeDef status;
+
+  while (size-- > 0)
+  {
+    elapsed = HAL_GetTick() - tickstart;
+    if ((timeout != HAL_MAX_DELAY) && (elapsed >= timeout))
+    {
+      return HAL_TIMEOUT;
+    }
+    status = HAL_UART_Receive(&UartHandle, p_data, 1, (timeout == HAL_MAX_DELAY) ? HAL_MAX_DELAY : timeout - elapsed);
+    if (status != HAL_OK)
+    {
+      return status;
+    }
+    while (__HAL_UART_GET_FLAG(&huart2, UART_FLAG_TXE) == RESET)
+    {
+    }
+    huart2.Instance->TDR = *p_data++;
+  }
+  SkipAnswers();
+  return HAL_OK;
+}
+
+/**
+  * @brief  Pass a single byte on to the next board, e.g. a menu key
+  * @note   Returns once the byte has left: the key may start the application,
+  *         which sets USART2 up again
+  * @param  byte: byte to send
+  * @retval None
+  */
+void Chain_Forward(uint8_t byte)
+{
+  HAL_UART_Transmit(&huart2, &byte, 1, TX_TIMEOUT);
+  SkipAnswers();
+}
+
+/**
+  * @brief  Merge an answer to the sender with the next board's answer
+  * @note   A CA is passed on at once, the rest of the chain ends the session
+  *         as well. Console text of the next board is skipped.
+  * @param  answer: ACK, NAK, CA or CRC16 this board would send
+  * @retval Answer to send, CHAIN_NO_ANSWER for nothing
+  */
+uint8_t Chain_Answer(uint8_t answer)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint8_t next = CHAIN_NO_ANSWER;
+  uint8_t byte;
+
+  if (ChainRxTail != RxHead())
+  {
+    NextBoard = 1;
+  }
+  if (answer == CA)
+  {
+    Chain_Forward(CA);
+    return CA;
+  }
+  if (NextBoard == 0)
+  {
+    /* Last board of the chain */
+    return answer;
+  }
+
+  while ((next == CHAIN_NO_ANSWER) && ((HAL_GetTick() - tickstart) < CHAIN_ANSWER_TIMEOUT))
+  {
+    while ((next == CHAIN_NO_ANSWER) && (ChainRxTail != RxHead()))
+    {
+      byte = aChainRx[ChainRxTail];
+      ChainRxTail = (ChainRxTail + 1) % CHAIN_RX_SIZE;
+      if ((byte == ACK) || (byte == NAK) || (byte == CA) || (byte == CRC16))
+      {
+        next = byte;
+      }
+    }
+  }
+
+  if (next == CA)
+  {
+    return CA;
+  }
+  if (answer == CRC16)
+  {
+    /* Ask for a packet only once the whole chain waits for it */
+    return (next == CHAIN_NO_ANSWER) ? CHAIN_NO_ANSWER : CRC16;
+  }
+  return ((answer == ACK) && (next == ACK)) ? ACK : NAK;
+}
+
+#endif /* IAP_CHAIN_ENABLED */
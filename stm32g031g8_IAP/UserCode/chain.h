@@ -0,0 +1,51 @@
+/**
+  ******************************************************************************
+  * @file    chain.h
+  * @brief   Update of boards wired in a chain (IAP_CHAIN_ENABLED): USART1 to
+  *          the previous board or the host, USART2 to the next board.
+  ******************************************************************************
+  * Every byte received on USART1 by the menu and by Ymodem_Receive is passed
+  * on to USART2 as soon as it is read (cut-through), so all the boards
+  * receive and program the same packet at the same time. The answer sent
+  * back is the worst of the board's own answer and the next board's one:
+  *
+  *   own \ next   ACK    NAK    CA     'C'    none
+  *   ACK          ACK    NAK    CA     NAK    NAK
+  *   NAK          NAK    NAK    CA     NAK    NAK
+  *   CA           CA     CA     CA     CA     CA
+  *   'C'          'C'    'C'    CA     'C'    -
+  *
+  * A packet is then acknowledged to the host once the last board has it in
+  * flash, and the chain takes one transfer plus a few byte times per board.
+  * A board that has never heard anything on USART2 (every IAP prints its
+  * menu) is the last one and answers alone.
+  *
+  * Both USARTs run at the same baud rate. Entries 2 (upload) and 5 (profile
+  * dump) of the menu are not passed on, only the board next to the host
+  * answers them.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CHAIN_H
+#define __CHAIN_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Longest time the next board takes to answer a packet: page erase, LZSS
+   decoding, image CRC32 after EOT */
+#define CHAIN_ANSWER_TIMEOUT    ((uint32_t)500)
+
+/* Chain_Answer: nothing to send yet, the next board is not ready */
+#define CHAIN_NO_ANSWER         ((uint8_t)0x00)
+
+/* Exported functions ------------------------------------------------------- */
+void Chain_Init(void);
+void Chain_DeInit(void);
+HAL_StatusTypeDef Chain_Receive(uint8_t *p_data, uint16_t size, uint32_t timeout);
+void Chain_Forward(uint8_t byte);
+uint8_t Chain_Answer(uint8_t answer);
+
+#endif  /* __CHAIN_H */
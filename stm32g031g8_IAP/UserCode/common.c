@@ -23,12 +23,19 @@
 /* Includes ------------------------------------------------------------------*/
 #include "common.h"
 #include "main.h"
-#include "usart.h"
+#include "link.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+/* CRC32 (IEEE 802.3, reflected 0xEDB88320) nibble table */
+static const uint32_t aCRC32Nibble[16] =
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
@@ -142,13 +149,18 @@ uint32_t Str2Int(uint8_t *p_inputstr, uint32_t *p_intnum)
   */
 void Serial_PutString(uint8_t *p_string)
 {
+#ifdef IAP_RS485_ENABLED
+  /* Other devices share the line, only rs485.c answers */
+  (void)p_string;
+#else
   uint16_t length = 0;
 
   while (p_string[length] != '\0')
   {
     length++;
   }
-  HAL_UART_Transmit(&UartHandle, p_string, length, TX_TIMEOUT);
+  Link_Transmit(p_string, length, TX_TIMEOUT);
+#endif /* IAP_RS485_ENABLED */
 }
 
 /**
@@ -158,8 +170,30 @@ void Serial_PutString(uint8_t *p_string)
   */
 HAL_StatusTypeDef Serial_PutByte( uint8_t param )
 {
-  return HAL_UART_Transmit(&UartHandle, &param, 1, TX_TIMEOUT);
+  return Link_Transmit(&param, 1, TX_TIMEOUT);
 }
+/**
+  * @brief  Update a CRC32 (same result as zlib crc32) over a buffer
+  * @param  crc: previous value, 0 to start a new computation
+  * @param  p_data: input data
+  * @param  size: length of input data
+  * @retval Updated CRC32
+  */
+uint32_t Cal_CRC32(uint32_t crc, const uint8_t *p_data, uint32_t size)
+{
+  const uint8_t *p_data_end = p_data + size;
+
+  crc = ~crc;
+  while (p_data < p_data_end)
+  {
+    crc ^= *p_data++;
+    crc = (crc >> 4) ^ aCRC32Nibble[crc & 0x0F];
+    crc = (crc >> 4) ^ aCRC32Nibble[crc & 0x0F];
+  }
+
+  return ~crc;
+}
+
 /**
   * @}
   */
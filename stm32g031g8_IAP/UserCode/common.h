@@ -38,11 +38,53 @@ typedef struct config_data_s
 	uint8_t HW_vision;	     //硬件版本
 	uint8_t FW_vision;		//软件版本
 	uint8_t updata_flg;        //更新标志
+	uint8_t crc_cal;           //APP写入的crc8, IAP不检查
+	uint8_t bus_address;       //RS-485地址, 0xFF未分配
 }__attribute__((packed)) config_data_t;
 extern config_data_t Read_Config;
 extern config_data_t Write_Config;
 
 /* Exported constants --------------------------------------------------------*/
+/* Optional image formats accepted by Ymodem_Receive */
+#define IAP_LZSS_ENABLED            /* LZSS compressed images, see lzss.h */
+#define IAP_DELTA_ENABLED           /* patches against the installed image, see delta.h */
+
+/* AES-128-CTR encrypted files of any of the formats above, see aes.h. Plain
+   files are still accepted. The key is an example (SP 800-38A): set the one
+   of the product, the same as tools/fw_package.py --key. */
+/* #define IAP_AES_ENABLED */
+#define IAP_AES_KEY                 {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, \
+                                     0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C}
+
+/* SHA-256 of the installed image, computed from the bytes programmed as the
+   packets arrive and stored after the image, see sha256.h and image.h.
+   Printed at the end of the download, reported by the APP status. */
+/* #define IAP_SHA256_ENABLED */
+
+/* Update over a shared RS-485 bus instead of the console menu, see rs485.h.
+   USART1 drives the transceiver DE pin (PB3) and the console stays silent. */
+/* #define IAP_RS485_ENABLED */
+
+/* Boards wired in a chain, USART2 (PA2/PA3) to the next board: the menu and
+   the Ymodem download are passed on as they arrive, see chain.h */
+/* #define IAP_CHAIN_ENABLED */
+
+/* Menu and Ymodem over SPI1 in slave mode with a READY line (PB1) instead of
+   USART1, for hosts with an SPI master, see spi_link.h */
+/* #define IAP_SPI_ENABLED */
+
+/* Boots trusted on the cached verification result before the application is
+   CRC checked again, see bootcache.h. 0 verifies on every boot. */
+#define IAP_VERIFY_PERIOD           32
+
+/* Drive the LED pin high from reset until the jump to the application, to
+   measure reset-to-app time on a scope (NRST vs LED) */
+/* #define IAP_BOOT_PROFILE */
+
+/* Enter/exit probes on the download hot paths, sent by menu entry 5, see
+   profile.h. Shared with the APP, which has its own switch. */
+/* #define PROFILE_ENABLED */
+
 /* Constants used by Serial Command Line Mode */
 #define TX_TIMEOUT          ((uint32_t)100)
 #define RX_TIMEOUT          HAL_MAX_DELAY
@@ -58,10 +100,23 @@ extern config_data_t Write_Config;
 #define CONVERTHEX_ALPHA(c) (IS_CAP_LETTER(c) ? ((c) - 'A'+10) : ((c) - 'a'+10))
 #define CONVERTHEX(c)       (IS_09(c) ? ((c) - '0') : CONVERTHEX_ALPHA(c))
 
+/* Register level so they can run before HAL_Init, LED_Pin is PB0 */
+#ifdef IAP_BOOT_PROFILE
+#define BOOT_PROFILE_START()  do { __HAL_RCC_GPIOB_CLK_ENABLE(); \
+                                   LED_GPIO_Port->BSRR = LED_Pin; \
+                                   LED_GPIO_Port->MODER = (LED_GPIO_Port->MODER & ~GPIO_MODER_MODE0) | GPIO_MODER_MODE0_0; \
+                                 } while (0)
+#define BOOT_PROFILE_STOP()   (LED_GPIO_Port->BRR = LED_Pin)
+#else
+#define BOOT_PROFILE_START()
+#define BOOT_PROFILE_STOP()
+#endif
+
 /* Exported functions ------------------------------------------------------- */
 void Int2Str(uint8_t *p_str, uint32_t intnum);
 uint32_t Str2Int(uint8_t *inputstr, uint32_t *intnum);
 void Serial_PutString(uint8_t *p_string);
 HAL_StatusTypeDef Serial_PutByte(uint8_t param);
+uint32_t Cal_CRC32(uint32_t crc, const uint8_t *p_data, uint32_t size);
 
 #endif  /* __COMMON_H */
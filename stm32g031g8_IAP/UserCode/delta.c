@@ -0,0 +1,284 @@
+/**
+  ******************************************************************************
+  * @file    delta.c
+  * @brief   In-place application of binary patches against the installed
+  *          image. Input can be fed in chunks of any size, e.g. one Ymodem
+  *          packet at a time; RAM use is one flash page plus a few words.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "delta.h"
+#include "common.h"
+#include "string.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Command parsing states */
+#define DELTA_STATE_OP          ((uint8_t)0)
+#define DELTA_STATE_LENGTH      ((uint8_t)1)
+#define DELTA_STATE_SEEK        ((uint8_t)2)
+#define DELTA_STATE_INSERT      ((uint8_t)3)
+
+/* Private macro -------------------------------------------------------------*/
+#define GET_U32(p)              ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+/* Private variables ---------------------------------------------------------*/
+/* Old content of the page currently being rewritten */
+static uint8_t aOldPage[FLASH_PAGE_SIZE];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Save the old page before the first new byte lands in it
+  * @param  dec: decoder instance
+  * @retval None
+  */
+static void SyncPage(DELTA_DecoderTypeDef *dec)
+{
+  uint32_t pos = FLASH_STREAM_SIZE(dec->out);
+
+  if (((pos % FLASH_PAGE_SIZE) == 0) && (!dec->page_valid || (dec->page_offset != pos)))
+  {
+    memcpy(aOldPage, (const uint8_t *)(dec->out->base + pos), FLASH_PAGE_SIZE);
+    dec->page_offset = pos;
+    dec->page_valid = 1;
+  }
+}
+
+/**
+  * @brief  Emit one byte of the new image
+  * @param  dec: decoder instance
+  * @param  byte: value to write
+  * @retval DELTA_OK, DELTA_DONE on the last byte, DELTA_ERROR otherwise
+  */
+static DELTA_StatusTypeDef PutByte(DELTA_DecoderTypeDef *dec, uint8_t byte)
+{
+  if (FLASH_STREAM_SIZE(dec->out) >= dec->new_size)
+  {
+    return DELTA_ERROR;
+  }
+  if (FLASH_Stream_Write(dec->out, &byte, 1) != FLASHIF_OK)
+  {
+    return DELTA_ERROR;
+  }
+  return (FLASH_STREAM_SIZE(dec->out) == dec->new_size) ? DELTA_DONE : DELTA_OK;
+}
+
+/**
+  * @brief  Copy the current command from the old image
+  * @param  dec: decoder instance
+  * @retval DELTA_OK, DELTA_DONE or DELTA_ERROR
+  */
+static DELTA_StatusTypeDef CopyOld(DELTA_DecoderTypeDef *dec)
+{
+  DELTA_StatusTypeDef status = DELTA_OK;
+  uint32_t offset;
+  uint8_t byte;
+
+  while ((dec->length > 0) && (status == DELTA_OK))
+  {
+    SyncPage(dec);
+    offset = dec->cursor;
+
+    if ((offset >= dec->old_size) || (offset < dec->page_offset))
+    {
+      /* Outside the old image, or already overwritten */
+      return DELTA_ERROR;
+    }
+    if (offset < dec->page_offset + FLASH_PAGE_SIZE)
+    {
+      byte = aOldPage[offset - dec->page_offset];
+    }
+    else
+    {
+      byte = *(__IO uint8_t *)(dec->out->base + offset);
+    }
+
+    status = PutByte(dec, byte);
+    dec->cursor++;
+    dec->length--;
+  }
+
+  if ((status == DELTA_DONE) && (dec->length > 0))
+  {
+    status = DELTA_ERROR;
+  }
+  return status;
+}
+
+/* Public functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check whether a first data block carries a patch header
+  * @param  p_data: start of the file
+  * @param  length: number of bytes available
+  * @retval 1 if it is a patch, 0 otherwise
+  */
+uint32_t DELTA_IsPatch(const uint8_t *p_data, uint32_t length)
+{
+  if (length < DELTA_HEADER_SIZE)
+  {
+    return 0;
+  }
+  return (GET_U32(p_data) == DELTA_MAGIC) ? 1 : 0;
+}
+
+/**
+  * @brief  Start applying a patch, after checking it matches the installed image
+  * @note   Nothing is erased here: a patch for another base is rejected while
+  *         the installed image is still intact.
+  * @param  dec: decoder instance
+  * @param  out: flash writer positioned on the installed image
+  * @param  p_header: the DELTA_HEADER_SIZE header bytes
+  * @param  max_size: room available at the destination
+  * @retval DELTA_OK, or DELTA_ERROR if the patch cannot be applied
+  */
+DELTA_StatusTypeDef DELTA_Init(DELTA_DecoderTypeDef *dec, FLASH_StreamTypeDef *out,
+                               const uint8_t *p_header, uint32_t max_size)
+{
+  uint32_t old_crc;
+
+  dec->out = out;
+  dec->old_size = GET_U32(&p_header[4]);
+  old_crc = GET_U32(&p_header[8]);
+  dec->new_size = GET_U32(&p_header[12]);
+  dec->new_crc = GET_U32(&p_header[16]);
+  dec->cursor = 0;
+  dec->length = 0;
+  dec->value = 0;
+  dec->shift = 0;
+  dec->op = 0;
+  dec->state = DELTA_STATE_OP;
+  dec->page_valid = 0;
+  dec->page_offset = 0;
+
+  if ((dec->old_size > max_size) || (dec->new_size == 0) || (dec->new_size > max_size))
+  {
+    return DELTA_ERROR;
+  }
+  if (Cal_CRC32(0, (const uint8_t *)out->base, dec->old_size) != old_crc)
+  {
+    /* Patch built against another image */
+    return DELTA_ERROR;
+  }
+  return DELTA_OK;
+}
+
+/**
+  * @brief  Apply a chunk of patch commands
+  * @param  dec: decoder instance
+  * @param  p_data: patch bytes, header excluded
+  * @param  length: number of bytes
+  * @retval DELTA_OK when more input is needed, DELTA_DONE once the new image
+  *         is complete, DELTA_ERROR on corrupted input or write failure
+  */
+DELTA_StatusTypeDef DELTA_Decode(DELTA_DecoderTypeDef *dec, const uint8_t *p_data, uint32_t length)
+{
+  DELTA_StatusTypeDef status = DELTA_OK;
+  uint8_t byte;
+
+  if (FLASH_STREAM_SIZE(dec->out) >= dec->new_size)
+  {
+    return DELTA_DONE;
+  }
+
+  while ((length > 0) && (status == DELTA_OK))
+  {
+    byte = *p_data++;
+    length--;
+
+    switch (dec->state)
+    {
+      case DELTA_STATE_OP:
+        if ((byte != DELTA_OP_COPY) && (byte != DELTA_OP_INSERT))
+        {
+          status = DELTA_ERROR;
+          break;
+        }
+        dec->op = byte;
+        dec->value = 0;
+        dec->shift = 0;
+        dec->state = DELTA_STATE_LENGTH;
+        break;
+
+      case DELTA_STATE_LENGTH:
+      case DELTA_STATE_SEEK:
+        if (dec->shift > 28)
+        {
+          status = DELTA_ERROR;
+          break;
+        }
+        dec->value |= (uint32_t)(byte & 0x7Fu) << dec->shift;
+        dec->shift += 7;
+        if (byte & 0x80u)
+        {
+          break;
+        }
+
+        if (dec->state == DELTA_STATE_LENGTH)
+        {
+          dec->length = dec->value;
+          dec->value = 0;
+          dec->shift = 0;
+          if (dec->length == 0)
+          {
+            status = DELTA_ERROR;
+          }
+          else
+          {
+            dec->state = (dec->op == DELTA_OP_COPY) ? DELTA_STATE_SEEK : DELTA_STATE_INSERT;
+          }
+        }
+        else
+        {
+          /* zigzag decoded seek, relative to the cursor */
+          dec->cursor += (dec->value >> 1) ^ (0u - (dec->value & 1u));
+          status = CopyOld(dec);
+          dec->state = DELTA_STATE_OP;
+        }
+        break;
+
+      case DELTA_STATE_INSERT:
+        SyncPage(dec);
+        status = PutByte(dec, byte);
+        dec->cursor++;
+        if (--dec->length == 0)
+        {
+          dec->state = DELTA_STATE_OP;
+        }
+        else if (status == DELTA_DONE)
+        {
+          status = DELTA_ERROR;
+        }
+        break;
+
+      default:
+        status = DELTA_ERROR;
+        break;
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Program the end of the new image and check its CRC32
+  * @param  dec: decoder instance
+  * @retval DELTA_DONE if the new image is complete and intact, DELTA_ERROR otherwise
+  */
+DELTA_StatusTypeDef DELTA_Finish(DELTA_DecoderTypeDef *dec)
+{
+  if (FLASH_STREAM_SIZE(dec->out) != dec->new_size)
+  {
+    return DELTA_ERROR;
+  }
+  if (FLASH_Stream_Flush(dec->out) != FLASHIF_OK)
+  {
+    return DELTA_ERROR;
+  }
+  if (Cal_CRC32(0, (const uint8_t *)dec->out->base, dec->new_size) != dec->new_crc)
+  {
+    return DELTA_ERROR;
+  }
+  return DELTA_DONE;
+}
@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file    delta.h
+  * @brief   In-place application of binary patches (tools/delta_diff.py)
+  *          against the image currently installed in the APP area.
+  ******************************************************************************
+  * Patch layout, all integers little-endian:
+  *
+  *   | "DLT1" | old size | old CRC32 | new size | new CRC32 | commands ... |
+  *
+  * Commands start with an opcode byte followed by an unsigned LEB128 length:
+  *   DELTA_OP_COPY   : zigzag LEB128 seek, then copy length bytes of the old
+  *                     image from (cursor + seek)
+  *   DELTA_OP_INSERT : length literal bytes follow
+  * The old image cursor advances with every output byte, so unchanged code
+  * that only moved costs a couple of bytes.
+  *
+  * The new image overwrites the old one page by page. The page being
+  * rewritten is saved in RAM first; the patch may therefore only read old
+  * bytes located at or after the start of the page currently produced.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DELTA_H
+#define __DELTA_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "flash.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define DELTA_MAGIC             ((uint32_t)0x31544C44)  /* "DLT1" */
+#define DELTA_HEADER_SIZE       ((uint32_t)20)
+
+#define DELTA_OP_COPY           ((uint8_t)0x01)
+#define DELTA_OP_INSERT         ((uint8_t)0x02)
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  DELTA_OK = 0,     /* more input expected */
+  DELTA_DONE,       /* new image complete, trailing input is ignored */
+  DELTA_ERROR       /* corrupted patch, wrong base image or flash failure */
+} DELTA_StatusTypeDef;
+
+typedef struct
+{
+  FLASH_StreamTypeDef *out;   /* destination, writes over the old image */
+  uint32_t old_size;          /* installed image size the patch applies to */
+  uint32_t new_size;          /* size of the image being built */
+  uint32_t new_crc;           /* expected CRC32 of the new image */
+  uint32_t cursor;            /* current offset in the old image */
+  uint32_t length;            /* bytes left in the current command */
+  uint32_t value;             /* LEB128 accumulator */
+  uint8_t  shift;             /* LEB128 bit position */
+  uint8_t  op;                /* current opcode */
+  uint8_t  state;             /* command parsing state */
+  uint8_t  page_valid;        /* aOldPage holds the page at page_offset */
+  uint32_t page_offset;       /* image offset of the page saved in RAM */
+} DELTA_DecoderTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t DELTA_IsPatch(const uint8_t *p_data, uint32_t length);
+DELTA_StatusTypeDef DELTA_Init(DELTA_DecoderTypeDef *dec, FLASH_StreamTypeDef *out,
+                               const uint8_t *p_header, uint32_t max_size);
+DELTA_StatusTypeDef DELTA_Decode(DELTA_DecoderTypeDef *dec, const uint8_t *p_data, uint32_t length);
+DELTA_StatusTypeDef DELTA_Finish(DELTA_DecoderTypeDef *dec);
+
+#endif  /* __DELTA_H */
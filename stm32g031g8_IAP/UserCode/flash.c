@@ -1,4 +1,6 @@
 #include "flash.h"
+#include "profile.h"
+#include "string.h"
 
 /**
  * @brief  Unlocks Flash for write access
@@ -48,6 +50,38 @@ uint32_t FLASH_Erase(uint32_t start)
   return status;
 }
 
+/**
+ * @brief  Erase the single flash page holding the given address
+ * @param  address: any address inside the page
+ * @retval FLASHIF_OK : page successfully erased
+ *         FLASHIF_ERASEKO : error occurred
+ */
+uint32_t FLASH_ErasePage(uint32_t address)
+{
+  uint32_t status = FLASHIF_ERASEKO;
+  FLASH_EraseInitTypeDef erase_init;
+  uint32_t error = 0u;
+
+  erase_init.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase_init.Page = (address - FLASH_BASE) / FLASH_PAGE_SIZE;
+  erase_init.Banks = FLASH_BANK_1;
+  erase_init.NbPages = 1;
+
+  if ((address >= FLASH_START) && (address < FLASH_END_ADDRESS))
+  {
+    PROFILE_ENTER(PROFILE_FLASH_ERASE);
+    HAL_FLASH_Unlock();
+    if (HAL_OK == HAL_FLASHEx_Erase(&erase_init, &error))
+    {
+      status = FLASHIF_OK;
+    }
+    HAL_FLASH_Lock();
+    PROFILE_EXIT(PROFILE_FLASH_ERASE);
+  }
+
+  return status;
+}
+
 /* Public functions ---------------------------------------------------------*/
 /**
  * @brief  This function writes a data buffer in flash (data are 32-bit aligned).
@@ -65,6 +99,7 @@ uint32_t FLASH_If_Write(uint32_t destination, uint32_t *p_source, uint32_t lengt
   uint32_t status = FLASHIF_OK;
   uint32_t i = 0;
 
+  PROFILE_ENTER(PROFILE_FLASH_WRITE);
   HAL_FLASH_Unlock();
 
   for (i = 0; (i < length / 2) && (destination <= (USER_FLASH_END_ADDRESS - 8)); i++)
@@ -91,6 +126,7 @@ uint32_t FLASH_If_Write(uint32_t destination, uint32_t *p_source, uint32_t lengt
     }
   }
   HAL_FLASH_Lock();
+  PROFILE_EXIT(PROFILE_FLASH_WRITE);
 
   return status;
 }
@@ -225,3 +261,143 @@ ERROR:
   return FLASHIF_READ_ERROR;
 }
 
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief  Erase the pages of [address, address + length) not erased yet, then
+ *         program them from the staging buffer.
+ * @param  stream: writer instance
+ * @param  length: number of bytes of data[] to program, multiple of 8
+ * @retval FLASHIF_OK or the erase/write error code
+ */
+static uint32_t FLASH_Stream_Program(FLASH_StreamTypeDef *stream, uint32_t length)
+{
+  uint32_t status = FLASHIF_OK;
+  uint32_t address = stream->base + stream->written;
+  uint32_t tick;
+
+  if (address + length > stream->limit)
+  {
+    return FLASHIF_WRITING_ERROR;
+  }
+  if ((stream->written == 0) && (stream->p_check != NULL))
+  {
+    if (stream->p_check(stream->data, stream->count) != FLASHIF_OK)
+    {
+      return FLASHIF_CHECK_ERROR;
+    }
+  }
+
+  tick = HAL_GetTick();
+  while ((stream->erased < address + length) && (status == FLASHIF_OK))
+  {
+    status = FLASH_ErasePage(stream->erased);
+    stream->erased += FLASH_PAGE_SIZE;
+  }
+  stream->erase_time += HAL_GetTick() - tick;
+
+  if (status == FLASHIF_OK)
+  {
+    status = FLASH_If_Write(address, (uint32_t *)stream->data, length / 4);
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Prepare a sequential writer starting at the given flash address.
+ * @param  stream: writer instance
+ * @param  base: flash address of the first byte, page aligned
+ * @param  limit: first flash address the writer must not touch
+ * @retval None
+ */
+void FLASH_Stream_Init(FLASH_StreamTypeDef *stream, uint32_t base, uint32_t limit)
+{
+  stream->base = base;
+  stream->limit = limit;
+  stream->erased = base;
+  stream->written = 0;
+  stream->count = 0;
+  stream->erase_time = 0;
+  stream->p_check = NULL;
+  stream->p_feed = NULL;
+}
+
+/**
+ * @brief  Append bytes to the stream, programming every full staging buffer.
+ * @param  stream: writer instance
+ * @param  p_data: bytes to append
+ * @param  length: number of bytes
+ * @retval FLASHIF_OK or the FLASH_If_Write error code
+ */
+uint32_t FLASH_Stream_Write(FLASH_StreamTypeDef *stream, const uint8_t *p_data, uint32_t length)
+{
+  uint32_t status = FLASHIF_OK;
+  uint32_t chunk;
+
+  while ((length > 0) && (status == FLASHIF_OK))
+  {
+    chunk = FLASH_STREAM_BUF_SIZE - stream->count;
+    if (chunk > length)
+    {
+      chunk = length;
+    }
+    memcpy(&stream->data[stream->count], p_data, chunk);
+    stream->count += chunk;
+    p_data += chunk;
+    length -= chunk;
+
+    if (stream->count == FLASH_STREAM_BUF_SIZE)
+    {
+      status = FLASH_Stream_Program(stream, FLASH_STREAM_BUF_SIZE);
+      if ((status == FLASHIF_OK) && (stream->p_feed != NULL))
+      {
+        stream->p_feed(stream->data, FLASH_STREAM_BUF_SIZE);
+      }
+      stream->written += FLASH_STREAM_BUF_SIZE;
+      stream->count = 0;
+    }
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Program the bytes still pending, padded with 0xFF to a double-word.
+ * @note   Call once at the end of the stream, nothing can be appended afterwards.
+ * @param  stream: writer instance
+ * @retval FLASHIF_OK or the FLASH_If_Write error code
+ */
+uint32_t FLASH_Stream_Flush(FLASH_StreamTypeDef *stream)
+{
+  uint32_t status = FLASHIF_OK;
+  uint32_t padded = (stream->count + 7u) & ~7u;
+
+  if (padded > 0)
+  {
+    memset(&stream->data[stream->count], 0xFF, padded - stream->count);
+    status = FLASH_Stream_Program(stream, padded);
+    if ((status == FLASHIF_OK) && (stream->p_feed != NULL))
+    {
+      stream->p_feed(stream->data, stream->count);
+    }
+    stream->written += stream->count;
+    stream->count = 0;
+  }
+
+  return status;
+}
+
+/**
+ * @brief  Read back a byte already pushed into the stream.
+ * @param  stream: writer instance
+ * @param  offset: stream offset, must be lower than FLASH_STREAM_SIZE(stream)
+ * @retval Byte value, taken from flash or from the staging buffer
+ */
+uint8_t FLASH_Stream_Peek(const FLASH_StreamTypeDef *stream, uint32_t offset)
+{
+  if (offset < stream->written)
+  {
+    return *(__IO uint8_t *)(stream->base + offset);
+  }
+  return stream->data[offset - stream->written];
+}
@@ -70,7 +70,8 @@ enum
   FLASHIF_WRITINGCTRL_ERROR,
   FLASHIF_WRITING_ERROR,
   FLASHIF_PROTECTION_ERRROR,
-  FLASHIF_READ_ERROR
+  FLASHIF_READ_ERROR,
+  FLASHIF_CHECK_ERROR
 };
 
 /* protection type */  
@@ -92,6 +93,7 @@ enum {
 #define FLASH_PAGE_STEP         FLASH_PAGE_SIZE           /* Size of page : 1K bytes */
 #define APPLICATION_ADDRESS     (uint32_t)0x08004000      /* Start user code address */
 #define CONFIG_START_ADDRESS     (uint32_t)0x0800F800      /* Config address */
+#define APPLICATION_MAX_SIZE     (CONFIG_START_ADDRESS - APPLICATION_ADDRESS) /* APP area, 46 Kbytes */
 
 
 /* Notable Flash addresses */
@@ -124,12 +126,42 @@ enum {
 /* Compute the mask to test if the Flash memory, where the user program will be
   loaded, is write protected */
 #define FLASH_PROTECTED_SECTORS       (~(uint32_t)((1 << FLASH_SECTOR_NUMBER) - 1))
+/* Staging buffer of the sequential flash writer, must be a multiple of 8 bytes
+   (the G0 programs one double-word at a time) */
+#define FLASH_STREAM_BUF_SIZE         ((uint32_t)256)
+
+/**
+  * @brief  Sequential flash writer: bytes are collected in RAM and programmed
+  *         once a full staging buffer is available. Pages are erased when the
+  *         writer first reaches them, nothing is erased ahead of the data.
+  */
+typedef struct
+{
+  uint8_t  data[FLASH_STREAM_BUF_SIZE];  /* staging buffer, keep it first for alignment */
+  uint32_t base;                         /* flash address of stream byte 0 */
+  uint32_t limit;                        /* first flash address not to be written */
+  uint32_t erased;                       /* first flash address not erased yet */
+  uint32_t written;                      /* bytes already programmed */
+  uint32_t count;                        /* bytes pending in data[] */
+  uint32_t erase_time;                   /* ms spent erasing pages */
+  /* Optional check of the first bytes, run before anything is erased;
+     a non FLASHIF_OK result aborts the stream with FLASHIF_CHECK_ERROR */
+  uint32_t (*p_check)(const uint8_t *p_data, uint32_t length);
+  /* Optional consumer of the stream bytes, given each staging buffer once it
+     is programmed (padding excluded) */
+  void (*p_feed)(const uint8_t *p_data, uint32_t length);
+} FLASH_StreamTypeDef;
+
+/* Number of bytes pushed into the stream so far */
+#define FLASH_STREAM_SIZE(s)          ((s)->written + (s)->count)
+
 /* Exported functions ------------------------------------------------------- */
 
 
 
 void FLASH_Init(void);
 uint32_t FLASH_Erase(uint32_t StartSector);
+uint32_t FLASH_ErasePage(uint32_t address);
 
 uint32_t FLASH_If_GetWriteProtectionStatus(void);
 uint32_t FLASH_If_Write(uint32_t destination, uint32_t *p_source, uint32_t length);
@@ -137,4 +169,9 @@ uint32_t FLASH_If_WriteProtectionConfig(uint32_t protectionstate);
 
 uint32_t STMFLASH_Read_Word(uint32_t ReadAddr,uint32_t *pBuffer,uint32_t NumToRead);
 uint32_t STMFLASH_Read(uint32_t ReadAddr, uint8_t *pBuffer, uint8_t len);
+
+void FLASH_Stream_Init(FLASH_StreamTypeDef *stream, uint32_t base, uint32_t limit);
+uint32_t FLASH_Stream_Write(FLASH_StreamTypeDef *stream, const uint8_t *p_data, uint32_t length);
+uint32_t FLASH_Stream_Flush(FLASH_StreamTypeDef *stream);
+uint8_t FLASH_Stream_Peek(const FLASH_StreamTypeDef *stream, uint32_t offset);
 #endif  /* __FLASH_IF_H */
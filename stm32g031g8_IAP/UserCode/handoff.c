@@ -0,0 +1,131 @@
+/**
+  ******************************************************************************
+  * @file    handoff.c
+  * @brief   IAP side of the boot handoff block, see handoff.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "handoff.h"
+#include "usart.h"
+#include "timebase.h"
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Invalidate the previous block, capture the reset cause and count
+  *         the boot
+  * @note   Call first thing in main(), before anything can reset the chip.
+  * @param  None
+  * @retval None
+  */
+void Handoff_Begin(void)
+{
+  HANDOFF_TypeDef *handoff = HANDOFF;
+  BOOT_InfoTypeDef *info = BOOT_INFO;
+
+  handoff->magic = 0;
+  handoff->reset_cause = RCC->CSR & 0xFE000000;
+  /* Clear the flags so the next reset reports only its own cause */
+  RCC->CSR |= RCC_CSR_RMVF;
+
+  /* RAM content is random after power-on */
+  if ((handoff->reset_cause & RCC_CSR_PWRRSTF) || (info->magic != BOOT_INFO_MAGIC)
+      || (info->check != BootInfo_Sum(info)))
+  {
+    info->magic = BOOT_INFO_MAGIC;
+    info->boot_count = 0;
+    info->update_result = BOOT_INFO_NO_UPDATE;
+    info->update_image = 0;
+    info->update_errors = 0;
+    info->update_size = 0;
+    info->update_time = 0;
+  }
+  info->boot_count++;
+  info->check = BootInfo_Sum(info);
+}
+
+/**
+  * @brief  Read and clear the command posted by the application
+  * @note   Call after Handoff_Begin. A mailbox found after power-on is
+  *         leftover RAM content and is ignored.
+  * @param  None
+  * @retval MAILBOX_xxx, MAILBOX_NONE if nothing valid was posted
+  */
+uint32_t Handoff_TakeMailbox(void)
+{
+  MAILBOX_TypeDef *mailbox = MAILBOX;
+  uint32_t command = MAILBOX_NONE;
+
+  if (((HANDOFF->reset_cause & RCC_CSR_PWRRSTF) == 0) && (mailbox->magic == MAILBOX_MAGIC)
+      && (mailbox->check == Mailbox_Sum(mailbox)))
+  {
+    command = mailbox->command;
+  }
+  mailbox->magic = 0;
+  return command;
+}
+
+/**
+  * @brief  Remember the outcome of a download for the application
+  * @param  result: COM_StatusTypeDef returned by Ymodem_Receive
+  * @param  image_status: IMAGE_StatusTypeDef if the image was refused
+  * @param  errors: packets retried
+  * @param  size: file size announced by the sender
+  * @param  time: session duration in ms
+  * @retval None
+  */
+void Handoff_RecordUpdate(uint8_t result, uint8_t image_status, uint16_t errors, uint32_t size, uint32_t time)
+{
+  BOOT_InfoTypeDef *info = BOOT_INFO;
+
+  info->update_result = result;
+  info->update_image = image_status;
+  info->update_errors = errors;
+  info->update_size = size;
+  info->update_time = time;
+  info->check = BootInfo_Sum(info);
+}
+
+/**
+  * @brief  Fill the block and release what the application does not take over
+  * @note   The TIM2 timebase always keeps running. On the fast path nothing
+  *         else has been initialised.
+  *         In bootloader mode the PLL and SysTick are handed over, the console
+  *         UART belongs to the IAP and is shut down. Interrupts are left
+  *         disabled, the application enables them once VTOR points at its own
+  *         vector table.
+  * @param  None
+  * @retval None
+  */
+void Handoff_Commit(void)
+{
+  HANDOFF_TypeDef *handoff = HANDOFF;
+
+  handoff->flags = (TIMEBASE_TIM->CR1 & TIM_CR1_CEN) ? HANDOFF_TIMEBASE : 0;
+  handoff->sysclk = SystemCoreClock;
+  handoff->tick = 0;
+  handoff->uart = 0;
+  handoff->baudrate = 0;
+
+  if (SysTick->CTRL & SysTick_CTRL_ENABLE_Msk)
+  {
+    handoff->flags |= HANDOFF_CLOCK | HANDOFF_TICK;
+    handoff->tick = HAL_GetTick();
+    if (UartHandle.gState != HAL_UART_STATE_RESET)
+    {
+      handoff->uart = (uint32_t)UartHandle.Instance;
+      handoff->baudrate = UartHandle.Init.BaudRate;
+      HAL_UART_DeInit(&UartHandle);
+    }
+  }
+
+  __disable_irq();
+  NVIC->ICER[0] = 0xFFFFFFFF;
+  NVIC->ICPR[0] = 0xFFFFFFFF;
+
+  handoff->version = HANDOFF_VERSION;
+  handoff->size = sizeof(HANDOFF_TypeDef);
+  handoff->magic = HANDOFF_MAGIC;
+  handoff->check = Handoff_Sum(handoff);
+}
@@ -0,0 +1,161 @@
+/**
+  ******************************************************************************
+  * @file    handoff.h
+  * @brief   State passed from the IAP to the application across the jump.
+  ******************************************************************************
+  * The top of RAM is kept out of IRAM1 in both projects (IRAM1 ends at
+  * NOINIT_RAM_ADDRESS), so neither the scatter loader nor the startup code
+  * touches it and it survives the jump and software resets:
+  *
+  *   NOINIT_RAM_ADDRESS + 0x00   HANDOFF_TypeDef
+  *   NOINIT_RAM_ADDRESS + 0x40   BOOT_TraceTypeDef, see boot_trace.h
+  *   NOINIT_RAM_ADDRESS + 0xC8   BOOT_InfoTypeDef
+  *   NOINIT_RAM_ADDRESS + 0xE0   MAILBOX_TypeDef
+  *
+  * The IAP fills the block right before the jump. The APP accepts it only if
+  * magic, version and checksum match, and then skips the initialisation steps
+  * listed in flags. Anything not listed has been de-initialised by the IAP.
+  *
+  * BOOT_InfoTypeDef is kept by the IAP from one reset to the next (boot count
+  * and outcome of the last download) and only read by the APP. It restarts
+  * from zero on power-on.
+  *
+  * MAILBOX_TypeDef goes the other way: the APP posts a command and resets with
+  * NVIC_SystemReset(), the IAP takes it first thing at boot. Nothing is
+  * written to flash, so a request does not survive power loss; use the
+  * updata_flg in the config page for that.
+  *
+  * This file is shared by both projects, keep the two copies identical.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HANDOFF_H
+#define __HANDOFF_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define NOINIT_RAM_ADDRESS      ((uint32_t)0x20001F00)
+#define NOINIT_RAM_SIZE         ((uint32_t)0x100)
+
+#define HANDOFF_ADDRESS         NOINIT_RAM_ADDRESS
+#define HANDOFF_MAGIC           ((uint32_t)0x464F4448)  /* "HDOF" */
+#define HANDOFF_VERSION         ((uint16_t)1)
+
+/* What the IAP left configured */
+#define HANDOFF_CLOCK           ((uint32_t)0x01)  /* PLL system clock and flash latency */
+#define HANDOFF_TICK            ((uint32_t)0x02)  /* SysTick at 1 ms, HAL tick continues */
+#define HANDOFF_TIMEBASE        ((uint32_t)0x04)  /* TIM2 1 MHz timebase, see timebase.h */
+
+#define BOOT_INFO_ADDRESS       (NOINIT_RAM_ADDRESS + 0xC8)
+#define BOOT_INFO_MAGIC         ((uint32_t)0x4F464E49)  /* "INFO" */
+#define BOOT_INFO_NO_UPDATE     ((uint8_t)0xFF)         /* update_result before any download */
+
+#define MAILBOX_ADDRESS         (NOINIT_RAM_ADDRESS + 0xE0)
+#define MAILBOX_MAGIC           ((uint32_t)0x58424D4C)  /* "LMBX" */
+
+/* Commands from the APP to the IAP */
+#define MAILBOX_NONE            ((uint32_t)0x00)
+#define MAILBOX_UPDATE          ((uint32_t)0x01)  /* stay in the bootloader menu */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;            /* sizeof(HANDOFF_TypeDef) of the writer */
+  uint32_t flags;           /* HANDOFF_xxx */
+  uint32_t reset_cause;     /* RCC->CSR reset flags, cleared by the IAP */
+  uint32_t sysclk;          /* SystemCoreClock, valid with HANDOFF_CLOCK */
+  uint32_t tick;            /* HAL tick at the jump, 0 on the fast path */
+  uint32_t uart;            /* console USART base the IAP used, 0 if none */
+  uint32_t baudrate;        /* its baud rate */
+  uint32_t check;           /* ~sum of the words above */
+} HANDOFF_TypeDef;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t boot_count;      /* IAP starts since power-on */
+  uint8_t  update_result;   /* COM_StatusTypeDef of the last download */
+  uint8_t  update_image;    /* IMAGE_StatusTypeDef when the image was refused */
+  uint16_t update_errors;   /* Ymodem packets retried */
+  uint32_t update_size;     /* file size announced by the sender */
+  uint32_t update_time;     /* ms from the first packet to the end of the session */
+  uint32_t check;           /* ~sum of the words above */
+} BOOT_InfoTypeDef;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t command;         /* MAILBOX_xxx */
+  uint32_t arg;             /* command specific, 0 if unused */
+  uint32_t check;           /* ~sum of the words above */
+} MAILBOX_TypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#define HANDOFF                 ((HANDOFF_TypeDef *)HANDOFF_ADDRESS)
+#define BOOT_INFO               ((BOOT_InfoTypeDef *)BOOT_INFO_ADDRESS)
+#define MAILBOX                 ((MAILBOX_TypeDef *)MAILBOX_ADDRESS)
+
+/**
+  * @brief  Checksum over every word of the block except check itself
+  * @param  handoff: block to sum
+  * @retval Value expected in handoff->check
+  */
+__STATIC_INLINE uint32_t Handoff_Sum(const HANDOFF_TypeDef *handoff)
+{
+  const uint32_t *p_word = (const uint32_t *)handoff;
+  uint32_t sum = 0;
+  uint32_t i;
+
+  for (i = 0; i < (sizeof(HANDOFF_TypeDef) / 4) - 1; i++)
+  {
+    sum += p_word[i];
+  }
+  return ~sum;
+}
+
+/**
+  * @brief  Checksum over every word of the boot info except check itself
+  * @param  info: record to sum
+  * @retval Value expected in info->check
+  */
+__STATIC_INLINE uint32_t BootInfo_Sum(const BOOT_InfoTypeDef *info)
+{
+  const uint32_t *p_word = (const uint32_t *)info;
+  uint32_t sum = 0;
+  uint32_t i;
+
+  for (i = 0; i < (sizeof(BOOT_InfoTypeDef) / 4) - 1; i++)
+  {
+    sum += p_word[i];
+  }
+  return ~sum;
+}
+
+/**
+  * @brief  Checksum over the mailbox words except check itself
+  * @param  mailbox: mailbox to sum
+  * @retval Value expected in mailbox->check
+  */
+__STATIC_INLINE uint32_t Mailbox_Sum(const MAILBOX_TypeDef *mailbox)
+{
+  return ~(mailbox->magic + mailbox->command + mailbox->arg);
+}
+
+/* Exported functions ------------------------------------------------------- */
+/* IAP side, handoff.c in stm32g031g8_IAP */
+void Handoff_Begin(void);
+void Handoff_Commit(void);
+void Handoff_RecordUpdate(uint8_t result, uint8_t image_status, uint16_t errors, uint32_t size, uint32_t time);
+uint32_t Handoff_TakeMailbox(void);
+/* APP side, handoff.c in stm32g031g8_APP */
+const HANDOFF_TypeDef *Handoff_Accept(void);
+const HANDOFF_TypeDef *Handoff_Get(void);
+const BOOT_InfoTypeDef *Handoff_GetBootInfo(void);
+void Handoff_PostMailbox(uint32_t command, uint32_t arg);
+
+#endif  /* __HANDOFF_H */
@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    image.c
+  * @brief   Application image header checks.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "image.h"
+#include "common.h"
+#include "string.h"
+
+/* Public functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check an image header against this device
+  * @param  header: header to check, in RAM or in flash
+  * @param  max_size: room available for the image and its trailer
+  * @retval IMAGE_OK if the image may be installed on this device
+  */
+IMAGE_StatusTypeDef Image_CheckHeader(const IMAGE_HeaderTypeDef *header, uint32_t max_size)
+{
+  if (header->magic != IMAGE_MAGIC)
+  {
+    return IMAGE_NO_HEADER;
+  }
+  if (strncmp(header->device_name, DEVICE_NAME, IMAGE_NAME_LENGTH) != 0)
+  {
+    return IMAGE_BAD_DEVICE;
+  }
+  if (header->hw_version != HW_VERSION)
+  {
+    return IMAGE_BAD_HW;
+  }
+  if ((header->length < IMAGE_HEADER_END) || (header->length > max_size - IMAGE_TRAILER_SIZE))
+  {
+    return IMAGE_BAD_LENGTH;
+  }
+  return IMAGE_OK;
+}
+
+/**
+  * @brief  Check the image programmed at an address: header and CRC32 over
+  *         exactly header.length bytes
+  * @param  address: start of the image (vector table)
+  * @param  max_size: size of the area holding the image
+  * @retval IMAGE_OK if the image is complete and intact
+  */
+IMAGE_StatusTypeDef Image_Verify(uint32_t address, uint32_t max_size)
+{
+  const IMAGE_HeaderTypeDef *header = IMAGE_HEADER(address);
+  IMAGE_StatusTypeDef status;
+
+  status = Image_CheckHeader(header, max_size);
+  if (status != IMAGE_OK)
+  {
+    return status;
+  }
+
+  if (Cal_CRC32(0, (const uint8_t *)address, header->length) != Image_GetCRC(address))
+  {
+    return IMAGE_BAD_CRC;
+  }
+  return IMAGE_OK;
+}
+
+/**
+  * @brief  Read the CRC32 trailer of an image whose header has been checked
+  * @param  address: start of the image (vector table)
+  * @retval CRC32 stored after the image
+  */
+uint32_t Image_GetCRC(uint32_t address)
+{
+  /* The trailer is not word aligned when length is not */
+  const uint8_t *p_trailer = (const uint8_t *)(address + IMAGE_HEADER(address)->length);
+
+  return p_trailer[0] | (p_trailer[1] << 8) | (p_trailer[2] << 16) | ((uint32_t)p_trailer[3] << 24);
+}
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    link.h
+  * @brief   Byte pipe to the host under the menu and Ymodem: USART1, or the
+  *          SPI slave link with IAP_SPI_ENABLED (see spi_link.h).
+  ******************************************************************************
+  * Both have the blocking HAL_UART_Receive / HAL_UART_Transmit semantics the
+  * ST Ymodem code was written for, so the protocol code does not know which
+  * one carries it. The RS-485 bus (rs485.c) and the chain (chain.c) are
+  * USART framings of their own and keep USART1.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LINK_H
+#define __LINK_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "common.h"
+#ifdef IAP_SPI_ENABLED
+#include "spi_link.h"
+#else
+#include "usart.h"
+#endif /* IAP_SPI_ENABLED */
+
+#if defined(IAP_SPI_ENABLED) && (defined(IAP_RS485_ENABLED) || defined(IAP_CHAIN_ENABLED))
+#error "IAP_SPI_ENABLED takes the place of USART1, it does not go with IAP_RS485_ENABLED or IAP_CHAIN_ENABLED"
+#endif
+
+/* Exported constants --------------------------------------------------------*/
+/* Link_TakeErrors */
+#define LINK_ERROR_OVERRUN      ((uint32_t)0x01)  /* USART ORE, SPI OVR */
+#define LINK_ERROR_FRAMING      ((uint32_t)0x02)  /* USART FE, SPI frame cut short */
+#define LINK_ERROR_NOISE        ((uint32_t)0x04)  /* USART NE */
+
+/* Exported macro ------------------------------------------------------------*/
+#ifdef IAP_SPI_ENABLED
+#define Link_Receive(p_data, size, timeout)     SpiLink_Receive((p_data), (size), (timeout))
+#define Link_Transmit(p_data, size, timeout)    SpiLink_Transmit((p_data), (size), (timeout))
+#define Link_Flush()                            SpiLink_Flush()
+#define Link_TakeErrors()                       SpiLink_TakeErrors()
+#else
+#define Link_Receive(p_data, size, timeout)     HAL_UART_Receive(&UartHandle, (p_data), (size), (timeout))
+#define Link_Transmit(p_data, size, timeout)    HAL_UART_Transmit(&UartHandle, (p_data), (size), (timeout))
+#define Link_Flush()                            __HAL_UART_FLUSH_DRREGISTER(&UartHandle)
+#define Link_TakeErrors()                       UartLink_TakeErrors()
+
+/**
+  * @brief  Receive errors USART1 has flagged since the last call
+  * @note   HAL_UART_Receive does not look at them
+  * @param  None
+  * @retval LINK_ERROR_xxx bits
+  */
+__STATIC_INLINE uint32_t UartLink_TakeErrors(void)
+{
+  uint32_t isr = UartHandle.Instance->ISR;
+  uint32_t errors = 0;
+
+  if (isr & USART_ISR_ORE)
+  {
+    errors |= LINK_ERROR_OVERRUN;
+  }
+  if (isr & USART_ISR_FE)
+  {
+    errors |= LINK_ERROR_FRAMING;
+  }
+  if (isr & USART_ISR_NE)
+  {
+    errors |= LINK_ERROR_NOISE;
+  }
+  __HAL_UART_CLEAR_FLAG(&UartHandle, UART_CLEAR_OREF | UART_CLEAR_FEF | UART_CLEAR_NEF);
+  return errors;
+}
+#endif /* IAP_SPI_ENABLED */
+
+#endif  /* __LINK_H */
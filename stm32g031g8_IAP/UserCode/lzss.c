@@ -0,0 +1,174 @@
+/**
+  ******************************************************************************
+  * @file    lzss.c
+  * @brief   Streaming LZSS decoder for compressed application images.
+  *          Input can be fed in chunks of any size, e.g. one Ymodem packet at
+  *          a time; decoded bytes go straight to a FLASH_StreamTypeDef.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "lzss.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Token decoding states */
+#define LZSS_STATE_FLAGS        ((uint8_t)0)
+#define LZSS_STATE_TOKEN        ((uint8_t)1)
+#define LZSS_STATE_REF_HI       ((uint8_t)2)
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Copy a back reference from the already decoded output
+  * @param  dec: decoder instance
+  * @param  lo: first byte of the reference
+  * @param  hi: second byte of the reference
+  * @retval LZSS_OK, LZSS_DONE or LZSS_ERROR
+  */
+static LZSS_StatusTypeDef CopyMatch(LZSS_DecoderTypeDef *dec, uint8_t lo, uint8_t hi)
+{
+  uint32_t distance = (((uint32_t)(hi & 0xF0u) << 4) | lo) + 1u;
+  uint32_t length = (hi & 0x0Fu) + LZSS_MIN_MATCH;
+  uint32_t pos = FLASH_STREAM_SIZE(dec->out);
+  uint8_t byte;
+
+  if (distance > pos)
+  {
+    return LZSS_ERROR;
+  }
+  if (length > dec->size - pos)
+  {
+    return LZSS_ERROR;
+  }
+
+  /* byte by byte: source and destination may overlap */
+  while (length--)
+  {
+    byte = FLASH_Stream_Peek(dec->out, pos - distance);
+    if (FLASH_Stream_Write(dec->out, &byte, 1) != FLASHIF_OK)
+    {
+      return LZSS_ERROR;
+    }
+    pos++;
+  }
+
+  return (pos == dec->size) ? LZSS_DONE : LZSS_OK;
+}
+
+/* Public functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Check whether a first data block carries an LZSS header
+  * @param  p_data: start of the image
+  * @param  length: number of bytes available
+  * @retval 1 if compressed, 0 otherwise
+  */
+uint32_t LZSS_IsCompressed(const uint8_t *p_data, uint32_t length)
+{
+  uint32_t magic;
+
+  if (length < LZSS_HEADER_SIZE)
+  {
+    return 0;
+  }
+  magic = p_data[0] | (p_data[1] << 8) | (p_data[2] << 16) | ((uint32_t)p_data[3] << 24);
+
+  return (magic == LZSS_MAGIC) ? 1 : 0;
+}
+
+/**
+  * @brief  Start decoding a compressed image
+  * @param  dec: decoder instance
+  * @param  out: initialised flash writer receiving the decoded bytes
+  * @param  p_header: the LZSS_HEADER_SIZE header bytes
+  * @param  max_size: room available at the destination
+  * @retval LZSS_OK, or LZSS_ERROR if the image does not fit
+  */
+LZSS_StatusTypeDef LZSS_Init(LZSS_DecoderTypeDef *dec, FLASH_StreamTypeDef *out,
+                             const uint8_t *p_header, uint32_t max_size)
+{
+  dec->out = out;
+  dec->size = p_header[4] | (p_header[5] << 8) | (p_header[6] << 16) | ((uint32_t)p_header[7] << 24);
+  dec->flags = 0;
+  dec->flag_bits = 0;
+  dec->ref_lo = 0;
+  dec->state = LZSS_STATE_FLAGS;
+
+  if ((dec->size == 0) || (dec->size > max_size))
+  {
+    return LZSS_ERROR;
+  }
+  return LZSS_OK;
+}
+
+/**
+  * @brief  Decode a chunk of compressed data
+  * @param  dec: decoder instance
+  * @param  p_data: compressed bytes, header excluded
+  * @param  length: number of bytes
+  * @retval LZSS_OK when more input is needed, LZSS_DONE once the announced
+  *         size is reached, LZSS_ERROR on corrupted input or write failure
+  */
+LZSS_StatusTypeDef LZSS_Decode(LZSS_DecoderTypeDef *dec, const uint8_t *p_data, uint32_t length)
+{
+  LZSS_StatusTypeDef status = LZSS_OK;
+  uint8_t byte;
+
+  if (FLASH_STREAM_SIZE(dec->out) >= dec->size)
+  {
+    return LZSS_DONE;
+  }
+
+  while ((length > 0) && (status == LZSS_OK))
+  {
+    byte = *p_data++;
+    length--;
+
+    switch (dec->state)
+    {
+      case LZSS_STATE_FLAGS:
+        dec->flags = byte;
+        dec->flag_bits = 8;
+        dec->state = LZSS_STATE_TOKEN;
+        break;
+
+      case LZSS_STATE_TOKEN:
+        if (dec->flags & 0x01u)
+        {
+          /* Literal */
+          if (FLASH_Stream_Write(dec->out, &byte, 1) != FLASHIF_OK)
+          {
+            status = LZSS_ERROR;
+          }
+          else if (FLASH_STREAM_SIZE(dec->out) == dec->size)
+          {
+            status = LZSS_DONE;
+          }
+          dec->flags >>= 1;
+          if (--dec->flag_bits == 0)
+          {
+            dec->state = LZSS_STATE_FLAGS;
+          }
+        }
+        else
+        {
+          /* First half of a back reference */
+          dec->ref_lo = byte;
+          dec->state = LZSS_STATE_REF_HI;
+        }
+        break;
+
+      case LZSS_STATE_REF_HI:
+        status = CopyMatch(dec, dec->ref_lo, byte);
+        dec->flags >>= 1;
+        dec->state = (--dec->flag_bits == 0) ? LZSS_STATE_FLAGS : LZSS_STATE_TOKEN;
+        break;
+
+      default:
+        status = LZSS_ERROR;
+        break;
+    }
+  }
+
+  return status;
+}
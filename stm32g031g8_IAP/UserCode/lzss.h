@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    lzss.h
+  * @brief   Streaming LZSS decoder for compressed application images.
+  ******************************************************************************
+  * Compressed image layout (produced by tools/lzss_pack.py):
+  *
+  *   | "LZS1" | original size (u32, LE) | token groups ... |
+  *
+  * Every group starts with a flag byte, bit 0 first. A set bit is a literal
+  * byte, a cleared bit a 2-byte back reference:
+  *
+  *   byte 0 = distance[7:0]
+  *   byte 1 = distance[11:8] << 4 | (length - LZSS_MIN_MATCH)
+  *
+  * with distance = offset - 1 into the already decoded output. The history is
+  * read back from the flash being programmed, so the decoder only keeps a few
+  * bytes of state in RAM whatever the window size.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LZSS_H
+#define __LZSS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "flash.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define LZSS_MAGIC              ((uint32_t)0x31535A4C)  /* "LZS1" */
+#define LZSS_HEADER_SIZE        ((uint32_t)8)
+#define LZSS_WINDOW_SIZE        ((uint32_t)4096)
+#define LZSS_MIN_MATCH          ((uint32_t)3)
+#define LZSS_MAX_MATCH          ((uint32_t)(LZSS_MIN_MATCH + 15))
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  LZSS_OK = 0,      /* more input expected */
+  LZSS_DONE,        /* original size reached, trailing input is ignored */
+  LZSS_ERROR        /* corrupted stream or flash failure */
+} LZSS_StatusTypeDef;
+
+typedef struct
+{
+  FLASH_StreamTypeDef *out;   /* destination of the decoded bytes */
+  uint32_t size;              /* decoded size announced in the header */
+  uint8_t  flags;             /* flag byte of the current group */
+  uint8_t  flag_bits;         /* tokens left in the current group */
+  uint8_t  ref_lo;            /* first byte of a split back reference */
+  uint8_t  state;             /* position inside the current token */
+} LZSS_DecoderTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t LZSS_IsCompressed(const uint8_t *p_data, uint32_t length);
+LZSS_StatusTypeDef LZSS_Init(LZSS_DecoderTypeDef *dec, FLASH_StreamTypeDef *out,
+                             const uint8_t *p_header, uint32_t max_size);
+LZSS_StatusTypeDef LZSS_Decode(LZSS_DecoderTypeDef *dec, const uint8_t *p_data, uint32_t length);
+
+#endif  /* __LZSS_H */
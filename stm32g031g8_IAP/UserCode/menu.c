@@ -29,7 +29,13 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "menu.h"
-#include "usart.h"
+#include "link.h"
+#include "bootcache.h"
+#include "handoff.h"
+#include "boot_trace.h"
+#include "rs485.h"
+#include "chain.h"
+#include "profile.h"
 #include "string.h"
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -43,15 +49,120 @@ config_data_t Write_Config ={
     .device_name = DEVICE_NAME,
     .FW_vision = FW_VERSION,
     .HW_vision = HW_VERSION,
-    .updata_flg = NOT_UPDATA
+    .updata_flg = NOT_UPDATA,
+    .bus_address = RS485_ADDRESS_NONE
 };
 
 /* Private function prototypes -----------------------------------------------*/
 void SerialDownload(void);
 void SerialUpload(void);
+static void SerialPutImageStatus(IMAGE_StatusTypeDef status);
+#ifdef IAP_SHA256_ENABLED
+static void SerialPutHex(const uint8_t *p_data, uint32_t length);
+#endif /* IAP_SHA256_ENABLED */
+#ifdef PROFILE_ENABLED
+static void ProfileSend(uint8_t *p_data, uint8_t length);
+#endif /* PROFILE_ENABLED */
 
 /* Private functions ---------------------------------------------------------*/
 
+/**
+  * @brief  Rewrite the config page from Write_Config
+  * @note   The whole page is erased, the boot cache record goes with it
+  * @param  fw_version: firmware version of the installed image
+  * @param  flag: UPDATA or NOT_UPDATA
+  * @param  bus_address: RS-485 address to keep
+  * @retval FLASHIF_OK if the page holds the new config, Read_Config is reloaded
+  */
+uint32_t WriteConfigPage(uint8_t fw_version, uint8_t flag, uint8_t bus_address)
+{
+  /* Whole double words, the bytes after the config stay erased */
+  uint32_t data[((sizeof(config_data_t) + 7) / 8) * 2];
+  uint32_t status;
+
+  Write_Config.FW_vision = fw_version;
+  Write_Config.updata_flg = flag;
+  Write_Config.bus_address = bus_address;
+  memset(data, 0xFF, sizeof(data));
+  memcpy(data, &Write_Config, sizeof(Write_Config));
+
+  status = FLASH_Erase(CONFIG_START_ADDRESS);
+  if (status == FLASHIF_OK)
+  {
+    status = FLASH_If_Write(CONFIG_START_ADDRESS, data, sizeof(data) / 4);
+  }
+  STMFLASH_Read(CONFIG_START_ADDRESS, (uint8_t *)&Read_Config, sizeof(Read_Config));
+  return status;
+}
+
+/**
+  * @brief  Print the reason an image was refused
+  * @param  status: result of Image_CheckHeader / Image_Verify
+  * @retval None
+  */
+static void SerialPutImageStatus(IMAGE_StatusTypeDef status)
+{
+  switch (status)
+  {
+    case IMAGE_NO_HEADER:
+      Serial_PutString((uint8_t *)" 镜像无文件头\r\n");
+      break;
+    case IMAGE_BAD_DEVICE:
+      Serial_PutString((uint8_t *)" 设备名称不匹配\r\n");
+      break;
+    case IMAGE_BAD_HW:
+      Serial_PutString((uint8_t *)" 硬件版本不匹配\r\n");
+      break;
+    case IMAGE_BAD_LENGTH:
+      Serial_PutString((uint8_t *)" 镜像长度错误\r\n");
+      break;
+    case IMAGE_BAD_CRC:
+      Serial_PutString((uint8_t *)" 镜像CRC错误\r\n");
+      break;
+    case IMAGE_BAD_VECTOR:
+      Serial_PutString((uint8_t *)" 栈顶地址错误\r\n");
+      break;
+    default:
+      break;
+  }
+}
+
+#ifdef IAP_SHA256_ENABLED
+/**
+  * @brief  Print bytes as lowercase hex digits
+  * @param  p_data: bytes to print
+  * @param  length: number of bytes
+  * @retval None
+  */
+static void SerialPutHex(const uint8_t *p_data, uint32_t length)
+{
+  static const char hex[] = "0123456789abcdef";
+  uint8_t text[3];
+
+  text[2] = '\0';
+  while (length-- > 0)
+  {
+    text[0] = hex[*p_data >> 4];
+    text[1] = hex[*p_data & 0x0F];
+    Serial_PutString(text);
+    p_data++;
+  }
+}
+#endif /* IAP_SHA256_ENABLED */
+
+#ifdef PROFILE_ENABLED
+/**
+  * @brief  Write a part of the probe dump on the console
+  * @param  p_data: bytes to send
+  * @param  length: number of bytes
+  * @retval None
+  */
+static void ProfileSend(uint8_t *p_data, uint8_t length)
+{
+  Link_Transmit(p_data, length, TX_TIMEOUT);
+}
+#endif /* PROFILE_ENABLED */
+
 /**
   * @brief  Download a file via serial port
   * @param  None
@@ -62,26 +173,41 @@ void SerialDownload(void)
   uint8_t number[11] = {0};
   uint32_t size = 0;
   COM_StatusTypeDef result;
+#ifdef IAP_SHA256_ENABLED
+  const IMAGE_DigestTypeDef *digest;
+#endif /* IAP_SHA256_ENABLED */
 
   Serial_PutString((uint8_t *)"等待文件发送…(按'A'或者'a'终止)\n\r");
   result = Ymodem_Receive( &size );
+  Handoff_RecordUpdate(result, (result == COM_IMAGE) ? Ymodem_GetImageStatus() : IMAGE_OK,
+                       (Ymodem_GetErrors() > 0xFFFF) ? 0xFFFF : Ymodem_GetErrors(), size, Ymodem_GetTransferTime());
   HAL_Delay(100);
   if (result == COM_OK)
   {
-	 if (FLASH_Erase(CONFIG_START_ADDRESS) == FLASHIF_OK)
+	 if (WriteConfigPage(IMAGE_HEADER(APPLICATION_ADDRESS)->fw_version, NOT_UPDATA, Read_Config.bus_address) == FLASHIF_OK)
 	 {
-         Write_Config.FW_vision = Read_Config.FW_vision;
-         Write_Config.updata_flg = NOT_UPDATA;
-         if (FLASH_If_Write(CONFIG_START_ADDRESS, (uint32_t *)&Write_Config, sizeof(Write_Config)) == FLASHIF_OK)
+         Serial_PutString((uint8_t *)"\n\n\r 程序下载完成!\n\r--------------------------------\r\n 文件: ");
+         Serial_PutString(aFileName);
+         Int2Str(number, size);
+         Serial_PutString((uint8_t *)"\n\r 大小: ");
+         Serial_PutString(number);
+         Serial_PutString((uint8_t *)" 字节\r\n");
+         memset(number, 0, sizeof(number));
+         Int2Str(number, Ymodem_GetProgramTime());
+         Serial_PutString((uint8_t *)" 编程耗时: ");
+         Serial_PutString(number);
+         Serial_PutString((uint8_t *)" ms\r\n");
+#ifdef IAP_SHA256_ENABLED
+         digest = Image_GetDigest(APPLICATION_ADDRESS, APPLICATION_MAX_SIZE);
+         if (digest != NULL)
          {
-             Serial_PutString((uint8_t *)"\n\n\r 程序下载完成!\n\r--------------------------------\r\n 文件: ");
-             Serial_PutString(aFileName);
-             Int2Str(number, size);
-             Serial_PutString((uint8_t *)"\n\r 大小: ");
-             Serial_PutString(number);
-             Serial_PutString((uint8_t *)" 字节\r\n");
-             Serial_PutString((uint8_t *)"--------------------------------\n");
-		}
+           /* tools/ymodem_send.py checks it against the image it sent */
+           Serial_PutString((uint8_t *)" SHA-256: ");
+           SerialPutHex(digest->sha256, sizeof(digest->sha256));
+           Serial_PutString((uint8_t *)"\r\n");
+         }
+#endif /* IAP_SHA256_ENABLED */
+         Serial_PutString((uint8_t *)"--------------------------------\n");
 	 }else{
 		 Serial_PutString((uint8_t *)"Config Erase Flash Err!\n");
 	 }
@@ -95,6 +221,11 @@ void SerialDownload(void)
   {
     Serial_PutString((uint8_t *)"\n\n\r验证失败!\n\r");
   }
+  else if (result == COM_IMAGE)
+  {
+    Serial_PutString((uint8_t *)"\n\n\r镜像与本设备不兼容, 未擦除!\n\r");
+    SerialPutImageStatus(Ymodem_GetImageStatus());
+  }
   else if (result == COM_ABORT)
   {
     Serial_PutString((uint8_t *)"\r\n\n用户终止.\n\r");
@@ -103,6 +234,8 @@ void SerialDownload(void)
   {
     Serial_PutString((uint8_t *)"\n\r文件接收失败!\n\r");
   }
+  /* After WriteConfigPage, which erases the page */
+  UpdateStats_Save(Ymodem_GetStats());
 }
 
 /**
@@ -116,7 +249,7 @@ void SerialUpload(void)
 
   Serial_PutString((uint8_t *)"\n\n\rWaiting to receive file\n\r");
 
-  HAL_UART_Receive(&UartHandle, &status, 1, RX_TIMEOUT);
+  Link_Receive(&status, 1, RX_TIMEOUT);
   if ( status == CRC16)
   {
     /* Transmit the flash image through ymodem protocol */
@@ -155,13 +288,23 @@ void Main_Menu(void)
     Serial_PutString((uint8_t *)"  Upload image from the internal Flash ----------------- 2\r\n\n");
     Serial_PutString((uint8_t *)"  Execute the loaded application ----------------------- 3\r\n\n");
     Serial_PutString((uint8_t *)"  Delete application ----------------------------------- 4\r\n\n");
+#ifdef PROFILE_ENABLED
+    Serial_PutString((uint8_t *)"  Profile results (tools/profile_dump.py) -------------- 5\r\n\n");
+#endif /* PROFILE_ENABLED */
     Serial_PutString((uint8_t *)"========================================================\r\n\n");
 
     /* Clean the input path */
-    __HAL_UART_FLUSH_DRREGISTER(&UartHandle);
+    Link_Flush();
 	
     /* Receive key */
-    HAL_UART_Receive(&UartHandle, &key, 1, RX_TIMEOUT);
+    Link_Receive(&key, 1, RX_TIMEOUT);
+#ifdef IAP_CHAIN_ENABLED
+    /* The rest of the chain follows, except for what this board sends back */
+    if ((key != '2') && (key != '5'))
+    {
+      Chain_Forward(key);
+    }
+#endif /* IAP_CHAIN_ENABLED */
 
     switch (key)
     {
@@ -178,8 +321,8 @@ void Main_Menu(void)
 		JumpToApplication_Funtion();
       break;
     case '4' :
-      /* Delete an application from the Flash */
-      if(FLASH_Erase(APPLICATION_ADDRESS) == FLASHIF_OK)
+      /* Delete an application from the Flash, the config page is erased last */
+      if((BootCache_Invalidate() == FLASHIF_OK) && (FLASH_Erase(APPLICATION_ADDRESS) == FLASHIF_OK))
 			{
 				Serial_PutString((uint8_t *)"Delete Success!\r\n\n");
 			}
@@ -188,6 +331,11 @@ void Main_Menu(void)
 				Serial_PutString((uint8_t *)"Delete Fail!\r\n\n");
 			}
       break;
+#ifdef PROFILE_ENABLED
+    case '5' :
+      Profile_Dump(ProfileSend);
+      break;
+#endif /* PROFILE_ENABLED */
 	default:
 	Serial_PutString((uint8_t *)"Invalid Number ! ==> The number should be either 1, 2, 3 or 4\r");
 	break;
@@ -198,24 +346,64 @@ void Main_Menu(void)
 
 void ReadyToUpdate(void)
 {
+	BootTrace_Event("MENU");
+	PROFILE_RESET();
 	FLASH_Init();
+#ifdef IAP_CHAIN_ENABLED
+	Chain_Init();
+#endif /* IAP_CHAIN_ENABLED */
+#ifdef IAP_RS485_ENABLED
+	RS485_Update();
+#else
 	Main_Menu();
+#endif /* IAP_RS485_ENABLED */
 }
 
-void JumpToApplication_Funtion(void)
+/**
+  * @brief  Start the application if it passes verification
+  * @note   Prints nothing and needs no HAL init, so it can run on the reset
+  *         clock before the bootloader brings anything up.
+  * @param  None
+  * @retval Reason the application was not started
+  */
+IMAGE_StatusTypeDef Application_Start(void)
 {
-	if (((*(__IO uint32_t*)APPLICATION_ADDRESS) & 0x2FFE0000 ) == 0x20000000)
+	IMAGE_StatusTypeDef status = BootCache_Verify();
+
+	BootTrace_Event("VRFY");
+	if (status != IMAGE_OK)
 	{
-		/* Jump to user application */
-		JumpAddress = *(__IO uint32_t*) (APPLICATION_ADDRESS + 4);
-		JumpToApplication = (pFunction) JumpAddress;
-		/* Initialize user application's Stack Pointer */
-		__set_MSP(*(__IO uint32_t*) APPLICATION_ADDRESS);
-		JumpToApplication();
+		return status;
 	}
-	else{
-		Serial_PutString((uint8_t *)"No image file is currently available!\r\n\n");
+	if (((*(__IO uint32_t*)APPLICATION_ADDRESS) & 0x2FFE0000 ) != 0x20000000)
+	{
+		return IMAGE_BAD_VECTOR;
 	}
+
+	/* Jump to user application */
+	JumpAddress = *(__IO uint32_t*) (APPLICATION_ADDRESS + 4);
+	JumpToApplication = (pFunction) JumpAddress;
+	BootTrace_Event("JUMP");
+	Handoff_Commit();
+#ifdef IAP_CHAIN_ENABLED
+	Chain_DeInit();
+#endif /* IAP_CHAIN_ENABLED */
+#ifdef IAP_SPI_ENABLED
+	SpiLink_DeInit();
+#endif /* IAP_SPI_ENABLED */
+	BOOT_PROFILE_STOP();
+	/* Initialize user application's Stack Pointer */
+	__set_MSP(*(__IO uint32_t*) APPLICATION_ADDRESS);
+	JumpToApplication();
+	return IMAGE_OK;
+}
+
+void JumpToApplication_Funtion(void)
+{
+	IMAGE_StatusTypeDef status = Application_Start();
+
+	Serial_PutString((uint8_t *)"No image file is currently available!\r\n\n");
+	SerialPutImageStatus(status);
 }
 /**
   * @}
@@ -39,4 +39,6 @@ extern uint32_t JumpAddress;
 void Main_Menu(void);
 void ReadyToUpdate(void);
 void JumpToApplication_Funtion(void);
+IMAGE_StatusTypeDef Application_Start(void);
+uint32_t WriteConfigPage(uint8_t fw_version, uint8_t flag, uint8_t bus_address);
 #endif  /* __MENU_H */
@@ -0,0 +1,112 @@
+/**
+  ******************************************************************************
+  * @file    profile.h
+  * @brief   Enter/exit probes on hot paths, timed with the TIM2 timebase.
+  ******************************************************************************
+  * With PROFILE_ENABLED (common.h of each project) every probe keeps count,
+  * min, max and total time of the code between PROFILE_ENTER and
+  * PROFILE_EXIT in a fixed table; without it the macros expand to nothing and
+  * profile.c is empty. Resolution is the 1 us timebase (64 cycles at 64 MHz),
+  * the cost a store on enter and about 20 cycles on exit. A probe must not
+  * be entered again before its exit (no recursion, no use from interrupts).
+  *
+  * Profile_Dump sends the table as one frame, little-endian:
+  *
+  *   60 F6 | n | n * PROFILE_RecordTypeDef | sum8
+  *
+  * The IAP sends it on menu entry 5, the APP on 60 F6 55 55;
+  * tools/profile_dump.py prints it with the mean of every probe.
+  *
+  * This file is shared by both projects, keep the two copies identical.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "common.h"
+#include "timebase.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define PROFILE_FRAME_ID        ((uint8_t)0xF6)
+
+/* Exported types ------------------------------------------------------------*/
+/* One entry per probe, PROFILE_NAMES in profile.c in the same order */
+typedef enum
+{
+  PROFILE_CRC16 = 0,        /* "CRC6" Cal_CRC16 of a received packet */
+  PROFILE_UART_RX,          /* "URX " HAL_UART_Receive of a packet body */
+  PROFILE_FLASH_WRITE,      /* "FPRG" FLASH_If_Write */
+  PROFILE_FLASH_ERASE,      /* "FERA" FLASH_ErasePage */
+  PROFILE_IMAGE_WRITE,      /* "IWRT" one packet decoded and programmed */
+  PROFILE_IMAGE_VERIFY,     /* "IVFY" Image_Verify, CRC32 of the image */
+  PROFILE_AES,              /* "AES " AES_CTR_Crypt of a packet payload */
+  PROFILE_SHA256,           /* "SHA " SHA256_Update of a staging buffer, SHA256_Final */
+  PROFILE_APP_LOOP,         /* "LOOP" one pass of the APP main loop, sleep excluded */
+  PROFILE_APP_RX,           /* "ARX " uart2_rx_handle */
+  PROFILE_PROBES
+} PROFILE_ProbeTypeDef;
+
+typedef struct
+{
+  uint32_t start;           /* Timebase_Now() at the last enter */
+  uint32_t count;
+  uint32_t min;             /* us */
+  uint32_t max;             /* us */
+  uint64_t total;           /* us */
+} PROFILE_EntryTypeDef;
+
+/* Probe as sent by Profile_Dump */
+typedef struct
+{
+  char     name[4];         /* not terminated */
+  uint32_t count;
+  uint32_t min;             /* us, 0xFFFFFFFF if never run */
+  uint32_t max;
+  uint64_t total;
+} __attribute__((packed)) PROFILE_RecordTypeDef;
+
+typedef void (*PROFILE_SendFn)(uint8_t *p_data, uint8_t length);
+
+/* Exported variables ------------------------------------------------------- */
+extern PROFILE_EntryTypeDef aProfile[PROFILE_PROBES];
+
+/* Exported macro ------------------------------------------------------------*/
+#ifdef PROFILE_ENABLED
+#define PROFILE_RESET()         Profile_Reset()
+#define PROFILE_ENTER(probe)    (aProfile[(probe)].start = Timebase_Now())
+#define PROFILE_EXIT(probe)     Profile_Exit(&aProfile[(probe)])
+#else
+#define PROFILE_RESET()         ((void)0)
+#define PROFILE_ENTER(probe)    ((void)0)
+#define PROFILE_EXIT(probe)     ((void)0)
+#endif /* PROFILE_ENABLED */
+
+/**
+  * @brief  Account the time since the probe was entered
+  * @param  entry: probe table entry
+  * @retval None
+  */
+__STATIC_INLINE void Profile_Exit(PROFILE_EntryTypeDef *entry)
+{
+  uint32_t elapsed = Timebase_Now() - entry->start;
+
+  entry->count++;
+  entry->total += elapsed;
+  if (elapsed < entry->min)
+  {
+    entry->min = elapsed;
+  }
+  if (elapsed > entry->max)
+  {
+    entry->max = elapsed;
+  }
+}
+
+/* Exported functions ------------------------------------------------------- */
+void Profile_Reset(void);
+void Profile_Dump(PROFILE_SendFn p_send);
+
+#endif  /* __PROFILE_H */
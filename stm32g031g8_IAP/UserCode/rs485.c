@@ -0,0 +1,426 @@
+/**
+  ******************************************************************************
+  * @file    rs485.c
+  * @brief   Broadcast update of many devices sharing one RS-485 bus.
+  *          Frames are received in aPacketData, Ymodem is not running.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "rs485.h"
+#include "common.h"
+#include "ymodem.h"
+#include "menu.h"
+#include "usart.h"
+#include "handoff.h"
+#include "bootcache.h"
+#include "string.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BLOCKS_PER_PAGE         (FLASH_PAGE_SIZE / RS485_BLOCK_SIZE)
+
+/* Private variables ---------------------------------------------------------*/
+static RS485_StatusTypeDef Status;
+static uint32_t SessionSize;
+static uint32_t SessionStart;
+/* Bit n: page n of the APP area must be erased again before its next block */
+static uint32_t PageErase;
+static uint8_t aAnswer[RS485_FRAME_HEADER_SIZE + sizeof(RS485_StatusTypeDef) + RS485_FRAME_CRC_SIZE];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t FrameCRC(const uint8_t *p_header, const uint8_t *p_payload, uint32_t length);
+static HAL_StatusTypeDef ReceiveFrame(uint8_t *p_header, uint32_t *p_length);
+static void SendStatus(uint8_t command);
+static void CountError(void);
+static void SetMissing(uint32_t block, uint32_t missing);
+static uint32_t IsMissing(uint32_t block);
+static uint32_t CountMissing(void);
+static void Begin(const uint8_t *p_payload, uint32_t length);
+static void Data(uint8_t *p_payload, uint32_t length);
+static void End(void);
+static void SetAddress(const uint8_t *p_payload, uint32_t length);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  CRC16 of a frame, the same as Cal_CRC16 over header and payload
+  * @param  p_header: address, command and length
+  * @param  p_payload: payload
+  * @param  length: payload length
+  * @retval CRC16
+  */
+static uint16_t FrameCRC(const uint8_t *p_header, const uint8_t *p_payload, uint32_t length)
+{
+  uint16_t crc = 0;
+  uint32_t i;
+
+  for (i = 0; i < RS485_FRAME_HEADER_SIZE - 1; i++)
+  {
+    crc = UpdateCRC16(crc, p_header[i]);
+  }
+  for (i = 0; i < length; i++)
+  {
+    crc = UpdateCRC16(crc, p_payload[i]);
+  }
+  crc = UpdateCRC16(crc, 0);
+  return UpdateCRC16(crc, 0);
+}
+
+/**
+  * @brief  Wait for the next frame, the payload goes to aPacketData
+  * @param  p_header: address, command and length of the frame
+  * @param  p_length: payload length
+  * @retval HAL_OK for a complete frame with a good CRC
+  */
+static HAL_StatusTypeDef ReceiveFrame(uint8_t *p_header, uint32_t *p_length)
+{
+  uint8_t sync = 0;
+  uint32_t crc;
+
+  while (sync != RS485_SYNC)
+  {
+    HAL_UART_Receive(&UartHandle, &sync, 1, RX_TIMEOUT);
+  }
+  if (HAL_UART_Receive(&UartHandle, p_header, RS485_FRAME_HEADER_SIZE - 1, RS485_FRAME_TIMEOUT) != HAL_OK)
+  {
+    return HAL_TIMEOUT;
+  }
+  *p_length = p_header[2] | ((uint32_t)p_header[3] << 8);
+  if (*p_length > RS485_MAX_PAYLOAD)
+  {
+    return HAL_ERROR;
+  }
+  if (HAL_UART_Receive(&UartHandle, aPacketData, *p_length + RS485_FRAME_CRC_SIZE, RS485_FRAME_TIMEOUT) != HAL_OK)
+  {
+    return HAL_TIMEOUT;
+  }
+  crc = ((uint32_t)aPacketData[*p_length] << 8) | aPacketData[*p_length + 1];
+  return (FrameCRC(p_header, aPacketData, *p_length) == crc) ? HAL_OK : HAL_ERROR;
+}
+
+/**
+  * @brief  Answer a frame sent to this device with the session status
+  * @param  command: command of the frame answered
+  * @retval None
+  */
+static void SendStatus(uint8_t command)
+{
+  uint16_t crc;
+
+  aAnswer[0] = RS485_SYNC;
+  aAnswer[1] = Read_Config.bus_address;
+  aAnswer[2] = command | RS485_ANSWER;
+  aAnswer[3] = sizeof(RS485_StatusTypeDef);
+  aAnswer[4] = 0;
+  memcpy(&aAnswer[RS485_FRAME_HEADER_SIZE], &Status, sizeof(RS485_StatusTypeDef));
+  crc = FrameCRC(&aAnswer[1], &aAnswer[RS485_FRAME_HEADER_SIZE], sizeof(RS485_StatusTypeDef));
+  aAnswer[RS485_FRAME_HEADER_SIZE + sizeof(RS485_StatusTypeDef)] = crc >> 8;
+  aAnswer[RS485_FRAME_HEADER_SIZE + sizeof(RS485_StatusTypeDef) + 1] = crc & 0xFF;
+  HAL_UART_Transmit(&UartHandle, aAnswer, sizeof(aAnswer), TX_TIMEOUT);
+
+  /* A transceiver with RE grounded echoes the answer back */
+  while (__HAL_UART_GET_FLAG(&UartHandle, UART_FLAG_TC) == RESET)
+  {
+  }
+  __HAL_UART_FLUSH_DRREGISTER(&UartHandle);
+  __HAL_UART_CLEAR_FLAG(&UartHandle, UART_CLEAR_OREF);
+}
+
+/**
+  * @brief  Count a dropped frame, saturating
+  * @param  None
+  * @retval None
+  */
+static void CountError(void)
+{
+  if (Status.errors < 0xFFFF)
+  {
+    Status.errors++;
+  }
+}
+
+/**
+  * @brief  Mark a block as still needed or as programmed
+  * @param  block: block number
+  * @param  missing: 1 if the block must be sent again
+  * @retval None
+  */
+static void SetMissing(uint32_t block, uint32_t missing)
+{
+  if (missing)
+  {
+    Status.missing[block / 8] |= (uint8_t)(1u << (block % 8));
+  }
+  else
+  {
+    Status.missing[block / 8] &= (uint8_t)~(1u << (block % 8));
+  }
+}
+
+/**
+  * @brief  Check whether a block is still needed
+  * @param  block: block number
+  * @retval 1 if the block has not been programmed
+  */
+static uint32_t IsMissing(uint32_t block)
+{
+  return (Status.missing[block / 8] >> (block % 8)) & 1u;
+}
+
+/**
+  * @brief  Number of blocks still needed
+  * @param  None
+  * @retval Block count
+  */
+static uint32_t CountMissing(void)
+{
+  uint32_t block, count = 0;
+
+  for (block = 0; block < Status.blocks; block++)
+  {
+    count += IsMissing(block);
+  }
+  return count;
+}
+
+/**
+  * @brief  Start a session: check the image header, erase the APP area
+  * @note   A BEGIN repeated for the session in progress is ignored, so the
+  *         host may send it again for devices that missed it.
+  * @param  p_payload: RS485_BeginTypeDef
+  * @param  length: payload length
+  * @retval None
+  */
+static void Begin(const uint8_t *p_payload, uint32_t length)
+{
+  const RS485_BeginTypeDef *begin = (const RS485_BeginTypeDef *)p_payload;
+  uint32_t block, page;
+
+  if (length != sizeof(RS485_BeginTypeDef))
+  {
+    CountError();
+    return;
+  }
+  if ((Status.state == RS485_RECEIVING) && (Status.build_id == begin->header.build_id) && (SessionSize == begin->size))
+  {
+    return;
+  }
+
+  memset(&Status, 0, sizeof(Status));
+  Status.build_id = begin->header.build_id;
+  SessionSize = begin->size;
+  SessionStart = HAL_GetTick();
+  PageErase = 0;
+
+  Status.image = Image_CheckHeader(&begin->header, APPLICATION_MAX_SIZE);
+  if ((Status.image == IMAGE_OK) && (begin->size != begin->header.length + IMAGE_TRAILER_SIZE))
+  {
+    Status.image = IMAGE_BAD_LENGTH;
+  }
+  if (Status.image != IMAGE_OK)
+  {
+    /* Nothing erased, the installed application is still there */
+    Status.state = RS485_FAILED;
+    Status.result = COM_IMAGE;
+    return;
+  }
+  if (BootCache_Invalidate() != FLASHIF_OK)
+  {
+    /* A partly written image must not pass for the recorded one */
+    Status.state = RS485_FAILED;
+    Status.result = COM_DATA;
+    return;
+  }
+
+  Status.blocks = (SessionSize + RS485_BLOCK_SIZE - 1) / RS485_BLOCK_SIZE;
+  for (block = 0; block < Status.blocks; block++)
+  {
+    SetMissing(block, 1);
+  }
+  for (page = 0; page * FLASH_PAGE_SIZE < SessionSize; page++)
+  {
+    if (FLASH_ErasePage(APPLICATION_ADDRESS + page * FLASH_PAGE_SIZE) != FLASHIF_OK)
+    {
+      PageErase |= 1u << page;
+    }
+  }
+  Status.state = RS485_RECEIVING;
+  Status.result = COM_OK;
+}
+
+/**
+  * @brief  Program one block at its offset, unless it is already there
+  * @param  p_payload: RS485_DataTypeDef followed by the block, 32-bit aligned
+  * @param  length: payload length
+  * @retval None
+  */
+static void Data(uint8_t *p_payload, uint32_t length)
+{
+  const RS485_DataTypeDef *data = (const RS485_DataTypeDef *)p_payload;
+  uint32_t block = data->block;
+  uint32_t offset = block * RS485_BLOCK_SIZE;
+  uint32_t page = offset / FLASH_PAGE_SIZE;
+  uint32_t size, padded, i;
+
+  if ((Status.state != RS485_RECEIVING) || (data->session != (uint16_t)Status.build_id))
+  {
+    return;
+  }
+  if ((length < RS485_DATA_HEADER_SIZE) || (block >= Status.blocks))
+  {
+    CountError();
+    return;
+  }
+  size = length - RS485_DATA_HEADER_SIZE;
+  if ((size != (((SessionSize - offset) < RS485_BLOCK_SIZE) ? (SessionSize - offset) : RS485_BLOCK_SIZE)))
+  {
+    CountError();
+    return;
+  }
+  if (!IsMissing(block))
+  {
+    return;
+  }
+
+  if (PageErase & (1u << page))
+  {
+    if (FLASH_ErasePage(APPLICATION_ADDRESS + page * FLASH_PAGE_SIZE) != FLASHIF_OK)
+    {
+      CountError();
+      return;
+    }
+    PageErase &= ~(1u << page);
+  }
+
+  /* The G0 programs double words, pad the last block with erased bytes */
+  padded = (size + 7) & ~7u;
+  memset(&p_payload[RS485_DATA_HEADER_SIZE + size], 0xFF, padded - size);
+  if (FLASH_If_Write(APPLICATION_ADDRESS + offset, (uint32_t *)&p_payload[RS485_DATA_HEADER_SIZE], padded / 4) == FLASHIF_OK)
+  {
+    SetMissing(block, 0);
+  }
+  else
+  {
+    /* The page can only be programmed again once erased, which loses the
+       other blocks it holds as well */
+    CountError();
+    PageErase |= 1u << page;
+    for (i = page * BLOCKS_PER_PAGE; (i < (page + 1) * BLOCKS_PER_PAGE) && (i < Status.blocks); i++)
+    {
+      SetMissing(i, 1);
+    }
+  }
+}
+
+/**
+  * @brief  Close the session once every block is programmed
+  * @param  None
+  * @retval None
+  */
+static void End(void)
+{
+  if ((Status.state != RS485_RECEIVING) || (CountMissing() != 0))
+  {
+    return;
+  }
+
+  Status.image = Image_Verify(APPLICATION_ADDRESS, APPLICATION_MAX_SIZE);
+  if (Status.image != IMAGE_OK)
+  {
+    Status.state = RS485_FAILED;
+    Status.result = COM_DATA;
+  }
+  else if (WriteConfigPage(IMAGE_HEADER(APPLICATION_ADDRESS)->fw_version, NOT_UPDATA, Read_Config.bus_address) != FLASHIF_OK)
+  {
+    Status.state = RS485_FAILED;
+    Status.result = COM_ERROR;
+  }
+  else
+  {
+    Status.state = RS485_DONE;
+    Status.result = COM_OK;
+  }
+  Handoff_RecordUpdate(Status.result, Status.image, Status.errors, SessionSize, HAL_GetTick() - SessionStart);
+}
+
+/**
+  * @brief  Store a new bus address in the config page
+  * @param  p_payload: new address
+  * @param  length: payload length
+  * @retval None
+  */
+static void SetAddress(const uint8_t *p_payload, uint32_t length)
+{
+  if ((length != 1) || (p_payload[0] == RS485_ADDRESS_BROADCAST) || (p_payload[0] == RS485_ADDRESS_NONE))
+  {
+    CountError();
+    return;
+  }
+  WriteConfigPage(Read_Config.FW_vision, Read_Config.updata_flg, p_payload[0]);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Serve the bus until an application is started, replaces the menu
+  * @param  None
+  * @retval None
+  */
+void RS485_Update(void)
+{
+  uint8_t header[RS485_FRAME_HEADER_SIZE - 1];
+  uint32_t length;
+  HAL_StatusTypeDef status;
+
+  memset(&Status, 0, sizeof(Status));
+  Status.state = RS485_IDLE;
+
+  while (1)
+  {
+    status = ReceiveFrame(header, &length);
+    if (status != HAL_OK)
+    {
+      /* Resynchronise on the gap before the next frame */
+      CountError();
+      while (HAL_UART_Receive(&UartHandle, header, 1, PURGE_TIMEOUT) == HAL_OK)
+      {
+      }
+      continue;
+    }
+    if ((header[0] != RS485_ADDRESS_BROADCAST) && (header[0] != Read_Config.bus_address))
+    {
+      continue;
+    }
+
+    switch (header[1])
+    {
+      case RS485_CMD_BEGIN:
+        Begin(aPacketData, length);
+        break;
+      case RS485_CMD_DATA:
+        Data(aPacketData, length);
+        break;
+      case RS485_CMD_END:
+        End();
+        break;
+      case RS485_CMD_RUN:
+        /* Only returns if the application cannot be started */
+        Application_Start();
+        break;
+      case RS485_CMD_ADDRESS:
+        if (header[0] != RS485_ADDRESS_BROADCAST)
+        {
+          SetAddress(aPacketData, length);
+        }
+        break;
+      case RS485_CMD_STATUS:
+      default:
+        break;
+    }
+
+    if (header[0] != RS485_ADDRESS_BROADCAST)
+    {
+      SendStatus(header[1]);
+    }
+  }
+}
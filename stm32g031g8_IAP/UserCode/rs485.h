@@ -0,0 +1,96 @@
+/**
+  ******************************************************************************
+  * @file    rs485.h
+  * @brief   Broadcast update of many devices sharing one RS-485 bus
+  *          (IAP_RS485_ENABLED, host side tools/rs485_update.py).
+  ******************************************************************************
+  * Frame layout, integers little-endian, CRC16 as Ymodem (big-endian):
+  *
+  *   | RS485_SYNC | address | command | length (2) | payload ... | CRC16 (2) |
+  *
+  * The CRC16 covers address to the end of the payload. Address 0 is a
+  * broadcast and is never answered; a device answers the frames sent to its
+  * own address (config_data_t.bus_address, RS485_ADDRESS_NONE while not
+  * assigned) with the command | RS485_ANSWER. The USART drives the DE pin,
+  * a device only transmits while answering.
+  *
+  * Update session:
+  *   BEGIN   broadcast: size + image header; the header is checked, then the
+  *           pages the image needs are erased (the host waits for it)
+  *   DATA    broadcast: one RS485_BLOCK_SIZE block programmed at its offset,
+  *           the host leaves the programming time between two blocks
+  *   STATUS  polled per device: bitmap of the blocks still missing, a block
+  *           lost or not programmed correctly is simply sent again
+  *   END     CRC32 check of the image, config page written
+  *   RUN     start the application
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RS485_H
+#define __RS485_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "flash.h"
+#include "image.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define RS485_SYNC              ((uint8_t)0xA5)
+#define RS485_FRAME_HEADER_SIZE ((uint32_t)5)     /* sync, address, command, length */
+#define RS485_FRAME_CRC_SIZE    ((uint32_t)2)
+
+#define RS485_ADDRESS_BROADCAST ((uint8_t)0x00)
+#define RS485_ADDRESS_NONE      ((uint8_t)0xFF)   /* erased config page */
+
+#define RS485_CMD_BEGIN         ((uint8_t)0x01)
+#define RS485_CMD_DATA          ((uint8_t)0x02)
+#define RS485_CMD_STATUS        ((uint8_t)0x03)
+#define RS485_CMD_END           ((uint8_t)0x04)
+#define RS485_CMD_RUN           ((uint8_t)0x05)
+#define RS485_CMD_ADDRESS       ((uint8_t)0x06)   /* payload: new address */
+#define RS485_ANSWER            ((uint8_t)0x80)
+
+#define RS485_BLOCK_SIZE        ((uint32_t)1024)
+#define RS485_DATA_HEADER_SIZE  ((uint32_t)4)     /* keeps the block 32-bit aligned */
+#define RS485_MAX_BLOCKS        ((APPLICATION_MAX_SIZE + RS485_BLOCK_SIZE - 1) / RS485_BLOCK_SIZE)
+#define RS485_MAX_PAYLOAD       (RS485_DATA_HEADER_SIZE + RS485_BLOCK_SIZE)
+
+/* Rest of a frame once its sync byte has been seen */
+#define RS485_FRAME_TIMEOUT     ((uint32_t)100)
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  RS485_IDLE = 0,       /* no session since reset */
+  RS485_RECEIVING,      /* pages erased, blocks arriving */
+  RS485_DONE,           /* image verified and config written */
+  RS485_FAILED          /* see result and image */
+} RS485_StateTypeDef;
+
+typedef struct
+{
+  uint32_t size;                  /* file size: header.length + IMAGE_TRAILER_SIZE */
+  IMAGE_HeaderTypeDef header;     /* copy of the image header, checked before erasing */
+} __attribute__((packed)) RS485_BeginTypeDef;
+
+typedef struct
+{
+  uint16_t block;                 /* block number, offset block * RS485_BLOCK_SIZE */
+  uint16_t session;               /* low half of the build ID given to BEGIN */
+} RS485_DataTypeDef;
+
+typedef struct
+{
+  uint8_t  state;                 /* RS485_StateTypeDef */
+  uint8_t  result;                /* COM_StatusTypeDef of the session */
+  uint8_t  image;                 /* IMAGE_StatusTypeDef */
+  uint8_t  blocks;                /* number of blocks of the image */
+  uint32_t build_id;              /* of the image being received */
+  uint16_t errors;                /* frames dropped: CRC, length, programming */
+  uint8_t  missing[(RS485_MAX_BLOCKS + 7) / 8];   /* bit n: block n still needed */
+} __attribute__((packed)) RS485_StatusTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void RS485_Update(void);
+
+#endif  /* __RS485_H */
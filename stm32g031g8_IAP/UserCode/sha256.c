@@ -0,0 +1,217 @@
+/**
+  ******************************************************************************
+  * @file    sha256.c
+  * @brief   SHA-256 with unrolled rounds and message schedule, see sha256.h.
+  ******************************************************************************
+  * The message words are read as little-endian words and byte reversed
+  * (REV), so whole blocks of a word aligned buffer, as the flash staging
+  * buffer, are hashed where they are without a copy.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sha256.h"
+#include "string.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Compiled to MOVS + RORS */
+#define ROTR(x, n)              (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* FIPS 180-4 4.1.2, factored so that one temporary is enough */
+#define SIGMA0(x)               ROTR(ROTR(ROTR((x), 9) ^ (x), 11) ^ (x), 2)
+#define SIGMA1(x)               ROTR(ROTR(ROTR((x), 14) ^ (x), 5) ^ (x), 6)
+#define SSIG0(x)                (ROTR(ROTR((x), 11) ^ (x), 7) ^ ((x) >> 3))
+#define SSIG1(x)                (ROTR(ROTR((x), 2) ^ (x), 17) ^ ((x) >> 10))
+#define CH(x, y, z)             ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z)            (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* Round j of the current 16: the caller rotates the variable names */
+#define ROUND(a, b, c, d, e, f, g, h, j)                                   \
+  do                                                                       \
+  {                                                                        \
+    (h) += SIGMA1(e) + CH((e), (f), (g)) + p_k[(j)] + w[(j)];              \
+    (d) += (h);                                                            \
+    (h) += SIGMA0(a) + MAJ((a), (b), (c));                                 \
+  } while (0)
+
+/* W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16], in the window */
+#define SCHEDULE(j)             (w[(j)] += SSIG1(w[((j) + 14) & 15]) + w[((j) + 9) & 15] + SSIG0(w[((j) + 1) & 15]))
+
+/* Private variables ---------------------------------------------------------*/
+static const uint32_t aK[64] =
+{
+  0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+  0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+  0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+  0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+  0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+  0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+  0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+  0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Hash one block into the state
+  * @param  p_state: 8 words
+  * @param  p_block: SHA256_BLOCK_SIZE bytes, word aligned
+  * @retval None
+  */
+static void SHA256_Compress(uint32_t *p_state, const uint32_t *p_block)
+{
+  const uint32_t *p_k = aK;
+  uint32_t w[16];
+  uint32_t a, b, c, d, e, f, g, h;
+  uint32_t i;
+
+  for (i = 0; i < 16; i++)
+  {
+    w[i] = __REV(p_block[i]);
+  }
+  a = p_state[0];
+  b = p_state[1];
+  c = p_state[2];
+  d = p_state[3];
+  e = p_state[4];
+  f = p_state[5];
+  g = p_state[6];
+  h = p_state[7];
+
+  for (i = 0; i < 4; i++)
+  {
+    if (i > 0)
+    {
+      SCHEDULE(0);  SCHEDULE(1);  SCHEDULE(2);  SCHEDULE(3);
+      SCHEDULE(4);  SCHEDULE(5);  SCHEDULE(6);  SCHEDULE(7);
+      SCHEDULE(8);  SCHEDULE(9);  SCHEDULE(10); SCHEDULE(11);
+      SCHEDULE(12); SCHEDULE(13); SCHEDULE(14); SCHEDULE(15);
+    }
+    ROUND(a, b, c, d, e, f, g, h, 0);
+    ROUND(h, a, b, c, d, e, f, g, 1);
+    ROUND(g, h, a, b, c, d, e, f, 2);
+    ROUND(f, g, h, a, b, c, d, e, 3);
+    ROUND(e, f, g, h, a, b, c, d, 4);
+    ROUND(d, e, f, g, h, a, b, c, 5);
+    ROUND(c, d, e, f, g, h, a, b, 6);
+    ROUND(b, c, d, e, f, g, h, a, 7);
+    ROUND(a, b, c, d, e, f, g, h, 8);
+    ROUND(h, a, b, c, d, e, f, g, 9);
+    ROUND(g, h, a, b, c, d, e, f, 10);
+    ROUND(f, g, h, a, b, c, d, e, 11);
+    ROUND(e, f, g, h, a, b, c, d, 12);
+    ROUND(d, e, f, g, h, a, b, c, 13);
+    ROUND(c, d, e, f, g, h, a, b, 14);
+    ROUND(b, c, d, e, f, g, h, a, 15);
+    p_k += 16;
+  }
+
+  p_state[0] += a;
+  p_state[1] += b;
+  p_state[2] += c;
+  p_state[3] += d;
+  p_state[4] += e;
+  p_state[5] += f;
+  p_state[6] += g;
+  p_state[7] += h;
+}
+
+/* Public functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Start a new digest
+  * @param  ctx: hash instance
+  * @retval None
+  */
+void SHA256_Init(SHA256_CtxTypeDef *ctx)
+{
+  ctx->state[0] = 0x6A09E667;
+  ctx->state[1] = 0xBB67AE85;
+  ctx->state[2] = 0x3C6EF372;
+  ctx->state[3] = 0xA54FF53A;
+  ctx->state[4] = 0x510E527F;
+  ctx->state[5] = 0x9B05688C;
+  ctx->state[6] = 0x1F83D9AB;
+  ctx->state[7] = 0x5BE0CD19;
+  ctx->length = 0;
+}
+
+/**
+  * @brief  Hash the next bytes of the message
+  * @param  ctx: hash instance
+  * @param  p_data: bytes following the ones of the previous call
+  * @param  length: number of bytes
+  * @retval None
+  */
+void SHA256_Update(SHA256_CtxTypeDef *ctx, const uint8_t *p_data, uint32_t length)
+{
+  uint32_t used = ctx->length & (SHA256_BLOCK_SIZE - 1);
+  uint32_t fill;
+
+  ctx->length += length;
+  if (used > 0)
+  {
+    fill = SHA256_BLOCK_SIZE - used;
+    if (length < fill)
+    {
+      memcpy((uint8_t *)ctx->block + used, p_data, length);
+      return;
+    }
+    memcpy((uint8_t *)ctx->block + used, p_data, fill);
+    SHA256_Compress(ctx->state, ctx->block);
+    p_data += fill;
+    length -= fill;
+  }
+
+  while (length >= SHA256_BLOCK_SIZE)
+  {
+    if (((uint32_t)p_data & 3) == 0)
+    {
+      SHA256_Compress(ctx->state, (const uint32_t *)p_data);
+    }
+    else
+    {
+      memcpy(ctx->block, p_data, SHA256_BLOCK_SIZE);
+      SHA256_Compress(ctx->state, ctx->block);
+    }
+    p_data += SHA256_BLOCK_SIZE;
+    length -= SHA256_BLOCK_SIZE;
+  }
+  memcpy(ctx->block, p_data, length);
+}
+
+/**
+  * @brief  Pad the message and output its digest
+  * @note   The instance must be initialized again before further use.
+  * @param  ctx: hash instance
+  * @param  p_digest: SHA256_DIGEST_SIZE bytes
+  * @retval None
+  */
+void SHA256_Final(SHA256_CtxTypeDef *ctx, uint8_t *p_digest)
+{
+  uint8_t *p_block = (uint8_t *)ctx->block;
+  uint32_t used = ctx->length & (SHA256_BLOCK_SIZE - 1);
+  uint32_t i;
+
+  p_block[used++] = 0x80;
+  if (used > SHA256_BLOCK_SIZE - 8)
+  {
+    memset(&p_block[used], 0, SHA256_BLOCK_SIZE - used);
+    SHA256_Compress(ctx->state, ctx->block);
+    used = 0;
+  }
+  memset(&p_block[used], 0, SHA256_BLOCK_SIZE - 8 - used);
+  /* Message length in bits, big-endian */
+  ctx->block[14] = __REV(ctx->length >> 29);
+  ctx->block[15] = __REV(ctx->length << 3);
+  SHA256_Compress(ctx->state, ctx->block);
+
+  for (i = 0; i < 8; i++)
+  {
+    p_digest[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+    p_digest[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+    p_digest[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+    p_digest[4 * i + 3] = (uint8_t)ctx->state[i];
+  }
+}
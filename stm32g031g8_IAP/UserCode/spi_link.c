@@ -0,0 +1,273 @@
+/**
+  ******************************************************************************
+  * @file    spi_link.c
+  * @brief   SPI slave link to the host, see spi_link.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "spi_link.h"
+#include "link.h"
+#include "spi.h"
+#include "string.h"
+
+#ifdef IAP_SPI_ENABLED
+
+/* Private define ------------------------------------------------------------*/
+#define SPI_LINK_HEADER_SIZE    ((uint16_t)2)
+#define SPI_LINK_FRAME_SIZE     (SPI_LINK_HEADER_SIZE + SPI_LINK_MTU)
+
+/* Private variables ---------------------------------------------------------*/
+/* Frame of the last transaction from the host */
+static uint8_t aLinkRx[SPI_LINK_FRAME_SIZE];
+/* Frame to the host: header, then the bytes queued by SpiLink_Transmit */
+static uint8_t aLinkTx[SPI_LINK_FRAME_SIZE];
+static uint16_t RxEnd;              /* end of the data in aLinkRx */
+static uint16_t RxRead;             /* next data byte to hand out */
+static uint16_t TxLength;           /* bytes queued in aLinkTx */
+static uint16_t TxArmed;            /* of which announced in the armed transaction */
+static uint8_t Armed;
+/* NSS has fallen since the transaction was armed */
+static volatile uint8_t Started;
+static uint32_t LineErrors;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Arm(void);
+static void Complete(void);
+static void Poll(void);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Set up the next transaction and raise READY
+  * @note   The whole frame is armed both ways: bytes past the announced
+  *         length are ignored by the host, and bytes queued meanwhile go
+  *         into the buffer after them, the DMA never reads them twice.
+  * @param  None
+  * @retval None
+  */
+static void Arm(void)
+{
+  TxArmed = TxLength;
+  aLinkTx[0] = (uint8_t)TxArmed;
+  aLinkTx[1] = (uint8_t)(TxArmed >> 8);
+  Started = 0;
+  HAL_SPI_TransmitReceive_DMA(&hspi1, aLinkTx, aLinkRx, SPI_LINK_FRAME_SIZE);
+  Armed = 1;
+  HAL_GPIO_WritePin(SPI_READY_GPIO_Port, SPI_READY_Pin, GPIO_PIN_SET);
+}
+
+/**
+  * @brief  Take in the transaction the host has just ended
+  * @note   The DMA channels run without interrupts and the transfer never
+  *         reaches its full size, so it is stopped here. SPI1 is reset
+  *         rather than disabled: the transmit FIFO holds up to 4 bytes past
+  *         the last one clocked, which would start the next transaction.
+  * @param  None
+  * @retval None
+  */
+static void Complete(void)
+{
+  uint16_t clocked = SPI_LINK_FRAME_SIZE - __HAL_DMA_GET_COUNTER(hspi1.hdmarx);
+  uint16_t length = 0;
+  uint16_t sent = 0;
+
+  if (__HAL_SPI_GET_FLAG(&hspi1, SPI_FLAG_OVR))
+  {
+    LineErrors |= LINK_ERROR_OVERRUN;
+  }
+  HAL_DMA_Abort(hspi1.hdmarx);
+  HAL_DMA_Abort(hspi1.hdmatx);
+  __HAL_RCC_SPI1_FORCE_RESET();
+  __HAL_RCC_SPI1_RELEASE_RESET();
+  HAL_SPI_Init(&hspi1);
+  Armed = 0;
+
+  if (clocked >= SPI_LINK_HEADER_SIZE)
+  {
+    length = aLinkRx[0] | (aLinkRx[1] << 8);
+    if (length > clocked - SPI_LINK_HEADER_SIZE)
+    {
+      /* Host stopped early, its frame is cut */
+      LineErrors |= LINK_ERROR_FRAMING;
+      length = clocked - SPI_LINK_HEADER_SIZE;
+    }
+    sent = clocked - SPI_LINK_HEADER_SIZE;
+    if (sent > TxArmed)
+    {
+      sent = TxArmed;
+    }
+  }
+  RxRead = SPI_LINK_HEADER_SIZE;
+  RxEnd = SPI_LINK_HEADER_SIZE + length;
+
+  TxLength -= sent;
+  memmove(&aLinkTx[SPI_LINK_HEADER_SIZE], &aLinkTx[SPI_LINK_HEADER_SIZE + sent], TxLength);
+}
+
+/**
+  * @brief  Take in the ended transaction, arm the next one when the last
+  *         frame from the host has been read
+  * @param  None
+  * @retval None
+  */
+static void Poll(void)
+{
+  if (Armed && Started && (HAL_GPIO_ReadPin(SPI_NSS_GPIO_Port, SPI_NSS_Pin) == GPIO_PIN_SET))
+  {
+    Complete();
+  }
+  if (!Armed && (RxRead == RxEnd))
+  {
+    Arm();
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start the link, SPI1 is initialized
+  * @param  None
+  * @retval None
+  */
+void SpiLink_Init(void)
+{
+  RxEnd = 0;
+  RxRead = 0;
+  TxLength = 0;
+  LineErrors = 0;
+  Armed = 0;
+  Poll();
+}
+
+/**
+  * @brief  Stop SPI1 and its DMA before the application takes the RAM
+  * @note   Also called on the fast boot path, before anything is initialized
+  * @param  None
+  * @retval None
+  */
+void SpiLink_DeInit(void)
+{
+  if (hspi1.State != HAL_SPI_STATE_RESET)
+  {
+    HAL_GPIO_WritePin(SPI_READY_GPIO_Port, SPI_READY_Pin, GPIO_PIN_RESET);
+    HAL_DMA_Abort(hspi1.hdmarx);
+    HAL_DMA_Abort(hspi1.hdmatx);
+    HAL_SPI_DeInit(&hspi1);
+    Armed = 0;
+  }
+}
+
+/**
+  * @brief  HAL_UART_Receive on the link
+  * @param  p_data: received bytes
+  * @param  size: number of bytes
+  * @param  timeout: for the whole call in ms, HAL_MAX_DELAY waits forever
+  * @retval HAL_OK or HAL_TIMEOUT
+  */
+HAL_StatusTypeDef SpiLink_Receive(uint8_t *p_data, uint16_t size, uint32_t timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint16_t count;
+
+  while (size > 0)
+  {
+    Poll();
+    count = RxEnd - RxRead;
+    if (count > 0)
+    {
+      if (count > size)
+      {
+        count = size;
+      }
+      memcpy(p_data, &aLinkRx[RxRead], count);
+      RxRead += count;
+      p_data += count;
+      size -= count;
+    }
+    else if ((HAL_GetTick() - tickstart) >= timeout)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  HAL_UART_Transmit on the link: the bytes are queued for the host
+  *         to read, the call waits only while the queue is full
+  * @note   The host can only empty the queue once the device has read what
+  *         it sent last.
+  * @param  p_data: bytes to send
+  * @param  size: number of bytes
+  * @param  timeout: in ms, for the room in the queue
+  * @retval HAL_OK, HAL_TIMEOUT if the host did not read in time
+  */
+HAL_StatusTypeDef SpiLink_Transmit(const uint8_t *p_data, uint16_t size, uint32_t timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint16_t count;
+
+  while (size > 0)
+  {
+    Poll();
+    count = SPI_LINK_MTU - TxLength;
+    if (count > 0)
+    {
+      if (count > size)
+      {
+        count = size;
+      }
+      memcpy(&aLinkTx[SPI_LINK_HEADER_SIZE + TxLength], p_data, count);
+      TxLength += count;
+      p_data += count;
+      size -= count;
+    }
+    else if ((HAL_GetTick() - tickstart) >= timeout)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  Poll();
+  return HAL_OK;
+}
+
+/**
+  * @brief  Drop what the host has sent and was not read yet
+  * @param  None
+  * @retval None
+  */
+void SpiLink_Flush(void)
+{
+  Poll();
+  RxRead = RxEnd;
+}
+
+/**
+  * @brief  Errors seen since the last call
+  * @param  None
+  * @retval LINK_ERROR_xxx bits
+  */
+uint32_t SpiLink_TakeErrors(void)
+{
+  uint32_t errors = LineErrors;
+
+  LineErrors = 0;
+  return errors;
+}
+
+/**
+  * @brief  NSS fell: a transaction has started, drop READY at once
+  * @param  GPIO_Pin: EXTI line
+  * @retval None
+  */
+void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin)
+{
+  if (GPIO_Pin == SPI_NSS_Pin)
+  {
+    HAL_GPIO_WritePin(SPI_READY_GPIO_Port, SPI_READY_Pin, GPIO_PIN_RESET);
+    Started = 1;
+  }
+}
+
+#endif /* IAP_SPI_ENABLED */
@@ -0,0 +1,56 @@
+/**
+  ******************************************************************************
+  * @file    spi_link.h
+  * @brief   Byte pipe to the host over SPI1 in slave mode (IAP_SPI_ENABLED),
+  *          in place of USART1, with a READY line to pace the host.
+  ******************************************************************************
+  * The host is the SPI master (mode 0, up to 16 MHz SCK) and drives:
+  *
+  *   PA1 SCK, PA4 NSS, PA7 MOSI    to the device
+  *   PA6 MISO, PB1 READY           from the device
+  *
+  * Every transaction is full duplex, NSS low from the first to the last byte,
+  * and carries one frame each way, lengths little-endian:
+  *
+  *   host -> device   len (2) | len bytes                  len <= SPI_LINK_MTU
+  *   device -> host   len (2) | len bytes | anything
+  *
+  * The host clocks at least 2 + its own len bytes and at most
+  * 2 + SPI_LINK_MTU. What the device sends is taken as far as it was clocked,
+  * the rest comes first in the next transaction; to read, the host sends an
+  * empty frame and clocks as much as it wants to read.
+  *
+  * READY high means the device has armed the next transaction: both DMA
+  * channels are set up and the last frame from the host has been read. It
+  * drops on the falling edge of NSS (EXTI), so the host waits for READY
+  * before every transaction and never overruns the device: while the device
+  * programs flash, READY stays low and the host holds the next packet back.
+  *
+  * Over this pipe the menu and Ymodem_Receive run as they do on the UART
+  * (see link.h). A 1K packet takes 0.5 ms at 16 MHz instead of 11 ms at
+  * 921600 baud, so the download time is mostly the flash time: for a 45056
+  * byte image ymodem_bench --spi gives about 1.05 s, 484 ms of page erase
+  * and 479 ms of double word programming, against 1.47 s on the UART.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPI_LINK_H
+#define __SPI_LINK_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "common.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Longest frame each way: a whole 1K Ymodem packet with its header and CRC */
+#define SPI_LINK_MTU            ((uint16_t)1032)
+
+/* Exported functions ------------------------------------------------------- */
+void SpiLink_Init(void);
+void SpiLink_DeInit(void);
+HAL_StatusTypeDef SpiLink_Receive(uint8_t *p_data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef SpiLink_Transmit(const uint8_t *p_data, uint16_t size, uint32_t timeout);
+void SpiLink_Flush(void);
+uint32_t SpiLink_TakeErrors(void);
+
+#endif  /* __SPI_LINK_H */
@@ -0,0 +1,58 @@
+/**
+  ******************************************************************************
+  * @file    timebase.c
+  * @brief   Free running 1 MHz timebase on TIM2, see timebase.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "timebase.h"
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start the timebase from 0 unless it is already running
+  * @note   Register level, usable before HAL_Init.
+  * @param  None
+  * @retval None
+  */
+void Timebase_Init(void)
+{
+  if (TIMEBASE_TIM->CR1 & TIM_CR1_CEN)
+  {
+    return;
+  }
+
+  RCC->APBENR1 |= RCC_APBENR1_TIM2EN;
+  (void)RCC->APBENR1;
+  TIMEBASE_TIM->CR1 = 0;
+  TIMEBASE_TIM->ARR = 0xFFFFFFFF;
+  TIMEBASE_TIM->PSC = (SystemCoreClock / 1000000) - 1;
+  /* Load the prescaler, this also clears the counter */
+  TIMEBASE_TIM->EGR = TIM_EGR_UG;
+  TIMEBASE_TIM->CR1 = TIM_CR1_CEN;
+}
+
+/**
+  * @brief  Keep 1 MHz after SystemCoreClock changed
+  * @note   The prescaler is only loaded on an update event, which also clears
+  *         the counter, so the count is put back by hand. The few cycles in
+  *         between and the time since the clock switch itself are lost.
+  * @param  None
+  * @retval None
+  */
+void Timebase_SetClock(void)
+{
+  uint32_t now;
+
+  if (!(TIMEBASE_TIM->CR1 & TIM_CR1_CEN))
+  {
+    Timebase_Init();
+    return;
+  }
+
+  now = TIMEBASE_TIM->CNT;
+  TIMEBASE_TIM->PSC = (SystemCoreClock / 1000000) - 1;
+  TIMEBASE_TIM->EGR = TIM_EGR_UG;
+  TIMEBASE_TIM->CNT = now;
+}
@@ -0,0 +1,33 @@
+/**
+  ******************************************************************************
+  * @file    timebase.h
+  * @brief   Free running 1 MHz timebase on TIM2.
+  ******************************************************************************
+  * The Cortex-M0+ has no DWT cycle counter, so timestamps come from the 32-bit
+  * TIM2 counter clocked at 1 MHz (wraps after 71 minutes). The counter is
+  * started once by the IAP and keeps running across the jump; the APP only
+  * adjusts the prescaler when it changes the system clock.
+  *
+  * TIM2 runs from PCLK, which must equal HCLK (APB prescaler 1, as set by
+  * SystemClock_Config in both projects).
+  *
+  * This file is shared by both projects, keep the two copies identical.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TIMEBASE_H
+#define __TIMEBASE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported macro ------------------------------------------------------------*/
+#define TIMEBASE_TIM            TIM2
+#define Timebase_Now()          (TIMEBASE_TIM->CNT)   /* microseconds */
+
+/* Exported functions ------------------------------------------------------- */
+void Timebase_Init(void);
+void Timebase_SetClock(void);
+
+#endif  /* __TIMEBASE_H */
@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file    update_stats.c
+  * @brief   IAP side of the update statistics record, see update_stats.h.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "update_stats.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Config data kept when the page has to be erased for a new record */
+#define STATS_CONFIG_SIZE       (UPDATE_STATS_ADDRESS - CONFIG_START_ADDRESS)
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Program the record of the session just ended into the config page
+  * @note   After a download WriteConfigPage has just erased the page and the
+  *         record is programmed as is. Otherwise the page is erased once more,
+  *         keeping the config data; the boot cache record is dropped, which
+  *         costs one full image verification on the next boot.
+  *         A session that never received anything is not recorded.
+  * @param  stats: counters and timings, magic, layout and check are filled in
+  * @retval FLASHIF_OK if the record is in flash
+  */
+uint32_t UpdateStats_Save(UPDATE_StatsTypeDef *stats)
+{
+  uint32_t config[STATS_CONFIG_SIZE / 4];
+  const uint32_t *p_record = (const uint32_t *)UPDATE_STATS_ADDRESS;
+  uint32_t status = FLASHIF_OK;
+  uint32_t i;
+
+  if ((stats->packets == 0) && (stats->crc_errors == 0) && (stats->bytes_skipped == 0))
+  {
+    return FLASHIF_OK;
+  }
+  stats->magic = UPDATE_STATS_MAGIC;
+  stats->layout = UPDATE_STATS_LAYOUT;
+  stats->reserved = 0;
+  stats->check = UpdateStats_Sum(stats);
+
+  for (i = 0; i < sizeof(UPDATE_StatsTypeDef) / 4; i++)
+  {
+    if (p_record[i] != 0xFFFFFFFF)
+    {
+      break;
+    }
+  }
+  if (i < sizeof(UPDATE_StatsTypeDef) / 4)
+  {
+    for (i = 0; i < STATS_CONFIG_SIZE / 4; i++)
+    {
+      config[i] = *(__IO uint32_t *)(CONFIG_START_ADDRESS + i * 4);
+    }
+    status = FLASH_ErasePage(CONFIG_START_ADDRESS);
+    /* Erased double words stay erased, see bootcache.c */
+    for (i = 0; (status == FLASHIF_OK) && (i < STATS_CONFIG_SIZE / 4); i += 2)
+    {
+      if ((config[i] & config[i + 1]) != 0xFFFFFFFF)
+      {
+        status = FLASH_If_Write(CONFIG_START_ADDRESS + i * 4, &config[i], 2);
+      }
+    }
+  }
+  if (status == FLASHIF_OK)
+  {
+    status = FLASH_If_Write(UPDATE_STATS_ADDRESS, (uint32_t *)stats, sizeof(UPDATE_StatsTypeDef) / 4);
+  }
+  return status;
+}
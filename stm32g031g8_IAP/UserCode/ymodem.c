@@ -28,23 +28,87 @@
 #include "string.h"
 #include "main.h"
 #include "menu.h"
-#include "usart.h"
+#include "link.h"
+#include "lzss.h"
+#include "delta.h"
+#include "aes.h"
+#include "sha256.h"
+#include "image.h"
+#include "bootcache.h"
+#include "chain.h"
+#include "update_stats.h"
+#include "profile.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define CRC16_F       /* activate the CRC16 integrity */
+
+/* Formats of the received file */
+#define IMAGE_FORMAT_RAW        UPDATE_FORMAT_RAW
+#define IMAGE_FORMAT_LZSS       UPDATE_FORMAT_LZSS
+#define IMAGE_FORMAT_DELTA      UPDATE_FORMAT_DELTA
 /* Private macro -------------------------------------------------------------*/
+#ifdef IAP_CHAIN_ENABLED
+/* What the sender sends goes on to the next board as it arrives */
+#define ReceiveBytes(p_data, size, timeout)   Chain_Receive((p_data), (size), (timeout))
+#else
+#define ReceiveBytes(p_data, size, timeout)   Link_Receive((p_data), (size), (timeout))
+#endif /* IAP_CHAIN_ENABLED */
 /* Private variables ---------------------------------------------------------*/
 /* @note ATTENTION - please keep this variable 32bit aligned */
-uint8_t aPacketData[PACKET_1K_SIZE + PACKET_DATA_INDEX + PACKET_TRAILER_SIZE];
+__ALIGNED(4) uint8_t aPacketData[PACKET_1K_SIZE + PACKET_DATA_INDEX + PACKET_TRAILER_SIZE];
+
+/* Destination of the received image, raw, decompressed or patched */
+static FLASH_StreamTypeDef ImageStream;
+static uint8_t ImageFormat;
+#ifdef IAP_LZSS_ENABLED
+static LZSS_DecoderTypeDef ImageDecoder;
+#endif /* IAP_LZSS_ENABLED */
+#ifdef IAP_DELTA_ENABLED
+static DELTA_DecoderTypeDef ImagePatch;
+#endif /* IAP_DELTA_ENABLED */
+#ifdef IAP_AES_ENABLED
+static const uint8_t aImageKey[AES_KEY_SIZE] = IAP_AES_KEY;
+static AES_CtrTypeDef ImageCipher;
+#endif /* IAP_AES_ENABLED */
+#ifdef IAP_SHA256_ENABLED
+/* Digest of the bytes programmed so far */
+static SHA256_CtxTypeDef ImageHash;
+#endif /* IAP_SHA256_ENABLED */
+/* The file is decrypted packet by packet */
+static uint8_t ImageEncrypted;
+/* Size announced in the file header packet, 0 if unknown */
+static uint32_t ImageFileSize;
+/* Same without the encryption header, where the raw image ends */
+static uint32_t ImageDataSize;
+/* Result of the image header and CRC checks */
+static IMAGE_StatusTypeDef ImageStatus;
+/* Time spent decoding and programming the last image, in ms */
+static uint32_t ImageProgramTime;
+/* Packets retried and session duration of the last transfer */
+static uint32_t TransferErrors;
+static uint32_t TransferStart;
+static uint32_t TransferTime;
+/* Result of the session in progress */
+static COM_StatusTypeDef result = COM_OK;
+/* Counters and phase timings of the last session, see update_stats.h */
+static UPDATE_StatsTypeDef SessionStats;
 
 /* Private function prototypes -----------------------------------------------*/
 static void PrepareIntialPacket(uint8_t *p_data, const uint8_t *p_file_name, uint32_t length);
 static void PreparePacket(uint8_t *p_source, uint8_t *p_packet, uint8_t pkt_nr, uint32_t size_blk);
 static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint32_t timeout);
-uint16_t UpdateCRC16(uint16_t crc_in, uint8_t byte);
-uint16_t Cal_CRC16(const uint8_t* p_data, uint32_t size);
+static void PurgeLine(void);
+static void CountLineErrors(void);
+static void SendAnswer(uint8_t answer);
 uint8_t CalcChecksum(const uint8_t *p_data, uint32_t size);
+static uint32_t CheckImageHeader(const uint8_t *p_data, uint32_t length);
+static uint32_t WriteImageData(uint8_t *p_data, uint32_t length, uint32_t first);
+static uint32_t FinishImageData(void);
+#ifdef IAP_SHA256_ENABLED
+static void HashImageData(const uint8_t *p_data, uint32_t length);
+static uint32_t StoreImageDigest(void);
+#endif /* IAP_SHA256_ENABLED */
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -61,13 +125,13 @@ uint8_t CalcChecksum(const uint8_t *p_data, uint32_t size);
   */
 static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint32_t timeout)
 {
-  uint32_t crc;
+  uint32_t crc, packet_crc;
   uint32_t packet_size = 0;
   HAL_StatusTypeDef status;
   uint8_t char1;
 
   *p_length = 0;
-  status = HAL_UART_Receive(&UartHandle, &char1, 1, timeout);
+  status = ReceiveBytes(&char1, 1, timeout);
 
   if (status == HAL_OK)
   {
@@ -82,7 +146,7 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
       case EOT:
         break;
       case CA:
-        if ((HAL_UART_Receive(&UartHandle, &char1, 1, timeout) == HAL_OK) && (char1 == CA))
+        if ((ReceiveBytes(&char1, 1, timeout) == HAL_OK) && (char1 == CA))
         {
           packet_size = 2;
         }
@@ -96,6 +160,7 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
         status = HAL_BUSY;
         break;
       default:
+        SessionStats.bytes_skipped++;
         status = HAL_ERROR;
         break;
     }
@@ -103,13 +168,17 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
 
     if (packet_size >= PACKET_SIZE )
     {
-      status = HAL_UART_Receive(&UartHandle, &p_data[PACKET_NUMBER_INDEX], packet_size + PACKET_OVERHEAD_SIZE, timeout);
+      PROFILE_ENTER(PROFILE_UART_RX);
+      status = ReceiveBytes(&p_data[PACKET_NUMBER_INDEX], packet_size + PACKET_OVERHEAD_SIZE, timeout);
+      PROFILE_EXIT(PROFILE_UART_RX);
 
       /* Simple packet sanity check */
       if (status == HAL_OK )
       {
         if (p_data[PACKET_NUMBER_INDEX] != ((p_data[PACKET_CNUMBER_INDEX]) ^ NEGATIVE_BYTE))
         {
+          SessionStats.crc_errors++;
+          SessionStats.bytes_skipped += packet_size + PACKET_OVERHEAD_SIZE + 1;
           packet_size = 0;
           status = HAL_ERROR;
         }
@@ -118,8 +187,13 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
           /* Check packet CRC */
           crc = p_data[ packet_size + PACKET_DATA_INDEX ] << 8;
           crc += p_data[ packet_size + PACKET_DATA_INDEX + 1 ];
-          if (Cal_CRC16(&p_data[PACKET_DATA_INDEX], packet_size) != crc )
+          PROFILE_ENTER(PROFILE_CRC16);
+          packet_crc = Cal_CRC16(&p_data[PACKET_DATA_INDEX], packet_size);
+          PROFILE_EXIT(PROFILE_CRC16);
+          if (packet_crc != crc )
           {
+            SessionStats.crc_errors++;
+            SessionStats.bytes_skipped += packet_size + PACKET_OVERHEAD_SIZE + 1;
             packet_size = 0;
             status = HAL_ERROR;
           }
@@ -131,10 +205,90 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
       }
     }
   }
+  CountLineErrors();
   *p_length = packet_size;
   return status;
 }
 
+/**
+  * @brief  Drop what is left of a damaged packet, until the line is idle
+  * @note   Otherwise each stray byte is read as a bad packet start and asks
+  *         the sender for the packet once more.
+  * @param  None
+  * @retval None
+  */
+static void PurgeLine(void)
+{
+  uint8_t byte;
+
+  while (ReceiveBytes(&byte, 1, PURGE_TIMEOUT) == HAL_OK)
+  {
+    SessionStats.bytes_skipped++;
+  }
+}
+
+/**
+  * @brief  Count the receive errors the link has flagged
+  * @note   Each error is counted once per packet, however many bytes it hit.
+  * @param  None
+  * @retval None
+  */
+static void CountLineErrors(void)
+{
+  uint32_t errors = Link_TakeErrors();
+
+  if (errors & LINK_ERROR_OVERRUN)
+  {
+    SessionStats.overruns++;
+  }
+  if (errors & LINK_ERROR_FRAMING)
+  {
+    SessionStats.framing_errors++;
+  }
+  if (errors & LINK_ERROR_NOISE)
+  {
+    SessionStats.noise_errors++;
+  }
+}
+
+/**
+  * @brief  Answer the sender: ACK, NAK, CA or CRC16
+  * @note   On a chain the answer waits for the next board's one, which may
+  *         cancel the session (see chain.h)
+  * @param  answer: control byte
+  * @retval None
+  */
+static void SendAnswer(uint8_t answer)
+{
+#ifdef IAP_CHAIN_ENABLED
+  uint8_t merged;
+
+  if (result != COM_OK)
+  {
+    /* Already cancelled by the next board */
+    return;
+  }
+  merged = Chain_Answer(answer);
+  if ((merged == CA) && (answer != CA))
+  {
+    Serial_PutByte(CA);
+    Serial_PutByte(CA);
+    result = COM_ABORT;
+    return;
+  }
+  answer = merged;
+  if (answer == CHAIN_NO_ANSWER)
+  {
+    return;
+  }
+#endif /* IAP_CHAIN_ENABLED */
+  if (answer == NAK)
+  {
+    SessionStats.naks++;
+  }
+  Serial_PutByte(answer);
+}
+
 /**
   * @brief  Prepare the first block
   * @param  p_data:  output buffer
@@ -282,32 +436,301 @@ uint8_t CalcChecksum(const uint8_t *p_data, uint32_t size)
   return (sum & 0xffu);
 }
 
+/**
+  * @brief  Check the header of the image about to be programmed, called by
+  *         the flash writer before the first page is erased
+  * @note   An accepted image drops the cached verification result first, see
+  *         BootCache_Invalidate.
+  * @param  p_data: first bytes of the (decoded) image
+  * @param  length: number of bytes available
+  * @retval FLASHIF_OK if the image is made for this device
+  */
+static uint32_t CheckImageHeader(const uint8_t *p_data, uint32_t length)
+{
+  if (length < IMAGE_HEADER_END)
+  {
+    ImageStatus = IMAGE_NO_HEADER;
+  }
+  else
+  {
+    ImageStatus = Image_CheckHeader((const IMAGE_HeaderTypeDef *)&p_data[IMAGE_HEADER_OFFSET], APPLICATION_MAX_SIZE);
+  }
+  if (ImageStatus != IMAGE_OK)
+  {
+    return FLASHIF_CHECK_ERROR;
+  }
+  /* Reported as a data error, the image itself was fine */
+  return (BootCache_Invalidate() == FLASHIF_OK) ? FLASHIF_OK : FLASHIF_CHECK_ERROR;
+}
+
+/**
+  * @brief  Pass the payload of a data packet to the image writer, decrypted
+  *         first when the file is encrypted
+  * @param  p_data: packet payload
+  * @param  length: payload length
+  * @param  first: 1 for the first data packet of the file
+  * @retval FLASHIF_OK if the data was accepted
+  */
+static uint32_t WriteImageData(uint8_t *p_data, uint32_t length, uint32_t first)
+{
+  uint32_t status = FLASHIF_OK;
+  uint32_t tick = HAL_GetTick();
+
+  PROFILE_ENTER(PROFILE_IMAGE_WRITE);
+  if (first)
+  {
+    FLASH_Stream_Init(&ImageStream, APPLICATION_ADDRESS, APPLICATION_ADDRESS + APPLICATION_MAX_SIZE);
+    ImageStream.p_check = CheckImageHeader;
+#ifdef IAP_SHA256_ENABLED
+    SHA256_Init(&ImageHash);
+    ImageStream.p_feed = HashImageData;
+#endif /* IAP_SHA256_ENABLED */
+    ImageFormat = IMAGE_FORMAT_RAW;
+    ImageStatus = IMAGE_OK;
+    ImageProgramTime = 0;
+    ImageEncrypted = 0;
+    ImageDataSize = ImageFileSize;
+#ifdef IAP_AES_ENABLED
+    if (AES_IsEncrypted(p_data, length))
+    {
+      AES_CTR_Init(&ImageCipher, aImageKey, p_data);
+      ImageEncrypted = 1;
+      p_data += AES_IMAGE_HEADER_SIZE;
+      length -= AES_IMAGE_HEADER_SIZE;
+      ImageDataSize = (ImageFileSize > AES_IMAGE_HEADER_SIZE) ? ImageFileSize - AES_IMAGE_HEADER_SIZE : 0;
+    }
+#endif /* IAP_AES_ENABLED */
+  }
+
+#ifdef IAP_AES_ENABLED
+  if (ImageEncrypted)
+  {
+    /* In place in aPacketData, before anything looks at the content */
+    PROFILE_ENTER(PROFILE_AES);
+    AES_CTR_Crypt(&ImageCipher, p_data, length);
+    PROFILE_EXIT(PROFILE_AES);
+  }
+#endif /* IAP_AES_ENABLED */
+
+  if (first)
+  {
+#ifdef IAP_LZSS_ENABLED
+    if (LZSS_IsCompressed(p_data, length))
+    {
+      if (LZSS_Init(&ImageDecoder, &ImageStream, p_data, APPLICATION_MAX_SIZE) != LZSS_OK)
+      {
+        status = FLASHIF_WRITING_ERROR;
+      }
+      ImageFormat = IMAGE_FORMAT_LZSS;
+      p_data += LZSS_HEADER_SIZE;
+      length -= LZSS_HEADER_SIZE;
+    }
+#endif /* IAP_LZSS_ENABLED */
+#ifdef IAP_DELTA_ENABLED
+    if ((status == FLASHIF_OK) && DELTA_IsPatch(p_data, length))
+    {
+      /* Rejected here if the installed image is not the patch base */
+      if (DELTA_Init(&ImagePatch, &ImageStream, p_data, APPLICATION_MAX_SIZE) != DELTA_OK)
+      {
+        status = FLASHIF_WRITING_ERROR;
+      }
+      ImageFormat = IMAGE_FORMAT_DELTA;
+      p_data += DELTA_HEADER_SIZE;
+      length -= DELTA_HEADER_SIZE;
+    }
+#endif /* IAP_DELTA_ENABLED */
+  }
+
+  /* Ymodem pads the last packet with 0x1A: the decoders stop by themselves
+     at the announced size and ignore the rest */
+  if (status == FLASHIF_OK)
+  {
+    switch (ImageFormat)
+    {
+#ifdef IAP_LZSS_ENABLED
+      case IMAGE_FORMAT_LZSS:
+        status = (LZSS_Decode(&ImageDecoder, p_data, length) == LZSS_ERROR) ? FLASHIF_WRITING_ERROR : FLASHIF_OK;
+        break;
+#endif /* IAP_LZSS_ENABLED */
+#ifdef IAP_DELTA_ENABLED
+      case IMAGE_FORMAT_DELTA:
+        status = (DELTA_Decode(&ImagePatch, p_data, length) == DELTA_ERROR) ? FLASHIF_WRITING_ERROR : FLASHIF_OK;
+        break;
+#endif /* IAP_DELTA_ENABLED */
+      default:
+        /* Drop the 0x1A padding beyond the announced file size */
+        if ((ImageDataSize != 0) && (FLASH_STREAM_SIZE(&ImageStream) + length > ImageDataSize))
+        {
+          length = (FLASH_STREAM_SIZE(&ImageStream) < ImageDataSize) ? ImageDataSize - FLASH_STREAM_SIZE(&ImageStream) : 0;
+        }
+        status = FLASH_Stream_Write(&ImageStream, p_data, length);
+        break;
+    }
+  }
+
+  ImageProgramTime += HAL_GetTick() - tick;
+  PROFILE_EXIT(PROFILE_IMAGE_WRITE);
+  return status;
+}
+
+/**
+  * @brief  Program the end of the image once EOT has been received
+  * @param  None
+  * @retval FLASHIF_OK if the whole image is in flash
+  */
+static uint32_t FinishImageData(void)
+{
+  uint32_t status = FLASHIF_OK;
+  uint32_t tick = HAL_GetTick();
+
+  switch (ImageFormat)
+  {
+#ifdef IAP_LZSS_ENABLED
+    case IMAGE_FORMAT_LZSS:
+      if (FLASH_STREAM_SIZE(&ImageStream) != ImageDecoder.size)
+      {
+        /* Stream ended before the announced size */
+        status = FLASHIF_WRITING_ERROR;
+      }
+      else
+      {
+        status = FLASH_Stream_Flush(&ImageStream);
+      }
+      break;
+#endif /* IAP_LZSS_ENABLED */
+#ifdef IAP_DELTA_ENABLED
+    case IMAGE_FORMAT_DELTA:
+      status = (DELTA_Finish(&ImagePatch) == DELTA_DONE) ? FLASHIF_OK : FLASHIF_WRITING_ERROR;
+      break;
+#endif /* IAP_DELTA_ENABLED */
+    default:
+      status = FLASH_Stream_Flush(&ImageStream);
+      break;
+  }
+
+  /* Whatever the transfer format, what is in flash must be a complete image */
+  if ((status == FLASHIF_OK) && (FLASH_STREAM_SIZE(&ImageStream) == 0))
+  {
+    status = FLASHIF_WRITING_ERROR;
+  }
+  if (status == FLASHIF_OK)
+  {
+    SessionStats.verify_time = HAL_GetTick();
+    PROFILE_ENTER(PROFILE_IMAGE_VERIFY);
+    ImageStatus = Image_Verify(APPLICATION_ADDRESS, APPLICATION_MAX_SIZE);
+    PROFILE_EXIT(PROFILE_IMAGE_VERIFY);
+    SessionStats.verify_time = HAL_GetTick() - SessionStats.verify_time;
+    if (ImageStatus != IMAGE_OK)
+    {
+      status = FLASHIF_WRITINGCTRL_ERROR;
+    }
+  }
+#ifdef IAP_SHA256_ENABLED
+  if (status == FLASHIF_OK)
+  {
+    /* The image stands without it */
+    StoreImageDigest();
+  }
+#endif /* IAP_SHA256_ENABLED */
+
+  ImageProgramTime += HAL_GetTick() - tick;
+  return status;
+}
+
+#ifdef IAP_SHA256_ENABLED
+/**
+  * @brief  Hash the bytes the flash writer has just programmed
+  * @param  p_data: staging buffer
+  * @param  length: number of image bytes in it
+  * @retval None
+  */
+static void HashImageData(const uint8_t *p_data, uint32_t length)
+{
+  PROFILE_ENTER(PROFILE_SHA256);
+  SHA256_Update(&ImageHash, p_data, length);
+  PROFILE_EXIT(PROFILE_SHA256);
+}
+
+/**
+  * @brief  Finish the digest of the image just verified and program its
+  *         record after it, see IMAGE_DigestTypeDef
+  * @note   Nothing is stored when the stream holds more than the image and
+  *         its trailer, or when the record does not fit in the APP area.
+  * @param  None
+  * @retval FLASHIF_OK if the record is in flash
+  */
+static uint32_t StoreImageDigest(void)
+{
+  IMAGE_DigestTypeDef record;
+  uint32_t length = IMAGE_HEADER(APPLICATION_ADDRESS)->length;
+  uint32_t address = APPLICATION_ADDRESS + IMAGE_DIGEST_OFFSET(length);
+  uint32_t status = FLASHIF_OK;
+  uint32_t tick;
+
+  PROFILE_ENTER(PROFILE_SHA256);
+  SHA256_Final(&ImageHash, record.sha256);
+  PROFILE_EXIT(PROFILE_SHA256);
+  if ((FLASH_STREAM_SIZE(&ImageStream) != length + IMAGE_TRAILER_SIZE)
+      || (IMAGE_DIGEST_OFFSET(length) + sizeof(IMAGE_DigestTypeDef) > APPLICATION_MAX_SIZE))
+  {
+    return FLASHIF_WRITING_ERROR;
+  }
+  record.magic = IMAGE_DIGEST_MAGIC;
+  record.crc32 = Image_GetCRC(APPLICATION_ADDRESS);
+
+  /* The flush padded the stream up to the record; it may start a page the
+     stream never reached */
+  tick = HAL_GetTick();
+  while ((ImageStream.erased < address + sizeof(record)) && (status == FLASHIF_OK))
+  {
+    status = FLASH_ErasePage(ImageStream.erased);
+    ImageStream.erased += FLASH_PAGE_SIZE;
+  }
+  ImageStream.erase_time += HAL_GetTick() - tick;
+  if (status == FLASHIF_OK)
+  {
+    status = FLASH_If_Write(address, (uint32_t *)&record, sizeof(record) / 4);
+  }
+  return status;
+}
+#endif /* IAP_SHA256_ENABLED */
+
 /* Public functions ---------------------------------------------------------*/
 /**
   * @brief  Receive a file using the ymodem protocol with CRC16.
   * @param  p_size The size of the file.
   * @retval COM_StatusTypeDef result of reception/programming
   */
-
-static COM_StatusTypeDef result = COM_OK;
-
 COM_StatusTypeDef Ymodem_Receive ( uint32_t *p_size )
 {
   uint32_t i, packet_length, session_done = 0, file_done, errors = 0, session_begin = 0;
-  uint32_t flashdestination, ramsource, filesize;
+  uint32_t filesize;
   uint8_t *file_ptr;
-  uint8_t file_size[FILE_SIZE_LENGTH], tmp, packets_received;
-
-  /* Initialize flashdestination variable */
-  flashdestination = APPLICATION_ADDRESS;
+  uint8_t file_size[FILE_SIZE_LENGTH];
+  /* Not wrapped like the 8-bit packet number: more than 255 packets of 128
+     bytes would otherwise take packet 256 for a new file name packet */
+  uint32_t packets_received;
+  uint32_t session_start = HAL_GetTick();
+  HAL_StatusTypeDef status;
 
+  result = COM_OK;
+  TransferErrors = 0;
+  TransferTime = 0;
+  ImageFileSize = 0;
+  ImageStatus = IMAGE_OK;
+  ImageFormat = IMAGE_FORMAT_RAW;
+  ImageEncrypted = 0;
+  ImageProgramTime = 0;
+  ImageStream.erase_time = 0;
+  memset(&SessionStats, 0, sizeof(SessionStats));
   while ((session_done == 0) && (result == COM_OK))
   {
     packets_received = 0;
     file_done = 0;
     while ((file_done == 0) && (result == COM_OK))
     {
-      switch (ReceivePacket(aPacketData, &packet_length, DOWNLOAD_TIMEOUT))
+      status = ReceivePacket(aPacketData, &packet_length, DOWNLOAD_TIMEOUT);
+      switch (status)
       {
         case HAL_OK:
           errors = 0;
@@ -315,19 +738,43 @@ COM_StatusTypeDef Ymodem_Receive ( uint32_t *p_size )
           {
             case 2:
               /* Abort by sender */
-              Serial_PutByte(ACK);
+              SendAnswer(ACK);
               result = COM_ABORT;
               break;
             case 0:
               /* End of transmission */
-              Serial_PutByte(ACK);
+              if ((packets_received > 0) && (FinishImageData() != FLASHIF_OK))
+              {
+                /* End session */
+                SendAnswer(CA);
+                SendAnswer(CA);
+                result = COM_DATA;
+                break;
+              }
+              SendAnswer(ACK);
               file_done = 1;
               break;
             default:
               /* Normal packet */
-              if (aPacketData[PACKET_NUMBER_INDEX] != packets_received)
+              if (aPacketData[PACKET_NUMBER_INDEX] != (uint8_t)packets_received)
               {
-                Serial_PutByte(NAK);
+                if ((packets_received > 0) && (aPacketData[PACKET_NUMBER_INDEX] == (uint8_t)(packets_received - 1)))
+                {
+                  /* Our ACK got lost and the sender repeats the packet:
+                     acknowledge it again, it is already written */
+                  SessionStats.duplicates++;
+                  SessionStats.bytes_retransmitted += packet_length;
+                  SendAnswer(ACK);
+                  if (packets_received == 1)
+                  {
+                    SendAnswer(CRC16);
+                  }
+                }
+                else
+                {
+                  SendAnswer(NAK);
+                }
+                TransferErrors++;
               }
               else
               {
@@ -353,29 +800,33 @@ COM_StatusTypeDef Ymodem_Receive ( uint32_t *p_size )
                       file_size[i++] = *file_ptr++;
                     }
                     file_size[i++] = '\0';
+                    filesize = 0;
                     Str2Int(file_size, &filesize);
 
                     /* Test the size of the image to be sent */
                     /* Image size is greater than Flash size */
-                    if (*p_size > (USER_FLASH_SIZE + 1))
+                    if (filesize > APPLICATION_MAX_SIZE)
                     {
                       /* End session */
-                      tmp = CA;
-                      HAL_UART_Transmit(&UartHandle, &tmp, 1, NAK_TIMEOUT);
-                      HAL_UART_Transmit(&UartHandle, &tmp, 1, NAK_TIMEOUT);
+                      SendAnswer(CA);
+                      SendAnswer(CA);
                       result = COM_LIMIT;
                     }
-                    /* erase user application area */
-                    FLASH_Erase(APPLICATION_ADDRESS);
-                    *p_size = filesize;
+                    else
+                    {
+                      /* user application area is erased page by page once
+                         the image header has been checked, see WriteImageData */
+                      *p_size = filesize;
+                      ImageFileSize = filesize;
 
-                    Serial_PutByte(ACK);
-                    Serial_PutByte(CRC16);
+                      SendAnswer(ACK);
+                      SendAnswer(CRC16);
+                    }
                   }
                   /* File header packet is empty, end session */
                   else
                   {
-                    Serial_PutByte(ACK);
+                    SendAnswer(ACK);
                     file_done = 1;
                     session_done = 1;
                     break;
@@ -383,55 +834,132 @@ COM_StatusTypeDef Ymodem_Receive ( uint32_t *p_size )
                 }
                 else /* Data packet */
                 {
-                  ramsource = (uint32_t) & aPacketData[PACKET_DATA_INDEX];
-
-                  /* Write received data in Flash */
-                  if (FLASH_If_Write(flashdestination, (uint32_t*) ramsource, packet_length/4) == FLASHIF_OK)                   
+                  /* Write received data in Flash, decompressing it if needed */
+                  if (WriteImageData(&aPacketData[PACKET_DATA_INDEX], packet_length, (packets_received == 1)) == FLASHIF_OK)
                   {
-                    flashdestination += packet_length;
-                    Serial_PutByte(ACK);
+                    SendAnswer(ACK);
                   }
-                  else /* An error occurred while writing to Flash memory */
+                  else /* Image rejected or error while writing to Flash memory */
                   {
                     /* End session */
-                    Serial_PutByte(CA);
-                    Serial_PutByte(CA);
-                    result = COM_DATA;
+                    SendAnswer(CA);
+                    SendAnswer(CA);
+                    result = (ImageStatus != IMAGE_OK) ? COM_IMAGE : COM_DATA;
                   }
                 }
                 packets_received ++;
+                SessionStats.packets++;
+                if (session_begin == 0)
+                {
+                  TransferStart = HAL_GetTick();
+                  SessionStats.handshake_time = TransferStart - session_start;
+                }
                 session_begin = 1;
               }
               break;
           }
           break;
         case HAL_BUSY: /* Abort actually */
-          Serial_PutByte(CA);
-          Serial_PutByte(CA);
+          SendAnswer(CA);
+          SendAnswer(CA);
           result = COM_ABORT;
           break;
         default:
+          if (status == HAL_ERROR)
+          {
+            PurgeLine();
+          }
           if (session_begin > 0)
           {
             errors ++;
+            TransferErrors++;
+            if (status == HAL_TIMEOUT)
+            {
+              SessionStats.timeouts++;
+            }
           }
           if (errors > MAX_ERRORS)
           {
             /* Abort communication */
-            Serial_PutByte(CA);
-            Serial_PutByte(CA);
+            SendAnswer(CA);
+            SendAnswer(CA);
+            result = COM_ABORT;
           }
           else
           {
-            Serial_PutByte(CRC16); /* Ask for a packet */
+            SendAnswer(CRC16); /* Ask for a packet */
           }
           break;
       }
     }
   }
+  if (session_begin > 0)
+  {
+    TransferTime = HAL_GetTick() - TransferStart;
+  }
+
+  SessionStats.result = result;
+  SessionStats.image_status = ImageStatus;
+  SessionStats.format = ImageFormat | (ImageEncrypted ? UPDATE_FORMAT_ENCRYPTED : 0);
+  SessionStats.file_size = ImageFileSize;
+  SessionStats.build_id = (result == COM_OK) ? IMAGE_HEADER(APPLICATION_ADDRESS)->build_id : 0;
+  SessionStats.erase_time = ImageStream.erase_time;
+  SessionStats.program_time = ImageProgramTime - SessionStats.erase_time - SessionStats.verify_time;
+  SessionStats.transfer_time = TransferTime;
+  SessionStats.total_time = HAL_GetTick() - session_start;
   return result;
 }
 
+/**
+  * @brief  Result of the header and CRC checks of the last received image
+  * @param  None
+  * @retval IMAGE_StatusTypeDef
+  */
+IMAGE_StatusTypeDef Ymodem_GetImageStatus(void)
+{
+  return ImageStatus;
+}
+
+/**
+  * @brief  Time spent decoding and programming the last received image
+  * @param  None
+  * @retval Duration in ms, transfer waits excluded
+  */
+uint32_t Ymodem_GetProgramTime(void)
+{
+  return ImageProgramTime;
+}
+
+/**
+  * @brief  Packets retried during the last transfer
+  * @param  None
+  * @retval NAKs and receive errors after the first packet
+  */
+uint32_t Ymodem_GetErrors(void)
+{
+  return TransferErrors;
+}
+
+/**
+  * @brief  Duration of the last transfer
+  * @param  None
+  * @retval ms from the first packet to the end of the session, 0 if none
+  */
+uint32_t Ymodem_GetTransferTime(void)
+{
+  return TransferTime;
+}
+
+/**
+  * @brief  Counters and phase timings of the last session
+  * @param  None
+  * @retval Record to pass to UpdateStats_Save
+  */
+UPDATE_StatsTypeDef *Ymodem_GetStats(void)
+{
+  return &SessionStats;
+}
+
 /**
   * @brief  Transmit a file using the ymodem protocol
   * @param  p_buf: Address of the first byte
@@ -459,7 +987,7 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
   while (( !ack_recpt ) && ( result == COM_OK ))
   {
     /* Send Packet */
-    HAL_UART_Transmit(&UartHandle, &aPacketData[PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE, NAK_TIMEOUT);
+    Link_Transmit(&aPacketData[PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE, NAK_TIMEOUT);
 
     /* Send CRC or Check Sum based on CRC16_F */
 #ifdef CRC16_F    
@@ -472,7 +1000,7 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
 #endif /* CRC16_F */
 
     /* Wait for Ack and 'C' */
-    if (HAL_UART_Receive(&UartHandle, &a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK)
+    if (Link_Receive(&a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK)
     {
       if (a_rx_ctrl[0] == ACK)
       {
@@ -480,10 +1008,10 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
       }
       else if (a_rx_ctrl[0] == CA)
       {
-        if ((HAL_UART_Receive(&UartHandle, &a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK) && (a_rx_ctrl[0] == CA))
+        if ((Link_Receive(&a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK) && (a_rx_ctrl[0] == CA))
         {
           HAL_Delay( 2 );
-          __HAL_UART_FLUSH_DRREGISTER(&UartHandle);
+          Link_Flush();
           result = COM_ABORT;
         }
       }
@@ -523,7 +1051,7 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
         pkt_size = PACKET_SIZE;
       }
 
-      HAL_UART_Transmit(&UartHandle, &aPacketData[PACKET_START_INDEX], pkt_size + PACKET_HEADER_SIZE, NAK_TIMEOUT);
+      Link_Transmit(&aPacketData[PACKET_START_INDEX], pkt_size + PACKET_HEADER_SIZE, NAK_TIMEOUT);
       
       /* Send CRC or Check Sum based on CRC16_F */
 #ifdef CRC16_F    
@@ -536,7 +1064,7 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
 #endif /* CRC16_F */
       
       /* Wait for Ack */
-      if ((HAL_UART_Receive(&UartHandle, &a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK) && (a_rx_ctrl[0] == ACK))
+      if ((Link_Receive(&a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK) && (a_rx_ctrl[0] == ACK))
       {
         ack_recpt = 1;
         if (size > pkt_size)
@@ -580,7 +1108,7 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
     Serial_PutByte(EOT);
 
     /* Wait for Ack */
-    if (HAL_UART_Receive(&UartHandle, &a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK)
+    if (Link_Receive(&a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK)
     {
       if (a_rx_ctrl[0] == ACK)
       {
@@ -588,10 +1116,10 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
       }
       else if (a_rx_ctrl[0] == CA)
       {
-        if ((HAL_UART_Receive(&UartHandle, &a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK) && (a_rx_ctrl[0] == CA))
+        if ((Link_Receive(&a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK) && (a_rx_ctrl[0] == CA))
         {
           HAL_Delay( 2 );
-          __HAL_UART_FLUSH_DRREGISTER(&UartHandle);
+          Link_Flush();
           result = COM_ABORT;
         }
       }
@@ -620,7 +1148,7 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
     }
 
     /* Send Packet */
-    HAL_UART_Transmit(&UartHandle, &aPacketData[PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE, NAK_TIMEOUT);
+    Link_Transmit(&aPacketData[PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE, NAK_TIMEOUT);
 
     /* Send CRC or Check Sum based on CRC16_F */
 #ifdef CRC16_F    
@@ -633,12 +1161,12 @@ COM_StatusTypeDef Ymodem_Transmit (uint8_t *p_buf, const uint8_t *p_file_name, u
 #endif /* CRC16_F */
 
     /* Wait for Ack and 'C' */
-    if (HAL_UART_Receive(&UartHandle, &a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK)
+    if (Link_Receive(&a_rx_ctrl[0], 1, NAK_TIMEOUT) == HAL_OK)
     {
       if (a_rx_ctrl[0] == CA)
       {
           HAL_Delay( 2 );
-          __HAL_UART_FLUSH_DRREGISTER(&UartHandle);
+          Link_Flush();
           result = COM_ABORT;
       }
     }
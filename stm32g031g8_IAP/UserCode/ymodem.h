@@ -22,6 +22,9 @@
 #define __YMODEM_H_
 
 /* Includes ------------------------------------------------------------------*/
+#include "image.h"
+#include "update_stats.h"
+
 /* Exported types ------------------------------------------------------------*/
 
 /**
@@ -34,7 +37,8 @@ typedef enum
   COM_ABORT    = 0x02,
   COM_TIMEOUT  = 0x03,
   COM_DATA     = 0x04,
-  COM_LIMIT    = 0x05
+  COM_LIMIT    = 0x05,
+  COM_IMAGE    = 0x06   /* image header rejected, nothing erased */
 } COM_StatusTypeDef;
 /**
   * @}
@@ -76,10 +80,22 @@ typedef enum
 
 #define NAK_TIMEOUT             ((uint32_t)0x100000)
 #define DOWNLOAD_TIMEOUT        ((uint32_t)1000) /* One second retry delay */
+#define PURGE_TIMEOUT           ((uint32_t)2)    /* line idle after a damaged packet */
 #define MAX_ERRORS              ((uint32_t)5)
 
+/* Exported variables ------------------------------------------------------- */
+/* Packet buffer, also used for the RS-485 frames (rs485.c) */
+extern uint8_t aPacketData[PACKET_1K_SIZE + PACKET_DATA_INDEX + PACKET_TRAILER_SIZE];
+
 /* Exported functions ------------------------------------------------------- */
 COM_StatusTypeDef Ymodem_Receive(uint32_t *p_size);
+IMAGE_StatusTypeDef Ymodem_GetImageStatus(void);
+uint32_t Ymodem_GetProgramTime(void);
+uint32_t Ymodem_GetErrors(void);
+uint32_t Ymodem_GetTransferTime(void);
+UPDATE_StatsTypeDef *Ymodem_GetStats(void);
 COM_StatusTypeDef Ymodem_Transmit(uint8_t *p_buf, const uint8_t *p_file_name, uint32_t file_size);
+uint16_t UpdateCRC16(uint16_t crc_in, uint8_t byte);
+uint16_t Cal_CRC16(const uint8_t* p_data, uint32_t size);
 
 #endif  /* __YMODEM_H_ */
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Encrypt an image file (raw, LZSS or patch) for an IAP built with IAP_AES_ENABLED.
+
+The layout matches stm32g031g8_IAP/UserCode/aes.h:
+
+    "AES1" | nonce (12) | file XOR AES-128(key, nonce | n), n = u32 BE block counter
+
+The nonce is random for every file, so the same key can be used for every
+release. The key is 16 bytes, given as 32 hex digits or as the path of a
+file holding them (or the 16 raw bytes); it must be IAP_AES_KEY of the IAP.
+No Python package is needed, the cipher is implemented here.
+
+Usage:
+    python3 tools/aes_ctr.py release/gx01.lzs --key product.key
+    python3 tools/aes_ctr.py app.bin -o app.aes --key 2b7e151628aed2a6abf7158809cf4f3c
+    python3 tools/aes_ctr.py app.aes --key product.key --decrypt -o app.bin
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b"AES1"
+HEADER_SIZE = 16
+NONCE_SIZE = 12
+KEY_SIZE = 16
+ROUNDS = 10
+
+
+def _xtime(a):
+    a <<= 1
+    return a ^ 0x11B if a & 0x100 else a
+
+
+def _sbox():
+    # multiplicative inverse through the 3**i generator tables, then the affine map
+    exp, log = [0] * 255, [0] * 256
+    a = 1
+    for i in range(255):
+        exp[i], log[a] = a, i
+        a ^= _xtime(a)
+    box = []
+    for x in range(256):
+        b = exp[(255 - log[x]) % 255] if x else 0
+        s = b
+        for shift in range(1, 5):
+            s ^= ((b << shift) | (b >> (8 - shift))) & 0xFF
+        box.append(s ^ 0x63)
+    return box
+
+
+SBOX = _sbox()
+# Column words as in aes.c: byte r is row r, TE[r][x] the column of S(x) in row r
+TE0 = [_xtime(s) | (s << 8) | (s << 16) | ((_xtime(s) ^ s) << 24) for s in SBOX]
+TE = [[((t << (8 * r)) | (t >> (32 - 8 * r))) & 0xFFFFFFFF for t in TE0] for r in range(4)]
+
+
+def expand_key(key):
+    if len(key) != KEY_SIZE:
+        raise ValueError("AES-128 key must be 16 bytes")
+    words = list(struct.unpack("<4I", key))
+    rcon = 1
+    for i in range(4, 4 * (ROUNDS + 1)):
+        t = words[i - 1]
+        if i % 4 == 0:
+            t = (SBOX[(t >> 8) & 0xFF] | (SBOX[(t >> 16) & 0xFF] << 8)
+                 | (SBOX[t >> 24] << 16) | (SBOX[t & 0xFF] << 24)) ^ rcon
+            rcon = _xtime(rcon)
+        words.append(words[i - 4] ^ t)
+    return words
+
+
+def encrypt_block(rk, block):
+    """AES-128 of one 16-byte block with the expanded key rk."""
+    t0, t1, t2, t3 = TE
+    s = [w ^ k for w, k in zip(struct.unpack("<4I", block), rk[0:4])]
+    for rnd in range(1, ROUNDS):
+        k = rk[4 * rnd:4 * rnd + 4]
+        s = [t0[s[c] & 0xFF] ^ t1[(s[(c + 1) % 4] >> 8) & 0xFF] ^ t2[(s[(c + 2) % 4] >> 16) & 0xFF]
+             ^ t3[s[(c + 3) % 4] >> 24] ^ k[c] for c in range(4)]
+    k = rk[4 * ROUNDS:]
+    out = [(SBOX[s[c] & 0xFF] | (SBOX[(s[(c + 1) % 4] >> 8) & 0xFF] << 8)
+            | (SBOX[(s[(c + 2) % 4] >> 16) & 0xFF] << 16) | (SBOX[s[(c + 3) % 4] >> 24] << 24)) ^ k[c]
+           for c in range(4)]
+    return struct.pack("<4I", *out)
+
+
+def ctr(key, nonce, data):
+    """data XOR the key stream, both ways."""
+    rk = expand_key(key)
+    out = bytearray(data)
+    for n, offset in enumerate(range(0, len(data), 16)):
+        stream = encrypt_block(rk, nonce + struct.pack(">I", n))
+        for i, b in enumerate(stream[:len(data) - offset]):
+            out[offset + i] ^= b
+    return bytes(out)
+
+
+def is_encrypted(data):
+    return len(data) >= HEADER_SIZE and data[:4] == MAGIC
+
+
+def encrypt(data, key, nonce=None):
+    nonce = os.urandom(NONCE_SIZE) if nonce is None else nonce
+    return MAGIC + nonce + ctr(key, nonce, data)
+
+
+def decrypt(blob, key):
+    if not is_encrypted(blob):
+        raise ValueError("not an AES1 file")
+    return ctr(key, blob[4:HEADER_SIZE], blob[HEADER_SIZE:])
+
+
+def parse_key(arg):
+    """Key from 32 hex digits, or from a file holding them or the raw bytes."""
+    if os.path.isfile(arg):
+        with open(arg, "rb") as f:
+            raw = f.read()
+        if len(raw) == KEY_SIZE:
+            return raw
+        arg = raw.decode("ascii", "replace").strip()
+    try:
+        key = bytes.fromhex(arg.replace(" ", ""))
+    except ValueError:
+        key = b""
+    if len(key) != KEY_SIZE:
+        raise ValueError("key: 32 hex digits or a key file expected")
+    return key
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("input", help="image file to encrypt (raw, .lzs or .dlt)")
+    ap.add_argument("-o", "--output", help="output file (default: <input>.aes, or <input> without .aes)")
+    ap.add_argument("--key", required=True, help="32 hex digits or key file")
+    ap.add_argument("--decrypt", action="store_true", help="decrypt an AES1 file instead")
+    args = ap.parse_args()
+
+    try:
+        key = parse_key(args.key)
+        with open(args.input, "rb") as f:
+            data = f.read()
+        out = decrypt(data, key) if args.decrypt else encrypt(data, key)
+    except (OSError, ValueError) as e:
+        sys.exit(str(e))
+
+    if args.output:
+        output = args.output
+    elif args.decrypt:
+        output = args.input[:-4] if args.input.endswith(".aes") else args.input + ".dec"
+    else:
+        output = args.input + ".aes"
+    with open(output, "wb") as f:
+        f.write(out)
+    print("%s: %d -> %d bytes" % (output, len(data), len(out)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Query the status of one or more devices running the APP.
+
+The APP answers the command 60 F3 55 55 on USART2 with a single frame
+(stm32g031g8_APP/UserCode/common.h, APP_StatusTypeDef):
+
+    60 F3 | len | status (len bytes, little-endian) | sum8
+
+Several ports are queried in parallel and printed one device per line, so a
+rack of devices can be inventoried without rebooting them into the IAP.
+From layout 2 the status carries the SHA-256 of the installed image, when
+the IAP that wrote it was built with IAP_SHA256_ENABLED; --json prints it
+in full, to audit a fleet against the manifest of a release
+(tools/fw_package.py, image_sha256).
+
+Usage:
+    python3 tools/app_status.py --port COM5 COM6 COM7
+    python3 tools/app_status.py --port /dev/ttyUSB* --json
+    python3 tools/app_status.py --file capture.bin
+"""
+
+import argparse
+import json
+import struct
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+CMD_IAP = 0x60
+CMD_STATUS = 0xF3
+REQUEST = bytes([CMD_IAP, CMD_STATUS, 0x55, 0x55])
+
+# layout 1, see APP_StatusTypeDef
+STATUS_FORMAT = "<BBBB10sBBIIIIIIIHH"
+STATUS_FIELDS = (
+    "layout", "hw_version", "fw_version", "update_result", "device_name",
+    "update_image", "reserved", "build_id", "image_crc", "uptime_ms",
+    "boot_count", "reset_cause", "update_size", "update_time_ms",
+    "update_errors", "log_dropped",
+)
+# layout 2 appends image_sha256, all zero when the image has no digest
+DIGEST_SIZE = 32
+
+# COM_StatusTypeDef in stm32g031g8_IAP/UserCode/ymodem.h
+UPDATE_RESULTS = {
+    0x00: "ok", 0x01: "error", 0x02: "abort", 0x03: "timeout",
+    0x04: "data", 0x05: "too large", 0x06: "image refused", 0xFF: "none",
+}
+# IMAGE_StatusTypeDef in image.h
+IMAGE_RESULTS = ["ok", "no header", "bad device", "bad hw", "bad length", "bad crc", "bad vector"]
+# RCC_CSR reset flags, bit 25 upwards
+RESET_FLAGS = [(25, "OBL"), (26, "PIN"), (27, "POR/BOR"), (28, "SW"), (29, "IWDG"), (30, "WWDG"), (31, "LPWR")]
+
+
+def decode(frame):
+    """Return the status fields as a dict from a complete answer."""
+    start = frame.find(bytes([CMD_IAP, CMD_STATUS]))
+    if start < 0 or len(frame) < start + 3:
+        raise ValueError("no status frame found")
+    length = frame[start + 2]
+    end = start + 3 + length
+    if len(frame) < end + 1:
+        raise ValueError("frame truncated: %d of %d bytes" % (len(frame) - start, end + 1 - start))
+    if sum(frame[start:end]) & 0xFF != frame[end]:
+        raise ValueError("checksum mismatch")
+    size = struct.calcsize(STATUS_FORMAT)
+    if length < size:
+        raise ValueError("status too short: %d bytes, layout 1 needs %d" % (length, size))
+    # newer layouts only append fields
+    status = dict(zip(STATUS_FIELDS, struct.unpack_from(STATUS_FORMAT, frame, start + 3)))
+    status["device_name"] = status["device_name"].split(b"\0")[0].decode("ascii", "replace")
+    del status["reserved"]
+    status["image_sha256"] = ""
+    if status["layout"] >= 2 and length >= size + DIGEST_SIZE:
+        digest = frame[start + 3 + size:start + 3 + size + DIGEST_SIZE]
+        status["image_sha256"] = digest.hex() if any(digest) else ""
+    return status
+
+
+def describe(status):
+    result = UPDATE_RESULTS.get(status["update_result"], "0x%02x" % status["update_result"])
+    if status["update_result"] == 0x06 and status["update_image"] < len(IMAGE_RESULTS):
+        result += " (%s)" % IMAGE_RESULTS[status["update_image"]]
+    causes = [name for bit, name in RESET_FLAGS if status["reset_cause"] & (1 << bit)]
+    return ("%-10s hw %d fw %d  build %08x crc %08x  sha256 %-16s  up %9.1f s  boots %4d  reset %-8s"
+            "  last update: %s, %d bytes in %d ms, %d retries" % (
+                status["device_name"], status["hw_version"], status["fw_version"],
+                status["build_id"], status["image_crc"], status["image_sha256"][:16] or "-",
+                status["uptime_ms"] / 1000.0,
+                status["boot_count"], "+".join(causes) or "-", result,
+                status["update_size"], status["update_time_ms"], status["update_errors"]))
+
+
+def fetch(port, baud, timeout):
+    import serial
+    with serial.Serial(port, baud, timeout=timeout) as link:
+        link.reset_input_buffer()
+        link.write(REQUEST)
+        head = link.read(3)
+        if len(head) < 3:
+            raise ValueError("no answer")
+        return head + link.read(head[2] + 1)
+
+
+def query(port, baud, timeout):
+    try:
+        return port, decode(fetch(port, baud, timeout)), None
+    except Exception as e:  # one bad port must not stop the inventory
+        return port, None, str(e)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = ap.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", nargs="+", help="serial ports of the APP consoles (USART2)")
+    source.add_argument("--file", help="raw capture of one APP answer")
+    ap.add_argument("--baud", type=int, default=115200, help="APP console baud rate")
+    ap.add_argument("--timeout", type=float, default=0.5, help="read timeout in seconds")
+    ap.add_argument("--json", action="store_true", help="print one JSON object per device")
+    args = ap.parse_args()
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+        try:
+            results = [(args.file, decode(data), None)]
+        except ValueError as e:
+            sys.exit(str(e))
+    else:
+        try:
+            import serial  # noqa: F401
+        except ImportError:
+            sys.exit("pyserial is needed for --port (pip install pyserial)")
+        with ThreadPoolExecutor(max_workers=min(64, len(args.port))) as pool:
+            results = list(pool.map(lambda p: query(p, args.baud, args.timeout), args.port))
+
+    failed = 0
+    for port, status, error in results:
+        if status is None:
+            failed += 1
+            print(json.dumps({"port": port, "error": error}) if args.json else "%-14s %s" % (port, error))
+        elif args.json:
+            print(json.dumps(dict(port=port, **status)))
+        else:
+            print("%-14s %s" % (port, describe(status)))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Fetch and decode the boot timing trace recorded by the IAP and the APP.
+
+Both stages append 4-character events stamped by the TIM2 1 MHz timebase to
+a buffer in no-init RAM (stm32g031g8_IAP/UserCode/boot_trace.h). The APP sends
+it back on the command 60 F2 55 55 as:
+
+    60 F2 | count | dropped | count * (time_us u32 LE, name[4]) | sum8
+
+Time 0 is the IAP main() entry.
+
+Usage:
+    python3 tools/boot_trace.py --port COM5
+    python3 tools/boot_trace.py --file capture.bin
+"""
+
+import argparse
+import struct
+import sys
+
+CMD_IAP = 0x60
+CMD_TRACE = 0xF2
+REQUEST = bytes([CMD_IAP, CMD_TRACE, 0x55, 0x55])
+EVENT_SIZE = 8
+
+# (label, from event, to event); stages whose events are missing are skipped
+STAGES = [
+    ("IAP decision", "RSET", "CONF"),
+    ("image check", "CONF", "VRFY"),
+    ("IAP clock init", "CONF", "CLK "),
+    ("IAP total", "RSET", "JUMP"),
+    ("jump to APP main", "JUMP", "AENT"),
+    ("APP HAL/clock init", "AENT", "ACLK"),
+    ("APP peripherals", "ACLK", "LOOP"),
+    ("reset to main loop", "RSET", "LOOP"),
+]
+
+
+def decode(record):
+    """Return (events, dropped) from a complete record, events as (name, us)."""
+    start = record.find(bytes([CMD_IAP, CMD_TRACE]))
+    if start < 0 or len(record) < start + 5:
+        raise ValueError("no trace record found")
+    count, dropped = record[start + 2], record[start + 3]
+    end = start + 4 + count * EVENT_SIZE
+    if len(record) < end + 1:
+        raise ValueError("record truncated: %d of %d bytes" % (len(record) - start, end + 1 - start))
+    if sum(record[start:end]) & 0xFF != record[end]:
+        raise ValueError("checksum mismatch")
+    events = []
+    for i in range(count):
+        time_us, name = struct.unpack_from("<I4s", record, start + 4 + i * EVENT_SIZE)
+        events.append((name.decode("ascii", "replace"), time_us))
+    return events, dropped
+
+
+def fetch(port, baud, timeout):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("pyserial is needed for --port (pip install pyserial)")
+    with serial.Serial(port, baud, timeout=timeout) as link:
+        link.reset_input_buffer()
+        link.write(REQUEST)
+        head = link.read(4)
+        if len(head) < 4:
+            sys.exit("no answer from %s" % port)
+        return head + link.read(head[2] * EVENT_SIZE + 1)
+
+
+def report(events, dropped):
+    print("%-6s %10s %10s" % ("event", "t (us)", "+dt (us)"))
+    previous = None
+    for name, time_us in events:
+        delta = "" if previous is None else "%d" % (time_us - previous)
+        print("%-6s %10d %10s" % (name, time_us, delta))
+        previous = time_us
+    if dropped:
+        print("(%d events dropped, buffer full)" % dropped)
+
+    times = {}
+    for name, time_us in events:
+        times.setdefault(name, time_us)
+    print()
+    for label, first, last in STAGES:
+        if first in times and last in times:
+            print("%-20s %8.3f ms" % (label, (times[last] - times[first]) / 1000.0))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = ap.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the APP console (USART2)")
+    source.add_argument("--file", help="raw capture of the APP answer")
+    ap.add_argument("--baud", type=int, default=115200, help="APP console baud rate")
+    ap.add_argument("--timeout", type=float, default=2.0, help="read timeout in seconds")
+    args = ap.parse_args()
+
+    if args.port:
+        record = fetch(args.port, args.baud, args.timeout)
+    else:
+        with open(args.file, "rb") as f:
+            record = f.read()
+
+    try:
+        events, dropped = decode(record)
+    except ValueError as e:
+        sys.exit(str(e))
+    report(events, dropped)
+
+
+if __name__ == "__main__":
+    main()
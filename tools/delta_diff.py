@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""Build a DLT1 patch turning the installed APP image into a new one.
+
+The IAP applies the patch in place (stm32g031g8_IAP/UserCode/delta.h): the new
+image overwrites the old one page by page, with only the page being rewritten
+saved in RAM. A COPY may therefore only read old bytes at or after the start
+of the flash page the output currently is in; the differ enforces that rule.
+
+Usage:
+    python3 tools/delta_diff.py old.bin new.bin -o update.dlt
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"DLT1"
+PAGE = 2048
+OP_COPY = 0x01
+OP_INSERT = 0x02
+KEY = 4            # hashed prefix length
+MAX_CHAIN = 64     # candidates tried per position
+MIN_GAIN = 3       # a COPY must save at least this many bytes over INSERT
+
+
+def leb128(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def page_floor(pos):
+    return pos - pos % PAGE
+
+
+def copy_limit(old_off, new_pos):
+    """Longest run the in-place rule allows from old_off while writing new_pos."""
+    if old_off >= new_pos:
+        return sys.maxsize
+    return page_floor(new_pos) + PAGE - new_pos
+
+
+def match_len(old, o, new, p, limit):
+    length = 0
+    while length < limit:
+        step = min(64, limit - length)
+        if old[o + length:o + length + step] == new[p + length:p + length + step]:
+            length += step
+            continue
+        while old[o + length] == new[p + length]:
+            length += 1
+        break
+    return length
+
+
+def diff(old, new):
+    index = {}
+    for i in range(len(old) - KEY + 1):
+        index.setdefault(old[i:i + KEY], []).append(i)
+
+    out = bytearray(MAGIC)
+    out += struct.pack("<IIII", len(old), zlib.crc32(old), len(new), zlib.crc32(new))
+
+    cursor = 0
+    literal = bytearray()
+    p = 0
+    while p < len(new):
+        floor = page_floor(p)
+        best_len, best_off, best_cost = 0, 0, 0
+        candidates = [cursor]
+        candidates += reversed(index.get(new[p:p + KEY], [])[-MAX_CHAIN:])
+        for o in candidates:
+            if o < floor or o >= len(old):
+                continue
+            limit = min(len(old) - o, len(new) - p, copy_limit(o, p))
+            length = match_len(old, o, new, p, limit)
+            cost = 1 + len(leb128(length)) + len(leb128(zigzag(o - cursor)))
+            if length - cost > best_len - best_cost:
+                best_len, best_off, best_cost = length, o, cost
+
+        if best_len - best_cost >= MIN_GAIN:
+            if literal:
+                out += bytes((OP_INSERT,)) + leb128(len(literal)) + literal
+                literal = bytearray()
+            out += bytes((OP_COPY,)) + leb128(best_len) + leb128(zigzag(best_off - cursor))
+            cursor = best_off + best_len
+            p += best_len
+        else:
+            literal.append(new[p])
+            cursor += 1
+            p += 1
+
+    if literal:
+        out += bytes((OP_INSERT,)) + leb128(len(literal)) + literal
+    return bytes(out)
+
+
+def apply(old, patch):
+    """Reference in-place application, mirrors delta.c including the page rule."""
+    old_size, old_crc, new_size, new_crc = struct.unpack_from("<IIII", patch, 4)
+    if patch[:4] != MAGIC or old_size != len(old) or zlib.crc32(old) != old_crc:
+        raise ValueError("patch does not match the old image")
+    new = bytearray()
+    cursor = 0
+    i = 20
+
+    def read_leb():
+        nonlocal i
+        value = shift = 0
+        while True:
+            byte = patch[i]
+            i += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    while len(new) < new_size:
+        op = patch[i]
+        i += 1
+        length = read_leb()
+        if op == OP_COPY:
+            seek = read_leb()
+            cursor += (seek >> 1) ^ -(seek & 1)
+            for _ in range(length):
+                if cursor < page_floor(len(new)) or cursor >= old_size:
+                    raise ValueError("copy from overwritten data at %d" % len(new))
+                new.append(old[cursor])
+                cursor += 1
+        elif op == OP_INSERT:
+            new += patch[i:i + length]
+            i += length
+            cursor += length
+        else:
+            raise ValueError("bad opcode")
+    if zlib.crc32(new) != new_crc:
+        raise ValueError("CRC mismatch")
+    return bytes(new)
+
+
+def ymodem_time(size, baud):
+    """Seconds on the wire with 1K Ymodem packets (8N1, 1029 bytes per packet)."""
+    return (size + 1023) // 1024 * 1029 * 10 / baud
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("old", help="image currently installed on the device")
+    ap.add_argument("new", help="image to install")
+    ap.add_argument("-o", "--output", help="output patch (default: <new>.dlt)")
+    ap.add_argument("--baud", type=int, default=921600, help="UART baud rate for the time estimate")
+    args = ap.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    patch = diff(old, new)
+    if apply(old, patch) != new:
+        sys.exit("internal error: round trip mismatch")
+
+    output = args.output or args.new.rsplit(".", 1)[0] + ".dlt"
+    with open(output, "wb") as f:
+        f.write(patch)
+
+    print("%s: %d bytes for a %d byte image (%.1f%%)" % (output, len(patch), len(new), 100.0 * len(patch) / len(new)))
+    print("ymodem @%d: %.2f s -> %.2f s" % (args.baud, ymodem_time(len(new), args.baud),
+                                           ymodem_time(len(patch), args.baud)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Rebuild the APP's deferred-format log from its binary records.
+
+DLOGn() calls in the APP (stm32g031g8_APP/UserCode/dlog.h) send only the
+offset of the format string in the image plus raw 32-bit arguments:
+
+    A5 | nargs | format offset (u16 LE) | time us (u32 LE) | nargs * u32 LE
+
+The format strings are read back from the APP .bin that is running on the
+device, so the same build must be passed in. Bytes that are not part of a
+record (Serial_PutString output on the same port) are printed as text.
+
+Usage:
+    python3 tools/dlog_decode.py stm32g031g8_APP/MDK-ARM/BIN/stm32g031g8_app.bin --port COM5
+    python3 tools/dlog_decode.py app.bin --file capture.bin
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+MAX_ARGS = 3
+HEADER_SIZE = 8
+DROPPED = "[%u records dropped]"
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z)?([diouxXcp%])")
+
+
+def format_string(image, offset):
+    """C string at offset in the image, or None if it does not look like one."""
+    if offset == 0:
+        return DROPPED
+    if offset >= len(image):
+        return None
+    end = image.find(b"\0", offset)
+    if end < 0:
+        return None
+    try:
+        text = image[offset:end].decode("ascii")
+    except UnicodeDecodeError:
+        return None
+    return text if text.isprintable() else None
+
+
+def arg_count(fmt):
+    return sum(1 for m in CONVERSION.finditer(fmt) if m.group(3) != "%")
+
+
+def render(fmt, args):
+    values = iter(args)
+
+    def one(m):
+        flags, conv = m.group(1), m.group(3)
+        if conv == "%":
+            return "%"
+        value = next(values)
+        if conv in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+            conv = "d"
+        elif conv == "u":
+            conv = "d"
+        elif conv == "p":
+            return "0x%08x" % value
+        elif conv == "c":
+            value = chr(value & 0xFF)
+        return ("%" + flags + conv) % value
+
+    return CONVERSION.sub(one, fmt)
+
+
+class Decoder:
+    def __init__(self, image):
+        self.image = image
+        self.data = bytearray()
+        self.text = bytearray()
+
+    def feed(self, chunk):
+        """Consume bytes, yield output lines."""
+        self.data += chunk
+        while self.data:
+            if self.data[0] == SYNC:
+                if len(self.data) < HEADER_SIZE:
+                    return
+                nargs = self.data[1]
+                offset = struct.unpack_from("<H", self.data, 2)[0]
+                fmt = format_string(self.image, offset) if nargs <= MAX_ARGS else None
+                if fmt is not None and arg_count(fmt) == nargs:
+                    size = HEADER_SIZE + 4 * nargs
+                    if len(self.data) < size:
+                        return
+                    time_us = struct.unpack_from("<I", self.data, 4)[0]
+                    args = struct.unpack_from("<%dI" % nargs, self.data, HEADER_SIZE)
+                    del self.data[:size]
+                    yield from self.flush_text()
+                    yield "%10.3f ms  %s" % (time_us / 1000.0, render(fmt, args))
+                    continue
+            self.text.append(self.data.pop(0))
+            if self.text.endswith(b"\n"):
+                yield from self.flush_text()
+
+    def flush_text(self):
+        line = self.text.decode("utf-8", "replace").strip()
+        self.text.clear()
+        if line:
+            yield "              | " + line
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("image", help="APP .bin the device is running")
+    source = ap.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the APP console (USART2)")
+    source.add_argument("--file", help="raw capture of the console")
+    ap.add_argument("--baud", type=int, default=115200, help="APP console baud rate")
+    args = ap.parse_args()
+
+    with open(args.image, "rb") as f:
+        decoder = Decoder(f.read())
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            for line in decoder.feed(f.read()):
+                print(line)
+        for line in decoder.flush_text():
+            print(line)
+        return
+
+    try:
+        import serial
+    except ImportError:
+        sys.exit("pyserial is needed for --port (pip install pyserial)")
+    with serial.Serial(args.port, args.baud, timeout=0.1) as link:
+        try:
+            while True:
+                for line in decoder.feed(link.read(256)):
+                    print(line, flush=True)
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()
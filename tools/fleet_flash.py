@@ -0,0 +1,522 @@
+#!/usr/bin/env python3
+"""Flash an APP image into many devices at once, one serial port each.
+
+One process and one epoll loop drive every port; each device has its own
+state machine, so dozens of ports cost no more than one thread:
+
+    trigger  60 F1 55 55 to the APP (USART2, 115200): request an update
+    boot     let the IAP restart and print its menu
+    menu     menu entry 1, wait for the first 'C'
+    transfer Ymodem, 1K blocks, as tools/ymodem_send.py
+    run      menu entry 3, start the new application
+    verify   60 F3 55 55 to the APP: the build ID it reports must be the
+             one of the image (tools/app_status.py), and so must the SHA-256
+             of the installed image when the IAP stores it
+             (IAP_SHA256_ENABLED)
+
+A device is "PORT" when the APP and the IAP consoles share the line (the
+baud rate is switched), or "IAPPORT=APPPORT" when they are two ports.
+Per-device timings and failures go to a CSV and/or JSON report. The image
+is a binary or the manifest of a release (tools/fw_package.py): the file
+sent is the one of --variant in --format, the build ID and the SHA-256 the
+manifest's ones.
+
+Usage:
+    python3 tools/fleet_flash.py app.bin --port /dev/ttyUSB0 /dev/ttyUSB1 --csv report.csv
+    python3 tools/fleet_flash.py app.bin --port /dev/ttyUSB0=/dev/ttyACM0 --no-verify
+    python3 tools/fleet_flash.py app.bin --sim sim/build/iap_sim --count 16 --json report.json
+    python3 tools/fleet_flash.py release/manifest.json --variant gx01 --format lzss --port /dev/ttyUSB0
+
+With --sim, each device is an iap_sim process on a socketpair, started on
+an erased flash so that the IAP is in its menu (no trigger); "verify" is
+then the simulation exit code of the jump to the checked application.
+
+Linux only (epoll, termios).
+"""
+
+import argparse
+import csv
+import errno
+import hashlib
+import json
+import os
+import select
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import termios
+import time
+
+import fw_package
+from app_status import REQUEST as STATUS_REQUEST, decode as decode_status
+from ymodem_send import ACK, CA, CRC16, EOT, MENU_DOWNLOAD, MENU_RUN, NAK, block
+
+CMD_IAP = 0x60
+CMD_UPDATE = 0xF1
+TRIGGER = bytes([CMD_IAP, CMD_UPDATE, 0x55, 0x55])
+
+IMAGE_HEADER_OFFSET = 0xC0      # image.h
+IMAGE_MAGIC = 0x48505041        # "APPH"
+SIM_EXIT_JUMP = 10              # sim/shim/sim.h
+
+BAUD_RATES = {rate: getattr(termios, "B%d" % rate) for rate in (
+    9600, 19200, 38400, 57600, 115200, 230400, 460800, 500000, 576000, 921600, 1000000)
+    if hasattr(termios, "B%d" % rate)}
+
+REPORT_FIELDS = ("device", "result", "error", "bytes", "blocks", "retransmits",
+                 "trigger_s", "transfer_s", "verify_s", "total_s", "bytes_per_second", "build_id",
+                 "image_sha256")
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    attr = termios.tcgetattr(fd)
+    attr[0] = 0                                             # iflag: raw
+    attr[1] = 0                                             # oflag
+    attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL  # cflag: 8N1
+    attr[3] = 0                                             # lflag
+    attr[6][termios.VMIN] = 0
+    attr[6][termios.VTIME] = 0
+    termios.tcsetattr(fd, termios.TCSANOW, attr)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def set_baud(fd, baud):
+    attr = termios.tcgetattr(fd)
+    attr[4] = attr[5] = BAUD_RATES[baud]
+    # the trigger must be on the line before the speed changes
+    termios.tcsetattr(fd, termios.TCSADRAIN, attr)
+
+
+class Device:
+    """Update state machine of one device, driven by Fleet."""
+
+    def __init__(self, fleet, name, fd, app_fd=None, proc=None):
+        self.fleet = fleet
+        self.name = name
+        self.fd = fd
+        self.app_fd = fd if app_fd is None else app_fd
+        self.proc = proc
+        self.out = {}           # fd -> bytes waiting for POLLOUT
+        self.state = None
+        self.deadline = None
+        self.tries = 0
+        self.cancel = 0
+        self.seq = 0
+        self.offset = 0
+        self.packet = b""
+        self.answer = b""
+        self.times = {}
+        self.result = {"device": name, "result": "", "error": "", "bytes": len(fleet.image),
+                       "blocks": 0, "retransmits": 0}
+
+    # -- helpers ---------------------------------------------------------
+    def enter(self, state, timeout):
+        self.state = state
+        self.deadline = time.monotonic() + timeout
+        self.cancel = 0
+
+    def write(self, data, fd=None):
+        self.fleet.write(self, self.fd if fd is None else fd, data)
+
+    def baud(self, fd, rate):
+        if self.proc is None and rate:
+            set_baud(fd, rate)
+
+    def fail(self, error):
+        self.result["result"] = "failed"
+        self.result["error"] = "%s (%s)" % (error, self.state)
+        self.finish()
+
+    def finish(self):
+        now = time.monotonic()
+        self.state = "done"
+        self.deadline = None
+        self.times["end"] = now
+        if not self.result["result"]:
+            self.result["result"] = "ok"
+        self.fleet.done(self)
+
+    def send_packet(self, packet):
+        self.packet = packet
+        self.write(packet)
+
+    def next_block(self):
+        data = self.fleet.image[self.offset:self.offset + 1024]
+        self.seq += 1
+        self.send_packet(block(self.seq, data))
+        self.enter("data", self.fleet.args.timeout)
+
+    def retry(self, what):
+        self.tries += 1
+        if self.tries > self.fleet.args.retries:
+            self.fail("no answer to %s after %d tries" % (what, self.fleet.args.retries))
+            return False
+        return True
+
+    # -- events ----------------------------------------------------------
+    def start(self):
+        self.times["start"] = time.monotonic()
+        if self.fleet.args.no_trigger or self.proc is not None:
+            self.enter("boot", 0.2)
+            return
+        self.baud(self.app_fd, self.fleet.args.app_baud)
+        self.write(TRIGGER, self.app_fd)
+        self.enter("boot", self.fleet.args.boot_wait)
+
+    def on_timeout(self):
+        args = self.fleet.args
+        if self.state == "boot":
+            # whatever the IAP printed is dropped, the menu is ready
+            self.times["boot"] = time.monotonic()
+            self.baud(self.fd, args.baud)
+            self.tries = 0
+            self.write(MENU_DOWNLOAD)
+            self.enter("menu", args.timeout)
+        elif self.state == "menu":
+            if self.retry("menu entry 1"):
+                self.write(MENU_DOWNLOAD)
+                self.enter("menu", args.timeout)
+        elif self.state in ("header", "data", "end"):
+            if self.retry("block %d" % self.packet[1]):
+                self.result["retransmits"] += 1
+                self.write(self.packet)
+                self.enter(self.state, args.timeout)
+        elif self.state == "eot":
+            if self.retry("EOT"):
+                self.result["retransmits"] += 1
+                self.write(bytes([EOT]))
+                self.enter("eot", args.timeout)
+        elif self.state in ("wait_c", "end_c"):
+            self.fail("no 'C'")
+        elif self.state == "run":
+            if self.proc is not None:
+                self.proc_exit()
+            else:
+                self.baud(self.app_fd, args.app_baud)
+                self.answer = b""
+                self.write(STATUS_REQUEST, self.app_fd)
+                self.enter("verify", args.timeout)
+        elif self.state == "verify":
+            self.fail("no status answer from the application")
+
+    def on_bytes(self, fd, data):
+        if self.state == "verify":
+            self.on_status(data)
+            return
+        if fd != self.fd:
+            return
+        for byte in data:
+            if self.state in (None, "done"):
+                return
+            if byte == CA and self.state not in ("boot", "run"):
+                self.cancel += 1
+                if self.cancel == 2:
+                    self.fail("transfer cancelled by the IAP")
+                    return
+                continue
+            self.cancel = 0
+            self.on_byte(byte)
+
+    def on_byte(self, byte):
+        args = self.fleet.args
+        if self.state == "menu" and byte == CRC16:
+            self.times["transfer"] = time.monotonic()
+            self.tries = 0
+            header = b"app.bin\0" + ("%d " % len(self.fleet.image)).encode("ascii")
+            self.send_packet(block(0, header))
+            self.enter("header", args.timeout)
+        elif self.state == "header" and byte in (ACK, NAK):
+            if byte == ACK:
+                self.enter("wait_c", args.timeout)
+            else:
+                self.on_timeout()
+        elif self.state == "wait_c" and byte == CRC16:
+            self.tries = 0
+            self.next_block()
+        elif self.state == "data" and byte in (ACK, NAK):
+            if byte == NAK:
+                self.on_timeout()
+                return
+            self.tries = 0
+            self.result["blocks"] += 1
+            self.offset += 1024
+            if self.offset < len(self.fleet.image):
+                self.next_block()
+            else:
+                self.write(bytes([EOT]))
+                self.enter("eot", args.timeout)
+        elif self.state == "eot" and byte in (ACK, NAK):
+            if byte == NAK:
+                self.on_timeout()
+            else:
+                # the IAP asks for the end of session block after its 1 s timeout
+                self.enter("end_c", args.timeout)
+        elif self.state == "end_c" and byte == CRC16:
+            self.tries = 0
+            self.send_packet(block(0, b""))
+            self.enter("end", args.timeout)
+        elif self.state == "end" and byte == ACK:
+            self.times["transferred"] = time.monotonic()
+            if args.no_verify:
+                self.finish()
+            else:
+                self.write(MENU_RUN)
+                self.enter("run", args.boot_wait)
+
+    def on_status(self, data):
+        self.answer += data
+        start = self.answer.find(STATUS_REQUEST[:2])
+        if start < 0 or len(self.answer) < start + 3 or len(self.answer) < start + 4 + self.answer[start + 2]:
+            return
+        try:
+            status = decode_status(self.answer)
+        except ValueError as e:
+            self.fail(str(e))
+            return
+        self.result["build_id"] = "%08x" % status["build_id"]
+        self.result["image_sha256"] = status["image_sha256"]
+        if status["build_id"] != self.fleet.build_id:
+            self.fail("application reports build %08x, image is %08x" % (status["build_id"], self.fleet.build_id))
+        elif status["image_sha256"] and self.fleet.digest and status["image_sha256"] != self.fleet.digest:
+            self.fail("application reports SHA-256 %s..., image is %s..." % (
+                status["image_sha256"][:16], self.fleet.digest[:16]))
+        else:
+            self.finish()
+
+    def proc_exit(self):
+        try:
+            code = self.proc.wait(timeout=0)
+        except subprocess.TimeoutExpired:
+            self.fail("simulation did not start the application")
+            return
+        if code != SIM_EXIT_JUMP:
+            self.fail("simulation exit code %d" % code)
+        else:
+            self.finish()
+
+    def report(self):
+        t = self.times
+        r = dict(self.result)
+        start = t.get("start", 0)
+        r["trigger_s"] = round(t["boot"] - start, 3) if "boot" in t else ""
+        if "transferred" in t:
+            seconds = t["transferred"] - t["transfer"]
+            r["transfer_s"] = round(seconds, 3)
+            r["bytes_per_second"] = int(len(self.fleet.image) / seconds) if seconds else 0
+            r["verify_s"] = round(t["end"] - t["transferred"], 3) if not self.fleet.args.no_verify else ""
+        else:
+            r["transfer_s"] = r["bytes_per_second"] = r["verify_s"] = ""
+        r["total_s"] = round(t.get("end", time.monotonic()) - start, 3)
+        r.setdefault("build_id", "")
+        r.setdefault("image_sha256", "")
+        return r
+
+
+class Fleet:
+    def __init__(self, args, image, build_id=None, digest=None):
+        self.args = args
+        self.image = image
+        self.build_id = image_build_id(image) if build_id is None else build_id
+        # a binary is the installed image itself
+        self.digest = hashlib.sha256(image).hexdigest() if build_id is None else digest
+        self.poll = select.epoll()
+        self.owners = {}        # fd -> device
+        self.devices = []
+        self.active = 0
+        self.sockets = []       # keeps the socketpair ends of --sim open
+
+    def add(self, device):
+        self.devices.append(device)
+        for fd in {device.fd, device.app_fd}:
+            self.owners[fd] = device
+            self.poll.register(fd, select.EPOLLIN)
+
+    def write(self, device, fd, data):
+        pending = device.out.get(fd, b"") + data
+        try:
+            sent = os.write(fd, pending) if not device.out.get(fd) else 0
+        except OSError as e:
+            if e.errno != errno.EAGAIN:
+                device.fail("write: %s" % e.strerror)
+                return
+            sent = 0
+        device.out[fd] = pending[sent:]
+        if device.out[fd]:
+            self.poll.modify(fd, select.EPOLLIN | select.EPOLLOUT)
+
+    def flush(self, fd):
+        device = self.owners[fd]
+        data = device.out.get(fd, b"")
+        try:
+            sent = os.write(fd, data)
+        except OSError as e:
+            if e.errno == errno.EAGAIN:
+                return
+            device.fail("write: %s" % e.strerror)
+            sent = len(data)
+        device.out[fd] = data[sent:]
+        if not device.out[fd]:
+            self.poll.modify(fd, select.EPOLLIN)
+
+    def done(self, device):
+        self.active -= 1
+        for fd in {device.fd, device.app_fd}:
+            if fd in self.owners:
+                self.poll.unregister(fd)
+                del self.owners[fd]
+
+    def run(self):
+        self.active = len(self.devices)
+        for device in self.devices:
+            device.start()
+        while self.active > 0:
+            now = time.monotonic()
+            deadlines = [d.deadline for d in self.devices if d.deadline is not None]
+            timeout = max(0.0, min(deadlines) - now) if deadlines else 1.0
+            for fd, events in self.poll.poll(timeout):
+                device = self.owners.get(fd)
+                if device is None:
+                    continue
+                if events & select.EPOLLOUT:
+                    self.flush(fd)
+                if events & (select.EPOLLIN | select.EPOLLHUP | select.EPOLLERR):
+                    try:
+                        data = os.read(fd, 4096)
+                    except OSError as e:
+                        if e.errno != errno.EAGAIN:
+                            device.fail("read: %s" % e.strerror)
+                        continue
+                    if not data:
+                        if device.proc is not None and device.state == "run":
+                            device.proc.wait()
+                            device.proc_exit()
+                        else:
+                            device.fail("line closed")
+                        continue
+                    device.on_bytes(fd, data)
+            now = time.monotonic()
+            for device in self.devices:
+                if device.deadline is not None and now >= device.deadline and device.state != "done":
+                    device.on_timeout()
+
+
+def image_build_id(image):
+    magic, _, build_id = struct.unpack_from("<III", image, IMAGE_HEADER_OFFSET)
+    if magic != IMAGE_MAGIC:
+        sys.exit("no image header, stamp the binary with tools/image_stamp.py first")
+    return build_id
+
+
+def parse_device(spec):
+    iap, _, app = spec.partition("=")
+    return iap, app or None
+
+
+def start_sims(args, fleet, workdir):
+    for i in range(args.count):
+        ours, theirs = socket.socketpair()
+        flash = os.path.join(workdir, "flash%d.bin" % i)
+        ram = os.path.join(workdir, "ram%d.bin" % i)
+        cmd = [args.sim, "--uart", "fd:%d" % theirs.fileno(), "--flash", flash, "--ram", ram, "--power-on"]
+        proc = subprocess.Popen(cmd, pass_fds=(theirs.fileno(),), stdout=subprocess.DEVNULL,
+                                stderr=subprocess.DEVNULL)
+        theirs.close()
+        ours.setblocking(False)
+        fleet.sockets.append(ours)
+        fleet.add(Device(fleet, "sim%d" % i, ours.fileno(), proc=proc))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("image", help="stamped APP binary (tools/image_stamp.py) or release manifest")
+    line = ap.add_mutually_exclusive_group(required=True)
+    line.add_argument("--port", nargs="+", help="devices: PORT or IAPPORT=APPPORT")
+    line.add_argument("--sim", help="path of iap_sim, to flash simulated devices")
+    ap.add_argument("--count", type=int, default=4, help="number of simulated devices (--sim)")
+    ap.add_argument("--baud", type=int, default=921600, help="IAP console baud rate")
+    ap.add_argument("--app-baud", type=int, default=115200, help="APP console baud rate")
+    ap.add_argument("--boot-wait", type=float, default=1.0, help="seconds for a reset into the IAP or the APP")
+    ap.add_argument("--timeout", type=float, default=3.0, help="seconds to wait for an answer")
+    ap.add_argument("--retries", type=int, default=10, help="tries per block")
+    ap.add_argument("--no-trigger", action="store_true", help="devices are already in the IAP menu")
+    ap.add_argument("--no-verify", action="store_true", help="stop after the transfer")
+    ap.add_argument("--variant", help="image of the manifest to send")
+    ap.add_argument("--format", choices=sorted(fw_package.FORMATS), default="raw", help="file of the manifest to send")
+    ap.add_argument("--csv", help="write the per-device report to this CSV file")
+    ap.add_argument("--json", help="write the per-device report and the totals to this JSON file")
+    args = ap.parse_args()
+
+    build_id = digest = None
+    if os.path.isdir(args.image) or args.image.endswith(".json"):
+        try:
+            _, image, build_id, digest = fw_package.load(args.image, args.variant, args.format)
+        except (OSError, ValueError) as e:
+            sys.exit(str(e))
+    else:
+        with open(args.image, "rb") as f:
+            image = f.read()
+    for rate in (args.baud, args.app_baud):
+        if args.port and rate not in BAUD_RATES:
+            sys.exit("unsupported baud rate %d" % rate)
+
+    fleet = Fleet(args, image, build_id, digest)
+    workdir = None
+    if args.sim:
+        workdir = tempfile.TemporaryDirectory(prefix="fleet_flash")
+        start_sims(args, fleet, workdir.name)
+    else:
+        opened = {}
+        for spec in args.port:
+            iap, app = parse_device(spec)
+            try:
+                for path in (iap, app):
+                    if path and path not in opened:
+                        opened[path] = open_port(path)
+            except OSError as e:
+                sys.exit("%s: %s" % (e.filename or spec, e.strerror))
+            fleet.add(Device(fleet, spec, opened[iap], opened[app] if app else None))
+
+    start = time.monotonic()
+    try:
+        fleet.run()
+    finally:
+        for device in fleet.devices:
+            if device.proc is not None and device.proc.poll() is None:
+                device.proc.terminate()
+                device.proc.wait()
+        if workdir is not None:
+            workdir.cleanup()
+    wall = time.monotonic() - start
+
+    reports = [d.report() for d in fleet.devices]
+    ok = [r for r in reports if r["result"] == "ok"]
+    summary = {"devices": len(reports), "ok": len(ok), "failed": len(reports) - len(ok),
+               "wall_s": round(wall, 3), "image_bytes": len(image),
+               "aggregate_bytes_per_second": int(len(image) * len(ok) / wall) if wall else 0}
+
+    for r in reports:
+        if r["result"] == "ok":
+            print("%-24s ok      %6.2f s  transfer %6.2f s  %7d B/s  %d retransmissions" % (
+                r["device"], r["total_s"], r["transfer_s"], r["bytes_per_second"], r["retransmits"]))
+        else:
+            print("%-24s FAILED  %6.2f s  %s" % (r["device"], r["total_s"], r["error"]))
+    print("%d/%d devices in %.2f s, %d B/s aggregate" % (
+        summary["ok"], summary["devices"], wall, summary["aggregate_bytes_per_second"]))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=REPORT_FIELDS)
+            writer.writeheader()
+            writer.writerows(reports)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"summary": summary, "devices": reports}, f, indent=2)
+    sys.exit(0 if summary["failed"] == 0 else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Package APP binaries into release images and a manifest.
+
+For every product variant (one fromelf binary each, the device name and
+hardware version come from its app_header.c):
+
+    <variant>.bin   stamped image: header + CRC32 trailer (tools/image_stamp.py)
+    <variant>.lzs   the same, LZSS compressed (--lzss, tools/lzss_pack.py)
+    <variant>.dlt   patch from the same variant of an earlier release
+                    (--base, tools/delta_diff.py)
+
+and manifest.json, read by tools/ymodem_send.py and tools/fleet_flash.py in
+place of a binary. Each image entry lists its files with size and SHA-256,
+the SHA-256 of the installed image (image_sha256, what an IAP built with
+IAP_SHA256_ENABLED stores and the APP reports, whatever file was sent)
+and the CRC32 of every 2 KB flash page of the installed image, the same
+CRC32 as Cal_CRC32 in the IAP, so the pages a patch rewrites can be told
+from the manifests of two releases. All variants share one build ID.
+Variants are packaged in parallel, one process per core.
+
+With --key every file is written AES-128-CTR encrypted, each with a nonce of
+its own (tools/aes_ctr.py), for an IAP built with IAP_AES_ENABLED; sizes and
+SHA-256 are those of the encrypted files, the page CRCs those of the image.
+
+Run from the MDK AfterMake step after fromelf, it stamps the binary in
+place and writes the manifest next to it.
+
+Usage:
+    python3 tools/fw_package.py stm32g031g8_APP/MDK-ARM/BIN/stm32g031g8_app.bin --lzss
+    python3 tools/fw_package.py build/*.bin -o release --lzss --base old_release -j 8
+    python3 tools/fw_package.py build/*.bin -o release --lzss --key product.key
+    python3 tools/ymodem_send.py release/manifest.json --variant gx01 --format lzss --port COM5
+"""
+
+import argparse
+import concurrent.futures
+import hashlib
+import json
+import os
+import struct
+import sys
+import time
+import zlib
+
+import aes_ctr
+import delta_diff
+import image_stamp
+import lzss_pack
+
+MANIFEST = "manifest.json"
+MANIFEST_FORMAT = 1
+PAGE = 2048                     # flash page, stm32g031g8_IAP/UserCode/flash.h
+FORMATS = {"raw": ".bin", "lzss": ".lzs", "delta": ".dlt"}
+
+
+def page_crcs(image):
+    """CRC32 of every flash page the stamped image covers."""
+    return ["%08x" % zlib.crc32(image[offset:offset + PAGE]) for offset in range(0, len(image), PAGE)]
+
+
+def write_file(outdir, name, data, key=None):
+    if key is not None:
+        data = aes_ctr.encrypt(data, key)
+    with open(os.path.join(outdir, name), "wb") as f:
+        f.write(data)
+    info = {"name": name, "size": len(data), "sha256": hashlib.sha256(data).hexdigest()}
+    if key is not None:
+        info["encrypted"] = "aes128-ctr"
+    return info
+
+
+def package(job):
+    """Package one variant, runs in a worker process."""
+    variant, path, outdir, build_id, lzss, base, key = job
+    with open(path, "rb") as f:
+        raw = f.read()
+    if key is not None and aes_ctr.is_encrypted(raw):
+        # written in place by an earlier run
+        raw = aes_ctr.decrypt(raw, key)
+    image = image_stamp.stamp(raw, build_id)
+    header = image_stamp.parse_header(image)
+    entry = {"variant": variant, "device": header["device"], "hw": header["hw"], "fw": header["fw"],
+             "build_id": "%08x" % build_id, "length": header["length"],
+             "crc32": "%08x" % struct.unpack_from("<I", image, header["length"])[0],
+             "image_sha256": hashlib.sha256(image).hexdigest(),
+             "page_size": PAGE, "pages": page_crcs(image), "files": {}}
+
+    entry["files"]["raw"] = write_file(outdir, variant + FORMATS["raw"], image, key)
+    if lzss:
+        packed = lzss_pack.compress(image)
+        if lzss_pack.decompress(packed) != image:
+            raise ValueError("%s: LZSS round trip mismatch" % variant)
+        entry["files"]["lzss"] = write_file(outdir, variant + FORMATS["lzss"], packed, key)
+    if base is not None:
+        old, old_entry = base
+        if (old_entry["device"], old_entry["hw"]) != (header["device"], header["hw"]):
+            raise ValueError("%s: base is for %s HW%02X" % (variant, old_entry["device"], old_entry["hw"]))
+        patch = delta_diff.diff(old, image)
+        if delta_diff.apply(old, patch) != image:
+            raise ValueError("%s: patch round trip mismatch" % variant)
+        entry["files"]["delta"] = write_file(outdir, variant + FORMATS["delta"], patch, key)
+        entry["files"]["delta"]["base_build_id"] = old_entry["build_id"]
+        entry["files"]["delta"]["pages_changed"] = sum(
+            1 for i, crc in enumerate(entry["pages"]) if i >= len(old_entry["pages"]) or old_entry["pages"][i] != crc)
+    return entry
+
+
+def read_manifest(path):
+    """Manifest of a release, from its file or its directory."""
+    if os.path.isdir(path):
+        path = os.path.join(path, MANIFEST)
+    with open(path) as f:
+        manifest = json.load(f)
+    if manifest.get("format") != MANIFEST_FORMAT:
+        raise ValueError("%s: unknown manifest format" % path)
+    manifest["dir"] = os.path.dirname(os.path.abspath(path))
+    return manifest
+
+
+def read_file(manifest, entry, fmt):
+    """Content of one file of a manifest entry, checked against its SHA-256."""
+    if fmt not in entry["files"]:
+        raise ValueError("%s: no %s image in the manifest" % (entry["variant"], fmt))
+    info = entry["files"][fmt]
+    with open(os.path.join(manifest["dir"], info["name"]), "rb") as f:
+        data = f.read()
+    if hashlib.sha256(data).hexdigest() != info["sha256"]:
+        raise ValueError("%s: SHA-256 mismatch" % info["name"])
+    return data
+
+
+def load(path, variant=None, fmt="raw"):
+    """Image to send from a manifest: (file name, data, build ID, SHA-256 of
+    the installed image or None for manifests written before it).
+
+    variant may be omitted when the manifest has a single image."""
+    manifest = read_manifest(path)
+    entries = manifest["images"]
+    if variant is not None:
+        entries = [e for e in entries if e["variant"] == variant]
+    if len(entries) != 1:
+        raise ValueError("%s: choose a variant among %s" % (
+            path, ", ".join(e["variant"] for e in manifest["images"])))
+    data = read_file(manifest, entries[0], fmt)
+    return (entries[0]["files"][fmt]["name"], data, int(entries[0]["build_id"], 16),
+            entries[0].get("image_sha256"))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("inputs", nargs="+", help="APP binaries from fromelf, one per variant")
+    ap.add_argument("-o", "--output", help="output directory (default: the directory of the first input)")
+    ap.add_argument("--build-id", type=lambda v: int(v, 0), help="build ID (default: git hash or time)")
+    ap.add_argument("--lzss", action="store_true", help="also write LZSS compressed images")
+    ap.add_argument("--base", help="manifest (or its directory) of the release to patch from")
+    ap.add_argument("--key", help="encrypt the files with this AES-128 key, 32 hex digits or key file")
+    ap.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="worker processes")
+    args = ap.parse_args()
+
+    outdir = args.output or os.path.dirname(os.path.abspath(args.inputs[0]))
+    os.makedirs(outdir, exist_ok=True)
+    build_id = args.build_id if args.build_id is not None else image_stamp.default_build_id()
+
+    variants = [os.path.splitext(os.path.basename(path))[0] for path in args.inputs]
+    if len(set(variants)) != len(variants):
+        sys.exit("two inputs have the same name, variants are named after the file")
+
+    key = None
+    if args.key:
+        try:
+            key = aes_ctr.parse_key(args.key)
+        except (OSError, ValueError) as err:
+            sys.exit(str(err))
+
+    bases = {}
+    if args.base:
+        try:
+            base = read_manifest(args.base)
+            for entry in base["images"]:
+                old = read_file(base, entry, "raw")
+                if entry["files"]["raw"].get("encrypted"):
+                    if key is None:
+                        raise ValueError("%s is encrypted, give its --key" % entry["files"]["raw"]["name"])
+                    old = aes_ctr.decrypt(old, key)
+                bases[entry["variant"]] = (old, entry)
+        except (OSError, ValueError) as err:
+            sys.exit("base: %s" % err)
+
+    jobs = [(variant, path, outdir, build_id, args.lzss, bases.get(variant), key)
+            for variant, path in zip(variants, args.inputs)]
+    start = time.monotonic()
+    try:
+        with concurrent.futures.ProcessPoolExecutor(max_workers=max(1, min(args.jobs, len(jobs)))) as pool:
+            entries = list(pool.map(package, jobs))
+    except (OSError, ValueError) as err:
+        sys.exit(str(err))
+
+    manifest = {"format": MANIFEST_FORMAT, "build_id": "%08x" % build_id,
+                "created": time.strftime("%Y-%m-%dT%H:%M:%S"), "images": entries}
+    with open(os.path.join(outdir, MANIFEST), "w") as f:
+        json.dump(manifest, f, indent=1)
+        f.write("\n")
+
+    for e in entries:
+        sizes = ", ".join("%s %d" % (fmt, e["files"][fmt]["size"]) for fmt in FORMATS if fmt in e["files"])
+        print("%s: %s HW%02X FW%02X, build %s, crc %s, %s" % (
+            e["variant"], e["device"], e["hw"], e["fw"], e["build_id"], e["crc32"], sizes))
+    print("%s: %d variants in %.2f s" % (os.path.join(outdir, MANIFEST), len(entries), time.monotonic() - start))
+
+
+if __name__ == "__main__":
+    main()
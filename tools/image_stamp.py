@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Stamp an APP binary so the IAP can check it before erasing anything.
+
+Fills in the IMAGE_HeaderTypeDef placed by app_header.c right after the
+vector table (see stm32g031g8_IAP/UserCode/image.h):
+
+    offset 0xC0: magic "APPH" | length | build_id | device_name[10] | hw | fw
+
+then appends the CRC32 of the first `length` bytes. Run from the MDK
+AfterMake step after fromelf; re-running on a stamped file restamps it.
+
+Usage:
+    python3 tools/image_stamp.py stm32g031g8_APP/MDK-ARM/BIN/stm32g031g8_app.bin
+    python3 tools/image_stamp.py app.bin --build-id 0x1234abcd
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+import time
+import zlib
+
+HEADER_OFFSET = 0xC0
+HEADER_FORMAT = "<4sII10sBB"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+MAGIC = b"APPH"
+TRAILER_SIZE = 4
+
+
+def parse_header(image):
+    if len(image) < HEADER_OFFSET + HEADER_SIZE:
+        raise ValueError("image too small for a header")
+    magic, length, build_id, name, hw, fw = struct.unpack_from(HEADER_FORMAT, image, HEADER_OFFSET)
+    if magic != MAGIC:
+        raise ValueError("no APPH header at 0x%X, is app_header.c linked?" % HEADER_OFFSET)
+    return {"length": length, "build_id": build_id, "device": name.rstrip(b"\0").decode("ascii", "replace"),
+            "hw": hw, "fw": fw}
+
+
+def strip_stamp(image):
+    """Return the unstamped body if the image was already stamped."""
+    header = parse_header(image)
+    length = header["length"]
+    if length and len(image) == length + TRAILER_SIZE:
+        if zlib.crc32(image[:length]) == struct.unpack_from("<I", image, length)[0]:
+            return image[:length]
+    return image
+
+
+def default_build_id():
+    """Short git hash of the tree when available, build time otherwise."""
+    try:
+        out = subprocess.check_output(["git", "rev-parse", "--short=8", "HEAD"], stderr=subprocess.DEVNULL)
+        return int(out.strip(), 16)
+    except (OSError, subprocess.CalledProcessError, ValueError):
+        return int(time.time()) & 0xFFFFFFFF
+
+
+def stamp(image, build_id):
+    body = bytearray(strip_stamp(bytes(image)))
+    struct.pack_into("<II", body, HEADER_OFFSET + 4, len(body), build_id)
+    return bytes(body) + struct.pack("<I", zlib.crc32(body))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("input", help="APP binary produced by fromelf")
+    ap.add_argument("-o", "--output", help="output file (default: stamp in place)")
+    ap.add_argument("--build-id", type=lambda v: int(v, 0), help="build ID (default: git hash or time)")
+    args = ap.parse_args()
+
+    with open(args.input, "rb") as f:
+        image = f.read()
+    try:
+        stamped = stamp(image, args.build_id if args.build_id is not None else default_build_id())
+    except ValueError as err:
+        sys.exit("%s: %s" % (args.input, err))
+
+    with open(args.output or args.input, "wb") as f:
+        f.write(stamped)
+    h = parse_header(stamped)
+    print("%s: %s HW%02X FW%02X, %d bytes, build %08X, crc %08X" % (
+        args.output or args.input, h["device"], h["hw"], h["fw"], h["length"], h["build_id"],
+        struct.unpack_from("<I", stamped, h["length"])[0]))
+
+
+if __name__ == "__main__":
+    main()
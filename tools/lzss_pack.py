@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Compress an APP binary into the LZSS image format accepted by the IAP.
+
+The layout matches stm32g031g8_IAP/UserCode/lzss.h:
+
+    "LZS1" | original size (u32 LE) | groups of [flag byte, 8 tokens]
+
+flag bit set   -> literal byte
+flag bit clear -> 2-byte back reference, 12-bit distance-1, 4-bit length-3
+
+Usage:
+    python3 tools/lzss_pack.py stm32g031g8_APP/MDK-ARM/BIN/stm32g031g8_app.bin
+    python3 tools/lzss_pack.py app.bin -o app.lzs --baud 921600
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"LZS1"
+WINDOW = 4096
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + 15
+MAX_CHAIN = 256
+
+
+def compress(data):
+    out = bytearray(MAGIC + struct.pack("<I", len(data)))
+    heads = {}
+    pos = 0
+    group = []
+
+    def flush_group():
+        flags = 0
+        body = bytearray()
+        for bit, token in enumerate(group):
+            if len(token) == 1:
+                flags |= 1 << bit
+            body += token
+        out.append(flags)
+        out.extend(body)
+        group.clear()
+
+    def insert(p):
+        if p + MIN_MATCH <= len(data):
+            heads.setdefault(data[p:p + MIN_MATCH], []).append(p)
+
+    while pos < len(data):
+        best_len, best_dist = 0, 0
+        chain = heads.get(data[pos:pos + MIN_MATCH], [])
+        limit = min(MAX_MATCH, len(data) - pos)
+        for cand in reversed(chain[-MAX_CHAIN:]):
+            dist = pos - cand
+            if dist > WINDOW:
+                break
+            length = 0
+            while length < limit and data[cand + length] == data[pos + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, dist
+                if length == limit:
+                    break
+
+        if best_len >= MIN_MATCH:
+            d = best_dist - 1
+            group.append(bytes((d & 0xFF, ((d >> 4) & 0xF0) | (best_len - MIN_MATCH))))
+            step = best_len
+        else:
+            group.append(data[pos:pos + 1])
+            step = 1
+        for p in range(pos, pos + step):
+            insert(p)
+        pos += step
+        if len(group) == 8:
+            flush_group()
+
+    if group:
+        flush_group()
+    return bytes(out)
+
+
+def decompress(blob):
+    if blob[:4] != MAGIC:
+        raise ValueError("not an LZS1 image")
+    size = struct.unpack_from("<I", blob, 4)[0]
+    out = bytearray()
+    i = 8
+    while len(out) < size:
+        flags = blob[i]
+        i += 1
+        for bit in range(8):
+            if len(out) >= size:
+                break
+            if flags & (1 << bit):
+                out.append(blob[i])
+                i += 1
+            else:
+                lo, hi = blob[i], blob[i + 1]
+                i += 2
+                dist = (((hi & 0xF0) << 4) | lo) + 1
+                for _ in range((hi & 0x0F) + MIN_MATCH):
+                    out.append(out[-dist])
+    return bytes(out)
+
+
+def ymodem_time(size, baud):
+    """Seconds on the wire with 1K Ymodem packets (8N1, 1029 bytes per packet)."""
+    packets = (size + 1023) // 1024
+    return packets * 1029 * 10 / baud
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("input", help="raw APP binary")
+    ap.add_argument("-o", "--output", help="output file (default: <input>.lzs)")
+    ap.add_argument("--baud", type=int, default=921600, help="UART baud rate for the time estimate")
+    args = ap.parse_args()
+
+    with open(args.input, "rb") as f:
+        raw = f.read()
+    packed = compress(raw)
+    if decompress(packed) != raw:
+        sys.exit("internal error: round trip mismatch")
+
+    output = args.output or args.input.rsplit(".", 1)[0] + ".lzs"
+    with open(output, "wb") as f:
+        f.write(packed)
+
+    t_raw = ymodem_time(len(raw), args.baud)
+    t_lzs = ymodem_time(len(packed), args.baud)
+    print("%s: %d -> %d bytes (%.1f%%)" % (output, len(raw), len(packed), 100.0 * len(packed) / len(raw)))
+    print("ymodem @%d: %.2f s -> %.2f s" % (args.baud, t_raw, t_lzs))
+
+
+if __name__ == "__main__":
+    main()
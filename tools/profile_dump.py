@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Read and print the hot path probes of an IAP or APP built with PROFILE_ENABLED.
+
+Both projects time their hot paths (packet receive, CRC16, flash program and
+erase, image write, decryption, image digest and verification, APP main
+loop) with enter/exit probes on the 1 us TIM2 timebase
+(stm32g031g8_IAP/UserCode/profile.h). The table is sent as one frame,
+little-endian:
+
+    60 F6 | n | n * (name[4] count min max total:u64) | sum8
+
+The IAP sends it on menu entry 5 (USART1), the APP on 60 F6 55 55 (USART2).
+--sim starts the iap_profile_sim program, downloads an image and reads the
+table of that session; the probes then show the time the host takes for
+each path, not the target, but are good enough to compare two builds.
+
+Usage:
+    python3 tools/profile_dump.py --port COM5
+    python3 tools/profile_dump.py --port COM4 --iap
+    python3 tools/profile_dump.py --sim sim/build/iap_profile_sim --image app.bin --json
+    python3 tools/profile_dump.py --file capture.bin
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import tempfile
+
+from app_status import CMD_IAP
+
+CMD_PROFILE = 0xF6
+REQUEST = bytes([CMD_IAP, CMD_PROFILE, 0x55, 0x55])
+MENU_PROFILE = b"5"
+
+RECORD_FORMAT = "<4sIIIQ"   # PROFILE_RecordTypeDef
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+
+def decode(frame):
+    """Return the probes of a complete answer as a list of dicts."""
+    start = frame.find(bytes([CMD_IAP, CMD_PROFILE]))
+    if start < 0 or len(frame) < start + 3:
+        raise ValueError("no profile frame found")
+    end = start + 3 + frame[start + 2] * RECORD_SIZE
+    if len(frame) < end + 1:
+        raise ValueError("frame truncated: %d of %d bytes" % (len(frame) - start, end + 1 - start))
+    if sum(frame[start:end]) & 0xFF != frame[end]:
+        raise ValueError("checksum mismatch")
+    probes = []
+    for offset in range(start + 3, end, RECORD_SIZE):
+        name, count, low, high, total = struct.unpack_from(RECORD_FORMAT, frame, offset)
+        probes.append({
+            "name": name.decode("ascii", "replace").strip(),
+            "count": count,
+            "min_us": low if count else None,
+            "max_us": high if count else None,
+            "mean_us": round(total / count, 2) if count else None,
+            "total_us": total,
+        })
+    return probes
+
+
+def read_frame(link, timeout):
+    """Read one answer: header, then its length, skipping anything before it."""
+    data = b""
+    while True:
+        chunk = link.read(4096, timeout)
+        if not chunk:
+            return data
+        data += chunk
+        start = data.find(bytes([CMD_IAP, CMD_PROFILE]))
+        if start >= 0 and len(data) >= start + 3 and len(data) >= start + 4 + data[start + 2] * RECORD_SIZE:
+            return data
+
+
+def fetch_port(args):
+    from ymodem_send import SerialLink
+    link = SerialLink(args.port, args.baud or (921600 if args.iap else 115200))
+    link.drain()
+    link.write(MENU_PROFILE if args.iap else REQUEST)
+    return read_frame(link, args.timeout)
+
+
+def fetch_sim(args):
+    """Download --image into a fresh simulated board, then ask for the table."""
+    from ymodem_send import FdLink, Sender, start_sim
+
+    with open(args.image, "rb") as f:
+        data = f.read()
+    with tempfile.TemporaryDirectory() as work:
+        sim_args = argparse.Namespace(sim=args.sim, chain=1, power_on=True,
+                                      flash=os.path.join(work, "flash.bin"),
+                                      ram=os.path.join(work, "ram.bin"))
+        procs, sock = start_sim(sim_args)
+        link = FdLink(sock.fileno())
+        try:
+            link.drain()
+            link.write(b"1")
+            Sender(link).send(os.path.basename(args.image), data)
+            link.drain()
+            link.write(MENU_PROFILE)
+            return read_frame(link, args.timeout)
+        finally:
+            for proc in procs:
+                proc.terminate()
+                proc.wait()
+
+
+def describe(probes):
+    lines = ["%-5s %8s %9s %9s %11s %12s" % ("probe", "count", "min us", "max us", "mean us", "total us")]
+    for p in probes:
+        if not p["count"]:
+            lines.append("%-5s %8d %9s %9s %11s %12s" % (p["name"], 0, "-", "-", "-", "-"))
+        else:
+            lines.append("%-5s %8d %9d %9d %11.2f %12d" % (
+                p["name"], p["count"], p["min_us"], p["max_us"], p["mean_us"], p["total_us"]))
+    return "\n".join(lines)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = ap.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the APP console (USART2), or of the IAP with --iap")
+    source.add_argument("--sim", help="path of the iap_profile_sim program to start")
+    source.add_argument("--file", help="raw capture of one answer")
+    ap.add_argument("--iap", action="store_true", help="the port is the IAP console (USART1, menu entry 5)")
+    ap.add_argument("--image", help="stamped APP binary downloaded with --sim")
+    ap.add_argument("--baud", type=int, help="baud rate, 921600 with --iap, else 115200")
+    ap.add_argument("--timeout", type=float, default=1.0, help="read timeout in seconds")
+    ap.add_argument("--json", action="store_true", help="print the probes as JSON")
+    args = ap.parse_args()
+    if args.sim and not args.image:
+        ap.error("--sim needs --image")
+
+    try:
+        if args.file:
+            with open(args.file, "rb") as f:
+                frame = f.read()
+        elif args.sim:
+            frame = fetch_sim(args)
+        else:
+            try:
+                import serial  # noqa: F401
+            except ImportError:
+                sys.exit("pyserial is needed for --port (pip install pyserial)")
+            frame = fetch_port(args)
+        probes = decode(frame)
+    except Exception as e:
+        sys.exit(str(e))
+
+    print(json.dumps(probes) if args.json else describe(probes))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,387 @@
+#!/usr/bin/env python3
+"""Update every device on an RS-485 bus at once (IAP built with IAP_RS485_ENABLED).
+
+The image is broadcast once; then each device is polled for the blocks it
+is still missing (lost frame, CRC error, failed programming) and only
+those blocks are broadcast again. The update therefore takes about as long
+as for one device, plus one short poll per device and round. Frame layout
+and commands: stm32g031g8_IAP/UserCode/rs485.h.
+
+    BEGIN   broadcast, header check and erase (wait --erase-ms per page)
+    DATA    broadcast, one 1K block every --gap ms (programming time)
+    STATUS  poll each address, re-send the union of the missing blocks
+    END     broadcast, CRC32 check and config page write, poll the result
+    RUN     broadcast with --run
+
+A device answers with its address once assigned; a new device (address
+0xFF) is given one with --set-address, alone on the bus.
+
+Usage:
+    python3 tools/rs485_update.py app.bin --port /dev/ttyUSB0 --address 1-16 --run
+    python3 tools/rs485_update.py --port /dev/ttyUSB0 --set-address 7
+    python3 tools/rs485_update.py app.bin --sim sim/build/iap_bus_sim --count 16 --loss 2 --json
+
+With --sim, each device is an iap_bus_sim process; the bus is simulated
+here (every frame goes to every device, --loss drops a frame for one
+device with the given probability in percent) and the devices are given
+the addresses 1..N first.
+"""
+
+import argparse
+import json
+import os
+import random
+import select
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from ymodem_send import crc16
+
+SYNC = 0xA5
+BROADCAST = 0x00
+ADDRESS_NONE = 0xFF
+
+CMD_BEGIN = 0x01
+CMD_DATA = 0x02
+CMD_STATUS = 0x03
+CMD_END = 0x04
+CMD_RUN = 0x05
+CMD_ADDRESS = 0x06
+ANSWER = 0x80
+
+BLOCK_SIZE = 1024
+PAGE_SIZE = 2048
+IMAGE_HEADER_OFFSET = 0xC0      # image.h
+IMAGE_HEADER_SIZE = struct.calcsize("<III10sBB")  # IMAGE_HeaderTypeDef
+IMAGE_MAGIC = 0x48505041        # "APPH"
+SIM_EXIT_JUMP = 10              # sim/shim/sim.h
+
+# RS485_StatusTypeDef, followed by the missing block bitmap
+STATUS_FORMAT = "<BBBBIH"
+STATES = ["idle", "receiving", "done", "failed"]
+# COM_StatusTypeDef and IMAGE_StatusTypeDef, as in tools/app_status.py
+RESULTS = ["ok", "error", "abort", "timeout", "data", "limit", "image"]
+IMAGE_RESULTS = ["ok", "no header", "bad device", "bad hw", "bad length", "bad crc", "bad vector"]
+
+
+class BusError(Exception):
+    pass
+
+
+def frame(address, command, payload=b""):
+    body = bytes([address, command]) + struct.pack("<H", len(payload)) + payload
+    crc = crc16(body)
+    return bytes([SYNC]) + body + bytes([crc >> 8, crc & 0xFF])
+
+
+class SerialBus:
+    def __init__(self, port, baud):
+        import serial
+        self.link = serial.Serial(port, baud, timeout=0)
+        self.rx = b""
+
+    def send(self, data):
+        self.link.write(data)
+        self.link.flush()
+
+    def receive(self, timeout):
+        self.link.timeout = timeout
+        return self.link.read(4096)
+
+    def close(self):
+        self.link.close()
+
+
+class SimBus:
+    """iap_bus_sim processes, each on a socketpair; frames go to all of them."""
+
+    def __init__(self, sim, count, loss, seed):
+        self.workdir = tempfile.TemporaryDirectory(prefix="rs485_update")
+        self.random = random.Random(seed)
+        self.loss = loss / 100.0
+        self.procs = []
+        self.socks = []
+        self.only = None
+        for i in range(count):
+            ours, theirs = socket.socketpair()
+            cmd = [sim, "--uart", "fd:%d" % theirs.fileno(), "--power-on",
+                   "--flash", os.path.join(self.workdir.name, "flash%d.bin" % i),
+                   "--ram", os.path.join(self.workdir.name, "ram%d.bin" % i)]
+            self.procs.append(subprocess.Popen(cmd, pass_fds=(theirs.fileno(),), stdout=subprocess.DEVNULL,
+                                               stderr=subprocess.DEVNULL))
+            theirs.close()
+            self.socks.append(ours)
+
+    def send(self, data):
+        for i, sock in enumerate(self.socks):
+            if self.only is not None and i != self.only:
+                continue
+            if self.only is None and data[2] == CMD_DATA and self.random.random() < self.loss:
+                continue
+            try:
+                sock.sendall(data)
+            except OSError:
+                pass        # the device has jumped to its application
+
+    def receive(self, timeout):
+        ready, _, _ = select.select(self.socks, [], [], timeout)
+        data = b""
+        for sock in ready:
+            try:
+                data += sock.recv(4096)
+            except OSError:
+                pass
+        return data
+
+    def close(self):
+        for sock in self.socks:
+            sock.close()
+        codes = []
+        for proc in self.procs:
+            try:
+                codes.append(proc.wait(timeout=2))
+            except subprocess.TimeoutExpired:
+                proc.terminate()
+                codes.append(proc.wait())
+        self.workdir.cleanup()
+        return codes
+
+
+class Master:
+    def __init__(self, bus, timeout, retries):
+        self.bus = bus
+        self.timeout = timeout
+        self.retries = retries
+        self.rx = b""
+        self.polls = 0
+
+    def broadcast(self, command, payload=b""):
+        self.bus.send(frame(BROADCAST, command, payload))
+
+    def answer(self, address, command):
+        """Wait for the answer of one device, None on timeout or CRC error."""
+        deadline = time.monotonic() + self.timeout
+        while True:
+            start = self.rx.find(bytes([SYNC]))
+            if start < 0:
+                self.rx = b""
+            else:
+                self.rx = self.rx[start:]
+                if len(self.rx) >= 5:
+                    length = struct.unpack_from("<H", self.rx, 3)[0]
+                    if len(self.rx) >= 7 + length:
+                        body, crc = self.rx[1:5 + length], self.rx[5 + length:7 + length]
+                        self.rx = self.rx[7 + length:]
+                        if crc16(body) == (crc[0] << 8 | crc[1]) and body[0] == address and body[1] == command | ANSWER:
+                            return body[4:]
+                        continue
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            self.rx += self.bus.receive(left)
+
+    def request(self, address, command, payload=b"", answer_from=None):
+        for _ in range(self.retries):
+            self.rx = b""
+            self.polls += 1
+            self.bus.send(frame(address, command, payload))
+            status = self.answer(address if answer_from is None else answer_from, command)
+            if status is not None:
+                return decode_status(status)
+        return None
+
+
+def decode_status(payload):
+    size = struct.calcsize(STATUS_FORMAT)
+    if len(payload) < size:
+        raise BusError("status too short: %d bytes" % len(payload))
+    state, result, image, blocks, build_id, errors = struct.unpack_from(STATUS_FORMAT, payload)
+    bitmap = payload[size:]
+    missing = [b for b in range(blocks) if bitmap[b // 8] >> (b % 8) & 1]
+    return {"state": STATES[state] if state < len(STATES) else state,
+            "result": RESULTS[result] if result < len(RESULTS) else result,
+            "image": IMAGE_RESULTS[image] if image < len(IMAGE_RESULTS) else image,
+            "blocks": blocks, "build_id": build_id, "errors": errors, "missing": missing}
+
+
+def parse_addresses(specs):
+    addresses = []
+    for spec in specs:
+        for part in spec.split(","):
+            first, _, last = part.partition("-")
+            addresses += range(int(first, 0), int(last or first, 0) + 1)
+    for address in addresses:
+        if not 0 < address < ADDRESS_NONE:
+            sys.exit("bus addresses are 1..254, not %d" % address)
+    return sorted(set(addresses))
+
+
+def update(master, image, addresses, args):
+    magic, length, build_id = struct.unpack_from("<III", image, IMAGE_HEADER_OFFSET)
+    if magic != IMAGE_MAGIC:
+        raise BusError("no image header, stamp the binary with tools/image_stamp.py first")
+    header = image[IMAGE_HEADER_OFFSET:IMAGE_HEADER_OFFSET + IMAGE_HEADER_SIZE]
+    blocks = [image[i:i + BLOCK_SIZE] for i in range(0, len(image), BLOCK_SIZE)]
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    devices = {a: {"address": a, "result": "", "error": "", "rounds": 0} for a in addresses}
+    sent = 0
+    start = time.monotonic()
+
+    def send_blocks(numbers):
+        nonlocal sent
+        for n in numbers:
+            master.broadcast(CMD_DATA, struct.pack("<HH", n, build_id & 0xFFFF) + blocks[n])
+            sent += 1
+            time.sleep(args.gap / 1000.0)
+
+    def begin():
+        master.broadcast(CMD_BEGIN, struct.pack("<I", len(image)) + header)
+        time.sleep(pages * args.erase_ms / 1000.0 + 0.05)
+
+    begin()
+    send_blocks(range(len(blocks)))
+    data_time = time.monotonic() - start
+
+    pending = set(addresses)
+    for round_ in range(args.rounds + 1):
+        missing = set()
+        restart = False
+        for address in sorted(pending):
+            status = master.request(address, CMD_STATUS)
+            device = devices[address]
+            if status is None:
+                device["result"], device["error"] = "failed", "no answer"
+                continue
+            device["errors"] = status["errors"]
+            if status["state"] == "failed" and status["build_id"] == build_id:
+                device["result"], device["error"] = "failed", "image %s (%s)" % (status["result"], status["image"])
+            elif status["state"] != "receiving" or status["build_id"] != build_id:
+                # missed BEGIN: the session must be started again for it
+                restart = True
+                missing.update(range(len(blocks)))
+            else:
+                missing.update(status["missing"])
+                device["missing"] = len(status["missing"])
+        pending = {a for a in pending if devices[a]["result"] != "failed"}
+        if not missing or round_ == args.rounds:
+            break
+        for address in pending:
+            devices[address]["rounds"] += 1
+        if restart:
+            begin()
+        send_blocks(sorted(missing))
+
+    master.broadcast(CMD_END)
+    time.sleep(args.erase_ms / 1000.0 + 0.1)
+    for address in sorted(pending):
+        status = master.request(address, CMD_STATUS)
+        device = devices[address]
+        if status is None:
+            device["result"], device["error"] = "failed", "no answer after END"
+        elif status["state"] == "done":
+            device["result"] = "ok"
+            device["errors"] = status["errors"]
+        else:
+            device["result"] = "failed"
+            device["error"] = "%s, %d blocks missing, result %s (%s)" % (
+                status["state"], len(status["missing"]), status["result"], status["image"])
+    if args.run:
+        master.broadcast(CMD_RUN)
+
+    total = time.monotonic() - start
+    ok = sum(1 for d in devices.values() if d["result"] == "ok")
+    summary = {"devices": len(devices), "ok": ok, "failed": len(devices) - ok, "image_bytes": len(image),
+               "blocks": len(blocks), "blocks_sent": sent, "polls": master.polls,
+               "data_s": round(data_time, 3), "total_s": round(total, 3)}
+    return summary, [devices[a] for a in addresses]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("image", nargs="?", help="stamped APP binary (tools/image_stamp.py)")
+    line = ap.add_mutually_exclusive_group(required=True)
+    line.add_argument("--port", help="serial port of the RS-485 adapter")
+    line.add_argument("--sim", help="path of iap_bus_sim, to update simulated devices")
+    ap.add_argument("--baud", type=int, default=921600, help="bus baud rate")
+    ap.add_argument("--address", nargs="+", default=[], help="device addresses, e.g. 1-16 or 3,5,9")
+    ap.add_argument("--set-address", type=int, help="give this address to the device at --old-address")
+    ap.add_argument("--old-address", type=int, default=ADDRESS_NONE, help="current address for --set-address")
+    ap.add_argument("--count", type=int, default=4, help="number of simulated devices (--sim)")
+    ap.add_argument("--loss", type=float, default=0.0, help="percent of data frames lost per device (--sim)")
+    ap.add_argument("--seed", type=int, default=1, help="random seed of --loss")
+    ap.add_argument("--gap", type=float, default=15.0, help="ms between two data frames, for programming")
+    ap.add_argument("--erase-ms", type=float, default=25.0, help="ms per page erase")
+    ap.add_argument("--timeout", type=float, default=0.1, help="seconds to wait for an answer")
+    ap.add_argument("--retries", type=int, default=3, help="tries per poll")
+    ap.add_argument("--rounds", type=int, default=5, help="rounds of missing block re-sends")
+    ap.add_argument("--run", action="store_true", help="start the applications after the update")
+    ap.add_argument("--json", action="store_true", help="print the result as JSON")
+    args = ap.parse_args()
+
+    if args.sim:
+        bus = SimBus(args.sim, args.count, args.loss, args.seed)
+        master = Master(bus, args.timeout, args.retries)
+        addresses = list(range(1, args.count + 1))
+        for i, address in enumerate(addresses):
+            bus.only = i
+            if master.request(ADDRESS_NONE, CMD_ADDRESS, bytes([address]), answer_from=address) is None:
+                sys.exit("simulated device %d did not take address %d" % (i, address))
+        bus.only = None
+    else:
+        try:
+            bus = SerialBus(args.port, args.baud)
+        except ImportError:
+            sys.exit("pyserial is needed for --port (pip install pyserial)")
+        master = Master(bus, args.timeout, args.retries)
+        addresses = parse_addresses(args.address)
+        if args.set_address is not None:
+            if not 0 < args.set_address < ADDRESS_NONE:
+                sys.exit("bus addresses are 1..254")
+            status = master.request(args.old_address, CMD_ADDRESS, bytes([args.set_address]),
+                                    answer_from=args.set_address)
+            bus.close()
+            if status is None:
+                sys.exit("no answer from address %d" % args.set_address)
+            print("address %d -> %d" % (args.old_address, args.set_address))
+            return
+
+    if not args.image or not addresses:
+        sys.exit("an image and --address are needed for an update")
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    try:
+        summary, devices = update(master, image, addresses, args)
+    except BusError as e:
+        sys.exit(str(e))
+    finally:
+        codes = bus.close()
+    if args.sim and args.run:
+        for device, code in zip(devices, codes):
+            device["sim_exit"] = code
+            if device["result"] == "ok" and code != SIM_EXIT_JUMP:
+                device["result"], device["error"] = "failed", "simulation exit code %d" % code
+        summary["ok"] = sum(1 for d in devices if d["result"] == "ok")
+        summary["failed"] = len(devices) - summary["ok"]
+
+    if args.json:
+        print(json.dumps({"summary": summary, "devices": devices}, indent=2))
+    else:
+        for d in devices:
+            if d["result"] == "ok":
+                print("address %3d  ok      %d re-send rounds, %d frames dropped" % (
+                    d["address"], d["rounds"], d.get("errors", 0)))
+            else:
+                print("address %3d  FAILED  %s" % (d["address"], d["error"]))
+        print("%d/%d devices, %d bytes in %.2f s (broadcast %.2f s), %d blocks sent for %d, %d polls" % (
+            summary["ok"], summary["devices"], len(image), summary["total_s"], summary["data_s"],
+            summary["blocks_sent"], summary["blocks"], summary["polls"]))
+    sys.exit(0 if summary["failed"] == 0 else 1)
+
+
+if __name__ == "__main__":
+    main()
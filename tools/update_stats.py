@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Read the statistics of the last update session of one or more devices.
+
+The IAP keeps counters and phase timings of its last Ymodem download in the
+config page (UPDATE_StatsTypeDef, stm32g031g8_IAP/UserCode/update_stats.h).
+The APP returns the record on 60 F5 55 55 (USART2):
+
+    60 F5 | len | record (len bytes, little-endian) | sum8
+
+len is 0 when no session has been recorded. The record can also be read
+from a flash dump (the simulation flash file, or a readout with a
+programmer). Several ports are queried in parallel; --csv collects one line
+per device to track link quality and throughput across a fleet.
+
+Usage:
+    python3 tools/update_stats.py --port COM5 COM6
+    python3 tools/update_stats.py --port /dev/ttyUSB* --csv stats.csv
+    python3 tools/update_stats.py --flash flash.bin --json
+"""
+
+import argparse
+import csv
+import json
+import struct
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+from app_status import CMD_IAP, IMAGE_RESULTS, UPDATE_RESULTS
+
+CMD_UPDATE_STATS = 0xF5
+REQUEST = bytes([CMD_IAP, CMD_UPDATE_STATS, 0x55, 0x55])
+
+FLASH_BASE = 0x08000000
+STATS_ADDRESS = 0x0800F800 + 0x80       # UPDATE_STATS_ADDRESS
+STATS_MAGIC = 0x54535055                # "UPST"
+
+# layout 1, see UPDATE_StatsTypeDef
+STATS_FORMAT = "<IIIBBBBHHHHHHHHIIIIIIIIII"
+STATS_FIELDS = (
+    "magic", "build_id", "file_size", "result", "image_status", "format", "layout",
+    "packets", "naks", "crc_errors", "timeouts", "overruns", "framing_errors",
+    "noise_errors", "duplicates", "bytes_skipped", "bytes_retransmitted",
+    "handshake_ms", "erase_ms", "program_ms", "verify_ms", "transfer_ms", "total_ms",
+    "reserved", "check",
+)
+FORMATS = ["raw", "lzss", "delta"]
+FORMAT_ENCRYPTED = 0x80
+CSV_FIELDS = ("port",) + tuple(f for f in STATS_FIELDS if f not in ("magic", "reserved", "check")) + (
+    "bytes_per_second", "error")
+
+
+def unpack(record):
+    """Return the record fields as a dict, None for an empty or damaged record."""
+    size = struct.calcsize(STATS_FORMAT)
+    if len(record) < size:
+        return None
+    words = struct.unpack_from("<%dI" % (size // 4), record)
+    if words[0] != STATS_MAGIC or (~sum(words[:-1])) & 0xFFFFFFFF != words[-1]:
+        return None
+    stats = dict(zip(STATS_FIELDS, struct.unpack_from(STATS_FORMAT, record)))
+    for field in ("magic", "reserved", "check"):
+        del stats[field]
+    ok = stats["result"] == 0 and stats["transfer_ms"]
+    stats["bytes_per_second"] = int(stats["file_size"] * 1000 / stats["transfer_ms"]) if ok else 0
+    return stats
+
+
+def decode(frame):
+    """Return the record from a complete answer, None if there is none."""
+    start = frame.find(bytes([CMD_IAP, CMD_UPDATE_STATS]))
+    if start < 0 or len(frame) < start + 3:
+        raise ValueError("no statistics frame found")
+    length = frame[start + 2]
+    end = start + 3 + length
+    if len(frame) < end + 1:
+        raise ValueError("frame truncated: %d of %d bytes" % (len(frame) - start, end + 1 - start))
+    if sum(frame[start:end]) & 0xFF != frame[end]:
+        raise ValueError("checksum mismatch")
+    if length == 0:
+        return None
+    stats = unpack(frame[start + 3:end])
+    if stats is None:
+        raise ValueError("damaged record")
+    return stats
+
+
+def read_flash(path):
+    with open(path, "rb") as f:
+        f.seek(STATS_ADDRESS - FLASH_BASE)
+        return unpack(f.read(struct.calcsize(STATS_FORMAT)))
+
+
+def describe(stats):
+    if stats is None:
+        return "no update recorded"
+    result = UPDATE_RESULTS.get(stats["result"], "0x%02x" % stats["result"])
+    if stats["result"] == 0x06 and stats["image_status"] < len(IMAGE_RESULTS):
+        result += " (%s)" % IMAGE_RESULTS[stats["image_status"]]
+    base = stats["format"] & ~FORMAT_ENCRYPTED
+    fmt = FORMATS[base] if base < len(FORMATS) else "?"
+    if stats["format"] & FORMAT_ENCRYPTED:
+        fmt += "+aes"
+    return ("%s, %s %d bytes, build %08x, %d B/s\n"
+            "    packets %d, naks %d, crc %d, timeouts %d, duplicates %d, ore/fe/ne %d/%d/%d,"
+            " %d bytes skipped, %d retransmitted\n"
+            "    handshake %d ms, erase %d, program %d, verify %d, transfer %d, total %d" % (
+                result, fmt, stats["file_size"], stats["build_id"], stats["bytes_per_second"],
+                stats["packets"], stats["naks"], stats["crc_errors"], stats["timeouts"], stats["duplicates"],
+                stats["overruns"], stats["framing_errors"], stats["noise_errors"],
+                stats["bytes_skipped"], stats["bytes_retransmitted"],
+                stats["handshake_ms"], stats["erase_ms"], stats["program_ms"], stats["verify_ms"],
+                stats["transfer_ms"], stats["total_ms"]))
+
+
+def fetch(port, baud, timeout):
+    import serial
+    with serial.Serial(port, baud, timeout=timeout) as link:
+        link.reset_input_buffer()
+        link.write(REQUEST)
+        head = link.read(3)
+        if len(head) < 3:
+            raise ValueError("no answer")
+        return head + link.read(head[2] + 1)
+
+
+def query(port, baud, timeout):
+    try:
+        return port, decode(fetch(port, baud, timeout)), None
+    except Exception as e:  # one bad port must not stop the others
+        return port, None, str(e)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = ap.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", nargs="+", help="serial ports of the APP consoles (USART2)")
+    source.add_argument("--file", help="raw capture of one APP answer")
+    source.add_argument("--flash", nargs="+", help="flash dumps starting at 0x08000000")
+    ap.add_argument("--baud", type=int, default=115200, help="APP console baud rate")
+    ap.add_argument("--timeout", type=float, default=0.5, help="read timeout in seconds")
+    ap.add_argument("--json", action="store_true", help="print one JSON object per device")
+    ap.add_argument("--csv", help="write one line per device to this CSV file")
+    args = ap.parse_args()
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+        try:
+            results = [(args.file, decode(data), None)]
+        except ValueError as e:
+            sys.exit(str(e))
+    elif args.flash:
+        results = [(path, read_flash(path), None) for path in args.flash]
+    else:
+        try:
+            import serial  # noqa: F401
+        except ImportError:
+            sys.exit("pyserial is needed for --port (pip install pyserial)")
+        with ThreadPoolExecutor(max_workers=min(64, len(args.port))) as pool:
+            results = list(pool.map(lambda p: query(p, args.baud, args.timeout), args.port))
+
+    failed = 0
+    for port, stats, error in results:
+        if error is not None:
+            failed += 1
+            print(json.dumps({"port": port, "error": error}) if args.json else "%-14s %s" % (port, error))
+        elif args.json:
+            print(json.dumps(dict(port=port, **(stats or {}))))
+        else:
+            print("%-14s %s" % (port, describe(stats)))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=CSV_FIELDS)
+            writer.writeheader()
+            for port, stats, error in results:
+                writer.writerow(dict(port=port, error=error or "", **(stats or {})))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
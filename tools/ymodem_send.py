@@ -0,0 +1,437 @@
+#!/usr/bin/env python3
+"""Send an APP image to the IAP with Ymodem (1K blocks, CRC16).
+
+Does what a terminal's "send Ymodem" does against the IAP menu
+(stm32g031g8_IAP/UserCode/menu.c), without the terminal: selects menu
+entry 1, sends the file, and with --run selects entry 3 to start it.
+
+The line is either a serial port or the host simulation (sim/), started
+here with its UART on one end of a socketpair. Boards wired in a chain
+(IAP_CHAIN_ENABLED, stm32g031g8_IAP/UserCode/chain.h) take the same
+transfer as a single board; --chain N starts N simulated boards, the USART2
+of each one linked to the USART1 of the next, board k>0 on FLASH-k / RAM-k.
+
+An IAP built with IAP_SPI_ENABLED (stm32g031g8_IAP/UserCode/spi_link.h)
+takes the same menu and transfer on its SPI slave link: --spidev drives it
+from a Linux SPI master, paced by its READY line (python3-gpiod), --spi
+talks to the iap_spi_sim program on the same link:
+
+Usage:
+    python3 tools/ymodem_send.py app.bin --port COM5 --run
+    python3 tools/ymodem_send.py app.bin --sim sim/build/iap_sim --flash flash.bin --ram ram.bin --run
+    python3 tools/ymodem_send.py release/manifest.json --variant gx01 --format lzss --port COM5
+    python3 tools/ymodem_send.py app.bin --sim sim/build/iap_chain_sim --chain 8 --flash f.bin --ram r.bin --power-on --run
+    python3 tools/ymodem_send.py app.bin --spidev /dev/spidev0.0 --ready gpiochip0:25 --run
+    python3 tools/ymodem_send.py app.bin --sim sim/build/iap_spi_sim --spi --flash flash.bin --ram ram.bin --run
+
+The image may also be the manifest of a release (tools/fw_package.py),
+with the variant and the file (raw, lzss or delta) to send.
+
+The transfer time, throughput and retransmissions are printed at the end,
+--json prints them as one JSON object. An IAP built with IAP_SHA256_ENABLED
+prints the SHA-256 of the image it installed; it is checked against the one
+of the image sent (the manifest's image_sha256 for a compressed file or a
+patch) and printed too.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import re
+import select
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+import fw_package
+
+SOH = 0x01
+STX = 0x02
+EOT = 0x04
+ACK = 0x06
+NAK = 0x15
+CA = 0x18
+CRC16 = 0x43
+PAD = 0x1A
+
+MENU_DOWNLOAD = b"1"
+MENU_RUN = b"3"
+MENU_TITLE = b"Main Menu"
+DIGEST = re.compile(rb"SHA-256: ([0-9a-f]{64})")
+IMAGE_MAGIC = b"APPH"
+IMAGE_HEADER_OFFSET = 0xC0
+
+
+class YmodemError(Exception):
+    pass
+
+
+def crc16(data):
+    """CRC-16/XMODEM, as Cal_CRC16 in ymodem.c."""
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def block(seq, payload):
+    size = 128 if len(payload) <= 128 else 1024
+    payload = payload.ljust(size, bytes([PAD if seq else 0]))
+    crc = crc16(payload)
+    return bytes([SOH if size == 128 else STX, seq & 0xFF, 0xFF - (seq & 0xFF)]) + payload + bytes([crc >> 8, crc & 0xFF])
+
+
+class FdLink:
+    """Byte pipe over a file descriptor (socketpair end, pty master)."""
+
+    def __init__(self, fd):
+        self.fd = fd
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+    def read(self, size, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return b""
+        data = os.read(self.fd, size)
+        if not data:
+            raise YmodemError("line closed by the device")
+        return data
+
+    def drain(self):
+        while self.read(4096, 0.05):
+            pass
+
+
+class SerialLink(FdLink):
+    def __init__(self, port, baud):
+        import serial
+        self.link = serial.Serial(port, baud, timeout=0)
+
+    def write(self, data):
+        self.link.write(data)
+
+    def read(self, size, timeout):
+        self.link.timeout = timeout
+        return self.link.read(size)
+
+
+class SpiLink(FdLink):
+    """Byte pipe over the SPI link of spi_link.h, we are the master.
+
+    Every transaction sends one frame, len (2) | len bytes, and clocks the
+    device's frame back as far as we want to read it; the device announces
+    how much it has queued, so the next transaction clocks the rest.
+    """
+
+    MTU = 1032          # SPI_LINK_MTU
+    POLL = 64           # bytes clocked when the device has nothing announced
+
+    def __init__(self):
+        self.rx = bytearray()
+        self.pending = 0
+
+    def exchange(self, mosi, timeout):
+        """One transaction once READY is high: MISO, or None on timeout."""
+        raise NotImplementedError
+
+    def transfer(self, data, timeout):
+        clock = 2 + min(self.MTU, max(len(data), self.pending, self.POLL))
+        mosi = struct.pack("<H", len(data)) + data
+        miso = self.exchange(mosi.ljust(clock, b"\0"), timeout)
+        if miso is None:
+            return False
+        length, = struct.unpack_from("<H", miso)
+        got = min(length, clock - 2)
+        self.rx += miso[2:2 + got]
+        self.pending = length - got
+        return True
+
+    def write(self, data):
+        for offset in range(0, max(len(data), 1), self.MTU):
+            if not self.transfer(data[offset:offset + self.MTU], 5.0):
+                raise YmodemError("SPI device not ready")
+
+    def read(self, size, timeout):
+        deadline = time.monotonic() + timeout
+        while not self.rx:
+            if not self.transfer(b"", max(0.0, deadline - time.monotonic())):
+                break
+            if time.monotonic() >= deadline:
+                break
+        data = bytes(self.rx[:size])
+        del self.rx[:size]
+        return data
+
+
+class SimSpiLink(SpiLink):
+    """SPI link of iap_spi_sim (sim/shim/sim_spi.c): u16 count | MOSI out,
+    MISO back. The simulation takes the transaction once READY is high, so
+    the answer may come later than the timeout; a dead device still fails."""
+
+    def __init__(self, fd):
+        SpiLink.__init__(self)
+        self.fd = fd
+
+    def exchange(self, mosi, timeout):
+        os.write(self.fd, struct.pack("<H", len(mosi)) + mosi)
+        miso = b""
+        while len(miso) < len(mosi):
+            ready, _, _ = select.select([self.fd], [], [], 10.0)
+            if not ready:
+                raise YmodemError("SPI device not ready")
+            data = os.read(self.fd, len(mosi) - len(miso))
+            if not data:
+                raise YmodemError("line closed by the device")
+            miso += data
+        return miso
+
+
+class SpidevLink(SpiLink):
+    """SPI link through Linux spidev, READY on a GPIO line (gpiod v2)."""
+
+    def __init__(self, device, ready, speed):
+        import gpiod
+        import spidev
+        SpiLink.__init__(self)
+        bus, dev = device.rsplit("spidev", 1)[1].split(".")
+        self.spi = spidev.SpiDev()
+        self.spi.open(int(bus), int(dev))
+        self.spi.mode = 0
+        self.spi.max_speed_hz = speed
+        chip, line = ready.rsplit(":", 1)
+        if not chip.startswith("/"):
+            chip = "/dev/" + chip
+        self.line = int(line)
+        self.active = gpiod.line.Value.ACTIVE
+        self.ready = gpiod.request_lines(chip, consumer="ymodem_send", config={
+            self.line: gpiod.LineSettings(direction=gpiod.line.Direction.INPUT,
+                                          edge_detection=gpiod.line.Edge.RISING)})
+
+    def exchange(self, mosi, timeout):
+        deadline = time.monotonic() + timeout
+        while self.ready.get_value(self.line) != self.active:
+            left = deadline - time.monotonic()
+            if left <= 0 or not self.ready.wait_edge_events(left):
+                return None
+            self.ready.read_edge_events()
+        return bytes(self.spi.xfer2(list(mosi)))
+
+
+class Sender:
+    def __init__(self, link, timeout=3.0, retries=10):
+        self.link = link
+        self.timeout = timeout
+        self.retries = retries
+        self.retransmits = 0
+
+    def wait(self, expected):
+        """Wait for one of the expected control bytes, skip console text."""
+        deadline = time.monotonic() + self.timeout
+        cancel = 0
+        while time.monotonic() < deadline:
+            data = self.link.read(1, deadline - time.monotonic())
+            if not data:
+                break
+            if data[0] == CA:
+                cancel += 1
+                if cancel == 2:
+                    raise YmodemError("transfer cancelled by the IAP")
+                continue
+            cancel = 0
+            if data[0] in expected:
+                return data[0]
+        return None
+
+    def send_block(self, packet):
+        for _ in range(self.retries):
+            self.link.write(packet)
+            answer = self.wait((ACK, NAK))
+            if answer == ACK:
+                return
+            self.retransmits += 1
+        raise YmodemError("no ACK for block %d after %d tries" % (packet[1], self.retries))
+
+    def send(self, name, data):
+        if self.wait((CRC16,)) is None:
+            raise YmodemError("IAP not waiting for a file (no 'C')")
+        start = time.monotonic()
+        header = name.encode("ascii") + b"\0" + ("%d " % len(data)).encode("ascii")
+        self.send_block(block(0, header))
+        if self.wait((CRC16,)) is None:
+            raise YmodemError("no 'C' after the header block")
+
+        seq = 1
+        for offset in range(0, len(data), 1024):
+            self.send_block(block(seq, data[offset:offset + 1024]))
+            seq += 1
+
+        # the IAP answers EOT with ACK once the image is checked
+        for _ in range(self.retries):
+            self.link.write(bytes([EOT]))
+            if self.wait((ACK,)) == ACK:
+                break
+            self.retransmits += 1
+        else:
+            raise YmodemError("EOT not acknowledged")
+        if self.wait((CRC16,)) is None:
+            raise YmodemError("no 'C' before the end of session block")
+        self.send_block(block(0, b""))
+        seconds = time.monotonic() - start
+        return {"bytes": len(data), "blocks": seq, "seconds": round(seconds, 3),
+                "bytes_per_second": int(len(data) / seconds) if seconds else 0,
+                "retransmits": self.retransmits}
+
+    def summary(self):
+        """Console text after the transfer, up to the menu printed again."""
+        deadline = time.monotonic() + self.timeout
+        text = b""
+        while MENU_TITLE not in text and time.monotonic() < deadline:
+            text += self.link.read(256, deadline - time.monotonic())
+        return text
+
+
+def board_file(path, default, board):
+    """File of board k of a chain: flash.bin, flash-1.bin, flash-2.bin..."""
+    if board == 0:
+        return path
+    root, ext = os.path.splitext(path or default)
+    return "%s-%d%s" % (root, board, ext)
+
+
+def start_sim(args):
+    """Start the simulated boards, the first one on our end of the line."""
+    ours, theirs = socket.socketpair()
+    procs = []
+    for board in range(args.chain):
+        cmd = [args.sim, "--spi" if getattr(args, "spi", False) else "--uart", "fd:%d" % theirs.fileno()]
+        fds = [theirs.fileno()]
+        down = up = None
+        if board + 1 < args.chain:
+            down, up = socket.socketpair()
+            cmd += ["--uart2", "fd:%d" % down.fileno()]
+            fds.append(down.fileno())
+        flash = board_file(args.flash, "flash.bin", board)
+        ram = board_file(args.ram, "ram.bin", board)
+        if flash:
+            cmd += ["--flash", flash]
+        if ram:
+            cmd += ["--ram", ram]
+        if args.power_on:
+            cmd.append("--power-on")
+        procs.append(subprocess.Popen(cmd, pass_fds=fds, stdout=subprocess.DEVNULL))
+        theirs.close()
+        if down is not None:
+            down.close()
+        theirs = up
+    return procs, ours
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("image", help="stamped APP binary (tools/image_stamp.py) or release manifest")
+    line = ap.add_mutually_exclusive_group(required=True)
+    line.add_argument("--port", help="serial port of the IAP console (USART1)")
+    line.add_argument("--sim", help="path of the iap_sim program to start")
+    line.add_argument("--spidev", help="SPI master device to the IAP SPI link (IAP_SPI_ENABLED), e.g. /dev/spidev0.0")
+    ap.add_argument("--baud", type=int, default=921600, help="IAP console baud rate")
+    ap.add_argument("--ready", help="READY line of the SPI link with --spidev, CHIP:LINE (gpiochip0:25)")
+    ap.add_argument("--spi-speed", type=int, default=16000000, help="SCK frequency with --spidev")
+    ap.add_argument("--spi", action="store_true", help="the simulation is iap_spi_sim, on its SPI link")
+    ap.add_argument("--flash", help="flash image file of the simulation")
+    ap.add_argument("--ram", help="SRAM image file of the simulation")
+    ap.add_argument("--power-on", action="store_true", help="start the simulation from a power-on reset")
+    ap.add_argument("--chain", type=int, default=1, help="number of simulated boards in a chain (iap_chain_sim)")
+    ap.add_argument("--run", action="store_true", help="start the application after the download")
+    ap.add_argument("--variant", help="image of the manifest to send")
+    ap.add_argument("--format", choices=sorted(fw_package.FORMATS), default="raw", help="file of the manifest to send")
+    ap.add_argument("--json", action="store_true", help="print the result as JSON")
+    args = ap.parse_args()
+    if args.chain < 1 or (args.chain > 1 and not args.sim):
+        ap.error("--chain needs --sim and at least one board")
+    if args.spi and (not args.sim or args.chain > 1):
+        ap.error("--spi needs --sim and a single board")
+    if args.spidev and not args.ready:
+        ap.error("--spidev needs --ready")
+
+    name = os.path.basename(args.image)
+    if os.path.isdir(args.image) or args.image.endswith(".json"):
+        try:
+            name, data, _, digest = fw_package.load(args.image, args.variant, args.format)
+        except (OSError, ValueError) as e:
+            sys.exit(str(e))
+    else:
+        with open(args.image, "rb") as f:
+            data = f.read()
+        # a stamped binary is the installed image itself
+        digest = hashlib.sha256(data).hexdigest() if data[IMAGE_HEADER_OFFSET:][:4] == IMAGE_MAGIC else None
+
+    procs = []
+    if args.sim:
+        procs, sock = start_sim(args)
+        link = SimSpiLink(sock.fileno()) if args.spi else FdLink(sock.fileno())
+    elif args.spidev:
+        try:
+            link = SpidevLink(args.spidev, args.ready, args.spi_speed)
+        except ImportError:
+            sys.exit("spidev and gpiod are needed for --spidev (pip install spidev gpiod)")
+    else:
+        try:
+            link = SerialLink(args.port, args.baud)
+        except ImportError:
+            sys.exit("pyserial is needed for --port (pip install pyserial)")
+
+    result = {"image": name}
+    try:
+        link.drain()
+        link.write(MENU_DOWNLOAD)
+        sender = Sender(link)
+        result.update(sender.send(name, data))
+        match = DIGEST.search(sender.summary())
+        if match:
+            result["image_sha256"] = match.group(1).decode("ascii")
+            if digest and result["image_sha256"] != digest:
+                result["error"] = "IAP installed SHA-256 %s, image is %s" % (result["image_sha256"], digest)
+        if args.run and "error" not in result:
+            link.drain()
+            link.write(MENU_RUN)
+    except YmodemError as e:
+        result["error"] = str(e)
+
+    for proc in procs:
+        if args.run and "error" not in result:
+            try:
+                proc.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                pass
+        if proc.poll() is None:
+            proc.terminate()
+            proc.wait()
+    if procs:
+        # sim.h: 10 = jumped to the application
+        result["sim_exit"] = procs[0].returncode
+    if len(procs) > 1:
+        result["chain_exit"] = [proc.returncode for proc in procs]
+
+    if args.json:
+        print(json.dumps(result))
+    elif "error" in result:
+        print("%s: %s" % (args.image, result["error"]))
+    else:
+        print("%d bytes in %.3f s, %d B/s, %d retransmissions%s%s" % (
+            result["bytes"], result["seconds"], result["bytes_per_second"], result["retransmits"],
+            ", sha256 %s" % result["image_sha256"][:16] if "image_sha256" in result else "",
+            ", sim exit %d" % result["sim_exit"] if "sim_exit" in result else ""))
+    failed = "error" in result or (args.run and any(code != 10 for code in result.get("chain_exit", [result.get("sim_exit", 10)])))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()